@@ -2,10 +2,25 @@ param(
     [ValidateSet("msvc", "gcc")]
     [string]$compiler = "gcc",
 
-    [switch]$PPL
+    # Tools and benchmarks are built next to main.exe but not run.
+    [ValidateSet("main", "mesh_cache", "leak_test", "benchmark", "render_farm", "accumulate", "render_server", "batch", "scene_export")]
+    [string]$target = "main",
+
+    [switch]$PPL,
+
+    # Compile the SIMD kernels for AVX2 instead of SSE2.
+    [switch]$AVX2,
+
+    # Count rays, BVH node visits and primitive tests (core/stats.h).
+    [switch]$Stats
 )
 
 $buildDir = "build"
+$source = switch ($target) {
+    "main" { "src/main.cpp" }
+    { $_ -in "leak_test", "benchmark" } { "src/bench/$target.cpp" }
+    default { "src/tools/$target.cpp" }
+}
 
 # Clean build directory
 if (Test-Path $buildDir) {
@@ -24,11 +39,14 @@ switch ($compiler) {
             "-Isrc"
             "-Iexternal"
             "-Iexternal/oneapi-tbb-2022_1_0/include"
-            "src/main.cpp"
+            $(if ($AVX2) { "-mavx2"; "-mfma" })
+            $(if ($Stats) { "-DRT_STATS" })
+            $source
             "-Lexternal/oneapi-tbb-2022_1_0/lib/mingw-w64-ucrt-x86_64"        
             "-o"
-            "$buildDir/main.exe"
+            "$buildDir/$target.exe"
             "-ltbb12"
+            $(if ($target -in "render_farm", "render_server") { "-lws2_32" })
         )
 
         $compileResult = & g++ @compilerArgs
@@ -43,9 +61,11 @@ switch ($compiler) {
             "/EHsc"
             "/Isrc"
             "/Iexternal"       
+            $(if ($AVX2) { "/arch:AVX2" })
+            $(if ($Stats) { "/DRT_STATS" })
             $(if ($PPL) { "/DPPL" } else { "/Iexternal/oneapi-tbb-2022_1_0/include" })
-            "src/main.cpp"
-            "/Fe:$buildDir/main.exe"    
+            $source
+            "/Fe:$buildDir/$target.exe"    
         )          
         if (!$PPL) {
             $compilerArgs += @(
@@ -68,6 +88,11 @@ if ($LASTEXITCODE -ne 0) {
 
 Copy-Item "assets" "$buildDir" -Recurse -Force
 
+if ($target -ne "main") {
+    Write-Host "Built $buildDir/$target.exe"
+    exit 0
+}
+
 # Run in build directory
 Write-Host "Running..."
 Push-Location $buildDir
@@ -0,0 +1,591 @@
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/random.h"
+#include "core/renderer.h"
+#include "collision/sphere.h"
+#include "collision/quad.h"
+#include "collision/triangle.h"
+#include "collision/face.h"
+#include "collision/bvh_node.h"
+#include "collision/sphere_set.h"
+#include "collision/triangle_packet.h"
+#include "collision/watertight.h"
+#include "collision/experimental/flat_bvh.h"
+#include "collision/experimental/static_bvh.h"
+#include "core/page_memory.h"
+#include "io/json_writer.h"
+#include "scenes/scene_registry.h"
+
+using namespace std::chrono;
+
+// Micro-benchmarks of the intersection kernels and BVHs, and macro-benchmarks that render the
+// bundled scenes with a fixed seed and sample count. Results are written as JSON.
+// Usage: benchmark [--json file] [--filter text] [--scenes a,b,...] [--micro] [--macro]
+//                  [--width n] [--spp n] [--depth n] [--threads n] [--seed n] [--min-time seconds]
+//                  [--huge-pages thp|explicit] [--replicate]
+
+struct Options
+{
+    std::string jsonFile = "benchmark.json";
+    std::string filter;
+    std::vector<std::string> scenes;
+    bool micro = true;
+    bool macro = true;
+    int width = 320;
+    int samplesPerPixel = 16;
+    int maxDepth = 50;
+    unsigned int threads = 0;
+    uint64_t seed = 1;
+    double minTime = 0.5;
+    // where the FlatBvh meshes of the scenes keep their data, see core/page_memory.h
+    MemoryPlacement placement;
+};
+
+struct MicroResult
+{
+    std::string name;
+    // what one operation is: a ray, a primitive of a BVH build, a sample
+    std::string unit;
+    uint64_t operations;
+    double seconds;
+};
+
+struct MacroResult
+{
+    std::string scene;
+    int width, height, samplesPerPixel, maxDepth;
+    double buildSeconds;
+    double renderSeconds;
+    uint64_t rays;
+    RenderStats stats;
+    // page memory of the scene's acceleration structures after the build
+    PageBuffer::Report memory;
+};
+
+// Keeps the benchmarked results alive so the optimizer cannot drop the work.
+static std::atomic<uint64_t> sink{0};
+
+// Calls body, which performs operationsPerCall operations and returns any value derived from
+// them, until minTime has passed. The time is the fastest of three rounds.
+template <typename Body>
+static MicroResult Measure(const std::string &name, const std::string &unit, uint64_t operationsPerCall, double minTime, const Body &body)
+{
+    uint64_t checksum = body();
+
+    double best = std::numeric_limits<double>::infinity();
+    uint64_t bestCalls = 1;
+    for (int round = 0; round < 3; round++)
+    {
+        uint64_t calls = 0;
+        auto start = steady_clock::now();
+        double elapsed = 0.0;
+        do
+        {
+            checksum += body();
+            calls++;
+            elapsed = duration<double>(steady_clock::now() - start).count();
+        } while (elapsed < minTime / 3);
+
+        if (elapsed / calls < best / bestCalls)
+        {
+            best = elapsed;
+            bestCalls = calls;
+        }
+    }
+    sink += checksum;
+    return MicroResult{name, unit, bestCalls * operationsPerCall, best};
+}
+
+// Rays from a sphere of radius 4 around the origin towards random points in [-1.5, 1.5]^3,
+// so that roughly half of them hit a unit sized primitive at the origin.
+static std::vector<Ray> PrimitiveRays(size_t count)
+{
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        Point3 origin = 4.0 * RandomUnitVector();
+        Point3 target = Vector3::Random(-1.5, 1.5);
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+// Rays from random points well above the box towards random points inside it.
+static std::vector<Ray> SceneRays(const AABB &box, size_t count)
+{
+    const Point3 min(box.x.min, box.y.min, box.z.min);
+    const Point3 max(box.x.max, box.y.max, box.z.max);
+    const Vector3 extent = max - min;
+
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        Point3 origin = min + Vector3(RandomDouble() * extent.x(), extent.y() + extent.Length(), RandomDouble() * extent.z());
+        Point3 target = min + Vector3(RandomDouble() * extent.x(), RandomDouble() * extent.y(), RandomDouble() * extent.z());
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+// Bumpy n x n height field in [-1, 1]^2, 2 n^2 triangles.
+static IndexedMesh HeightField(int n)
+{
+    IndexedMesh mesh;
+    for (int i = 0; i <= n; i++)
+    {
+        for (int j = 0; j <= n; j++)
+        {
+            double x = 2.0 * i / n - 1.0, z = 2.0 * j / n - 1.0;
+            mesh.positions.push_back(Point3(x, 0.1 * std::sin(8.0 * x) * std::cos(6.0 * z) + 0.02 * RandomDouble(), z));
+        }
+    }
+    auto at = [n](int i, int j)
+    { return static_cast<uint32_t>(i * (n + 1) + j); };
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            mesh.triangles.push_back(IndexedTriangle{{at(i, j), at(i + 1, j), at(i + 1, j + 1)}});
+            mesh.triangles.push_back(IndexedTriangle{{at(i, j), at(i + 1, j + 1), at(i, j + 1)}});
+        }
+    }
+    return mesh;
+}
+
+template <typename HitFunction>
+static uint64_t CountHits(const std::vector<Ray> &rays, const HitFunction &hit)
+{
+    uint64_t hits = 0;
+    for (const auto &ray : rays)
+        hits += hit(ray) ? 1 : 0;
+    return hits;
+}
+
+static std::vector<MicroResult> RunMicro(const Options &options)
+{
+    std::vector<MicroResult> results;
+    auto run = [&](const std::string &name, const std::string &unit, uint64_t operations, const std::function<uint64_t()> &body)
+    {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            return;
+        results.push_back(Measure(name, unit, operations, options.minTime, body));
+        const auto &r = results.back();
+        fmt::println("{:<32} {:>10.2f} ns/{:<9} {:>10.2f} M/s", r.name, r.seconds / r.operations * 1e9, r.unit, r.operations / r.seconds * 1e-6);
+    };
+
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    const auto rays = PrimitiveRays(4096);
+    const uint64_t rayCount = rays.size();
+
+    // single primitives
+    const Sphere sphere(Point3(0, 0, 0), 1.0);
+    run("sphere_hit", "ray", rayCount, [&]
+        { return CountHits(rays, [&](const Ray &ray)
+                           { HitResult hit; return sphere.Hit(ray, hit, 0.001, inf); }); });
+
+    const Quad quad(Point3(-1, -1, 0), Vector3(2, 0, 0), Vector3(0, 2, 0), DefaultMaterial());
+    run("quad_hit", "ray", rayCount, [&]
+        { return CountHits(rays, [&](const Ray &ray)
+                           { HitResult hit; return quad.Hit(ray, hit, 0.001, inf); }); });
+
+    const Point3 v0(-1, -1, 0), v1(1, -1, 0.2), v2(0, 1, -0.2);
+    const Triangle triangle(v0, v1, v2);
+    run("triangle_hit", "ray", rayCount, [&]
+        { return CountHits(rays, [&](const Ray &ray)
+                           { HitResult hit; return triangle.Hit(ray, hit, 0.001, inf); }); });
+
+    const Face face(v0, v1, v2);
+    run("hit_face", "ray", rayCount, [&]
+        { return CountHits(rays, [&](const Ray &ray)
+                           { double t; return HitFace(ray, face, t) && t > 0.001; }); });
+
+    run("hit_triangle_watertight", "ray", rayCount, [&]
+        { return CountHits(rays, [&](const Ray &ray)
+                           { double t, u, v; return HitTriangleWatertight(WatertightRay(ray), v0, v1, v2, t, u, v) && t > 0.001; }); });
+
+    TrianglePacket4 packet;
+    for (uint32_t lane = 0; lane < TrianglePacket4::WIDTH; lane++)
+    {
+        const Vector3 offset(0.0, 0.0, 0.25 * lane);
+        packet.Set(lane, lane, v0 + offset, v1 + offset, v2 + offset);
+    }
+    run("triangle_packet4_hit", "ray", rayCount, [&]
+        { return CountHits(rays, [&](const Ray &ray)
+                           { double t = inf, u, v; uint32_t index; return IntersectPacket(packet, ray, 0.001, t, index, u, v); }); });
+
+    const AABB box(Point3(-1, -1, -1), Point3(1, 1, 1));
+    run("aabb_hit", "ray", rayCount, [&]
+        { return CountHits(rays, [&](const Ray &ray)
+                           { return box.Hit(ray, 0.001, inf); }); });
+
+    constexpr uint64_t SAMPLES = 4096;
+    run("random_unit_vector", "sample", SAMPLES, [&]
+        {
+            uint64_t positive = 0;
+            for (uint64_t i = 0; i < SAMPLES; i++)
+                positive += RandomUnitVector().x() > 0.0 ? 1 : 0;
+            return positive; });
+
+    // BvhNode over spheres, and the same spheres as a SphereSet
+    constexpr size_t SPHERES = 10000;
+    std::vector<shared_ptr<Hittable>> spheres;
+    SphereList sphereList;
+    for (size_t i = 0; i < SPHERES; i++)
+    {
+        Point3 center = Vector3::Random(-10.0, 10.0);
+        double radius = 0.05 + 0.1 * RandomDouble();
+        spheres.push_back(make_shared<Sphere>(center, radius));
+        sphereList.Add(center, radius, DefaultMaterial());
+    }
+
+    run("bvh_node_build", "primitive", SPHERES, [&]
+        { return static_cast<uint64_t>(BvhNode::Build(spheres) != nullptr); });
+
+    const auto bvhNode = BvhNode::Build(spheres);
+    const auto sphereRays = SceneRays(bvhNode->BoundingBox(), 4096);
+    run("bvh_node_traverse", "ray", sphereRays.size(), [&]
+        { return CountHits(sphereRays, [&](const Ray &ray)
+                           { HitResult hit; return bvhNode->Hit(ray, hit, 0.001, inf); }); });
+
+    const auto sphereSet = SphereSet::Create(std::move(sphereList));
+    run("sphere_set_traverse", "ray", sphereRays.size(), [&]
+        { return CountHits(sphereRays, [&](const Ray &ray)
+                           { HitResult hit; return sphereSet->Hit(ray, hit, 0.001, inf); }); });
+
+    // mesh BVHs over a 131k triangle height field
+    const IndexedMesh field = HeightField(256);
+    const uint64_t triangleCount = field.triangles.size();
+
+    run("flat_bvh_build", "primitive", triangleCount, [&]
+        {
+            auto triangles = field.triangles;
+            return static_cast<uint64_t>(FlatBvh::BuildFlatBvh(field.positions, triangles, TrianglePacket4::WIDTH).size()); });
+
+    run("static_bvh_build", "primitive", triangleCount, [&]
+        {
+            auto triangles = field.triangles;
+            std::vector<TrianglePacket4> packets;
+            Arena arena;
+            StaticBvh::Build(field.positions, triangles, packets, arena);
+            return static_cast<uint64_t>(packets.size()); });
+
+    const auto flatMesh = FlatBvh::Mesh::Create(IndexedMesh(field));
+    const auto staticMesh = StaticBvh::Mesh::Create(IndexedMesh(field));
+    const auto meshRays = SceneRays(flatMesh->BoundingBox(), 4096);
+    for (auto kernel : {TriangleKernel::MollerTrumbore, TriangleKernel::Watertight})
+    {
+        const std::string suffix = kernel == TriangleKernel::Watertight ? "_watertight" : "";
+        flatMesh->SetKernel(kernel);
+        staticMesh->SetKernel(kernel);
+        run("flat_bvh_traverse" + suffix, "ray", meshRays.size(), [&]
+            { return CountHits(meshRays, [&](const Ray &ray)
+                               { HitResult hit; return flatMesh->Hit(ray, hit, 0.001, inf); }); });
+        run("static_bvh_traverse" + suffix, "ray", meshRays.size(), [&]
+            { return CountHits(meshRays, [&](const Ray &ray)
+                               { HitResult hit; return staticMesh->Hit(ray, hit, 0.001, inf); }); });
+    }
+
+    return results;
+}
+
+// Passes through to the scene and counts the rays traced against it. Every ray the renderer
+// shoots, camera or secondary, goes through exactly one top level Hit call.
+class RayCounter final : public Hittable
+{
+public:
+    explicit RayCounter(const Hittable &world) : world(world) {}
+
+    bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
+    {
+        // one counter per cache line, picked by thread, so the workers do not contend
+        thread_local const size_t shard = std::hash<std::thread::id>{}(std::this_thread::get_id()) % SHARDS;
+        shards[shard].count.fetch_add(1, std::memory_order_relaxed);
+        return world.Hit(ray, hit, t_min, t_max);
+    }
+
+    AABB BoundingBox() const override { return world.BoundingBox(); }
+    AABB BoundingBoxAt(double time) const override { return world.BoundingBoxAt(time); }
+
+    uint64_t Count() const
+    {
+        uint64_t total = 0;
+        for (const auto &shard : shards)
+            total += shard.count.load();
+        return total;
+    }
+
+private:
+    static constexpr size_t SHARDS = 64;
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> count{0};
+    };
+
+    const Hittable &world;
+    mutable std::array<Shard, SHARDS> shards;
+};
+
+static std::vector<MacroResult> RunMacro(const Options &options)
+{
+    std::vector<MacroResult> results;
+    for (const auto &entry : BundledScenes())
+    {
+        if (!options.scenes.empty() && std::find(options.scenes.begin(), options.scenes.end(), entry.name) == options.scenes.end())
+            continue;
+        if (!options.filter.empty() && entry.name.find(options.filter) == std::string::npos)
+            continue;
+
+        SetRandomSeed(options.seed);
+        auto buildStart = steady_clock::now();
+        Scene scene;
+        try
+        {
+            scene = entry.create();
+        }
+        catch (const std::exception &e)
+        {
+            fmt::println(stderr, "Skipping {}: {}", entry.name, e.what());
+            continue;
+        }
+        double buildSeconds = duration<double>(steady_clock::now() - buildStart).count();
+        const PageBuffer::Report memory = PageBuffer::Collect();
+
+        const int width = options.width;
+        const int height = std::max(1, static_cast<int>(width / scene.camera->AspectRatio()));
+        Image image(width, height);
+        RayCounter counter(*scene.objects);
+        Renderer renderer{
+            .maxDepth = options.maxDepth,
+            .samplesPerPixel = options.samplesPerPixel,
+            .maxThreadCount = options.threads,
+            .environmentMap = scene.environmentMap,
+            .quiet = true};
+
+        SetRandomSeed(options.seed);
+        auto renderStart = steady_clock::now();
+        renderer.Render(image, *scene.camera, counter);
+        double renderSeconds = duration<double>(steady_clock::now() - renderStart).count();
+
+        results.push_back(MacroResult{entry.name, width, height, options.samplesPerPixel, options.maxDepth, buildSeconds, renderSeconds, counter.Count(), renderer.stats, memory});
+        const auto &r = results.back();
+        fmt::println("{:<32} {:>4}x{:<4} {:>4} spp {:>8.3f}s {:>10.2f} ns/ray {:>8.2f} Mrays/s",
+                     r.scene, r.width, r.height, r.samplesPerPixel, r.renderSeconds, r.renderSeconds / r.rays * 1e9, r.rays / r.renderSeconds * 1e-6);
+    }
+    return results;
+}
+
+static std::string CompilerName()
+{
+#if defined(__clang__)
+    return fmt::format("clang {}.{}.{}", __clang_major__, __clang_minor__, __clang_patchlevel__);
+#elif defined(__GNUC__)
+    return fmt::format("gcc {}.{}.{}", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
+#elif defined(_MSC_VER)
+    return fmt::format("msvc {}", _MSC_FULL_VER);
+#else
+    return "unknown";
+#endif
+}
+
+static void WriteJson(const Options &options, const std::vector<MicroResult> &micro, const std::vector<MacroResult> &macro)
+{
+    JsonWriter json;
+    json.BeginObject();
+
+    json.Key("config").BeginObject();
+    json.Field("compiler", CompilerName());
+#if defined(SIMD_AVX)
+    json.Field("simd", "avx");
+#elif defined(SIMD_SSE2)
+    json.Field("simd", "sse2");
+#else
+    json.Field("simd", "scalar");
+#endif
+#ifdef PPL
+    json.Field("scheduler", "ppl");
+#else
+    json.Field("scheduler", "tbb");
+#endif
+    json.Field("hardware_threads", std::thread::hardware_concurrency());
+    json.Field("max_threads", options.threads);
+    json.Field("seed", options.seed);
+    json.Field("min_time", options.minTime);
+    json.Field("stats", STATS_ENABLED);
+    json.Field("huge_pages", PagePolicyName(options.placement.pages));
+    json.Field("replicate_per_node", options.placement.replicatePerNode);
+    json.Field("numa_nodes", Numa::Nodes().size());
+    json.EndObject();
+
+    json.Key("micro").BeginArray();
+    for (const auto &r : micro)
+    {
+        json.BeginObject();
+        json.Field("name", r.name);
+        json.Field("unit", r.unit);
+        json.Field("operations", r.operations);
+        json.Field("seconds", r.seconds);
+        json.Field("ns_per_op", r.seconds / r.operations * 1e9);
+        json.Field("ops_per_sec", r.operations / r.seconds);
+        if (r.unit == "ray")
+        {
+            json.Field("ns_per_ray", r.seconds / r.operations * 1e9);
+            json.Field("rays_per_sec", r.operations / r.seconds);
+        }
+        json.EndObject();
+    }
+    json.EndArray();
+
+    json.Key("macro").BeginArray();
+    for (const auto &r : macro)
+    {
+        const double samples = static_cast<double>(r.width) * r.height * r.samplesPerPixel;
+        json.BeginObject();
+        json.Field("scene", r.scene);
+        json.Field("width", r.width);
+        json.Field("height", r.height);
+        json.Field("samples_per_pixel", r.samplesPerPixel);
+        json.Field("max_depth", r.maxDepth);
+        json.Field("build_seconds", r.buildSeconds);
+        json.Field("render_seconds", r.renderSeconds);
+        json.Field("rays", r.rays);
+        json.Field("rays_per_sample", r.rays / samples);
+        json.Field("ns_per_ray", r.renderSeconds / r.rays * 1e9);
+        json.Field("rays_per_sec", r.rays / r.renderSeconds);
+        json.Field("samples_per_sec", samples / r.renderSeconds);
+        if (options.placement.Enabled())
+        {
+            json.Key("acceleration_memory").BeginObject();
+            json.Field("buffers", r.memory.buffers);
+            json.Field("bytes", r.memory.bytes);
+            json.Field("reserved_bytes", r.memory.reserved);
+            json.Field("resident_bytes", r.memory.resident);
+            json.Field("huge_page_bytes", r.memory.hugePages);
+            json.EndObject();
+        }
+        if (STATS_ENABLED)
+        {
+            json.Key("stats");
+            r.stats.WriteJson(json);
+        }
+        json.EndObject();
+    }
+    json.EndArray();
+
+    json.EndObject();
+    json.Save(options.jsonFile);
+}
+
+static std::vector<std::string> SplitList(const std::string &list)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        if (end > start)
+            items.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return items;
+}
+
+static Options ParseOptions(int argc, char *argv[])
+{
+    Options options;
+    bool onlyMicro = false, onlyMacro = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--json")
+            options.jsonFile = value();
+        else if (arg == "--filter")
+            options.filter = value();
+        else if (arg == "--scenes")
+            options.scenes = SplitList(value());
+        else if (arg == "--micro")
+            onlyMicro = true;
+        else if (arg == "--macro")
+            onlyMacro = true;
+        else if (arg == "--width")
+            options.width = std::stoi(value());
+        else if (arg == "--spp")
+            options.samplesPerPixel = std::stoi(value());
+        else if (arg == "--depth")
+            options.maxDepth = std::stoi(value());
+        else if (arg == "--threads")
+            options.threads = static_cast<unsigned int>(std::stoul(value()));
+        else if (arg == "--seed")
+            options.seed = std::stoull(value());
+        else if (arg == "--min-time")
+            options.minTime = std::stod(value());
+        else if (arg == "--huge-pages")
+            options.placement.pages = ParsePagePolicy(value());
+        else if (arg == "--replicate")
+            options.placement.replicatePerNode = true;
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+
+    // --micro or --macro alone selects that suite, neither or both run everything
+    if (onlyMicro != onlyMacro)
+    {
+        options.micro = onlyMicro;
+        options.macro = onlyMacro;
+    }
+    return options;
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        Options options = ParseOptions(argc, argv);
+        AccelerationMemoryPlacement() = options.placement;
+
+        std::vector<MicroResult> micro;
+        if (options.micro)
+        {
+            SetRandomSeed(options.seed);
+            micro = RunMicro(options);
+        }
+
+        std::vector<MacroResult> macro;
+        if (options.macro)
+            macro = RunMacro(options);
+
+        WriteJson(options, micro, macro);
+        fmt::println("Results written to {}", options.jsonFile);
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
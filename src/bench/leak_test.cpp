@@ -0,0 +1,258 @@
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "collision/indexed_mesh.h"
+#include "collision/watertight.h"
+#include "collision/experimental/flat_bvh.h"
+#include "collision/experimental/static_bvh.h"
+
+using namespace std::chrono;
+
+// Fires dense ray grids at closed meshes and counts the rays that leak through.
+// A ray that enters and leaves a closed mesh crosses its surface an even number of times;
+// an odd count means it slipped through a shared edge or vertex somewhere. Rays aimed
+// at a mesh vertex also leak when they miss the mesh entirely.
+// Usage: leak_test [grid resolution] [closed.obj ...]
+
+struct LeakResult
+{
+    size_t rays = 0;
+    size_t leaks = 0;
+    double seconds = 0.0;
+};
+
+// Counts surface crossings along the whole ray. Hits of neighbouring triangles at the same
+// distance (on a shared edge) are counted once.
+static int CountCrossings(const Hittable &mesh, const Ray &ray, double skip)
+{
+    int crossings = 0;
+    double t_min = 0.0;
+    HitResult hit;
+    while (mesh.Hit(ray, hit, t_min, std::numeric_limits<double>::infinity()))
+    {
+        crossings++;
+        t_min = hit.t + skip;
+    }
+    return crossings;
+}
+
+struct LeakRay
+{
+    Ray ray;
+    // aimed at a point on the surface
+    bool mustHit;
+};
+
+static LeakResult RunRays(const Hittable &mesh, const std::vector<LeakRay> &rays, double skip)
+{
+    LeakResult result;
+    auto start = steady_clock::now();
+    for (const auto &[ray, mustHit] : rays)
+    {
+        int crossings = CountCrossings(mesh, ray, skip);
+        if (crossings % 2 != 0 || (mustHit && crossings == 0))
+            result.leaks++;
+    }
+    result.seconds = duration<double>(steady_clock::now() - start).count();
+    result.rays = rays.size();
+    return result;
+}
+
+// Cube [-1, 1]^3 with every side split into n x n quads of two triangles, sharing all vertices.
+static IndexedMesh TessellatedCube(int n)
+{
+    IndexedMesh mesh;
+    auto vertex = [&](double x, double y, double z)
+    {
+        mesh.positions.push_back(Point3(x, y, z));
+        return static_cast<uint32_t>(mesh.positions.size() - 1);
+    };
+
+    // vertices on the (n + 1)^3 lattice, created once and shared by all sides touching them
+    std::vector<uint32_t> grid((n + 1) * (n + 1) * (n + 1), UINT32_MAX);
+    auto at = [&](int i, int j, int k) -> uint32_t
+    {
+        uint32_t &index = grid[(i * (n + 1) + j) * (n + 1) + k];
+        if (index == UINT32_MAX)
+            index = vertex(2.0 * i / n - 1.0, 2.0 * j / n - 1.0, 2.0 * k / n - 1.0);
+        return index;
+    };
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int side : {0, n})
+        {
+            for (int a = 0; a < n; a++)
+            {
+                for (int b = 0; b < n; b++)
+                {
+                    auto corner = [&](int da, int db)
+                    {
+                        int c[3];
+                        c[axis] = side;
+                        c[(axis + 1) % 3] = a + da;
+                        c[(axis + 2) % 3] = b + db;
+                        return at(c[0], c[1], c[2]);
+                    };
+                    mesh.triangles.push_back(IndexedTriangle{{corner(0, 0), corner(1, 0), corner(1, 1)}});
+                    mesh.triangles.push_back(IndexedTriangle{{corner(0, 0), corner(1, 1), corner(0, 1)}});
+                }
+            }
+        }
+    }
+    return mesh;
+}
+
+// Unit sphere from a subdivided octahedron, with shared vertices along all edges.
+static IndexedMesh Octasphere(int n)
+{
+    IndexedMesh mesh;
+    std::vector<uint32_t> borders;
+    for (int sx : {-1, 1})
+    {
+        for (int sy : {-1, 1})
+        {
+            for (int sz : {-1, 1})
+            {
+                // barycentric grid on the face with corners sx*X, sy*Y, sz*Z
+                std::vector<uint32_t> face((n + 1) * (n + 1), UINT32_MAX);
+                auto index = [&](int i, int j)
+                {
+                    uint32_t &v = face[i * (n + 1) + j];
+                    if (v != UINT32_MAX)
+                        return v;
+
+                    int k = n - i - j;
+                    Point3 q = UnitVector(Vector3(sx * double(i) / n, sy * double(j) / n, sz * double(k) / n));
+                    // reuse the vertices of neighbouring faces on the borders so the sphere stays closed
+                    bool border = i == 0 || j == 0 || k == 0;
+                    if (border)
+                    {
+                        for (uint32_t shared : borders)
+                        {
+                            if (mesh.positions[shared][0] == q[0] && mesh.positions[shared][1] == q[1] && mesh.positions[shared][2] == q[2])
+                                return v = shared;
+                        }
+                    }
+                    mesh.positions.push_back(q);
+                    v = static_cast<uint32_t>(mesh.positions.size() - 1);
+                    if (border)
+                        borders.push_back(v);
+                    return v;
+                };
+
+                for (int i = 0; i < n; i++)
+                {
+                    for (int j = 0; j < n - i; j++)
+                    {
+                        mesh.triangles.push_back(IndexedTriangle{{index(i, j), index(i + 1, j), index(i, j + 1)}});
+                        if (j + 1 < n - i)
+                            mesh.triangles.push_back(IndexedTriangle{{index(i + 1, j), index(i + 1, j + 1), index(i, j + 1)}});
+                    }
+                }
+            }
+        }
+    }
+    return mesh;
+}
+
+// Axis aligned rays on a grid that runs through the mesh bounds, plus rays from outside the
+// mesh aimed exactly at its vertices. The generated meshes are convex, so the vertex rays enter there.
+static std::vector<LeakRay> LeakRays(const IndexedMesh &mesh, int resolution)
+{
+    AABBHelper bbox = Union(mesh.positions, mesh.triangles, 0, mesh.triangles.size());
+    Vector3 extent = bbox.max - bbox.min;
+    Point3 center = 0.5 * (bbox.min + bbox.max);
+    double radius = extent.Length();
+
+    std::vector<LeakRay> rays;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int a = (axis + 1) % 3, b = (axis + 2) % 3;
+        for (int i = 1; i < resolution; i++)
+        {
+            for (int j = 1; j < resolution; j++)
+            {
+                Point3 origin = center;
+                origin[axis] = bbox.min[axis] - radius;
+                origin[a] = bbox.min[a] + extent[a] * i / resolution;
+                origin[b] = bbox.min[b] + extent[b] * j / resolution;
+                Vector3 direction;
+                direction[axis] = 1.0;
+                rays.push_back(LeakRay{Ray(origin, direction), false});
+            }
+        }
+    }
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    for (const auto &target : mesh.positions)
+    {
+        // come in from outside, roughly against the outward direction, so the ray enters at the
+        // vertex instead of grazing the silhouette
+        Vector3 jitter(uniform(rng), uniform(rng), uniform(rng));
+        Point3 origin = target + radius * UnitVector(UnitVector(target - center) + 0.5 * jitter);
+        rays.push_back(LeakRay{Ray(origin, target - origin), true});
+    }
+    return rays;
+}
+
+static void Report(const std::string &mesh, const std::string &bvh, TriangleKernel kernel, const LeakResult &result)
+{
+    fmt::println("{:<24} {:<8} {:<16} {:>9} rays {:>7} leaks ({:.4f}%) {:>8.2f} Mrays/s",
+                 mesh, bvh, kernel == TriangleKernel::Watertight ? "watertight" : "moeller-trumbore",
+                 result.rays, result.leaks, 100.0 * result.leaks / result.rays, result.rays / result.seconds * 1e-6);
+}
+
+static void Test(const std::string &name, const std::function<IndexedMesh()> &load, int resolution)
+{
+    IndexedMesh mesh = load();
+    auto rays = LeakRays(mesh, resolution);
+    AABBHelper bbox = Union(mesh.positions, mesh.triangles, 0, mesh.triangles.size());
+    double skip = 1e-9 * (bbox.max - bbox.min).Length();
+
+    auto flat = FlatBvh::Mesh::Create(load());
+    auto fast = StaticBvh::Mesh::Create(load());
+    for (auto kernel : {TriangleKernel::MollerTrumbore, TriangleKernel::Watertight})
+    {
+        flat->SetKernel(kernel);
+        fast->SetKernel(kernel);
+        Report(name, "flat", kernel, RunRays(*flat, rays, skip));
+        Report(name, "static", kernel, RunRays(*fast, rays, skip));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int resolution = argc > 1 ? std::stoi(argv[1]) : 256;
+
+    try
+    {
+        Test("cube 16x16", []
+             { return TessellatedCube(16); }, resolution);
+        Test("octasphere 64", []
+             { return Octasphere(64); }, resolution);
+
+        for (int i = 2; i < argc; i++)
+        {
+            std::string file = argv[i];
+            Test(file, [&]
+                 { return LoadIndexedMesh(file); }, resolution);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
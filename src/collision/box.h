@@ -4,12 +4,15 @@
 
 #include "collision/hittable_list.h"
 #include "collision/quad.h"
+#include "core/arena.h"
 
-inline shared_ptr<HittableList> CreateBox(const Point3 &a, const Point3 &b, shared_ptr<Material> mat)
+// Allocates from the arena when one is given. The arena has to outlive the box.
+inline shared_ptr<HittableList> CreateBox(const Point3 &a, const Point3 &b, shared_ptr<Material> mat, Arena *arena = nullptr)
 {
     // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
 
-    auto sides = make_shared<HittableList>();
+    auto sides = MakeShared<HittableList>(arena);
+    sides->shapes.reserve(6);
 
     // Construct the two opposite vertices with the minimum and maximum coordinates.
     auto min = Point3(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
@@ -19,12 +22,12 @@ inline shared_ptr<HittableList> CreateBox(const Point3 &a, const Point3 &b, shar
     auto dy = Vector3(0, max.y() - min.y(), 0);
     auto dz = Vector3(0, 0, max.z() - min.z());
 
-    sides->add(make_shared<Quad>(Point3(min.x(), min.y(), max.z()), dx, dy, mat));  // front
-    sides->add(make_shared<Quad>(Point3(max.x(), min.y(), max.z()), -dz, dy, mat)); // right
-    sides->add(make_shared<Quad>(Point3(max.x(), min.y(), min.z()), -dx, dy, mat)); // back
-    sides->add(make_shared<Quad>(Point3(min.x(), min.y(), min.z()), dz, dy, mat));  // left
-    sides->add(make_shared<Quad>(Point3(min.x(), max.y(), max.z()), dx, -dz, mat)); // top
-    sides->add(make_shared<Quad>(Point3(min.x(), min.y(), min.z()), dx, dz, mat));  // bottom
+    sides->add(MakeShared<Quad>(arena, Point3(min.x(), min.y(), max.z()), dx, dy, mat));  // front
+    sides->add(MakeShared<Quad>(arena, Point3(max.x(), min.y(), max.z()), -dz, dy, mat)); // right
+    sides->add(MakeShared<Quad>(arena, Point3(max.x(), min.y(), min.z()), -dx, dy, mat)); // back
+    sides->add(MakeShared<Quad>(arena, Point3(min.x(), min.y(), min.z()), dz, dy, mat));  // left
+    sides->add(MakeShared<Quad>(arena, Point3(min.x(), max.y(), max.z()), dx, -dz, mat)); // top
+    sides->add(MakeShared<Quad>(arena, Point3(min.x(), min.y(), min.z()), dx, dz, mat));  // bottom
 
     return sides;
 }
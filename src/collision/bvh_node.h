@@ -13,6 +13,8 @@
 #include "core/aabb.h"
 #include "core/hittable.h"
 #include "collision/hittable_list.h"
+#include "core/arena.h"
+#include "core/trace.h"
 
 #include <algorithm>
 
@@ -23,6 +25,7 @@ class BvhNode : public Hittable
 public:
     static shared_ptr<BvhNode> Build(std::vector<shared_ptr<Hittable>> shapes)
     {
+        TRACE_SCOPE("BvhNode::Build", "bvh");
         if (shapes.empty())
         {
             throw std::runtime_error("BvhNode::Build: cannot build BVH from empty shape list.");
@@ -32,6 +35,7 @@ public:
 
     static shared_ptr<BvhNode> Build(std::vector<shared_ptr<Hittable>> shapes, size_t start, size_t end)
     {
+        TRACE_SCOPE("BvhNode::Build", "bvh");
         if (start >= end)
         {
             throw std::runtime_error("BvhNode::Build: invalid span (start >= end).");
@@ -39,14 +43,33 @@ public:
         return BuildRecursive(shapes, start, end);
     }
 
+    // Allocates the nodes (with their shared_ptr control blocks) from the arena, one after the
+    // other in build order. The arena has to outlive the tree.
+    static shared_ptr<BvhNode> Build(std::vector<shared_ptr<Hittable>> shapes, Arena &arena)
+    {
+        TRACE_SCOPE("BvhNode::Build", "bvh");
+        if (shapes.empty())
+        {
+            throw std::runtime_error("BvhNode::Build: cannot build BVH from empty shape list.");
+        }
+        return BuildRecursive(shapes, 0, shapes.size(), &arena);
+    }
+
 private:
-    BvhNode(shared_ptr<Hittable> left, shared_ptr<Hittable> right, AABB bbox)
+    // Keeps the constructor private while still allowing std::allocate_shared.
+    struct ConstructionToken
+    {
+    };
+
+public:
+    BvhNode(ConstructionToken, shared_ptr<Hittable> left, shared_ptr<Hittable> right, AABB bbox)
         // standard pattern to avoid creating another copy of the parameters
         : left(std::move(left)), right(std::move(right)), bbox(std::move(bbox))
     {
     }
 
-    static shared_ptr<BvhNode> BuildRecursive(std::vector<shared_ptr<Hittable>> &shapes, size_t start, size_t end)
+private:
+    static shared_ptr<BvhNode> BuildRecursive(std::vector<shared_ptr<Hittable>> &shapes, size_t start, size_t end, Arena *arena = nullptr)
     {
         // Build the bounding box of the span of source objects.
         auto bbox = AABB::empty;
@@ -71,15 +94,16 @@ private:
             std::sort(std::begin(shapes) + start, std::begin(shapes) + end, BoxCompare(bbox.LongestAxisIndex()));
 
             auto mid = start + object_span / 2;
-            left = BuildRecursive(shapes, start, mid);
-            right = BuildRecursive(shapes, mid, end);
+            left = BuildRecursive(shapes, start, mid, arena);
+            right = BuildRecursive(shapes, mid, end, arena);
         }
-        return std::shared_ptr<BvhNode>(new BvhNode(left, right, bbox)); // can use make_shared because the constructor is private
+        return MakeShared<BvhNode>(arena, ConstructionToken{}, left, right, bbox);
     }
 
 public:
     bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
     {
+        STATS_RECURSIVE_NODE();
         if (!bbox.Hit(ray, t_min, t_max))
             return false;
 
@@ -91,6 +115,10 @@ public:
 
     AABB BoundingBox() const override { return bbox; }
 
+    // Both are the same shape in a leaf built from a single one.
+    const shared_ptr<Hittable> &Left() const { return left; }
+    const shared_ptr<Hittable> &Right() const { return right; }
+
 private:
     shared_ptr<Hittable> left;
     shared_ptr<Hittable> right;
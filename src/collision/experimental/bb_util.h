@@ -2,10 +2,13 @@
 
 #include <vector>
 #include <stack>
+#include <span>
+#include <limits>
 
 #include "core/ray.h"
 #include "core/hittable.h"
 #include "collision/face.h"
+#include "collision/indexed_mesh.h"
 
 AABB CalculateBoundingBoxFromFaces(const vector<Face> &faces)
 {
@@ -30,12 +33,15 @@ struct AABBHelper
     Vector3 max;
 };
 
-AABBHelper FromFace(const Face &face)
+AABBHelper FromTriangle(std::span<const Point3> positions, const IndexedTriangle &tri)
 {
     constexpr double delta = 1e-4;
+    const Point3 &v0 = positions[tri.v[0]];
+    const Point3 &v1 = positions[tri.v[1]];
+    const Point3 &v2 = positions[tri.v[2]];
     AABBHelper bbox;
-    bbox.min = Vector3::Min(face.v0, Vector3::Min(face.v1, face.v2));
-    bbox.max = Vector3::Max(face.v0, Vector3::Max(face.v1, face.v2));
+    bbox.min = Vector3::Min(v0, Vector3::Min(v1, v2));
+    bbox.max = Vector3::Max(v0, Vector3::Max(v1, v2));
     for (auto i = 0; i < 3; ++i)
     {
         if (std::abs(bbox.max[i] - bbox.min[i]) < delta)
@@ -56,16 +62,16 @@ AABBHelper Union(const AABBHelper &a, const AABBHelper &b)
     return bbox;
 }
 
-AABBHelper Union(const std::vector<Face> &faces, size_t begin, size_t end)
+AABBHelper Union(std::span<const Point3> positions, std::span<const IndexedTriangle> triangles, size_t begin, size_t end)
 {
     AABBHelper bbox;
     if (begin >= end)
         throw std::invalid_argument("Cannot compute bounding box of empty range");
 
-    bbox = FromFace(faces[begin]);
+    bbox = FromTriangle(positions, triangles[begin]);
 
     for (size_t i = begin + 1; i < end; ++i)
-        bbox = Union(bbox, FromFace(faces[i]));
+        bbox = Union(bbox, FromTriangle(positions, triangles[i]));
 
     return bbox;
 }
@@ -78,6 +84,7 @@ bool HitAABB(
     double t_min,
     double t_max)
 {
+    STATS_COUNT(AABBTests);
 
     for (int axis = 0; axis < 3; axis++)
     {
@@ -93,6 +100,14 @@ bool HitAABB(
         auto t0 = (min[axis] - ray_orig[axis]) * adinv;
         auto t1 = (max[axis] - ray_orig[axis]) * adinv;
 
+        // Widen the far slab by the rounding error of the slab distances so rays through
+        // edges and flat boxes (all coplanar triangles) are not culled (Ize, "Robust BVH Ray Traversal").
+        constexpr double ROUNDING = 1.0 + 2.0 * (3.0 * std::numeric_limits<double>::epsilon() * 0.5) / (1.0 - 3.0 * std::numeric_limits<double>::epsilon() * 0.5);
+        if (t0 < t1)
+            t1 *= ROUNDING;
+        else
+            t0 *= ROUNDING;
+
         if (t0 < t1)
         {
             if (t0 > t_min)
@@ -108,7 +123,7 @@ bool HitAABB(
                 t_max = t0;
         }
 
-        if (t_max <= t_min)
+        if (t_max < t_min)
             return false;
     }
     return true;
@@ -117,12 +132,13 @@ bool HitAABB(
 struct BBCompareByMin
 {
     int index;
-    BBCompareByMin(int idx) : index(idx) {}
+    std::span<const Point3> positions;
+    BBCompareByMin(int idx, std::span<const Point3> positions) : index(idx), positions(positions) {}
 
-    bool operator()(const Face &a, const Face &b) const
+    bool operator()(const IndexedTriangle &a, const IndexedTriangle &b) const
     {
-        auto a_axis_interval = FromFace(a);
-        auto b_axis_interval = FromFace(b);
+        auto a_axis_interval = FromTriangle(positions, a);
+        auto b_axis_interval = FromTriangle(positions, b);
         return a_axis_interval.min[index] < b_axis_interval.min[index];
     }
 };
@@ -130,12 +146,13 @@ struct BBCompareByMin
 struct BBCompareByCentroid
 {
     int index;
-    BBCompareByCentroid(int idx) : index(idx) {}
+    std::span<const Point3> positions;
+    BBCompareByCentroid(int idx, std::span<const Point3> positions) : index(idx), positions(positions) {}
 
-    bool operator()(const Face &a, const Face &b) const
+    bool operator()(const IndexedTriangle &a, const IndexedTriangle &b) const
     {
-        double a_centroid = (a.v0[index] + a.v1[index] + a.v2[index]) / 3.0;
-        double b_centroid = (b.v0[index] + b.v1[index] + b.v2[index]) / 3.0;
+        double a_centroid = (positions[a.v[0]][index] + positions[a.v[1]][index] + positions[a.v[2]][index]) / 3.0;
+        double b_centroid = (positions[b.v[0]][index] + positions[b.v[1]][index] + positions[b.v[2]][index]) / 3.0;
         return a_centroid < b_centroid;
     }
 };
@@ -1,12 +1,21 @@
 #pragma once
 
+#include <cstring>
+#include <memory>
+#include <span>
 #include <vector>
 
 #include "core/ray.h"
 #include "core/hittable.h"
 #include "collision/face.h"
+#include "collision/indexed_mesh.h"
+#include "collision/triangle_packet.h"
+#include "collision/watertight.h"
 #include "collision/experimental/bb_util.h"
 #include "core/material.h"
+#include "core/numa.h"
+#include "core/page_memory.h"
+#include "core/trace.h"
 #include "io/object_loader.h"
 
 // BvhNode uses integer indices instead of pointers.
@@ -31,17 +40,25 @@ namespace FlatBvh
         HitResult &hit,
         double t_min,
         double t_max,
-        const std::vector<BvhFlatNode> &nodes,
-        const std::vector<Face> &faces)
+        std::span<const BvhFlatNode> nodes,
+        const IndexedMeshView &mesh,
+        size_t leafSize = 1,
+        TriangleKernel kernel = TriangleKernel::MollerTrumbore)
     {
+        const WatertightRay watertightRay(ray);
+
         std::vector<size_t> stack;
         stack.reserve(128);
         stack.push_back(0);
-        bool hasHit(false);
+
+        // Only the closest hit is turned into a hit record, after the traversal.
+        size_t hitTriangle = INVALID_INDEX;
+        double hitU = 0.0, hitV = 0.0;
 
         while (!stack.empty())
         {
-            auto node = nodes[stack.back()];
+            const auto &node = nodes[stack.back()];
+            STATS_NODE(stack.size());
             stack.pop_back();
 
             const auto isLeaf = node.object_index != INVALID_INDEX;
@@ -53,18 +70,22 @@ namespace FlatBvh
             // it's a leaf
             if (isLeaf)
             {
-                auto face = faces[node.object_index];
-                double t = 0.0;
-                if (HitFace(ray, face, t))
+                const size_t end = std::min(node.object_index + leafSize, mesh.triangles.size());
+                for (size_t triangle = node.object_index; triangle < end; triangle++)
                 {
-                    if (t >= t_min && t < t_max)
+                    double t = 0.0, u, v;
+                    const bool intersects = kernel == TriangleKernel::Watertight
+                                                ? HitTriangleWatertight(watertightRay, mesh.Vertex(triangle, 0), mesh.Vertex(triangle, 1), mesh.Vertex(triangle, 2), t, u, v)
+                                                : HitTriangle(ray, mesh.Vertex(triangle, 0), mesh.Vertex(triangle, 1), mesh.Vertex(triangle, 2), t, u, v);
+                    if (intersects)
                     {
-                        t_max = t;
-                        hit.t = t;
-                        hit.point = ray.At(t);
-                        hit.normal = face.normal;
-                        hit.SetFaceNormal(ray, face.normal);
-                        hasHit = true;
+                        if (t >= t_min && t < t_max)
+                        {
+                            t_max = t;
+                            hitTriangle = triangle;
+                            hitU = u;
+                            hitV = v;
+                        }
                     }
                 }
             }
@@ -75,11 +96,62 @@ namespace FlatBvh
             }
         }
 
-        return hasHit;
+        if (hitTriangle == INVALID_INDEX)
+            return false;
+
+        mesh.FillHit(ray, hitTriangle, t_max, hitU, hitV, hit);
+        return true;
+    }
+
+    // Same traversal for a tree built with leafSize = TrianglePacket4::WIDTH, where leaf
+    // object_index / WIDTH is the packet holding the leaf's triangles.
+    bool TraverseFlatBvhPackets(
+        const Ray &ray,
+        HitResult &hit,
+        double t_min,
+        double t_max,
+        std::span<const BvhFlatNode> nodes,
+        std::span<const TrianglePacket4> packets,
+        const IndexedMeshView &mesh)
+    {
+        size_t stack[64];
+        size_t stackSize = 0;
+        stack[stackSize++] = 0;
+
+        uint32_t hitTriangle = TrianglePacket4::EMPTY;
+        double hitU = 0.0, hitV = 0.0;
+
+        while (stackSize > 0)
+        {
+            const auto &node = nodes[stack[--stackSize]];
+            STATS_NODE(stackSize + 1);
+
+            if (!HitAABB(node.min, node.max, ray.origin, ray.direction, t_min, t_max))
+                continue;
+
+            if (node.object_index != INVALID_INDEX)
+            {
+                IntersectPacket(packets[node.object_index / TrianglePacket4::WIDTH], ray, t_min, t_max, hitTriangle, hitU, hitV);
+            }
+            else
+            {
+                stack[stackSize++] = node.left_index;
+                stack[stackSize++] = node.right_index;
+            }
+        }
+
+        if (hitTriangle == TrianglePacket4::EMPTY)
+            return false;
+
+        mesh.FillHit(ray, hitTriangle, t_max, hitU, hitV, hit);
+        return true;
     }
 
-    std::vector<BvhFlatNode> BuildFlatBvh(std::vector<Face> &faces)
+    // Leaves hold up to leafSize triangles. Splits are rounded to multiples of leafSize, so
+    // every leaf is the aligned range [object_index, object_index + leafSize) clipped to the mesh.
+    std::vector<BvhFlatNode> BuildFlatBvh(std::span<const Point3> positions, std::span<IndexedTriangle> triangles, size_t leafSize = 1)
     {
+        TRACE_SCOPE("BuildFlatBvh", "bvh");
         std::vector<BvhFlatNode> nodes;
 
         struct BuildEntry
@@ -90,7 +162,7 @@ namespace FlatBvh
         };
 
         std::stack<BuildEntry> stack;
-        stack.push({0, faces.size(), INVALID_INDEX, false});
+        stack.push({0, triangles.size(), INVALID_INDEX, false});
 
         while (!stack.empty())
         {
@@ -101,7 +173,7 @@ namespace FlatBvh
             size_t end = entry.end;
             size_t count = end - begin;
 
-            AABBHelper bbox = Union(faces, begin, end);
+            AABBHelper bbox = Union(positions, triangles, begin, end);
             BvhFlatNode node = {
                 .min = bbox.min,
                 .max = bbox.max,
@@ -120,7 +192,7 @@ namespace FlatBvh
                     nodes[entry.parentIndex].right_index = nodeIndex;
             }
 
-            if (count == 1)
+            if (count <= leafSize)
             {
                 nodes[nodeIndex].object_index = begin;
                 continue;
@@ -130,12 +202,12 @@ namespace FlatBvh
             Vector3 extent = bbox.max - bbox.min;
             int axis = (extent.x() > extent.y() && extent.x() > extent.z()) ? 0 : (extent.y() > extent.z() ? 1 : 2);
 
-            // Partition around middle
-            size_t mid = begin + count / 2;
+            // Partition around middle, keeping the left half a multiple of the leaf size
+            size_t mid = begin + (count / 2 + leafSize - 1) / leafSize * leafSize;
             // This function is an optimization. It doesn't sort the whole array.
             // It only reorders the elements such that all elements left from the n-th element
             // are less than the n-th element and vice versa.
-            std::nth_element(faces.begin() + begin, faces.begin() + mid, faces.begin() + end, BBCompareByMin(axis));
+            std::nth_element(triangles.begin() + begin, triangles.begin() + mid, triangles.begin() + end, BBCompareByMin(axis, positions));
 
             // Push children in reverse order (right first) so left is on top for better memory layout.
             stack.push({mid, end, nodeIndex, false});
@@ -148,44 +220,252 @@ namespace FlatBvh
     class Mesh : public Hittable
     {
     private:
-        std::vector<Face> faces;
+        // Owned storage; stays empty when the mesh lives in external memory.
+        IndexedMesh mesh;
         std::vector<BvhFlatNode> bvhNodes;
+        std::vector<TrianglePacket4> packetStorage;
+        // Keeps external storage (e.g. a mapped cache file) alive.
+        std::shared_ptr<const void> storage;
+
+        IndexedMeshView view;
+        std::span<const BvhFlatNode> nodes;
+        // leaf triangles with precomputed edges, see TraverseFlatBvhPackets
+        std::span<const TrianglePacket4> packets;
         std::shared_ptr<Material> material;
         AABB bbox;
+        TriangleKernel kernel = TriangleKernel::MollerTrumbore;
+        std::string source;
+
+        // Copies of the geometry, nodes and packets in page memory, one per NUMA node when
+        // replicated (see Place). view, nodes and packets then point at the first one.
+        struct Replica
+        {
+            std::unique_ptr<PageBuffer> memory;
+            IndexedMeshView view;
+            std::span<const BvhFlatNode> nodes;
+            std::span<const TrianglePacket4> packets;
+        };
+        std::vector<Replica> replicas;
+
+        // Copies everything the traversal reads into one page buffer, each array on its own cache line.
+        Replica CopyToPages(PagePolicy pages) const
+        {
+            constexpr size_t ALIGNMENT = 64;
+            size_t size = 0;
+            auto reserve = [&](size_t bytes)
+            {
+                const size_t offset = size;
+                size = (size + bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+                return offset;
+            };
+            const size_t positionsAt = reserve(view.positions.size_bytes());
+            const size_t trianglesAt = reserve(view.triangles.size_bytes());
+            const size_t normalsAt = reserve(view.normals.size_bytes());
+            const size_t uvsAt = reserve(view.uvs.size_bytes());
+            const size_t nodesAt = reserve(nodes.size_bytes());
+            const size_t packetsAt = reserve(packets.size_bytes());
+
+            Replica replica{.memory = std::make_unique<PageBuffer>(size, pages), .view = {}, .nodes = {}, .packets = {}};
+            std::byte *base = replica.memory->Data();
+            auto copy = [&]<typename T>(std::span<const T> source, size_t offset)
+            {
+                if (!source.empty())
+                    std::memcpy(base + offset, source.data(), source.size_bytes());
+                return std::span<const T>(reinterpret_cast<const T *>(base + offset), source.size());
+            };
+            replica.view.positions = copy(view.positions, positionsAt);
+            replica.view.triangles = copy(view.triangles, trianglesAt);
+            replica.view.normals = copy(view.normals, normalsAt);
+            replica.view.uvs = copy(view.uvs, uvsAt);
+            replica.nodes = copy(nodes, nodesAt);
+            replica.packets = copy(packets, packetsAt);
+            return replica;
+        }
+
+        Mesh(IndexedMesh &&mesh, std::vector<BvhFlatNode> &&bvhNodes, std::vector<TrianglePacket4> &&packetStorage, AABB bbox,
+             std::shared_ptr<Material> material = DefaultMaterial())
+            : mesh(std::move(mesh)), bvhNodes(std::move(bvhNodes)), packetStorage(std::move(packetStorage)), material(material), bbox(bbox)
+        {
+            view = this->mesh.View();
+            nodes = this->bvhNodes;
+            packets = this->packetStorage;
+        }
 
-        Mesh(std::vector<Face> &&faces, std::vector<BvhFlatNode> &&bvhNodes, AABB bbox, std::shared_ptr<Material> material = DefaultMaterial())
-            : faces(std::move(faces)), bvhNodes(std::move(bvhNodes)), bbox(bbox), material(material)
+        Mesh(std::shared_ptr<const void> storage, IndexedMeshView view, std::span<const BvhFlatNode> nodes, std::span<const TrianglePacket4> packets,
+             AABB bbox, std::shared_ptr<Material> material)
+            : storage(std::move(storage)), view(view), nodes(nodes), packets(packets), material(material), bbox(bbox)
         {
         }
 
     public:
+        // view and nodes may point into the mesh's own buffers
+        Mesh(const Mesh &) = delete;
+        Mesh &operator=(const Mesh &) = delete;
+
         static shared_ptr<Mesh> Create(const std::string &file, std::shared_ptr<Material> material = DefaultMaterial())
         {
-            std::vector<Face> faces = ReadFaces(file);
-            if (faces.empty())
+            auto mesh = Create(LoadIndexedMesh(file), material);
+            mesh->SetSource(file);
+            return mesh;
+        }
+
+        static shared_ptr<Mesh> Create(IndexedMesh &&mesh, std::shared_ptr<Material> material = DefaultMaterial())
+        {
+            if (mesh.triangles.empty())
             {
-                throw std::runtime_error("No valid faces found in OBJ file: " + file);
+                throw std::runtime_error("FlatBvh::Mesh::Create: mesh has no triangles.");
             }
 
-            auto bvhNodes = BuildFlatBvh(faces);
-            auto root = bvhNodes[0];
+            auto bvhNodes = BuildFlatBvh(mesh.positions, mesh.triangles, TrianglePacket4::WIDTH);
+            auto packets = BuildPackets(mesh.View());
+            const auto &root = bvhNodes[0];
             AABB bbox(root.min, root.max);
-            return shared_ptr<Mesh>(new Mesh(std::move(faces), std::move(bvhNodes), bbox, material));
+            shared_ptr<Mesh> result(new Mesh(std::move(mesh), std::move(bvhNodes), std::move(packets), bbox, material));
+            result->Place(AccelerationMemoryPlacement());
+            return result;
+        }
+
+        // Packets for a mesh whose tree was built with leafSize = TrianglePacket4::WIDTH.
+        static std::vector<TrianglePacket4> BuildPackets(const IndexedMeshView &view)
+        {
+            std::vector<TrianglePacket4> packets;
+            packets.reserve((view.triangles.size() + TrianglePacket4::WIDTH - 1) / TrianglePacket4::WIDTH);
+            AppendTrianglePackets(view, 0, view.triangles.size(), packets);
+            return packets;
+        }
+
+        // Uses prebuilt geometry, nodes and packets in place. The storage owner must keep them alive.
+        static shared_ptr<Mesh> CreateView(std::shared_ptr<const void> storage, IndexedMeshView view, std::span<const BvhFlatNode> nodes,
+                                           std::span<const TrianglePacket4> packets, std::shared_ptr<Material> material = DefaultMaterial())
+        {
+            if (nodes.empty() || view.triangles.empty())
+            {
+                throw std::runtime_error("FlatBvh::Mesh::CreateView: mesh has no triangles.");
+            }
+
+            if (packets.size() * TrianglePacket4::WIDTH < view.triangles.size())
+            {
+                throw std::runtime_error("FlatBvh::Mesh::CreateView: not enough triangle packets.");
+            }
+
+            AABB bbox(nodes[0].min, nodes[0].max);
+            shared_ptr<Mesh> result(new Mesh(std::move(storage), view, nodes, packets, bbox, material));
+            result->Place(AccelerationMemoryPlacement());
+            return result;
+        }
+
+        // Moves the mesh data into page memory as placement asks and frees where it was. With
+        // replicatePerNode every NUMA node gets a copy, written by a thread on that node, and
+        // Hit reads the copy of the node it runs on. Not thread safe; call it before rendering.
+        void Place(const MemoryPlacement &placement)
+        {
+            if (!placement.Enabled())
+                return;
+
+            TRACE_SCOPE("PlaceMesh", "bvh");
+            std::vector<Replica> copies;
+            if (placement.replicatePerNode)
+            {
+                for (const auto &node : Numa::Nodes())
+                {
+                    // the thread that writes a page first decides the node it lives on
+                    Numa::PinCurrentThreadToNode(node);
+                    copies.push_back(CopyToPages(placement.pages));
+                    Numa::UnpinCurrentThread();
+                }
+            }
+            else
+            {
+                copies.push_back(CopyToPages(placement.pages));
+            }
+
+            replicas = std::move(copies);
+            view = replicas[0].view;
+            nodes = replicas[0].nodes;
+            packets = replicas[0].packets;
+            mesh = IndexedMesh();
+            bvhNodes = {};
+            packetStorage = {};
+            storage.reset();
+        }
+
+        // Copies of the data, one per NUMA node when replicated; 0 until Place.
+        size_t ReplicaCount() const
+        {
+            return replicas.size();
+        }
+
+        const IndexedMeshView &View() const
+        {
+            return view;
+        }
+
+        std::span<const BvhFlatNode> Nodes() const
+        {
+            return nodes;
+        }
+
+        // The packets hold Moeller-Trumbore data; the watertight kernel runs on the original
+        // positions through the scalar traversal.
+        void SetKernel(TriangleKernel value)
+        {
+            kernel = value;
+        }
+
+        TriangleKernel Kernel() const
+        {
+            return kernel;
+        }
+
+        std::span<const TrianglePacket4> Packets() const
+        {
+            return packets;
+        }
+
+        const std::shared_ptr<Material> &GetMaterial() const
+        {
+            return material;
+        }
+
+        // OBJ file the mesh was loaded from, empty for meshes built in memory. Scene files
+        // refer to meshes by it (see scenes/scene_file.h).
+        const std::string &Source() const
+        {
+            return source;
+        }
+
+        void SetSource(const std::string &file)
+        {
+            source = file;
         }
 
         size_t FaceCount() const
         {
-            return faces.size();
+            return view.triangles.size();
         }
 
         size_t BvhNodeCount() const
         {
-            return bvhNodes.size();
+            return nodes.size();
+        }
+
+        // Of one copy; see ReplicaCount.
+        size_t MemoryUsage() const
+        {
+            return view.positions.size_bytes() + view.triangles.size_bytes() + view.normals.size_bytes() +
+                   view.uvs.size_bytes() + nodes.size_bytes() + packets.size_bytes();
         }
 
         bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
         {
-            if (TraverseFlatBvh(ray, hit, t_min, t_max, bvhNodes, faces))
+            const bool local = replicas.size() > 1;
+            const Replica *replica = local ? &replicas[Numa::CurrentNodeIndex() % replicas.size()] : nullptr;
+            const auto &hitView = local ? replica->view : view;
+            const auto hitNodes = local ? replica->nodes : nodes;
+            const bool hasHit = kernel == TriangleKernel::Watertight
+                                    ? TraverseFlatBvh(ray, hit, t_min, t_max, hitNodes, hitView, TrianglePacket4::WIDTH, kernel)
+                                    : TraverseFlatBvhPackets(ray, hit, t_min, t_max, hitNodes, local ? replica->packets : packets, hitView);
+            if (hasHit)
             {
                 hit.material = material;
                 return true;
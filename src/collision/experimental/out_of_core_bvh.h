@@ -0,0 +1,821 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/ray.h"
+#include "core/hittable.h"
+#include "core/material.h"
+#include "core/parallel.h"
+#include "collision/indexed_mesh.h"
+#include "collision/experimental/bb_util.h"
+#include "collision/experimental/flat_bvh.h"
+#include "io/mapped_file.h"
+#include "io/obj_parser.h"
+#include "io/random_access_file.h"
+#include "core/trace.h"
+#include "io/mesh_cache.h"
+
+// Meshes that do not fit into memory.
+// The mesh is split into spatially coherent chunks of at most a fixed number of triangles.
+// Each chunk holds its own vertices (with their normals and uvs, when the whole mesh has
+// them), triangles and flat BVH and is stored in a file. Only a small top-level BVH over the
+// chunk bounds stays resident; chunks are read on demand through a cache with a memory cap.
+//
+// Converting an OBJ file does not load it either: it is parsed a few blocks at a time and the
+// vertex and index streams go to temporary files, which are mapped while the chunks are cut.
+// What stays in memory is 4 bytes per triangle for the partition order.
+namespace OutOfCore
+{
+    static constexpr char MAGIC[8] = {'S', 'R', 'T', 'O', 'O', 'C', '\0', '\0'};
+    static constexpr uint32_t VERSION = 2;
+    static constexpr size_t DEFAULT_TRIANGLES_PER_CHUNK = 16 * 1024;
+
+    // ChunkRecord::attributes
+    static constexpr uint32_t HAS_NORMALS = 1;
+    static constexpr uint32_t HAS_UVS = 2;
+
+    struct StoreHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t nodeSize;
+        uint64_t triangleCount;
+        uint64_t chunkCount;
+        uint64_t chunkTableOffset;
+        uint64_t topNodeCount;
+        uint64_t topNodeOffset;
+        // size and modification time of the OBJ file the store was converted from
+        uint64_t sourceSize;
+        int64_t sourceTime;
+    };
+
+    struct ChunkRecord
+    {
+        uint64_t offset;
+        uint64_t bytes;
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+        uint32_t nodeCount;
+        uint32_t attributes;
+    };
+
+    // Byte layout of a chunk payload: positions, triangles, normals, uvs, then nodes. Every
+    // array after the triangles starts at an 8 byte boundary.
+    struct ChunkLayout
+    {
+        size_t trianglesOffset, normalsOffset, uvsOffset, nodesOffset, bytes;
+
+        explicit ChunkLayout(const ChunkRecord &record)
+        {
+            auto align = [](size_t offset)
+            { return (offset + 7) / 8 * 8; };
+            const size_t normalCount = record.attributes & HAS_NORMALS ? record.vertexCount : 0;
+            const size_t uvCount = record.attributes & HAS_UVS ? record.vertexCount : 0;
+            trianglesOffset = size_t(record.vertexCount) * sizeof(Point3);
+            normalsOffset = align(trianglesOffset + size_t(record.triangleCount) * sizeof(IndexedTriangle));
+            uvsOffset = normalsOffset + normalCount * sizeof(Vector3);
+            nodesOffset = uvsOffset + uvCount * sizeof(TexCoord);
+            bytes = nodesOffset + size_t(record.nodeCount) * sizeof(FlatBvh::BvhFlatNode);
+        }
+    };
+
+    // A chunk read back from the store.
+    struct Chunk
+    {
+        std::unique_ptr<uint64_t[]> buffer;
+        size_t bytes = 0;
+        IndexedMeshView view;
+        std::span<const FlatBvh::BvhFlatNode> nodes;
+    };
+
+    // A mesh to partition, with normals and uvs referenced per triangle corner as in an OBJ
+    // file. The normal and uv streams are either empty or complete, with one index triangle
+    // per triangle.
+    struct SourceMesh
+    {
+        std::span<const Point3> positions;
+        std::span<const IndexedTriangle> triangles;
+        std::span<const Vector3> normals;
+        std::span<const IndexedTriangle> normalTriangles;
+        std::span<const TexCoord> uvs;
+        std::span<const IndexedTriangle> uvTriangles;
+    };
+
+    // Partitions the mesh and writes the chunk store. Only one chunk is materialized at a
+    // time, so the input can itself be backed by mapped files (see ConvertObj). The store is
+    // written to a temporary file and renamed, so a store file is always complete; sourceFile,
+    // when given, is recorded for OpenOrConvert's staleness check.
+    inline void WriteStore(const SourceMesh &mesh, const std::string &storeFile, const std::string &sourceFile = "",
+                           size_t trianglesPerChunk = DEFAULT_TRIANGLES_PER_CHUNK)
+    {
+        TRACE_SCOPE("OutOfCore::WriteStore", "io");
+        if (mesh.triangles.empty())
+            throw std::invalid_argument("OutOfCore::WriteStore: mesh has no triangles.");
+        if (mesh.triangles.size() > UINT32_MAX)
+            throw std::invalid_argument("OutOfCore::WriteStore: mesh has too many triangles.");
+
+        const bool hasNormals = !mesh.normals.empty();
+        const bool hasUvs = !mesh.uvs.empty();
+        const std::string tempFile = storeFile + ".tmp";
+        std::ofstream ofs(tempFile, std::ios::binary | std::ios::trunc);
+        if (!ofs)
+            throw std::runtime_error("Cannot open file for writing: " + tempFile);
+
+        StoreHeader header{};
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        std::vector<uint32_t> order(mesh.triangles.size());
+        std::iota(order.begin(), order.end(), 0u);
+
+        std::vector<FlatBvh::BvhFlatNode> topNodes;
+        std::vector<ChunkRecord> chunks;
+
+        auto vertex = [&](uint32_t triangle, int corner) -> const Point3 &
+        {
+            return mesh.positions[mesh.triangles[triangle].v[corner]];
+        };
+        auto centroid = [&](uint32_t triangle, int axis)
+        {
+            return vertex(triangle, 0)[axis] + vertex(triangle, 1)[axis] + vertex(triangle, 2)[axis];
+        };
+
+        struct VertexKey
+        {
+            uint32_t position, normal, uv;
+            bool operator==(const VertexKey &) const = default;
+        };
+        struct VertexKeyHash
+        {
+            size_t operator()(const VertexKey &k) const
+            {
+                uint64_t h = k.position * 0x9E3779B97F4A7C15ull;
+                h ^= (k.normal + 0x7F4A7C15ull) * 0xC2B2AE3D27D4EB4Full;
+                h ^= (k.uv + 0x165667B1ull) * 0x165667B19E3779F9ull;
+                return static_cast<size_t>(h ^ (h >> 29));
+            }
+        };
+
+        auto writeChunk = [&](size_t begin, size_t end)
+        {
+            // Gather the triangles with chunk-local vertices, one per combination of position,
+            // normal and uv.
+            std::unordered_map<VertexKey, uint32_t, VertexKeyHash> localIndex;
+            std::vector<Point3> positions;
+            std::vector<Vector3> normals;
+            std::vector<TexCoord> uvs;
+            std::vector<IndexedTriangle> triangles;
+            triangles.reserve(end - begin);
+            for (size_t i = begin; i < end; ++i)
+            {
+                const uint32_t triangle = order[i];
+                IndexedTriangle local;
+                for (int c = 0; c < 3; ++c)
+                {
+                    const VertexKey key{mesh.triangles[triangle].v[c],
+                                        hasNormals ? mesh.normalTriangles[triangle].v[c] : 0,
+                                        hasUvs ? mesh.uvTriangles[triangle].v[c] : 0};
+                    auto [it, inserted] = localIndex.try_emplace(key, static_cast<uint32_t>(positions.size()));
+                    if (inserted)
+                    {
+                        positions.push_back(mesh.positions[key.position]);
+                        if (hasNormals)
+                            normals.push_back(UnitVector(mesh.normals[key.normal]));
+                        if (hasUvs)
+                            uvs.push_back(mesh.uvs[key.uv]);
+                    }
+                    local.v[c] = it->second;
+                }
+                triangles.push_back(local);
+            }
+            auto nodes = FlatBvh::BuildFlatBvh(positions, triangles);
+
+            const ChunkRecord record{
+                .offset = static_cast<uint64_t>(ofs.tellp()),
+                .bytes = 0,
+                .vertexCount = static_cast<uint32_t>(positions.size()),
+                .triangleCount = static_cast<uint32_t>(triangles.size()),
+                .nodeCount = static_cast<uint32_t>(nodes.size()),
+                .attributes = (hasNormals ? HAS_NORMALS : 0) | (hasUvs ? HAS_UVS : 0)};
+            ChunkLayout layout(record);
+            std::vector<char> payload(layout.bytes, 0);
+            std::memcpy(payload.data(), positions.data(), positions.size() * sizeof(Point3));
+            std::memcpy(payload.data() + layout.trianglesOffset, triangles.data(), triangles.size() * sizeof(IndexedTriangle));
+            std::memcpy(payload.data() + layout.normalsOffset, normals.data(), normals.size() * sizeof(Vector3));
+            std::memcpy(payload.data() + layout.uvsOffset, uvs.data(), uvs.size() * sizeof(TexCoord));
+            std::memcpy(payload.data() + layout.nodesOffset, nodes.data(), nodes.size() * sizeof(FlatBvh::BvhFlatNode));
+
+            chunks.push_back(record);
+            chunks.back().bytes = payload.size();
+            ofs.write(payload.data(), payload.size());
+        };
+
+        // Median splits along the longest axis; ranges small enough become chunks and the
+        // top-level nodes reference them through object_index.
+        auto build = [&](auto &self, size_t begin, size_t end) -> size_t
+        {
+            AABBHelper bbox = FromTriangle(mesh.positions, mesh.triangles[order[begin]]);
+            for (size_t i = begin + 1; i < end; ++i)
+                bbox = Union(bbox, FromTriangle(mesh.positions, mesh.triangles[order[i]]));
+
+            size_t nodeIndex = topNodes.size();
+            topNodes.push_back(FlatBvh::BvhFlatNode{.min = bbox.min, .max = bbox.max});
+
+            if (end - begin <= trianglesPerChunk)
+            {
+                topNodes[nodeIndex].object_index = chunks.size();
+                writeChunk(begin, end);
+                return nodeIndex;
+            }
+
+            Vector3 extent = bbox.max - bbox.min;
+            int axis = (extent.x() > extent.y() && extent.x() > extent.z()) ? 0 : (extent.y() > extent.z() ? 1 : 2);
+            size_t mid = begin + (end - begin) / 2;
+            std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                             [&](uint32_t a, uint32_t b)
+                             { return centroid(a, axis) < centroid(b, axis); });
+
+            size_t left = self(self, begin, mid);
+            size_t right = self(self, mid, end);
+            topNodes[nodeIndex].left_index = left;
+            topNodes[nodeIndex].right_index = right;
+            return nodeIndex;
+        };
+        build(build, 0, order.size());
+
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.nodeSize = sizeof(FlatBvh::BvhFlatNode);
+        header.triangleCount = mesh.triangles.size();
+        header.chunkCount = chunks.size();
+        header.chunkTableOffset = static_cast<uint64_t>(ofs.tellp());
+        ofs.write(reinterpret_cast<const char *>(chunks.data()), chunks.size() * sizeof(ChunkRecord));
+        header.topNodeCount = topNodes.size();
+        header.topNodeOffset = static_cast<uint64_t>(ofs.tellp());
+        ofs.write(reinterpret_cast<const char *>(topNodes.data()), topNodes.size() * sizeof(FlatBvh::BvhFlatNode));
+        if (!sourceFile.empty())
+        {
+            header.sourceSize = std::filesystem::file_size(sourceFile);
+            header.sourceTime = MeshCache::FileTime(sourceFile);
+        }
+
+        ofs.seekp(0);
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        ofs.close();
+        if (!ofs)
+            throw std::runtime_error("Failed to write out-of-core store: " + tempFile);
+        std::filesystem::rename(tempFile, storeFile);
+    }
+
+    // Temporary file of trivially copyable elements, appended to and then mapped. Removed
+    // when destroyed.
+    template <typename T>
+    class SpillFile
+    {
+    public:
+        explicit SpillFile(std::string path) : path(std::move(path)), out(this->path, std::ios::binary | std::ios::trunc)
+        {
+            if (!out)
+                throw std::runtime_error("Cannot open file for writing: " + this->path);
+        }
+
+        ~SpillFile()
+        {
+            mapped.reset();
+            out.close();
+            std::error_code ignored;
+            std::filesystem::remove(path, ignored);
+        }
+
+        SpillFile(const SpillFile &) = delete;
+        SpillFile &operator=(const SpillFile &) = delete;
+
+        void Append(std::span<const T> values)
+        {
+            out.write(reinterpret_cast<const char *>(values.data()), values.size_bytes());
+            count += values.size();
+        }
+
+        size_t Count() const { return count; }
+
+        std::span<const T> Map()
+        {
+            out.close();
+            if (!out)
+                throw std::runtime_error("Failed to write temporary file: " + path);
+            if (count == 0)
+                return {};
+            mapped = std::make_unique<MappedFile>(path);
+            return std::span(reinterpret_cast<const T *>(mapped->Data()), count);
+        }
+
+    private:
+        std::string path;
+        std::ofstream out;
+        size_t count = 0;
+        std::unique_ptr<MappedFile> mapped;
+    };
+
+    // Converts an OBJ file to a store without loading it. The file is parsed a batch of
+    // blocks at a time (see ObjParser), and the vertex streams and triangles are appended to
+    // spill files next to the store, which WriteStore then reads through mappings. Normals
+    // and uvs are kept when every corner references them, as LoadIndexedMesh does.
+    inline void ConvertObj(const std::string &objFile, const std::string &storeFile,
+                           size_t trianglesPerChunk = DEFAULT_TRIANGLES_PER_CHUNK)
+    {
+        TRACE_SCOPE("OutOfCore::ConvertObj", "io");
+        static constexpr size_t BATCH_BLOCKS = 16;
+        const auto start = std::chrono::steady_clock::now();
+
+        SpillFile<Point3> positions(storeFile + ".positions.tmp");
+        SpillFile<Vector3> normals(storeFile + ".normals.tmp");
+        SpillFile<TexCoord> uvs(storeFile + ".uvs.tmp");
+        SpillFile<IndexedTriangle> triangles(storeFile + ".triangles.tmp");
+        SpillFile<IndexedTriangle> normalTriangles(storeFile + ".normal_triangles.tmp");
+        SpillFile<IndexedTriangle> uvTriangles(storeFile + ".uv_triangles.tmp");
+
+        // Faces may refer to vertices further down the file, so indices are resolved against
+        // an open count and checked once all vertices are known.
+        static constexpr size_t OPEN = UINT32_MAX;
+        uint32_t maxPosition = 0, maxNormal = 0, maxUv = 0;
+        bool allNormals = true, allUvs = true;
+
+        // the OBJ file is unmapped before the chunks are cut
+        {
+            MappedFile file(objFile);
+            const auto bounds = ObjParser::SplitAtLines(file.Data(), file.Size());
+            const size_t blockCount = bounds.size() - 1;
+
+            std::vector<ObjParser::Chunk> blocks(BATCH_BLOCKS);
+            std::vector<IndexedTriangle> out;
+
+            // Writes a block's index triangles; false if a corner has no reference.
+            auto emit = [&](const ObjParser::Chunk &block, std::vector<int64_t> &corners, size_t offset, bool strict,
+                            SpillFile<IndexedTriangle> &spill, uint32_t &maxIndex)
+            {
+                out.resize(block.triangleCount);
+                ObjParser::Triangulate(block, corners, offset, OPEN, strict, out.data());
+                for (const auto &triangle : out)
+                {
+                    for (uint32_t index : triangle.v)
+                    {
+                        if (index == ObjData::NO_INDEX)
+                            return false;
+                        maxIndex = std::max(maxIndex, index);
+                    }
+                }
+                spill.Append(out);
+                return true;
+            };
+
+            for (size_t first = 0; first < blockCount; first += BATCH_BLOCKS)
+            {
+                const size_t count = std::min(BATCH_BLOCKS, blockCount - first);
+                ParallelFor(count, [&](size_t i)
+                            {
+                    blocks[i] = ObjParser::Chunk{};
+                    ObjParser::ParseChunk(blocks[i], bounds[first + i], bounds[first + i + 1]); });
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    ObjParser::Chunk &block = blocks[i];
+                    if (block.triangleCount > 0)
+                    {
+                        emit(block, block.corners, positions.Count(), true, triangles, maxPosition);
+                        allNormals = allNormals && !block.normalCorners.empty() &&
+                                     emit(block, block.normalCorners, normals.Count(), false, normalTriangles, maxNormal);
+                        allUvs = allUvs && !block.texcoordCorners.empty() &&
+                                 emit(block, block.texcoordCorners, uvs.Count(), false, uvTriangles, maxUv);
+                    }
+                    positions.Append(block.vertices);
+                    normals.Append(block.normals);
+                    uvs.Append(block.texcoords);
+                }
+            }
+        }
+
+        if (triangles.Count() == 0)
+            throw std::runtime_error("No valid faces found in OBJ file: " + objFile);
+        if (positions.Count() > UINT32_MAX || normals.Count() > UINT32_MAX || uvs.Count() > UINT32_MAX)
+            throw std::runtime_error("OBJ file has too many vertices: " + objFile);
+        if (maxPosition >= positions.Count())
+            throw std::runtime_error("Face references invalid vertex indices");
+        const bool useNormals = allNormals && maxNormal < normals.Count();
+        const bool useUvs = allUvs && maxUv < uvs.Count();
+
+        fmt::println("Streamed {}: {} vertices, {} triangles{}{} in {:.3f}s", objFile, positions.Count(), triangles.Count(),
+                     useNormals ? ", normals" : "", useUvs ? ", uvs" : "",
+                     std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        SourceMesh mesh{
+            .positions = positions.Map(),
+            .triangles = triangles.Map(),
+            .normals = {},
+            .normalTriangles = {},
+            .uvs = {},
+            .uvTriangles = {}};
+        if (useNormals)
+        {
+            mesh.normals = normals.Map();
+            mesh.normalTriangles = normalTriangles.Map();
+        }
+        if (useUvs)
+        {
+            mesh.uvs = uvs.Map();
+            mesh.uvTriangles = uvTriangles.Map();
+        }
+        WriteStore(mesh, storeFile, objFile, trianglesPerChunk);
+    }
+
+    struct CacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t bytesRead = 0;
+        uint64_t residentBytes = 0;
+
+        double HitRate() const
+        {
+            auto total = hits + misses;
+            return total > 0 ? static_cast<double>(hits) / total : 0.0;
+        }
+    };
+
+    // Cache of chunks with a cap on the resident chunk bytes.
+    // Looking up a resident chunk takes no lock: every chunk has a slot with an atomic
+    // pointer, a count of the traversals using it (pins) and a reference bit. The mutex is
+    // only taken on a miss, to load the chunk and to evict others with the clock (second
+    // chance) algorithm. An evicted chunk is freed once its slot is no longer pinned.
+    class ChunkCache
+    {
+    private:
+        struct alignas(64) Slot
+        {
+            std::atomic<const Chunk *> chunk{nullptr};
+            std::atomic<uint32_t> pins{0};
+            std::atomic<bool> referenced{false};
+            std::atomic<uint64_t> hits{0};
+            // resident bytes; guarded by the mutex
+            size_t bytes = 0;
+        };
+
+    public:
+        // A pinned chunk; it stays valid until the Ref is destroyed, even when evicted.
+        class Ref
+        {
+        public:
+            Ref(Slot &slot, const Chunk *chunk) : slot(&slot), chunk(chunk) {}
+            Ref(Ref &&other) noexcept : slot(std::exchange(other.slot, nullptr)), chunk(other.chunk) {}
+            Ref(const Ref &) = delete;
+            Ref &operator=(const Ref &) = delete;
+            Ref &operator=(Ref &&) = delete;
+
+            ~Ref()
+            {
+                if (slot)
+                    slot->pins.fetch_sub(1, std::memory_order_release);
+            }
+
+            const Chunk *operator->() const { return chunk; }
+
+        private:
+            Slot *slot;
+            const Chunk *chunk;
+        };
+
+        ChunkCache(const std::string &storeFile, std::vector<ChunkRecord> records, size_t memoryCap)
+            : file(storeFile), records(std::move(records)), memoryCap(memoryCap),
+              slots(std::make_unique<Slot[]>(this->records.size()))
+        {
+        }
+
+        ~ChunkCache()
+        {
+            for (size_t id = 0; id < records.size(); ++id)
+                delete slots[id].chunk.load();
+            for (const auto &evicted : retired)
+                delete evicted.chunk;
+        }
+
+        ChunkCache(const ChunkCache &) = delete;
+        ChunkCache &operator=(const ChunkCache &) = delete;
+
+        Ref Get(size_t id)
+        {
+            Slot &slot = slots[id];
+            while (true)
+            {
+                if (const Chunk *chunk = Pin(slot))
+                {
+                    slot.hits.fetch_add(1, std::memory_order_relaxed);
+                    return Ref(slot, chunk);
+                }
+
+                std::promise<void> promise;
+                std::shared_future<void> pending;
+                {
+                    std::lock_guard lock(mutex);
+                    auto found = loading.find(id);
+                    if (found != loading.end())
+                        pending = found->second;
+                    else if (slot.chunk.load() != nullptr)
+                        continue; // loaded since the lookup
+                    else
+                        loading.emplace(id, promise.get_future().share());
+                }
+
+                // Another thread is loading the chunk; look it up again once it is there.
+                if (pending.valid())
+                {
+                    pending.get();
+                    continue;
+                }
+                return Load(id, slot, promise);
+            }
+        }
+
+        CacheStats Stats() const
+        {
+            std::lock_guard lock(mutex);
+            uint64_t hits = 0;
+            for (size_t id = 0; id < records.size(); ++id)
+                hits += slots[id].hits.load(std::memory_order_relaxed);
+            return CacheStats{
+                .hits = hits,
+                .misses = misses,
+                .evictions = evictions,
+                .bytesRead = bytesRead,
+                .residentBytes = residentBytes};
+        }
+
+    private:
+        struct Retired
+        {
+            Slot *slot;
+            const Chunk *chunk;
+        };
+
+        // Pins the slot and returns its chunk, or nullptr (unpinned) if it is not resident.
+        // The pin is taken before the pointer is read, and Evict clears the pointer before it
+        // reads the pins (both sequentially consistent), so an evicted chunk that a traversal
+        // still reads is never seen unpinned.
+        static const Chunk *Pin(Slot &slot)
+        {
+            slot.pins.fetch_add(1);
+            const Chunk *chunk = slot.chunk.load();
+            if (chunk == nullptr)
+            {
+                slot.pins.fetch_sub(1, std::memory_order_release);
+                return nullptr;
+            }
+            if (!slot.referenced.load(std::memory_order_relaxed))
+                slot.referenced.store(true, std::memory_order_relaxed);
+            return chunk;
+        }
+
+        // Reads the chunk outside of the lock, so other threads keep traversing, then
+        // publishes it and makes room for it.
+        Ref Load(size_t id, Slot &slot, std::promise<void> &promise)
+        {
+            const Chunk *chunk;
+            try
+            {
+                chunk = Read(records[id]).release();
+            }
+            catch (...)
+            {
+                {
+                    std::lock_guard lock(mutex);
+                    loading.erase(id);
+                }
+                promise.set_exception(std::current_exception());
+                throw;
+            }
+
+            slot.pins.fetch_add(1);
+            {
+                std::lock_guard lock(mutex);
+                slot.bytes = chunk->bytes;
+                slot.referenced.store(true, std::memory_order_relaxed);
+                slot.chunk.store(chunk);
+                ring.push_back(id);
+                residentBytes += chunk->bytes;
+                bytesRead += chunk->bytes;
+                misses++;
+                loading.erase(id);
+                Evict();
+            }
+            promise.set_value();
+            return Ref(slot, chunk);
+        }
+
+        std::unique_ptr<Chunk> Read(const ChunkRecord &record) const
+        {
+            auto chunk = std::make_unique<Chunk>();
+            chunk->bytes = record.bytes;
+            chunk->buffer = std::make_unique<uint64_t[]>((record.bytes + 7) / 8);
+            file.ReadAt(record.offset, chunk->buffer.get(), record.bytes);
+
+            ChunkLayout layout(record);
+            const char *base = reinterpret_cast<const char *>(chunk->buffer.get());
+            chunk->view.positions = std::span(reinterpret_cast<const Point3 *>(base), record.vertexCount);
+            chunk->view.triangles = std::span(reinterpret_cast<const IndexedTriangle *>(base + layout.trianglesOffset), record.triangleCount);
+            if (record.attributes & HAS_NORMALS)
+                chunk->view.normals = std::span(reinterpret_cast<const Vector3 *>(base + layout.normalsOffset), record.vertexCount);
+            if (record.attributes & HAS_UVS)
+                chunk->view.uvs = std::span(reinterpret_cast<const TexCoord *>(base + layout.uvsOffset), record.vertexCount);
+            chunk->nodes = std::span(reinterpret_cast<const FlatBvh::BvhFlatNode *>(base + layout.nodesOffset), record.nodeCount);
+            return chunk;
+        }
+
+        // Evicts chunks until the resident ones fit into the cap again, always keeping one.
+        // The clock hand gives a chunk that was used since it last passed a second chance;
+        // after a full round of those it evicts regardless.
+        void Evict()
+        {
+            size_t spared = 0;
+            while (residentBytes > memoryCap && ring.size() > 1)
+            {
+                if (hand >= ring.size())
+                    hand = 0;
+                Slot &slot = slots[ring[hand]];
+                if (spared < ring.size() && slot.referenced.exchange(false, std::memory_order_relaxed))
+                {
+                    ++hand;
+                    ++spared;
+                    continue;
+                }
+                retired.push_back(Retired{&slot, slot.chunk.exchange(nullptr)});
+                residentBytes -= slot.bytes;
+                ring[hand] = ring.back();
+                ring.pop_back();
+                ++evictions;
+            }
+
+            std::erase_if(retired, [](const Retired &evicted)
+                          {
+                if (evicted.slot->pins.load() != 0)
+                    return false;
+                delete evicted.chunk;
+                return true; });
+        }
+
+        RandomAccessFile file;
+        std::vector<ChunkRecord> records;
+        size_t memoryCap;
+        std::unique_ptr<Slot[]> slots;
+
+        mutable std::mutex mutex;
+        // ids of the resident chunks, swept by the clock hand
+        std::vector<size_t> ring;
+        size_t hand = 0;
+        std::unordered_map<size_t, std::shared_future<void>> loading;
+        // evicted chunks that were still pinned
+        std::vector<Retired> retired;
+        size_t residentBytes = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t bytesRead = 0;
+    };
+
+    class Mesh : public Hittable
+    {
+    private:
+        std::vector<FlatBvh::BvhFlatNode> topNodes;
+        std::unique_ptr<ChunkCache> cache;
+        size_t triangleCount;
+        std::shared_ptr<Material> material;
+        AABB bbox;
+        TriangleKernel kernel = TriangleKernel::MollerTrumbore;
+
+        Mesh(std::vector<FlatBvh::BvhFlatNode> &&topNodes, std::unique_ptr<ChunkCache> cache, size_t triangleCount, std::shared_ptr<Material> material)
+            : topNodes(std::move(topNodes)), cache(std::move(cache)), triangleCount(triangleCount), material(material),
+              bbox(this->topNodes[0].min, this->topNodes[0].max)
+        {
+        }
+
+    public:
+        // Opens a store written by WriteStore. memoryCap bounds the bytes of resident chunks.
+        static std::shared_ptr<Mesh> Open(const std::string &storeFile, size_t memoryCap, std::shared_ptr<Material> material = DefaultMaterial())
+        {
+            RandomAccessFile file(storeFile);
+            StoreHeader header;
+            file.ReadAt(0, &header, sizeof(header));
+            if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+                header.nodeSize != sizeof(FlatBvh::BvhFlatNode) || header.topNodeCount == 0)
+                throw std::runtime_error("Not an out-of-core mesh store: " + storeFile);
+
+            std::vector<ChunkRecord> records(header.chunkCount);
+            file.ReadAt(header.chunkTableOffset, records.data(), records.size() * sizeof(ChunkRecord));
+            std::vector<FlatBvh::BvhFlatNode> topNodes(header.topNodeCount);
+            file.ReadAt(header.topNodeOffset, topNodes.data(), topNodes.size() * sizeof(FlatBvh::BvhFlatNode));
+
+            auto cache = std::make_unique<ChunkCache>(storeFile, std::move(records), memoryCap);
+            return std::shared_ptr<Mesh>(new Mesh(std::move(topNodes), std::move(cache), header.triangleCount, material));
+        }
+
+        size_t FaceCount() const
+        {
+            return triangleCount;
+        }
+
+        CacheStats Stats() const
+        {
+            return cache->Stats();
+        }
+
+        void SetKernel(TriangleKernel value)
+        {
+            kernel = value;
+        }
+
+        bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
+        {
+            size_t stack[64];
+            size_t stackSize = 0;
+            stack[stackSize++] = 0;
+            bool hasHit = false;
+
+            while (stackSize > 0)
+            {
+                const auto &node = topNodes[stack[--stackSize]];
+                STATS_NODE(stackSize + 1);
+
+                if (!HitAABB(node.min, node.max, ray.origin, ray.direction, t_min, t_max))
+                    continue;
+
+                if (node.object_index != FlatBvh::INVALID_INDEX)
+                {
+                    auto chunk = cache->Get(node.object_index);
+                    if (FlatBvh::TraverseFlatBvh(ray, hit, t_min, t_max, chunk->nodes, chunk->view, 1, kernel))
+                    {
+                        t_max = hit.t;
+                        hasHit = true;
+                    }
+                }
+                else
+                {
+                    stack[stackSize++] = node.left_index;
+                    stack[stackSize++] = node.right_index;
+                }
+            }
+
+            if (hasHit)
+                hit.material = material;
+            return hasHit;
+        }
+
+        AABB BoundingBox() const override
+        {
+            return bbox;
+        }
+    };
+
+    inline std::string DefaultStorePath(const std::string &objFile)
+    {
+        return objFile + ".srtooc";
+    }
+
+    // Whether storeFile is a store of this version converted from objFile as it is now, by
+    // size and modification time. A store whose OBJ file is gone is used as it is.
+    inline bool IsUpToDate(const std::string &storeFile, const std::string &objFile)
+    {
+        if (!std::filesystem::exists(storeFile))
+            return false;
+        if (!std::filesystem::exists(objFile))
+            return true;
+
+        RandomAccessFile file(storeFile);
+        StoreHeader header;
+        if (file.Size() < sizeof(header))
+            return false;
+        file.ReadAt(0, &header, sizeof(header));
+        return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+               header.sourceSize == std::filesystem::file_size(objFile) && header.sourceTime == MeshCache::FileTime(objFile);
+    }
+
+    // Opens the store next to the OBJ file and (re)writes it when it is missing or stale.
+    inline std::shared_ptr<Mesh> OpenOrConvert(const std::string &objFile, size_t memoryCap, std::shared_ptr<Material> material = DefaultMaterial())
+    {
+        auto storeFile = DefaultStorePath(objFile);
+        if (!IsUpToDate(storeFile, objFile))
+        {
+            fmt::println("Writing out-of-core store: {}", storeFile);
+            ConvertObj(objFile, storeFile);
+        }
+        return Mesh::Open(storeFile, memoryCap, material);
+    }
+}
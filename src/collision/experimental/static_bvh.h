@@ -1,13 +1,20 @@
 #pragma once
 
+#include <span>
 #include <vector>
 #include <array>
 
 #include "core/ray.h"
 #include "core/hittable.h"
 #include "collision/face.h"
+#include "collision/indexed_mesh.h"
+#include "collision/triangle_packet.h"
+#include "collision/watertight.h"
+#include "core/arena.h"
 #include "core/material.h"
+#include "core/trace.h"
 #include "io/object_loader.h"
+#include "io/mesh_cache.h"
 #include "collision/experimental/bb_util.h"
 
 // Uses "final" types to prevent dynamic dispatching and raw pointers.
@@ -24,40 +31,77 @@ namespace StaticBvh
         FastBvhNode *leftNode = nullptr;
         FastBvhNode *rightNode = nullptr;
 
-        std::array<size_t, MAX_FACES_PER_LEAF> faces;
+        // Leaves reference the consecutive triangle packets holding their faces.
+        uint32_t firstPacket = 0;
+        uint32_t packetCount = 0;
+    };
 
-        FastBvhNode()
-        {
-            faces.fill(INVALID_INDEX);
-        }
+    // Closest hit found so far; turned into a hit record once the traversal is done.
+    struct ClosestHit
+    {
+        size_t triangle = INVALID_INDEX;
+        double u = 0.0, v = 0.0;
     };
 
-    bool Traverse(const Ray &ray, HitResult &hit, double &t_min, double &t_max, FastBvhNode *node, const std::vector<Face> &faces)
+    bool Traverse(const Ray &ray, ClosestHit &closest, double &t_min, double &t_max, FastBvhNode *node, std::span<const TrianglePacket4> packets)
     {
         if (node == nullptr)
             return false;
+        STATS_RECURSIVE_NODE();
 
         if (!HitAABB(node->min, node->max, ray.origin, ray.direction, t_min, t_max))
             return false;
 
-        if (node->faces[0] != INVALID_INDEX)
+        if (node->packetCount > 0)
+        {
+            bool hasHit(false);
+            for (uint32_t i = node->firstPacket; i < node->firstPacket + node->packetCount; i++)
+            {
+                uint32_t triangle;
+                double u, v;
+                if (IntersectPacket(packets[i], ray, t_min, t_max, triangle, u, v))
+                {
+                    closest = ClosestHit{triangle, u, v};
+                    hasHit = true;
+                }
+            }
+            return hasHit;
+        }
+
+        bool hitLeft = false, hitRight = false;
+        if (node->leftNode)
+            hitLeft = Traverse(ray, closest, t_min, t_max, node->leftNode, packets);
+        if (node->rightNode)
+            hitRight = Traverse(ray, closest, t_min, t_max, node->rightNode, packets);
+        return hitLeft || hitRight;
+    }
+
+    // Watertight variant of Traverse. Takes the triangles of each packet from the original positions.
+    bool TraverseWatertight(const WatertightRay &ray, ClosestHit &closest, double &t_min, double &t_max, FastBvhNode *node,
+                            std::span<const TrianglePacket4> packets, const IndexedMeshView &mesh, const Ray &original)
+    {
+        if (node == nullptr)
+            return false;
+        STATS_RECURSIVE_NODE();
+
+        if (!HitAABB(node->min, node->max, original.origin, original.direction, t_min, t_max))
+            return false;
+
+        if (node->packetCount > 0)
         {
-            double t;
             bool hasHit(false);
-            for (size_t i = 0; i < node->faces.size(); i++)
+            for (uint32_t i = node->firstPacket; i < node->firstPacket + node->packetCount; i++)
             {
-                if (node->faces[i] == INVALID_INDEX)
-                    break;
-                auto &face = faces[node->faces[i]];
-                if (HitFace(ray, face, t))
+                for (uint32_t triangle : packets[i].triangle)
                 {
-                    if (t >= t_min && t < t_max)
+                    if (triangle == TrianglePacket4::EMPTY)
+                        break;
+                    double t, u, v;
+                    if (HitTriangleWatertight(ray, mesh.Vertex(triangle, 0), mesh.Vertex(triangle, 1), mesh.Vertex(triangle, 2), t, u, v) &&
+                        t >= t_min && t < t_max)
                     {
                         t_max = t;
-                        hit.t = t;
-                        hit.point = ray.At(t);
-                        hit.normal = face.normal;
-                        hit.SetFaceNormal(ray, face.normal);
+                        closest = ClosestHit{triangle, u, v};
                         hasHit = true;
                     }
                 }
@@ -65,15 +109,13 @@ namespace StaticBvh
             return hasHit;
         }
 
-        bool hitLeft = false, hitRight = false;
-        if (node->leftNode)
-            hitLeft = Traverse(ray, hit, t_min, t_max, node->leftNode, faces);
-        if (node->rightNode)
-            hitRight = Traverse(ray, hit, t_min, t_max, node->rightNode, faces);
+        bool hitLeft = TraverseWatertight(ray, closest, t_min, t_max, node->leftNode, packets, mesh, original);
+        bool hitRight = TraverseWatertight(ray, closest, t_min, t_max, node->rightNode, packets, mesh, original);
         return hitLeft || hitRight;
     }
 
-    void BuildRecursive(FastBvhNode *node, std::vector<Face> &faces, size_t start, size_t end)
+    void BuildRecursive(FastBvhNode *node, std::span<const Point3> positions, std::span<IndexedTriangle> triangles, size_t start, size_t end,
+                        std::vector<TrianglePacket4> &packets, Arena &arena)
     {
         if (node == nullptr)
             throw std::invalid_argument("node can't be null.");
@@ -83,21 +125,20 @@ namespace StaticBvh
         // current range length
         size_t count = end - start;
 
-        if (count < 0)
-            throw std::invalid_argument("count can't be negative.");
+        if (start >= end || end > triangles.size())
+            throw std::invalid_argument("triangle range out of bounds.");
 
         // assign bounding box
-        AABBHelper bbox = Union(faces, start, end);
+        AABBHelper bbox = Union(positions, triangles, start, end);
         n.min = bbox.min;
         n.max = bbox.max;
 
-        // if sparse enough add faces
+        // if sparse enough pack the faces, their order is final at this point
         if (count <= MAX_FACES_PER_LEAF)
         {
-            for (int i = 0; i < count; i++)
-            {
-                n.faces[i] = start + i;
-            }
+            n.firstPacket = static_cast<uint32_t>(packets.size());
+            AppendTrianglePackets(IndexedMeshView{.positions = positions, .triangles = triangles, .normals = {}, .uvs = {}}, start, end, packets);
+            n.packetCount = static_cast<uint32_t>(packets.size()) - n.firstPacket;
             return;
         }
 
@@ -107,60 +148,112 @@ namespace StaticBvh
 
         // sort and split faces
         size_t mid = start + count / 2;
-        std::nth_element(faces.begin() + start, faces.begin() + mid, faces.begin() + end, BBCompareByMin(axisId));
+        std::nth_element(triangles.begin() + start, triangles.begin() + mid, triangles.begin() + end, BBCompareByMin(axisId, positions));
 
-        n.leftNode = new FastBvhNode();
-        n.rightNode = new FastBvhNode();
-        BuildRecursive(n.leftNode, faces, start, mid);
-        BuildRecursive(n.rightNode, faces, mid, end);
+        // siblings are allocated next to each other
+        n.leftNode = arena.Create<FastBvhNode>();
+        n.rightNode = arena.Create<FastBvhNode>();
+        BuildRecursive(n.leftNode, positions, triangles, start, mid, packets, arena);
+        BuildRecursive(n.rightNode, positions, triangles, mid, end, packets, arena);
     }
 
-    FastBvhNode *Build(std::vector<Face> &faces)
+    // The nodes live in the arena and are released with it.
+    FastBvhNode *Build(std::span<const Point3> positions, std::span<IndexedTriangle> triangles, std::vector<TrianglePacket4> &packets, Arena &arena)
     {
-        if (faces.size() == 0)
-            throw std::invalid_argument("faces can't be empty.");
+        TRACE_SCOPE("StaticBvh::Build", "bvh");
+        if (triangles.size() == 0)
+            throw std::invalid_argument("triangles can't be empty.");
 
-        auto root = new FastBvhNode();
-        BuildRecursive(root, faces, 0, faces.size());
+        auto root = arena.Create<FastBvhNode>();
+        BuildRecursive(root, positions, triangles, 0, triangles.size(), packets, arena);
         return root;
     }
 
     class Mesh : public Hittable
     {
     private:
-        std::vector<Face> faces;
+        IndexedMesh mesh;
+        std::vector<TrianglePacket4> packets;
+        // owns the nodes
+        Arena arena;
         FastBvhNode *root;
         std::shared_ptr<Material> material;
         AABB bbox;
+        TriangleKernel kernel = TriangleKernel::MollerTrumbore;
+        std::string source;
 
-        Mesh(FastBvhNode *root, std::vector<Face> &&faces, AABB bbox, std::shared_ptr<Material> material = DefaultMaterial())
-            : root(root), faces(std::move(faces)), bbox(bbox), material(material)
+        Mesh(IndexedMesh &&mesh, std::shared_ptr<Material> material)
+            : mesh(std::move(mesh)), material(material)
         {
+            root = Build(this->mesh.positions, this->mesh.triangles, packets, arena);
+            bbox = AABB(root->min, root->max);
         }
 
     public:
         static std::shared_ptr<Mesh> Create(const std::string &file, std::shared_ptr<Material> material = DefaultMaterial())
         {
-            std::vector<Face> faces = ReadFaces(file);
-            if (faces.empty())
-            {
-                throw std::runtime_error("No valid faces found in OBJ file: " + file);
-            }
+            auto mesh = Create(LoadIndexedMesh(file), material);
+            mesh->source = file;
+            return mesh;
+        }
+
+        // Takes the geometry from the binary mesh cache instead of parsing the OBJ file.
+        // The pointer based tree is not position independent, so it is still built on load.
+        static std::shared_ptr<Mesh> CreateCached(const std::string &file, std::shared_ptr<Material> material = DefaultMaterial())
+        {
+            auto cached = MeshCache::LoadOrConvert(file);
+            const auto &view = cached->View();
+
+            IndexedMesh mesh;
+            mesh.positions.assign(view.positions.begin(), view.positions.end());
+            mesh.triangles.assign(view.triangles.begin(), view.triangles.end());
+            mesh.normals.assign(view.normals.begin(), view.normals.end());
+            mesh.uvs.assign(view.uvs.begin(), view.uvs.end());
+            auto result = Create(std::move(mesh), material);
+            result->source = file;
+            return result;
+        }
 
-            auto root = Build(faces);
-            AABB bbox(root->min, root->max);
-            return std::shared_ptr<Mesh>(new Mesh(root, std::move(faces), bbox, material));
+        static std::shared_ptr<Mesh> Create(IndexedMesh &&mesh, std::shared_ptr<Material> material = DefaultMaterial())
+        {
+            return std::shared_ptr<Mesh>(new Mesh(std::move(mesh), material));
+        }
+
+        void SetKernel(TriangleKernel value)
+        {
+            kernel = value;
+        }
+
+        TriangleKernel Kernel() const
+        {
+            return kernel;
         }
 
         size_t FaceCount() const
         {
-            return faces.size();
+            return mesh.TriangleCount();
+        }
+
+        const std::shared_ptr<Material> &GetMaterial() const
+        {
+            return material;
+        }
+
+        // OBJ file the mesh was loaded from, empty for meshes built in memory.
+        const std::string &Source() const
+        {
+            return source;
         }
 
         bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
         {
-            if (Traverse(ray, hit, t_min, t_max, root, faces))
+            ClosestHit closest;
+            const bool hasHit = kernel == TriangleKernel::Watertight
+                                    ? TraverseWatertight(WatertightRay(ray), closest, t_min, t_max, root, packets, mesh.View(), ray)
+                                    : Traverse(ray, closest, t_min, t_max, root, packets);
+            if (hasHit)
             {
+                mesh.View().FillHit(ray, closest.triangle, t_max, closest.u, closest.v, hit);
                 hit.material = material;
                 return true;
             }
@@ -171,21 +264,5 @@ namespace StaticBvh
         {
             return bbox;
         }
-
-        ~Mesh()
-        {
-            DestroyNode(root);
-        }
-
-    private:
-        void DestroyNode(FastBvhNode *node)
-        {
-            if (node)
-            {
-                DestroyNode(node->leftNode);
-                DestroyNode(node->rightNode);
-                delete node;
-            }
-        }
     };
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "core/vector3.h"
 #include "core/hittable.h"
+#include "core/stats.h"
 
 struct Face
 {
@@ -13,13 +14,14 @@ struct Face
         : v0(v0), v1(v1), v2(v2), normal(UnitVector(Cross(v1 - v0, v2 - v0))) {}
 };
 
-inline bool HitFace(const Ray &ray, const Face &face, double &t)
+// Moeller-Trumbore intersection against a triangle given by one corner and its two edges
+// (edge1 = v1 - v0, edge2 = v2 - v0), so callers can precompute the edges. On a hit, returns
+// the ray parameter t and the barycentric coordinates (u, v) of the hit point with respect to v1 and v2.
+inline bool HitTriangleEdges(const Ray &ray, const Point3 &v0, const Vector3 &edge1, const Vector3 &edge2, double &t, double &u, double &v)
 {
+    STATS_COUNT(TriangleTests);
     constexpr double EPS = 1e-8;
 
-    const Vector3 edge1 = face.v1 - face.v0;
-    const Vector3 edge2 = face.v2 - face.v0;
-
     const Vector3 h = Cross(ray.direction, edge2);
     const double a = Dot(edge1, h);
 
@@ -27,14 +29,14 @@ inline bool HitFace(const Ray &ray, const Face &face, double &t)
         return false; // Ray is parallel to triangle
 
     const double f = 1.0 / a;
-    const Vector3 s = ray.origin - face.v0;
-    const double u = f * Dot(s, h);
+    const Vector3 s = ray.origin - v0;
+    u = f * Dot(s, h);
 
     if (u < 0.0 || u > 1.0)
         return false;
 
     const Vector3 q = Cross(s, edge1);
-    const double v = f * Dot(ray.direction, q);
+    v = f * Dot(ray.direction, q);
 
     if (v < 0.0 || (u + v) > 1.0)
         return false;
@@ -42,4 +44,15 @@ inline bool HitFace(const Ray &ray, const Face &face, double &t)
     t = f * Dot(edge2, q);
 
     return true;
-}
\ No newline at end of file
+}
+
+inline bool HitTriangle(const Ray &ray, const Point3 &v0, const Point3 &v1, const Point3 &v2, double &t, double &u, double &v)
+{
+    return HitTriangleEdges(ray, v0, v1 - v0, v2 - v0, t, u, v);
+}
+
+inline bool HitFace(const Ray &ray, const Face &face, double &t)
+{
+    double u, v;
+    return HitTriangle(ray, face.v0, face.v1, face.v2, t, u, v);
+}
@@ -51,6 +51,14 @@ public:
 
     AABB BoundingBox() const override { return bbox; }
 
+    AABB BoundingBoxAt(double time) const override
+    {
+        AABB box;
+        for (const auto &s : shapes)
+            box = AABB(box, s->BoundingBoxAt(time));
+        return box;
+    }
+
 private:
     AABB bbox = AABB();
 };
\ No newline at end of file
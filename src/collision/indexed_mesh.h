@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "core/vector3.h"
+#include "core/ray.h"
+#include "core/hittable.h"
+
+// Three indices into the vertex streams of an indexed mesh.
+struct IndexedTriangle
+{
+    uint32_t v[3];
+};
+
+struct TexCoord
+{
+    double u, v;
+};
+
+// Non-owning view of the vertex and index streams of a triangle mesh.
+// The normal and uv streams are either empty or hold one entry per position.
+struct IndexedMeshView
+{
+    std::span<const Point3> positions;
+    std::span<const IndexedTriangle> triangles;
+    std::span<const Vector3> normals;
+    std::span<const TexCoord> uvs;
+
+    const Point3 &Vertex(size_t triangle, int corner) const
+    {
+        return positions[triangles[triangle].v[corner]];
+    }
+
+    // Completes the hit record for a hit on the given triangle at barycentric coordinates (b1, b2).
+    void FillHit(const Ray &ray, size_t triangle, double t, double b1, double b2, HitResult &hit) const
+    {
+        const IndexedTriangle &tri = triangles[triangle];
+        const double b0 = 1.0 - b1 - b2;
+
+        Vector3 normal;
+        if (!normals.empty())
+            normal = UnitVector(b0 * normals[tri.v[0]] + b1 * normals[tri.v[1]] + b2 * normals[tri.v[2]]);
+        else
+            normal = UnitVector(Cross(positions[tri.v[1]] - positions[tri.v[0]], positions[tri.v[2]] - positions[tri.v[0]]));
+
+        hit.t = t;
+        hit.point = ray.At(t);
+        hit.SetFaceNormal(ray, normal);
+
+        if (!uvs.empty())
+        {
+            hit.u = b0 * uvs[tri.v[0]].u + b1 * uvs[tri.v[1]].u + b2 * uvs[tri.v[2]].u;
+            hit.v = b0 * uvs[tri.v[0]].v + b1 * uvs[tri.v[1]].v + b2 * uvs[tri.v[2]].v;
+        }
+        else
+        {
+            hit.u = b1;
+            hit.v = b2;
+        }
+    }
+};
+
+// Triangle mesh with one shared vertex buffer and a uint32 index buffer.
+// A closed mesh has about twice as many triangles as vertices, so this takes roughly
+// 12 bytes of indices plus 12 bytes of positions per triangle instead of a copy of
+// all three corners per face.
+struct IndexedMesh
+{
+    std::vector<Point3> positions;
+    std::vector<IndexedTriangle> triangles;
+    // Optional per-vertex streams.
+    std::vector<Vector3> normals;
+    std::vector<TexCoord> uvs;
+
+    IndexedMeshView View() const
+    {
+        return IndexedMeshView{
+            .positions = positions,
+            .triangles = triangles,
+            .normals = normals,
+            .uvs = uvs};
+    }
+
+    size_t TriangleCount() const { return triangles.size(); }
+
+    size_t MemoryUsage() const
+    {
+        return positions.size() * sizeof(Point3) +
+               triangles.size() * sizeof(IndexedTriangle) +
+               normals.size() * sizeof(Vector3) +
+               uvs.size() * sizeof(TexCoord);
+    }
+};
@@ -20,11 +20,19 @@ public:
           inverse_transform(transform.Inverse()),
           bbox(AABB::Transformed(hittable->BoundingBox(), transform)) {}
 
+    const shared_ptr<Hittable> &Object() const { return hittable; }
+    const Transform &ObjectToWorld() const { return transform; }
+
     AABB BoundingBox() const override
     {
         return bbox;
     }
 
+    AABB BoundingBoxAt(double time) const override
+    {
+        return AABB::Transformed(hittable->BoundingBoxAt(time), transform);
+    }
+
     bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
     {
         // Transform the ray to the object's local space
@@ -42,4 +50,59 @@ public:
         }
         return false;
     }
-};
\ No newline at end of file
+};
+
+// Instance whose transform moves from startTransform at shutter time 0 to endTransform at time 1.
+// The matrices are interpolated component-wise, so keep the rotation between the keys small.
+class MotionInstance : public Hittable
+{
+private:
+    shared_ptr<Hittable> hittable;
+    Transform startTransform;
+    Transform endTransform;
+    AABB bbox0, bbox1;
+    AABB bbox;
+
+public:
+    MotionInstance(shared_ptr<Hittable> hittable, const Transform &startTransform, const Transform &endTransform)
+        : hittable(hittable),
+          startTransform(startTransform),
+          endTransform(endTransform),
+          // Every point of the wrapped shape moves linearly between the keys, so the
+          // boxes at both keys interpolate to a conservative box at any time between.
+          bbox0(AABB::Transformed(hittable->BoundingBox(), startTransform)),
+          bbox1(AABB::Transformed(hittable->BoundingBox(), endTransform)),
+          bbox(bbox0, bbox1) {}
+
+    const shared_ptr<Hittable> &Object() const { return hittable; }
+    const Transform &StartTransform() const { return startTransform; }
+    const Transform &EndTransform() const { return endTransform; }
+
+    AABB BoundingBox() const override
+    {
+        return bbox;
+    }
+
+    AABB BoundingBoxAt(double time) const override
+    {
+        return AABB::Lerp(bbox0, bbox1, ShutterTime(time));
+    }
+
+    bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
+    {
+        auto transform = Transform::Lerp(startTransform, endTransform, ShutterTime(ray.time));
+        auto inverse_transform = transform.Inverse();
+
+        Ray local_ray(inverse_transform * ray.origin,
+                      inverse_transform.TransformDirection(ray.direction),
+                      ray.time);
+
+        if (hittable->Hit(local_ray, hit, t_min, t_max))
+        {
+            hit.point = transform * hit.point;
+            hit.normal = transform.TransformNormal(hit.normal);
+            return true;
+        }
+        return false;
+    }
+};
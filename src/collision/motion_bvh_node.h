@@ -0,0 +1,117 @@
+#pragma once
+
+#include "core/aabb.h"
+#include "core/hittable.h"
+#include "collision/hittable_list.h"
+
+#include <algorithm>
+
+// Bounding Volume Hierarchy for moving shapes.
+// Every node stores its bounds at shutter time 0 and 1 and interpolates them at the ray time,
+// so a fast moving shape only inflates the nodes around it by its motion per instant
+// instead of by the whole swept volume.
+class MotionBvhNode : public Hittable
+{
+
+public:
+    static shared_ptr<MotionBvhNode> Build(std::vector<shared_ptr<Hittable>> shapes)
+    {
+        if (shapes.empty())
+        {
+            throw std::runtime_error("MotionBvhNode::Build: cannot build BVH from empty shape list.");
+        }
+        return BuildRecursive(shapes, 0, shapes.size());
+    }
+
+private:
+    MotionBvhNode(shared_ptr<Hittable> left, shared_ptr<Hittable> right, AABB bbox0, AABB bbox1)
+        : left(std::move(left)), right(std::move(right)), bbox0(std::move(bbox0)), bbox1(std::move(bbox1)),
+          bbox(this->bbox0, this->bbox1)
+    {
+    }
+
+    static shared_ptr<MotionBvhNode> BuildRecursive(std::vector<shared_ptr<Hittable>> &shapes, size_t start, size_t end)
+    {
+        auto bbox0 = AABB::empty;
+        auto bbox1 = AABB::empty;
+        for (size_t i = start; i < end; i++)
+        {
+            bbox0 = AABB(bbox0, shapes[i]->BoundingBoxAt(0.0));
+            bbox1 = AABB(bbox1, shapes[i]->BoundingBoxAt(1.0));
+        }
+
+        size_t object_span = end - start;
+
+        shared_ptr<Hittable> left, right;
+
+        if (object_span == 1)
+        {
+            left = right = shapes[start];
+        }
+        else if (object_span == 2)
+        {
+            left = shapes[start];
+            right = shapes[start + 1];
+        }
+        else
+        {
+            // Split by the box at mid shutter, which is where the interpolated bounds are loosest.
+            auto axis = AABB::Lerp(bbox0, bbox1, 0.5).LongestAxisIndex();
+            std::sort(std::begin(shapes) + start, std::begin(shapes) + end, MidTimeCompare(axis));
+
+            auto mid = start + object_span / 2;
+            left = BuildRecursive(shapes, start, mid);
+            right = BuildRecursive(shapes, mid, end);
+        }
+        return std::shared_ptr<MotionBvhNode>(new MotionBvhNode(left, right, bbox0, bbox1));
+    }
+
+public:
+    bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
+    {
+        STATS_RECURSIVE_NODE();
+        if (!BoundingBoxAt(ray.time).Hit(ray, t_min, t_max))
+            return false;
+
+        auto h1 = left->Hit(ray, hit, t_min, t_max);
+        auto h2 = right->Hit(ray, hit, t_min, h1 ? hit.t : t_max);
+
+        return h1 || h2;
+    }
+
+    AABB BoundingBox() const override { return bbox; }
+
+    // Both are the same shape in a leaf built from a single one.
+    const shared_ptr<Hittable> &Left() const { return left; }
+    const shared_ptr<Hittable> &Right() const { return right; }
+
+    AABB BoundingBoxAt(double time) const override
+    {
+        return AABB::Lerp(bbox0, bbox1, ShutterTime(time));
+    }
+
+private:
+    shared_ptr<Hittable> left;
+    shared_ptr<Hittable> right;
+    AABB bbox0, bbox1;
+    // union over the whole shutter interval
+    AABB bbox;
+
+    struct MidTimeCompare
+    {
+        int index;
+        MidTimeCompare(int idx) : index(idx) {}
+
+        bool operator()(const shared_ptr<Hittable> &a, const shared_ptr<Hittable> &b) const
+        {
+            return Center(*a) < Center(*b);
+        }
+
+        double Center(const Hittable &h) const
+        {
+            auto i0 = h.BoundingBoxAt(0.0).AxisInterval(index);
+            auto i1 = h.BoundingBoxAt(1.0).AxisInterval(index);
+            return i0.min + i0.max + i1.min + i1.max;
+        }
+    };
+};
@@ -34,8 +34,14 @@ public:
 
     AABB BoundingBox() const override { return bbox; }
 
+    const Point3 &Corner() const { return Q; }
+    const Vector3 &EdgeU() const { return u; }
+    const Vector3 &EdgeV() const { return v; }
+    const shared_ptr<Material> &GetMaterial() const { return mat; }
+
     bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
     {
+        STATS_COUNT(QuadTests);
         auto denom = Dot(normal, ray.direction);
 
         // No hit if the ray is parallel to the plane.
@@ -7,22 +7,32 @@
 
 struct Sphere : Hittable
 {
+    // Center at shutter time 0.
     Vector3 center;
     double radius;
     std::shared_ptr<Material> material;
+    // Displacement of the center over the shutter interval, zero for static spheres.
+    Vector3 motion;
 
     Sphere() : Sphere(Vector3(), 1.0) {}
     Sphere(Vector3 c, double r) : Sphere(c, r, DefaultMaterial()) {}
-    Sphere(Vector3 c, double r, std::shared_ptr<Material> m) : center(c), radius(r), material(m)
+    Sphere(Vector3 c, double r, std::shared_ptr<Material> m) : Sphere(c, c, r, m) {}
+
+    // Sphere moving linearly from c0 at shutter time 0 to c1 at shutter time 1.
+    Sphere(Vector3 c0, Vector3 c1, double r, std::shared_ptr<Material> m)
+        : center(c0), radius(r), material(m), motion(c1 - c0)
     {
         if (!material)
             throw std::invalid_argument("Material must not be null");
 
         Vector3 rvec(r, r, r);
-        bbox = AABB(c - rvec, c + rvec);
+        bbox0 = AABB(c0 - rvec, c0 + rvec);
+        bbox1 = AABB(c1 - rvec, c1 + rvec);
+        bbox = AABB(bbox0, bbox1);
     }
 
 private:
+    AABB bbox0, bbox1;
     AABB bbox;
 
 public:
@@ -31,9 +41,21 @@ public:
         return bbox;
     }
 
+    AABB BoundingBoxAt(double time) const override
+    {
+        return AABB::Lerp(bbox0, bbox1, ShutterTime(time));
+    }
+
+    Point3 CenterAt(double time) const
+    {
+        return center + ShutterTime(time) * motion;
+    }
+
     bool Hit(const Ray &ray, HitResult &hitResult, double t_min, double t_max) const override
     {
-        Vector3 oc = center - ray.origin;
+        STATS_COUNT(SphereTests);
+        const Point3 current_center = CenterAt(ray.time);
+        Vector3 oc = current_center - ray.origin;
         double a = ray.direction.LengthSquared();
         double b = Dot(oc, ray.direction);
         double c = oc.LengthSquared() - radius * radius;
@@ -53,8 +75,8 @@ public:
         }
 
         Point3 hit_point = ray.At(root);
-        // Vector3 outward_normal = (hit_point - center) / radius;
-        Vector3 outward_normal = UnitVector(hit_point - center);
+        // Vector3 outward_normal = (hit_point - current_center) / radius;
+        Vector3 outward_normal = UnitVector(hit_point - current_center);
         hitResult.point = hit_point;
         hitResult.normal = outward_normal;
         hitResult.t = root;
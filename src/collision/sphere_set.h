@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "core/simd.h"
+#include "core/vector3.h"
+#include "core/ray.h"
+#include "core/hittable.h"
+#include "core/aabb.h"
+#include "core/material.h"
+#include "core/stats.h"
+#include "core/trace.h"
+
+// Spheres collected for a SphereSet. Materials are deduplicated and referenced by id.
+struct SphereList
+{
+    std::vector<Point3> centers;
+    std::vector<double> radii;
+    std::vector<uint32_t> materialIds;
+    std::vector<std::shared_ptr<Material>> materials;
+
+    uint32_t AddMaterial(const std::shared_ptr<Material> &material)
+    {
+        if (!material)
+            throw std::invalid_argument("Material must not be null");
+
+        auto [it, inserted] = materialLookup.try_emplace(material.get(), static_cast<uint32_t>(materials.size()));
+        if (inserted)
+            materials.push_back(material);
+        return it->second;
+    }
+
+    void Add(const Point3 &center, double radius, const std::shared_ptr<Material> &material)
+    {
+        Add(center, radius, AddMaterial(material));
+    }
+
+    void Add(const Point3 &center, double radius, uint32_t materialId)
+    {
+        centers.push_back(center);
+        radii.push_back(radius);
+        materialIds.push_back(materialId);
+    }
+
+    size_t Size() const { return centers.size(); }
+
+private:
+    std::unordered_map<const Material *, uint32_t> materialLookup;
+};
+
+// Four spheres in structure-of-arrays layout. Unused lanes have a NaN center and never hit.
+struct alignas(32) SpherePacket4
+{
+    static constexpr size_t WIDTH = 4;
+
+    double cx[WIDTH], cy[WIDTH], cz[WIDTH];
+    double radius[WIDTH];
+    uint32_t materialId[WIDTH];
+};
+
+// Many static spheres in one primitive: the spheres are stored in packets of four, ordered by
+// a BVH whose leaves are single packets, and each packet is tested with one SIMD quadratic.
+// Compared to a BvhNode over Sphere objects there is no per-sphere allocation, material
+// pointer or virtual call. Moving spheres are not supported; use Sphere for those.
+class SphereSet final : public Hittable
+{
+public:
+    struct Node
+    {
+        AABB bbox;
+        // inner nodes: children; leaves: left is the packet index and right is INVALID
+        uint32_t left, right;
+    };
+
+    static constexpr uint32_t INVALID = std::numeric_limits<uint32_t>::max();
+
+    static std::shared_ptr<SphereSet> Create(SphereList &&list)
+    {
+        if (list.Size() == 0)
+            throw std::invalid_argument("SphereSet::Create: no spheres.");
+        return std::shared_ptr<SphereSet>(new SphereSet(std::move(list)));
+    }
+
+    size_t Size() const { return sphereCount; }
+
+    // The spheres back as a list, in tree order, with the set's materials and ids.
+    SphereList Spheres() const
+    {
+        SphereList list;
+        // the set's materials are distinct, so they keep their ids
+        for (const auto &material : materials)
+            list.AddMaterial(material);
+        for (const auto &packet : packets)
+        {
+            for (size_t lane = 0; lane < SpherePacket4::WIDTH; lane++)
+            {
+                if (!std::isnan(packet.cx[lane]))
+                    list.Add(Point3(packet.cx[lane], packet.cy[lane], packet.cz[lane]), packet.radius[lane], packet.materialId[lane]);
+            }
+        }
+        return list;
+    }
+    size_t NodeCount() const { return nodes.size(); }
+
+    size_t MemoryUsage() const
+    {
+        return packets.size() * sizeof(SpherePacket4) + nodes.size() * sizeof(Node) +
+               materials.size() * sizeof(std::shared_ptr<Material>);
+    }
+
+    bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
+    {
+        uint32_t stack[64];
+        size_t stackSize = 0;
+        stack[stackSize++] = 0;
+
+        const SpherePacket4 *hitPacket = nullptr;
+        int hitLane = 0;
+
+        while (stackSize > 0)
+        {
+            const Node &node = nodes[stack[--stackSize]];
+            STATS_NODE(stackSize + 1);
+            if (!node.bbox.Hit(ray, t_min, t_max))
+                continue;
+
+            if (node.right == INVALID)
+            {
+                const SpherePacket4 &packet = packets[node.left];
+                int lane = IntersectPacket(packet, ray, t_min, t_max);
+                if (lane >= 0)
+                {
+                    hitPacket = &packet;
+                    hitLane = lane;
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.right;
+                stack[stackSize++] = node.left;
+            }
+        }
+
+        if (hitPacket == nullptr)
+            return false;
+
+        const Point3 center(hitPacket->cx[hitLane], hitPacket->cy[hitLane], hitPacket->cz[hitLane]);
+        const Point3 point = ray.At(t_max);
+        const Vector3 outward_normal = UnitVector(point - center);
+        hit.t = t_max;
+        hit.point = point;
+        hit.normal = outward_normal;
+        hit.material = materials[hitPacket->materialId[hitLane]];
+        hit.SetFaceNormal(ray, outward_normal);
+        return true;
+    }
+
+    AABB BoundingBox() const override
+    {
+        return nodes[0].bbox;
+    }
+
+    // Same quadratic as Sphere::Hit for the four spheres of a packet. Narrows t_max to the
+    // nearest root in [t_min, t_max] and returns its lane, or -1 if no sphere is hit.
+    static int IntersectPacket(const SpherePacket4 &packet, const Ray &ray, double t_min, double &t_max)
+    {
+        STATS_COUNT(SpherePacketTests);
+
+        const Double4 dx(ray.direction.x()), dy(ray.direction.y()), dz(ray.direction.z());
+        const Double4 ocx = Double4::Load(packet.cx) - Double4(ray.origin.x());
+        const Double4 ocy = Double4::Load(packet.cy) - Double4(ray.origin.y());
+        const Double4 ocz = Double4::Load(packet.cz) - Double4(ray.origin.z());
+        const Double4 r = Double4::Load(packet.radius);
+
+        const Double4 a(ray.direction.LengthSquared());
+        const Double4 b = ocx * dx + ocy * dy + ocz * dz;
+        const Double4 c = (ocx * ocx + ocy * ocy + ocz * ocz) - r * r;
+        const Double4 discriminant = b * b - a * c;
+
+        Mask4 valid = discriminant >= Double4(0.0);
+        if (MoveMask(valid) == 0)
+            return -1;
+
+        const Double4 sqrtd = Sqrt(Select(valid, discriminant, Double4(0.0)));
+        const Double4 lo(t_min), hi(t_max);
+        const Double4 near = (b - sqrtd) / a;
+        const Double4 far = (b + sqrtd) / a;
+        const Mask4 nearValid = (near >= lo) & (near <= hi);
+        const Mask4 farValid = (far >= lo) & (far <= hi);
+        const Double4 root = Select(nearValid, near, far);
+        valid = valid & (nearValid | farValid);
+
+        int mask = MoveMask(valid);
+        if (mask == 0)
+            return -1;
+
+        alignas(32) double roots[4];
+        root.Store(roots);
+        int best = -1;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if ((mask & (1 << lane)) && (best < 0 || roots[lane] < roots[best]))
+                best = lane;
+        }
+        t_max = roots[best];
+        return best;
+    }
+
+private:
+    std::vector<SpherePacket4> packets;
+    std::vector<Node> nodes;
+    std::vector<std::shared_ptr<Material>> materials;
+    size_t sphereCount;
+
+    explicit SphereSet(SphereList &&list)
+        : materials(std::move(list.materials)), sphereCount(list.Size())
+    {
+        TRACE_SCOPE("SphereSet::Create", "bvh");
+        std::vector<uint32_t> order(list.Size());
+        std::iota(order.begin(), order.end(), 0u);
+        nodes.reserve(2 * (list.Size() / SpherePacket4::WIDTH + 1));
+        Build(list, order, 0, order.size());
+    }
+
+    static AABB SphereBox(const SphereList &list, uint32_t sphere)
+    {
+        const Vector3 r(list.radii[sphere], list.radii[sphere], list.radii[sphere]);
+        return AABB(list.centers[sphere] - r, list.centers[sphere] + r);
+    }
+
+    // Median split on the longest axis of the centers, rounded to whole packets so that
+    // every leaf holds exactly one packet.
+    uint32_t Build(const SphereList &list, std::vector<uint32_t> &order, size_t begin, size_t end)
+    {
+        AABB bbox = SphereBox(list, order[begin]);
+        AABB centroids(list.centers[order[begin]], list.centers[order[begin]]);
+        for (size_t i = begin + 1; i < end; i++)
+        {
+            bbox = AABB(bbox, SphereBox(list, order[i]));
+            centroids = AABB(centroids, AABB(list.centers[order[i]], list.centers[order[i]]));
+        }
+
+        const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(Node{bbox, INVALID, INVALID});
+
+        const size_t count = end - begin;
+        if (count <= SpherePacket4::WIDTH)
+        {
+            SpherePacket4 packet;
+            for (size_t lane = 0; lane < SpherePacket4::WIDTH; lane++)
+            {
+                const bool used = lane < count;
+                const uint32_t sphere = used ? order[begin + lane] : 0;
+                const double nan = std::numeric_limits<double>::quiet_NaN();
+                packet.cx[lane] = used ? list.centers[sphere].x() : nan;
+                packet.cy[lane] = used ? list.centers[sphere].y() : nan;
+                packet.cz[lane] = used ? list.centers[sphere].z() : nan;
+                packet.radius[lane] = used ? list.radii[sphere] : 0.0;
+                packet.materialId[lane] = used ? list.materialIds[sphere] : 0;
+            }
+            nodes[nodeIndex].left = static_cast<uint32_t>(packets.size());
+            packets.push_back(packet);
+            return nodeIndex;
+        }
+
+        const int axis = centroids.LongestAxisIndex();
+        const size_t mid = begin + (count / 2 + SpherePacket4::WIDTH - 1) / SpherePacket4::WIDTH * SpherePacket4::WIDTH;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                         [&](uint32_t a, uint32_t b)
+                         { return list.centers[a][axis] < list.centers[b][axis]; });
+
+        const uint32_t left = Build(list, order, begin, mid);
+        const uint32_t right = Build(list, order, mid, end);
+        nodes[nodeIndex].left = left;
+        nodes[nodeIndex].right = right;
+        return nodeIndex;
+    }
+};
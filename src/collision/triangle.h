@@ -5,17 +5,20 @@
 #include "core/hittable.h"
 #include "core/aabb.h"
 #include "core/material.h"
+#include "collision/face.h"
 
 struct Triangle final : public Hittable
 {
     Point3 v0, v1, v2;
     Vector3 normal;
+    // v1 - v0 and v2 - v0, precomputed for the intersection test
+    Vector3 edge1, edge2;
     std::shared_ptr<Material> material;
 
     Triangle(const Point3 &v0, const Point3 &v1, const Point3 &v2, std::shared_ptr<Material> material = DefaultMaterial())
-        : v0(v0), v1(v1), v2(v2), material(material)
+        : v0(v0), v1(v1), v2(v2), edge1(v1 - v0), edge2(v2 - v0), material(material)
     {
-        normal = UnitVector(Cross(v1 - v0, v2 - v0));
+        normal = UnitVector(Cross(edge1, edge2));
         Vector3 minPoint = Vector3::Min(v0, Vector3::Min(v1, v2));
         Vector3 maxPoint = Vector3::Max(v0, Vector3::Max(v1, v2));
         bbox = AABB(minPoint, maxPoint);
@@ -23,31 +26,10 @@ struct Triangle final : public Hittable
 
     bool Hit(const Ray &ray, HitResult &hit, double t_min, double t_max) const override
     {
-        constexpr double EPS = 1e-8;
-
-        const Vector3 edge1 = v1 - v0;
-        const Vector3 edge2 = v2 - v0;
-
-        const Vector3 h = Cross(ray.direction, edge2);
-        const double a = Dot(edge1, h);
-
-        if (std::abs(a) < EPS)
-            return false; // Ray is parallel to triangle
-
-        const double f = 1.0 / a;
-        const Vector3 s = ray.origin - v0;
-        const double u = f * Dot(s, h);
-
-        if (u < 0.0 || u > 1.0)
-            return false;
-
-        const Vector3 q = Cross(s, edge1);
-        const double v = f * Dot(ray.direction, q);
-
-        if (v < 0.0 || (u + v) > 1.0)
+        double t, u, v;
+        if (!HitTriangleEdges(ray, v0, edge1, edge2, t, u, v))
             return false;
 
-        const double t = f * Dot(edge2, q);
         if (t < t_min || t > t_max)
             return false;
 
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "core/simd.h"
+#include "core/ray.h"
+#include "core/stats.h"
+#include "collision/indexed_mesh.h"
+
+// Four triangles in structure-of-arrays layout with the edges precomputed.
+// All four are tested against a ray at once (see IntersectPacket). Unused lanes hold a
+// degenerate triangle that never reports a hit.
+struct alignas(32) TrianglePacket4
+{
+    static constexpr size_t WIDTH = 4;
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    double v0x[WIDTH], v0y[WIDTH], v0z[WIDTH];
+    // v1 - v0
+    double e1x[WIDTH], e1y[WIDTH], e1z[WIDTH];
+    // v2 - v0
+    double e2x[WIDTH], e2y[WIDTH], e2z[WIDTH];
+    // triangle index in the mesh, EMPTY for unused lanes
+    uint32_t triangle[WIDTH];
+
+    TrianglePacket4()
+    {
+        for (size_t lane = 0; lane < WIDTH; lane++)
+            Set(lane, EMPTY, Point3(), Point3(), Point3());
+    }
+
+    void Set(size_t lane, uint32_t index, const Point3 &v0, const Point3 &v1, const Point3 &v2)
+    {
+        const Vector3 edge1 = v1 - v0;
+        const Vector3 edge2 = v2 - v0;
+        v0x[lane] = v0.x(), v0y[lane] = v0.y(), v0z[lane] = v0.z();
+        e1x[lane] = edge1.x(), e1y[lane] = edge1.y(), e1z[lane] = edge1.z();
+        e2x[lane] = edge2.x(), e2y[lane] = edge2.y(), e2z[lane] = edge2.z();
+        triangle[lane] = index;
+    }
+};
+
+// Packs the mesh triangles [begin, end) into packets, appending them to packets.
+inline void AppendTrianglePackets(const IndexedMeshView &mesh, size_t begin, size_t end, std::vector<TrianglePacket4> &packets)
+{
+    for (size_t first = begin; first < end; first += TrianglePacket4::WIDTH)
+    {
+        TrianglePacket4 &packet = packets.emplace_back();
+        for (size_t lane = 0; lane < TrianglePacket4::WIDTH && first + lane < end; lane++)
+        {
+            const size_t triangle = first + lane;
+            packet.Set(lane, static_cast<uint32_t>(triangle), mesh.Vertex(triangle, 0), mesh.Vertex(triangle, 1), mesh.Vertex(triangle, 2));
+        }
+    }
+}
+
+// Moeller-Trumbore against the four triangles of a packet. Uses the same arithmetic as
+// HitTriangleEdges, so both report the same hits (bit for bit unless the compiler contracts
+// the scalar code into FMAs). Finds the nearest hit with t in [t_min, t_max), then narrows
+// t_max to it and returns the triangle index and barycentrics.
+inline bool IntersectPacket(const TrianglePacket4 &packet, const Ray &ray, double t_min, double &t_max, uint32_t &triangle, double &u, double &v)
+{
+    STATS_COUNT(TrianglePacketTests);
+
+    const Double4 EPS(1e-8);
+    const Double4 zero(0.0), one(1.0);
+
+    const Double4 dx(ray.direction.x()), dy(ray.direction.y()), dz(ray.direction.z());
+    const Double4 e1x = Double4::Load(packet.e1x), e1y = Double4::Load(packet.e1y), e1z = Double4::Load(packet.e1z);
+    const Double4 e2x = Double4::Load(packet.e2x), e2y = Double4::Load(packet.e2y), e2z = Double4::Load(packet.e2z);
+
+    // h = d x e2, a = e1 . h
+    const Double4 hx = dy * e2z - dz * e2y;
+    const Double4 hy = dz * e2x - dx * e2z;
+    const Double4 hz = dx * e2y - dy * e2x;
+    const Double4 a = e1x * hx + e1y * hy + e1z * hz;
+
+    Mask4 valid = Abs(a) >= EPS;
+    if (MoveMask(valid) == 0)
+        return false;
+
+    const Double4 f = one / a;
+    const Double4 sx = Double4(ray.origin.x()) - Double4::Load(packet.v0x);
+    const Double4 sy = Double4(ray.origin.y()) - Double4::Load(packet.v0y);
+    const Double4 sz = Double4(ray.origin.z()) - Double4::Load(packet.v0z);
+    const Double4 bu = f * (sx * hx + sy * hy + sz * hz);
+    valid = valid & (bu >= zero) & (bu <= one);
+    if (MoveMask(valid) == 0)
+        return false;
+
+    // q = s x e1
+    const Double4 qx = sy * e1z - sz * e1y;
+    const Double4 qy = sz * e1x - sx * e1z;
+    const Double4 qz = sx * e1y - sy * e1x;
+    const Double4 bv = f * (dx * qx + dy * qy + dz * qz);
+    const Double4 t = f * (e2x * qx + e2y * qy + e2z * qz);
+    valid = valid & (bv >= zero) & ((bu + bv) <= one) & (t >= Double4(t_min)) & (t < Double4(t_max));
+
+    int mask = MoveMask(valid);
+    if (mask == 0)
+        return false;
+
+    alignas(32) double ts[4], us[4], vs[4];
+    t.Store(ts);
+    bu.Store(us);
+    bv.Store(vs);
+
+    int best = -1;
+    for (int lane = 0; lane < 4; lane++)
+    {
+        if ((mask & (1 << lane)) && (best < 0 || ts[lane] < ts[best]))
+            best = lane;
+    }
+
+    t_max = ts[best];
+    triangle = packet.triangle[best];
+    u = us[best];
+    v = vs[best];
+    return true;
+}
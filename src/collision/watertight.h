@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cmath>
+#include <utility>
+
+#include "core/vector3.h"
+#include "core/ray.h"
+#include "core/stats.h"
+
+// Ray/triangle kernels a mesh can be traced with.
+enum class TriangleKernel
+{
+    // HitTriangle: fast, but rays through shared edges and vertices can slip between
+    // neighbouring triangles because of its determinant cutoff and barycentric rounding.
+    MollerTrumbore,
+    // HitTriangleWatertight: never misses a shared edge of a closed mesh.
+    Watertight,
+};
+
+// Per-ray constants of the watertight test (Woop, Benthin, Wald: "Watertight Ray/Triangle
+// Intersection", JCGT 2013). The ray is translated to the origin and sheared so that it
+// points along +z; the permutation and shear are computed once per ray, not per triangle.
+struct WatertightRay
+{
+    Point3 origin;
+    int kx, ky, kz;
+    double Sx, Sy, Sz;
+
+    explicit WatertightRay(const Ray &ray) : origin(ray.origin)
+    {
+        const Vector3 &d = ray.direction;
+
+        // z is the dimension where the direction is largest, x and y keep the winding
+        kz = std::abs(d.x()) > std::abs(d.y()) ? (std::abs(d.x()) > std::abs(d.z()) ? 0 : 2)
+                                               : (std::abs(d.y()) > std::abs(d.z()) ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (d[kz] < 0.0)
+            std::swap(kx, ky);
+
+        Sx = d[kx] / d[kz];
+        Sy = d[ky] / d[kz];
+        Sz = 1.0 / d[kz];
+    }
+};
+
+// Watertight intersection. Same contract as HitTriangle: on a hit returns the ray parameter t
+// (unchecked against any interval) and the barycentric coordinates (u, v) with respect to v1 and v2.
+inline bool HitTriangleWatertight(const WatertightRay &ray, const Point3 &v0, const Point3 &v1, const Point3 &v2, double &t, double &u, double &v)
+{
+    STATS_COUNT(WatertightTriangleTests);
+
+    const Vector3 A = v0 - ray.origin;
+    const Vector3 B = v1 - ray.origin;
+    const Vector3 C = v2 - ray.origin;
+
+    // shear and scale the vertices into ray space
+    const double Ax = A[ray.kx] - ray.Sx * A[ray.kz];
+    const double Ay = A[ray.ky] - ray.Sy * A[ray.kz];
+    const double Bx = B[ray.kx] - ray.Sx * B[ray.kz];
+    const double By = B[ray.ky] - ray.Sy * B[ray.kz];
+    const double Cx = C[ray.kx] - ray.Sx * C[ray.kz];
+    const double Cy = C[ray.ky] - ray.Sy * C[ray.kz];
+
+    // scaled barycentrics: signed edge functions of the projected triangle at the origin
+    double U = Cx * By - Cy * Bx;
+    double V = Ax * Cy - Ay * Cx;
+    double W = Bx * Ay - By * Ax;
+
+    // On an edge the products cancel exactly and rounding decides the sign; recompute in
+    // higher precision so the neighbouring triangle sees the same value.
+    // (long double is double on MSVC, where this is a no-op.)
+    if (U == 0.0 || V == 0.0 || W == 0.0)
+    {
+        U = static_cast<double>(static_cast<long double>(Cx) * By - static_cast<long double>(Cy) * Bx);
+        V = static_cast<double>(static_cast<long double>(Ax) * Cy - static_cast<long double>(Ay) * Cx);
+        W = static_cast<double>(static_cast<long double>(Bx) * Ay - static_cast<long double>(By) * Ax);
+    }
+
+    // the origin has to be on the same side of all edges, either winding is accepted
+    if ((U < 0.0 || V < 0.0 || W < 0.0) && (U > 0.0 || V > 0.0 || W > 0.0))
+        return false;
+
+    const double det = U + V + W;
+    if (det == 0.0)
+        return false;
+
+    const double Az = ray.Sz * A[ray.kz];
+    const double Bz = ray.Sz * B[ray.kz];
+    const double Cz = ray.Sz * C[ray.kz];
+    const double T = U * Az + V * Bz + W * Cz;
+
+    const double invDet = 1.0 / det;
+    t = T * invDet;
+    u = V * invDet;
+    v = W * invDet;
+    return true;
+}
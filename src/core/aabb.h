@@ -4,6 +4,7 @@
 #include "core/vector3.h"
 #include "core/ray.h"
 #include "core/transform.h"
+#include "core/stats.h"
 
 class AABB
 {
@@ -48,6 +49,7 @@ public:
 
     bool Hit(const Ray &r, double t_min, double t_max) const
     {
+        STATS_COUNT(AABBTests);
         const Point3 &ray_orig = r.origin;
         const Vector3 &ray_dir = r.direction;
 
@@ -140,6 +142,14 @@ public:
         return AABB(new_x, new_y, new_z);
     }
 
+    // Linear interpolation of two boxes; used for the bounds of moving shapes at a shutter time.
+    static AABB Lerp(const AABB &box0, const AABB &box1, double t)
+    {
+        auto lerp = [t](const Interval &a, const Interval &b)
+        { return Interval(a.min + t * (b.min - a.min), a.max + t * (b.max - a.max)); };
+        return AABB(lerp(box0.x, box1.x), lerp(box0.y, box1.y), lerp(box0.z, box1.z));
+    }
+
     static const AABB empty, universe;
 
 private:
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/vector3.h"
+#include "io/image.h"
+
+// Sum of the samples of every pixel and how many were taken, filled by Renderer::Accumulate.
+// Buffers holding different sample ranges of the same frame merge into the buffer one render
+// of all those samples would have produced, bit for bit: sums are kept in 64-bit fixed point,
+// so adding them up is exact and does not depend on the order.
+//
+// Each sample is clamped to [0, MAX_SAMPLE] per channel (NaN counts as 0). With 2^-28 as the
+// unit a pixel can hold 2^35 of radiance, e.g. a million samples averaging 30000.
+class AccumulationBuffer
+{
+public:
+    static constexpr double SCALE = double(1ull << 28);
+    static constexpr double MAX_SAMPLE = double(1ull << 20);
+
+    // a run of samples [start, start + count) of every pixel
+    struct SampleRange
+    {
+        uint32_t start;
+        uint32_t count;
+    };
+
+    int width, height;
+    // the seed the samples were taken with; the ranges are only comparable within a seed
+    uint64_t seed;
+    std::vector<SampleRange> ranges;
+    // three fixed point channel sums per pixel, row by row from the top
+    std::vector<int64_t> sums;
+    // samples taken per pixel
+    std::vector<uint32_t> weights;
+
+    AccumulationBuffer(int width, int height, uint64_t seed = 1)
+        : width(width), height(height), seed(seed), sums(size_t(width) * height * 3), weights(size_t(width) * height)
+    {
+    }
+
+    size_t Index(int x, int y) const
+    {
+        return size_t(y) * width + x;
+    }
+
+    void AddSample(size_t pixel, const Color &color)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            // also maps NaN to 0
+            const double value = color[c] > 0.0 ? std::min(color[c], MAX_SAMPLE) : 0.0;
+            sums[pixel * 3 + c] += static_cast<int64_t>(std::llround(value * SCALE));
+        }
+        weights[pixel]++;
+    }
+
+    // Records that samples [start, start + count) were added to every pixel.
+    void AddRange(uint32_t start, uint32_t count)
+    {
+        InsertRange(ranges, start, count);
+    }
+
+    // Adds the samples of other, which must not share sample ranges with this buffer. Nothing
+    // changes if it does.
+    void Merge(const AccumulationBuffer &other)
+    {
+        if (other.width != width || other.height != height)
+            throw std::invalid_argument("AccumulationBuffer: cannot merge buffers of different sizes.");
+        if (other.seed != seed)
+            throw std::invalid_argument("AccumulationBuffer: cannot merge buffers rendered with different seeds.");
+        std::vector<SampleRange> merged = ranges;
+        for (const auto &range : other.ranges)
+            InsertRange(merged, range.start, range.count);
+        ranges = std::move(merged);
+        for (size_t i = 0; i < sums.size(); i++)
+            sums[i] += other.sums[i];
+        for (size_t i = 0; i < weights.size(); i++)
+            weights[i] += other.weights[i];
+    }
+
+    // Mean of the samples of every pixel; black where there are none.
+    void Resolve(Image &image) const
+    {
+        if (image.width != width || image.height != height)
+            throw std::invalid_argument("AccumulationBuffer: image size does not match.");
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const size_t pixel = Index(x, y);
+                const double scale = weights[pixel] > 0 ? 1.0 / (SCALE * weights[pixel]) : 0.0;
+                image.pixels[y][x] = Color(sums[pixel * 3] * scale, sums[pixel * 3 + 1] * scale, sums[pixel * 3 + 2] * scale);
+            }
+        }
+    }
+
+    uint64_t TotalSamples() const
+    {
+        uint64_t total = 0;
+        for (const auto &range : ranges)
+            total += range.count;
+        return total;
+    }
+
+    // Layout: magic, version, width, height, seed, range count, the ranges, then the sums and
+    // the weights as stored in memory (little endian on every platform we build for).
+    void Save(const std::string &filename) const
+    {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Cannot open file for writing: " + filename);
+
+        const uint32_t header[4] = {VERSION, static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(ranges.size())};
+        file.write(MAGIC, sizeof(MAGIC));
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+        file.write(reinterpret_cast<const char *>(ranges.data()), ranges.size() * sizeof(SampleRange));
+        file.write(reinterpret_cast<const char *>(sums.data()), sums.size() * sizeof(int64_t));
+        file.write(reinterpret_cast<const char *>(weights.data()), weights.size() * sizeof(uint32_t));
+        if (!file)
+            throw std::runtime_error("Failed to write accumulation buffer: " + filename);
+    }
+
+    static AccumulationBuffer Load(const std::string &filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Cannot open file: " + filename);
+
+        char magic[sizeof(MAGIC)];
+        uint32_t header[4];
+        uint64_t seed;
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char *>(header), sizeof(header));
+        file.read(reinterpret_cast<char *>(&seed), sizeof(seed));
+        if (!file || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || header[0] != VERSION)
+            throw std::runtime_error("Not an accumulation buffer of this version: " + filename);
+
+        // check the header against the file size before allocating what it claims
+        const uint64_t headerBytes = static_cast<uint64_t>(file.tellg());
+        file.seekg(0, std::ios::end);
+        const uint64_t fileBytes = static_cast<uint64_t>(file.tellg());
+        file.seekg(static_cast<std::streamoff>(headerBytes));
+        if (header[1] == 0 || header[2] == 0 || header[1] > INT32_MAX || header[2] > INT32_MAX)
+            throw std::runtime_error("Invalid accumulation buffer size: " + filename);
+        const uint64_t pixels = uint64_t(header[1]) * header[2];
+        const uint64_t pixelBytes = 3 * sizeof(int64_t) + sizeof(uint32_t);
+        const uint64_t available = fileBytes - headerBytes;
+        if (header[3] > available / sizeof(SampleRange) || pixels > (available - header[3] * sizeof(SampleRange)) / pixelBytes ||
+            header[3] * sizeof(SampleRange) + pixels * pixelBytes != available)
+            throw std::runtime_error("Accumulation buffer does not match its file size: " + filename);
+
+        AccumulationBuffer buffer(static_cast<int>(header[1]), static_cast<int>(header[2]), seed);
+        buffer.ranges.resize(header[3]);
+        file.read(reinterpret_cast<char *>(buffer.ranges.data()), buffer.ranges.size() * sizeof(SampleRange));
+        file.read(reinterpret_cast<char *>(buffer.sums.data()), buffer.sums.size() * sizeof(int64_t));
+        file.read(reinterpret_cast<char *>(buffer.weights.data()), buffer.weights.size() * sizeof(uint32_t));
+        if (!file)
+            throw std::runtime_error("Truncated accumulation buffer: " + filename);
+        return buffer;
+    }
+
+private:
+    static constexpr char MAGIC[8] = {'S', 'R', 'T', 'A', 'C', 'C', 'U', '\0'};
+    static constexpr uint32_t VERSION = 1;
+
+    static void InsertRange(std::vector<SampleRange> &ranges, uint32_t start, uint32_t count)
+    {
+        const uint64_t end = uint64_t(start) + count;
+        if (end > UINT32_MAX)
+            throw std::invalid_argument("AccumulationBuffer: sample range exceeds 2^32 samples.");
+        for (const auto &range : ranges)
+        {
+            if (start < uint64_t(range.start) + range.count && range.start < end)
+                throw std::invalid_argument("AccumulationBuffer: sample ranges overlap.");
+        }
+        ranges.push_back({start, count});
+        std::ranges::sort(ranges, {}, &SampleRange::start);
+    }
+};
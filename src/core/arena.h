@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Monotonic bump allocator. Memory is handed out from large blocks in allocation order and
+// is only released all at once, when the arena is reset or destroyed.
+// Objects made with Create are destroyed in reverse order of creation at that point.
+// Not thread safe; scenes and BVHs are built on one thread.
+class Arena
+{
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+    explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE) : blockSize(blockSize) {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        Reset();
+    }
+
+    void *Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        size_t padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+        if (cursor == nullptr || padding + bytes > static_cast<size_t>(end - cursor))
+        {
+            // requests larger than a block get a block of their own
+            AddBlock(std::max(blockSize, bytes + alignment));
+            padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+        }
+
+        std::byte *result = cursor + padding;
+        cursor = result + bytes;
+        used += bytes;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T *Create(Args &&...args)
+    {
+        T *object = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            destructors.push_back({[](void *p)
+                                   { static_cast<T *>(p)->~T(); },
+                                   object});
+        return object;
+    }
+
+    // Destroys everything made with Create and releases all blocks.
+    void Reset()
+    {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+            it->destroy(it->object);
+        destructors.clear();
+        blocks.clear();
+        cursor = end = nullptr;
+        used = reserved = 0;
+    }
+
+    // Bytes handed out, without alignment padding.
+    size_t BytesUsed() const { return used; }
+    size_t BytesReserved() const { return reserved; }
+    size_t BlockCount() const { return blocks.size(); }
+
+private:
+    struct Destructor
+    {
+        void (*destroy)(void *);
+        void *object;
+    };
+
+    void AddBlock(size_t size)
+    {
+        blocks.push_back(std::make_unique<std::byte[]>(size));
+        cursor = blocks.back().get();
+        end = cursor + size;
+        reserved += size;
+    }
+
+    size_t blockSize;
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::byte *cursor = nullptr;
+    std::byte *end = nullptr;
+    size_t used = 0;
+    size_t reserved = 0;
+    std::vector<Destructor> destructors;
+};
+
+// Standard allocator on top of an Arena, e.g. for std::allocate_shared, which then puts the
+// control block and the object next to each other in the arena. deallocate is a no-op, so
+// the arena has to outlive everything allocated through it.
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    Arena *arena;
+
+    explicit ArenaAllocator(Arena &arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+};
+
+// std::make_shared, or std::allocate_shared from the arena when one is given.
+template <typename T, typename... Args>
+std::shared_ptr<T> MakeShared(Arena *arena, Args &&...args)
+{
+    if (arena)
+        return std::allocate_shared<T>(ArenaAllocator<T>(*arena), std::forward<Args>(args)...);
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
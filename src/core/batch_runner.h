@@ -0,0 +1,349 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef PPL
+#include <tbb/task_arena.h>
+#endif
+
+#include "core/camera.h"
+#include "core/random.h"
+#include "core/renderer.h"
+#include "core/trace.h"
+#include "io/image_writer.h"
+#include "io/json_reader.h"
+#include "io/json_writer.h"
+#include "scenes/scene_registry.h"
+
+struct BatchJob
+{
+    std::string id;
+    std::string scene;
+    int width = 320;
+    // 0 follows from the width and the scene camera's aspect ratio
+    int height = 0;
+    int samplesPerPixel = 16;
+    int maxDepth = 50;
+    uint64_t seed = 1;
+    std::string output;
+    // relative claim on the threads while the job runs alongside others
+    double share = 1.0;
+};
+
+// One job from a JSON line:
+//   {"id": "a", "scene": "cornell_box", "width": 256, "spp": 32, "output": "a.png", "share": 2}
+inline BatchJob ParseBatchJob(const std::string &line)
+{
+    std::istringstream stream(line);
+    JsonReader json(stream);
+    BatchJob job;
+    json.BeginObject();
+    std::string key;
+    while (json.NextKey(key))
+    {
+        if (key == "id")
+            job.id = json.ReadString();
+        else if (key == "scene")
+            job.scene = json.ReadString();
+        else if (key == "width")
+            job.width = static_cast<int>(json.ReadInt());
+        else if (key == "height")
+            job.height = static_cast<int>(json.ReadInt());
+        else if (key == "spp")
+            job.samplesPerPixel = static_cast<int>(json.ReadInt());
+        else if (key == "depth")
+            job.maxDepth = static_cast<int>(json.ReadInt());
+        else if (key == "seed")
+            job.seed = static_cast<uint64_t>(json.ReadInt());
+        else if (key == "output")
+            job.output = json.ReadString();
+        else if (key == "share")
+            job.share = json.ReadNumber();
+        else
+            json.Fail("unknown member '" + key + "'");
+    }
+    json.ExpectEnd();
+
+    if (job.scene.empty() || job.output.empty())
+        throw std::invalid_argument("A batch job needs a scene and an output file.");
+    if (job.width <= 0 || job.height < 0 || job.samplesPerPixel <= 0 || job.maxDepth <= 0 || !(job.share > 0.0))
+        throw std::invalid_argument("Image size, samples, depth and share of a batch job must be positive.");
+    return job;
+}
+
+struct BatchJobResult
+{
+    std::string id;
+    int width = 0, height = 0, samplesPerPixel = 0;
+    // from the start of the batch until the job's file was complete
+    double latencySeconds = 0.0;
+    double waitSeconds = 0.0;
+    double buildSeconds = 0.0;
+    double renderSeconds = 0.0;
+    // fewest and most threads the job had while it rendered
+    int minThreads = 0, maxThreads = 0;
+    // empty when the job succeeded
+    std::string error;
+};
+
+struct BatchReport
+{
+    std::vector<BatchJobResult> jobs;
+    double seconds = 0.0;
+    unsigned int threads = 0;
+
+    size_t Succeeded() const
+    {
+        return static_cast<size_t>(std::count_if(jobs.begin(), jobs.end(), [](const BatchJobResult &job)
+                                                 { return job.error.empty(); }));
+    }
+
+    void Print() const
+    {
+        fmt::println("{:<16} {:>9} {:>5} {:>9} {:>9} {:>9} {:>9} {:>7}", "job", "size", "spp", "latency", "wait", "build", "render", "threads");
+        uint64_t samples = 0;
+        for (const auto &job : jobs)
+        {
+            if (!job.error.empty())
+            {
+                fmt::println("{:<16} failed: {}", job.id, job.error);
+                continue;
+            }
+            samples += uint64_t(job.width) * job.height * job.samplesPerPixel;
+            fmt::println("{:<16} {:>4}x{:<4} {:>5} {:>8.3f}s {:>8.3f}s {:>8.3f}s {:>8.3f}s {:>3}-{:<3}",
+                         job.id, job.width, job.height, job.samplesPerPixel, job.latencySeconds, job.waitSeconds,
+                         job.buildSeconds, job.renderSeconds, job.minThreads, job.maxThreads);
+        }
+        fmt::println("{} of {} jobs in {:.3f}s on {} threads: {:.2f} jobs/s, {:.2f} Msamples/s",
+                     Succeeded(), jobs.size(), seconds, threads, Succeeded() / seconds, samples / seconds * 1e-6);
+    }
+
+    void WriteJson(JsonWriter &json) const
+    {
+        json.BeginObject();
+        json.Field("seconds", seconds);
+        json.Field("threads", threads);
+        json.Field("jobs_per_sec", Succeeded() / seconds);
+        json.Key("jobs").BeginArray();
+        for (const auto &job : jobs)
+        {
+            json.BeginObject();
+            json.Field("id", job.id);
+            if (!job.error.empty())
+            {
+                json.Field("error", job.error);
+                json.EndObject();
+                continue;
+            }
+            json.Field("width", job.width).Field("height", job.height).Field("samples_per_pixel", job.samplesPerPixel);
+            json.Field("latency_seconds", job.latencySeconds).Field("wait_seconds", job.waitSeconds);
+            json.Field("build_seconds", job.buildSeconds).Field("render_seconds", job.renderSeconds);
+            json.Field("min_threads", job.minThreads).Field("max_threads", job.maxThreads);
+            json.EndObject();
+        }
+        json.EndArray();
+        json.EndObject();
+    }
+};
+
+struct BatchOptions
+{
+    // threads shared by all jobs; 0 uses every hardware thread
+    unsigned int threads = 0;
+    // jobs in flight at once; 0 allows one per thread
+    size_t maxConcurrentJobs = 0;
+    // rows rendered between checks for a new thread share; 0 takes four per thread of the job
+    int bandRows = 0;
+    bool quiet = false;
+};
+
+// Renders many jobs at once, each in its own task arena, so that one job's serial phases
+// (building the scene, encoding rows, the tail of a parallel loop) leave the cores to the
+// others rather than idle. The threads are split over the running jobs by their shares.
+// Whenever a job starts or ends the split is recomputed, and every job moves to an arena of
+// its new size at its next band of rows, so the last jobs of a batch get the whole machine.
+//
+// Scenes are built once per name, one at a time, on a random stream of their own (see
+// ScopedRandomSeed), so they come out the same whatever renders meanwhile, and stay loaded
+// for later jobs. Statistics (RT_STATS) are not kept per job: the counters are per thread,
+// and threads move between jobs.
+class BatchRunner
+{
+public:
+    explicit BatchRunner(const BatchOptions &options) : options(options)
+    {
+        const unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+        threads = options.threads == 0 ? hardware : std::min(options.threads, hardware);
+    }
+
+    BatchReport Run(const std::vector<BatchJob> &jobs)
+    {
+        TRACE_SCOPE("Batch", "batch");
+        BatchReport report;
+        report.threads = threads;
+        report.jobs.resize(jobs.size());
+        start = std::chrono::steady_clock::now();
+
+        const size_t slots = std::min(jobs.size(), options.maxConcurrentJobs > 0 ? options.maxConcurrentJobs : size_t(threads));
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> runners;
+        for (size_t slot = 0; slot < slots; slot++)
+        {
+            runners.emplace_back([&]
+                                 {
+                for (size_t index = next++; index < jobs.size(); index = next++)
+                    report.jobs[index] = RunJob(jobs[index]); });
+        }
+        for (auto &runner : runners)
+            runner.join();
+
+        report.seconds = Since(start);
+        return report;
+    }
+
+private:
+    BatchOptions options;
+    unsigned int threads = 1;
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex scenesMutex;
+    std::map<std::string, Scene> scenes;
+
+    // shares of the running jobs; every change bumps generation
+    std::mutex sharesMutex;
+    std::map<const BatchJob *, double> running;
+    std::atomic<uint64_t> generation{0};
+
+    static double Since(std::chrono::steady_clock::time_point from)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - from).count();
+    }
+
+    const Scene &LoadScene(const std::string &name)
+    {
+        std::lock_guard lock(scenesMutex);
+        auto found = scenes.find(name);
+        if (found != scenes.end())
+            return found->second;
+        const auto &entry = FindScene(name);
+        ScopedRandomSeed seed(1);
+        return scenes.emplace(name, entry.create()).first->second;
+    }
+
+    void Join(const BatchJob &job)
+    {
+        std::lock_guard lock(sharesMutex);
+        running[&job] = job.share;
+        generation++;
+    }
+
+    void Leave(const BatchJob &job)
+    {
+        std::lock_guard lock(sharesMutex);
+        running.erase(&job);
+        generation++;
+    }
+
+    // The job's threads under the current split: its share of all threads, at least one.
+    int ThreadsFor(const BatchJob &job)
+    {
+        std::lock_guard lock(sharesMutex);
+        double total = 0.0;
+        for (const auto &[other, share] : running)
+            total += share;
+        const double share = running.count(&job) ? running[&job] : job.share;
+        return std::max(1, static_cast<int>(threads * share / std::max(total, share)));
+    }
+
+    BatchJobResult RunJob(const BatchJob &job)
+    {
+        TRACE_SCOPE("BatchJob", "batch");
+        BatchJobResult result;
+        result.id = job.id;
+        result.samplesPerPixel = job.samplesPerPixel;
+        result.waitSeconds = Since(start);
+        Join(job);
+        try
+        {
+            auto phase = std::chrono::steady_clock::now();
+            const Scene &scene = LoadScene(job.scene);
+            result.buildSeconds = Since(phase);
+
+            const Camera &base = *scene.camera;
+            const int width = job.width;
+            const int height = job.height > 0 ? job.height : std::max(1, static_cast<int>(width / base.AspectRatio()));
+            const Camera camera(base.Origin(), base.Target(), base.Fov(), static_cast<double>(width) / height,
+                                base.FocusDistance(), base.Aperture(), base.ExposureStart(), base.ExposureEnd(), base.Up());
+            result.width = width;
+            result.height = height;
+
+            const Renderer renderer{
+                .maxDepth = job.maxDepth,
+                .samplesPerPixel = job.samplesPerPixel,
+                .seed = job.seed,
+                .environmentMap = scene.environmentMap,
+                .quiet = true};
+
+            phase = std::chrono::steady_clock::now();
+            auto writer = CreateImageWriter(job.output, width, height);
+            result.minThreads = threads;
+
+#ifndef PPL
+            std::unique_ptr<tbb::task_arena> arena;
+            uint64_t arenaGeneration = ~uint64_t(0);
+            int arenaThreads = 0;
+#endif
+            for (int y0 = 0, y1 = 0; y0 < height; y0 = y1)
+            {
+                std::vector<Color> band;
+#ifndef PPL
+                if (arenaGeneration != generation.load())
+                {
+                    arenaGeneration = generation.load();
+                    const int share = ThreadsFor(job);
+                    if (share != arenaThreads)
+                    {
+                        arena = std::make_unique<tbb::task_arena>(share);
+                        arenaThreads = share;
+                    }
+                }
+                result.minThreads = std::min(result.minThreads, arenaThreads);
+                result.maxThreads = std::max(result.maxThreads, arenaThreads);
+                y1 = std::min(height, y0 + (options.bandRows > 0 ? options.bandRows : 4 * arenaThreads));
+                arena->execute([&]
+                               { band = renderer.RenderTile(camera, *scene.objects, width, height, 0, y0, width, y1); });
+#else
+                // PPL has no arenas to split; the jobs share its one scheduler
+                result.minThreads = result.maxThreads = static_cast<int>(threads);
+                y1 = std::min(height, y0 + (options.bandRows > 0 ? options.bandRows : 4 * static_cast<int>(threads)));
+                band = renderer.RenderTile(camera, *scene.objects, width, height, 0, y0, width, y1);
+#endif
+                // encoded on this thread, while the other jobs keep the cores busy
+                for (int y = y0; y < y1; y++)
+                    writer->WriteRow(y, band.data() + size_t(y - y0) * width);
+            }
+            writer->Finish();
+            result.renderSeconds = Since(phase);
+        }
+        catch (const std::exception &e)
+        {
+            result.error = e.what();
+        }
+        Leave(job);
+        result.latencySeconds = Since(start);
+        if (!options.quiet)
+            fmt::println("{} {} after {:.3f}s", job.id, result.error.empty() ? "done" : "failed", result.latencySeconds);
+        return result;
+    }
+};
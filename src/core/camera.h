@@ -13,6 +13,13 @@ class Camera
 public:
     double AspectRatio() const { return aspectRatio; }
     double Fov() const { return fovInDegree; }
+    const Vector3 &Origin() const { return origin; }
+    const Vector3 &Target() const { return target; }
+    const Vector3 &Up() const { return cameraUp; }
+    double FocusDistance() const { return focusDistance; }
+    double Aperture() const { return aperture; }
+    double ExposureStart() const { return exposureStart; }
+    double ExposureEnd() const { return exposureEnd; }
 
 private:
     Vector3 origin;
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#ifndef PPL
+#include <tbb/task_group.h>
+#endif
+
+// Stopping a render early without losing what it has done so far.
+
+// Set from any thread, including a signal handler, to ask a render to stop.
+class CancellationToken
+{
+public:
+    void Cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    void Reset() { cancelled.store(false, std::memory_order_relaxed); }
+    bool IsCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+enum class RenderStatus
+{
+    Complete,
+    Cancelled,
+    DeadlineExceeded,
+};
+
+// When one render has to stop: on cancellation or once the deadline has passed. Render
+// threads ask ShouldStop between batches of samples; the first to see the condition cancels
+// the attached task group contexts, so tasks that have not started yet never run.
+class StopCondition
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    StopCondition(const CancellationToken *token, Clock::time_point deadline) : token(token), deadline(deadline) {}
+
+    // No token and no deadline: nothing can stop the render, and nobody needs to ask.
+    bool Active() const { return token || deadline != Clock::time_point::max(); }
+
+#ifndef PPL
+    void Attach(tbb::task_group_context &context)
+    {
+        std::lock_guard lock(mutex);
+        contexts.push_back(&context);
+        if (Stopped())
+            context.cancel_group_execution();
+    }
+#endif
+
+    // Costs an atomic load and, until the render stops, a clock read.
+    bool ShouldStop()
+    {
+        if (Stopped())
+            return true;
+        if (token && token->IsCancelled())
+            Stop(RenderStatus::Cancelled);
+        else if (deadline != Clock::time_point::max() && Clock::now() >= deadline)
+            Stop(RenderStatus::DeadlineExceeded);
+        return Stopped();
+    }
+
+    bool Stopped() const { return status.load(std::memory_order_relaxed) != RenderStatus::Complete; }
+
+    RenderStatus Status() const { return status.load(); }
+
+private:
+    const CancellationToken *token;
+    Clock::time_point deadline;
+    std::atomic<RenderStatus> status{RenderStatus::Complete};
+    std::mutex mutex;
+#ifndef PPL
+    std::vector<tbb::task_group_context *> contexts;
+#endif
+
+    void Stop(RenderStatus reason)
+    {
+        RenderStatus expected = RenderStatus::Complete;
+        if (!status.compare_exchange_strong(expected, reason))
+            return;
+#ifndef PPL
+        std::lock_guard lock(mutex);
+        for (auto *context : contexts)
+            context->cancel_group_execution();
+#endif
+    }
+};
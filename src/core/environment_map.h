@@ -24,6 +24,9 @@ public:
         return (1.0f - t) * bottomColor + t * topColor;
     }
 
+    const Vector3 &BottomColor() const { return bottomColor; }
+    const Vector3 &TopColor() const { return topColor; }
+
     static std::shared_ptr<GradientMap> Sky()
     {
         static const auto sky = std::make_shared<GradientMap>(Color(1.0, 1.0, 1.0), Color(0.5, 0.7, 1.0));
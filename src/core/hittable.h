@@ -22,6 +22,9 @@ public:
     double t;
     // True if the ray is hitting the front face of the object.
     bool front_face;
+    // Surface coordinates of the hit point, if the shape provides them.
+    double u = 0.0;
+    double v = 0.0;
 
     std::shared_ptr<Material> material;
 
@@ -39,4 +42,9 @@ public:
     virtual ~Hittable() = default;
     virtual bool Hit(const Ray &ray, HitResult &hitResult, double t_min, double t_max) const = 0;
     virtual AABB BoundingBox() const = 0;
+
+    // Bounding box at a given shutter time. Static shapes are the same at all times.
+    // Moving shapes must return boxes that are conservative under linear interpolation
+    // between time 0 and time 1.
+    virtual AABB BoundingBoxAt(double time) const { return BoundingBox(); }
 };
@@ -39,6 +39,8 @@ public:
         return emission;
     }
 
+    const Color &Emission() const { return emission; }
+
 private:
     Color emission;
 };
@@ -56,11 +58,13 @@ public:
         if (scatter_direction.NearZero())
             scatter_direction = hit.normal;
 
-        ray_out = Ray(hit.point, scatter_direction);
+        ray_out = Ray(hit.point, scatter_direction, ray_in.time);
         attenuation = albedo;
         return true;
     }
 
+    const Color &Albedo() const { return albedo; }
+
 private:
     Color albedo;
 };
@@ -74,11 +78,14 @@ public:
     {
         auto reflected = Reflect(ray_in.direction, hit.normal);
         reflected = UnitVector(reflected) + (fuzziness * RandomUnitVector());
-        ray_out = Ray(hit.point, reflected);
+        ray_out = Ray(hit.point, reflected, ray_in.time);
         attenuation = albedo;
         return (Dot(reflected, hit.normal) > 0);
     }
 
+    const Color &Albedo() const { return albedo; }
+    double Fuzziness() const { return fuzziness; }
+
 private:
     Color albedo;
     double fuzziness;
@@ -112,10 +119,12 @@ public:
         else
             direction = Refract(unit_direction, hit.normal, ri);
 
-        ray_out = Ray(hit.point, direction);
+        ray_out = Ray(hit.point, direction, ray_in.time);
         return true;
     }
 
+    double RefractionIndex() const { return refraction_index; }
+
 private:
     // Refractive index in vacuum or air, or the ratio of the material's refractive index over
     // the refractive index of the enclosing media
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifndef PPL
+#include <tbb/info.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+#endif
+
+// NUMA nodes and the CPUs that belong to them, and pinning threads to CPUs.
+namespace Numa
+{
+    struct Node
+    {
+        // as TBB numbers it for task_arena constraints; -1 when the topology is unknown
+        int id;
+        std::vector<int> cpus;
+    };
+
+    namespace Detail
+    {
+        inline std::vector<int> AllCpus()
+        {
+            std::vector<int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+            for (size_t i = 0; i < cpus.size(); i++)
+                cpus[i] = static_cast<int>(i);
+            return cpus;
+        }
+
+        // Parses a Linux CPU list such as "0-7,16-23".
+        inline std::vector<int> ParseCpuList(const std::string &list)
+        {
+            std::vector<int> cpus;
+            std::stringstream stream(list);
+            std::string range;
+            while (std::getline(stream, range, ','))
+            {
+                if (range.empty() || range == "\n")
+                    continue;
+                const size_t dash = range.find('-');
+                const int first = std::stoi(range.substr(0, dash));
+                const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; cpu++)
+                    cpus.push_back(cpu);
+            }
+            return cpus;
+        }
+
+        inline std::vector<int> NodeCpus(int node)
+        {
+            std::vector<int> cpus;
+            if (node >= 0)
+            {
+#if defined(__linux__)
+                std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                std::string list;
+                if (file && std::getline(file, list))
+                    cpus = ParseCpuList(list);
+#elif defined(_WIN32)
+                ULONGLONG mask = 0;
+                if (GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+                {
+                    for (int cpu = 0; cpu < 64; cpu++)
+                    {
+                        if (mask & (1ull << cpu))
+                            cpus.push_back(cpu);
+                    }
+                }
+#endif
+            }
+            return cpus.empty() ? AllCpus() : cpus;
+        }
+
+#if defined(__linux__)
+        using Affinity = cpu_set_t;
+#elif defined(_WIN32)
+        using Affinity = DWORD_PTR;
+#else
+        using Affinity = int;
+#endif
+
+        // the affinity a thread had before it was first pinned
+        struct SavedAffinity
+        {
+            bool saved = false;
+            Affinity affinity{};
+        };
+
+        inline SavedAffinity &LocalAffinity()
+        {
+            static thread_local SavedAffinity saved;
+            return saved;
+        }
+
+        // index into Nodes() of the node arena the thread works in, set by NodeObserver
+        inline thread_local int currentNode = -1;
+    }
+
+    // The machine's NUMA nodes; a single node with every CPU where TBB cannot tell (it needs
+    // its tbbbind library for that) or the machine has only one.
+    inline const std::vector<Node> &Nodes()
+    {
+        static const std::vector<Node> nodes = []
+        {
+            std::vector<Node> result;
+#ifndef PPL
+            for (int id : tbb::info::numa_nodes())
+                result.push_back(Node{id, Detail::NodeCpus(id)});
+#endif
+            if (result.empty())
+                result.push_back(Node{-1, Detail::AllCpus()});
+            return result;
+        }();
+        return nodes;
+    }
+
+    // Restricts the calling thread to one CPU, remembering what it was allowed before.
+    inline void PinCurrentThread(int cpu)
+    {
+        auto &saved = Detail::LocalAffinity();
+#if defined(__linux__)
+        if (!saved.saved)
+            saved.saved = pthread_getaffinity_np(pthread_self(), sizeof(saved.affinity), &saved.affinity) == 0;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+        const DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+        if (!saved.saved && previous != 0)
+        {
+            saved.affinity = previous;
+            saved.saved = true;
+        }
+#else
+        (void)cpu;
+        (void)saved;
+#endif
+    }
+
+    // Gives the calling thread back the CPUs it had before PinCurrentThread.
+    inline void UnpinCurrentThread()
+    {
+        auto &saved = Detail::LocalAffinity();
+        if (!saved.saved)
+            return;
+#if defined(__linux__)
+        pthread_setaffinity_np(pthread_self(), sizeof(saved.affinity), &saved.affinity);
+#elif defined(_WIN32)
+        SetThreadAffinityMask(GetCurrentThread(), saved.affinity);
+#endif
+        saved.saved = false;
+    }
+
+    // Restricts the calling thread to the CPUs of a node. Memory it touches first is then
+    // allocated on that node.
+    inline void PinCurrentThreadToNode(const Node &node)
+    {
+        auto &saved = Detail::LocalAffinity();
+#if defined(__linux__)
+        if (!saved.saved)
+            saved.saved = pthread_getaffinity_np(pthread_self(), sizeof(saved.affinity), &saved.affinity) == 0;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : node.cpus)
+            CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+        DWORD_PTR mask = 0;
+        for (int cpu : node.cpus)
+            mask |= cpu < 64 ? DWORD_PTR(1) << cpu : 0;
+        const DWORD_PTR previous = SetThreadAffinityMask(GetCurrentThread(), mask);
+        if (!saved.saved && previous != 0)
+        {
+            saved.affinity = previous;
+            saved.saved = true;
+        }
+#else
+        (void)node;
+        (void)saved;
+#endif
+    }
+
+    // Index into Nodes() of the node the calling thread runs on: the node of its arena in
+    // NumaMode::SplitImage renders, otherwise the node of the CPU it is on right now.
+    inline size_t CurrentNodeIndex()
+    {
+        if (Detail::currentNode >= 0)
+            return static_cast<size_t>(Detail::currentNode);
+#if defined(__linux__)
+        static const std::vector<int> cpuNodes = []
+        {
+            std::vector<int> result;
+            const auto &nodes = Nodes();
+            for (size_t i = 0; i < nodes.size(); i++)
+            {
+                for (int cpu : nodes[i].cpus)
+                {
+                    if (cpu >= int(result.size()))
+                        result.resize(cpu + 1, 0);
+                    result[cpu] = static_cast<int>(i);
+                }
+            }
+            return result;
+        }();
+        const int cpu = sched_getcpu();
+        if (cpu >= 0 && cpu < int(cpuNodes.size()))
+            return static_cast<size_t>(cpuNodes[cpu]);
+#endif
+        return 0;
+    }
+
+#ifndef PPL
+    // Tells CurrentNodeIndex which node the threads that join arena belong to.
+    class NodeObserver : public tbb::task_scheduler_observer
+    {
+    public:
+        NodeObserver(tbb::task_arena &arena, int nodeIndex)
+            : tbb::task_scheduler_observer(arena), nodeIndex(nodeIndex)
+        {
+            observe(true);
+        }
+
+        ~NodeObserver()
+        {
+            observe(false);
+        }
+
+        void on_scheduler_entry(bool) override
+        {
+            Detail::currentNode = nodeIndex;
+        }
+
+        void on_scheduler_exit(bool) override
+        {
+            Detail::currentNode = -1;
+        }
+
+    private:
+        int nodeIndex;
+    };
+
+    // Pins every thread that joins arena to one of cpus, by its slot in the arena, for as long
+    // as it works there. Threads leave the arena unpinned again.
+    class ThreadPinner : public tbb::task_scheduler_observer
+    {
+    public:
+        ThreadPinner(tbb::task_arena &arena, std::vector<int> cpus)
+            : tbb::task_scheduler_observer(arena), cpus(std::move(cpus))
+        {
+            observe(true);
+        }
+
+        ~ThreadPinner()
+        {
+            observe(false);
+        }
+
+        void on_scheduler_entry(bool) override
+        {
+            const int slot = tbb::this_task_arena::current_thread_index();
+            if (slot >= 0 && !cpus.empty())
+                PinCurrentThread(cpus[slot % cpus.size()]);
+        }
+
+        void on_scheduler_exit(bool) override
+        {
+            UnpinCurrentThread();
+        }
+
+    private:
+        std::vector<int> cpus;
+    };
+#endif
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Page-level control over where read-only acceleration data lives: huge pages, which cut the
+// TLB misses of traversals over large meshes, and one copy per NUMA node (see Numa), so no
+// thread has to read its BVH from the other socket.
+
+enum class PagePolicy
+{
+    // ordinary 4 KB pages
+    Default,
+    // 2 MB aligned and marked for transparent huge pages (Linux); the kernel may still decline
+    TransparentHuge,
+    // reserved huge pages (Linux hugetlbfs pool, Windows large pages); falls back to transparent
+    // huge pages, then ordinary ones, when none are available
+    ExplicitHuge,
+};
+
+// "default", "thp" or "explicit", as the command line options take them.
+inline PagePolicy ParsePagePolicy(const std::string &name)
+{
+    if (name == "default")
+        return PagePolicy::Default;
+    if (name == "thp")
+        return PagePolicy::TransparentHuge;
+    if (name == "explicit")
+        return PagePolicy::ExplicitHuge;
+    throw std::invalid_argument("Unknown page policy: " + name + " (expected default, thp or explicit)");
+}
+
+inline const char *PagePolicyName(PagePolicy policy)
+{
+    switch (policy)
+    {
+    case PagePolicy::TransparentHuge:
+        return "thp";
+    case PagePolicy::ExplicitHuge:
+        return "explicit";
+    default:
+        return "default";
+    }
+}
+
+struct MemoryPlacement
+{
+    PagePolicy pages = PagePolicy::Default;
+    // a copy per NUMA node, each first touched, and so backed, by that node's memory
+    bool replicatePerNode = false;
+
+    bool Enabled() const { return pages != PagePolicy::Default || replicatePerNode; }
+};
+
+// Where acceleration structures built from now on put their data. Set it before the scene is built.
+inline MemoryPlacement &AccelerationMemoryPlacement()
+{
+    static MemoryPlacement placement;
+    return placement;
+}
+
+// Memory in whole pages, straight from the OS. Pages are only backed when first written,
+// by the node of the writing thread. Live buffers are tracked for CollectPageMemory.
+class PageBuffer
+{
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+    PageBuffer(size_t size, PagePolicy policy) : size(std::max<size_t>(size, 1)), policy(policy)
+    {
+#if defined(__linux__)
+        if (policy == PagePolicy::ExplicitHuge)
+        {
+            reserved = RoundUp(this->size, HUGE_PAGE_SIZE);
+            void *address = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (address != MAP_FAILED)
+                data = static_cast<std::byte *>(address);
+            else
+                this->policy = PagePolicy::TransparentHuge;
+        }
+        if (!data && this->policy == PagePolicy::TransparentHuge)
+        {
+            // over-allocate so the buffer can start on a huge page boundary
+            reserved = RoundUp(this->size, HUGE_PAGE_SIZE);
+            mapping = reserved + HUGE_PAGE_SIZE;
+            void *address = mmap(nullptr, mapping, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED)
+                throw std::bad_alloc();
+            mappingStart = static_cast<std::byte *>(address);
+            data = reinterpret_cast<std::byte *>(RoundUp(reinterpret_cast<uintptr_t>(address), HUGE_PAGE_SIZE));
+            madvise(data, reserved, MADV_HUGEPAGE);
+        }
+        if (!data)
+        {
+            reserved = RoundUp(this->size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+            void *address = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED)
+                throw std::bad_alloc();
+            data = static_cast<std::byte *>(address);
+        }
+#elif defined(_WIN32)
+        if (policy != PagePolicy::Default)
+        {
+            // needs the "Lock pages in memory" privilege; without it the call fails
+            const size_t largePage = GetLargePageMinimum();
+            if (largePage > 0)
+            {
+                reserved = RoundUp(this->size, largePage);
+                data = static_cast<std::byte *>(VirtualAlloc(nullptr, reserved, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+            }
+        }
+        if (data)
+            this->policy = PagePolicy::ExplicitHuge;
+        else
+        {
+            this->policy = PagePolicy::Default;
+            reserved = RoundUp(this->size, 4096);
+            data = static_cast<std::byte *>(VirtualAlloc(nullptr, reserved, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+            if (!data)
+                throw std::bad_alloc();
+        }
+#else
+        this->policy = PagePolicy::Default;
+        reserved = RoundUp(this->size, 4096);
+        data = static_cast<std::byte *>(::operator new(reserved, std::align_val_t(4096)));
+#endif
+        std::lock_guard lock(RegistryMutex());
+        Registry().push_back(this);
+    }
+
+    PageBuffer(const PageBuffer &) = delete;
+    PageBuffer &operator=(const PageBuffer &) = delete;
+
+    ~PageBuffer()
+    {
+        {
+            std::lock_guard lock(RegistryMutex());
+            std::erase(Registry(), this);
+        }
+#if defined(__linux__)
+        if (mappingStart)
+            munmap(mappingStart, mapping);
+        else
+            munmap(data, reserved);
+#elif defined(_WIN32)
+        VirtualFree(data, 0, MEM_RELEASE);
+#else
+        ::operator delete(data, std::align_val_t(4096));
+#endif
+    }
+
+    std::byte *Data() const { return data; }
+    size_t Size() const { return size; }
+    size_t Reserved() const { return reserved; }
+    // what the buffer actually got, which can be less than was asked for
+    PagePolicy Policy() const { return policy; }
+
+    // Bytes backed by physical memory right now.
+    size_t ResidentBytes() const
+    {
+#if defined(__linux__)
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        std::vector<unsigned char> pages((reserved + pageSize - 1) / pageSize);
+        if (mincore(data, reserved, pages.data()) != 0)
+            return reserved;
+        size_t resident = 0;
+        for (unsigned char page : pages)
+            resident += (page & 1) ? pageSize : 0;
+        return resident;
+#else
+        return reserved;
+#endif
+    }
+
+    // Bytes backed by huge pages, as far as the OS tells.
+    size_t HugePageBytes() const
+    {
+        if (policy == PagePolicy::ExplicitHuge)
+            return reserved;
+#if defined(__linux__)
+        if (policy == PagePolicy::TransparentHuge)
+            return SmapsField("AnonHugePages:");
+#endif
+        return 0;
+    }
+
+    struct Report
+    {
+        size_t buffers = 0;
+        size_t bytes = 0;
+        size_t reserved = 0;
+        size_t resident = 0;
+        size_t hugePages = 0;
+    };
+
+    // Totals over all live buffers.
+    static Report Collect()
+    {
+        Report report;
+        std::lock_guard lock(RegistryMutex());
+        for (const PageBuffer *buffer : Registry())
+        {
+            report.buffers++;
+            report.bytes += buffer->size;
+            report.reserved += buffer->reserved;
+            report.resident += buffer->ResidentBytes();
+            report.hugePages += buffer->HugePageBytes();
+        }
+        return report;
+    }
+
+private:
+    size_t size;
+    PagePolicy policy;
+    std::byte *data = nullptr;
+    size_t reserved = 0;
+    // the whole mapping, when data starts inside it
+    std::byte *mappingStart = nullptr;
+    size_t mapping = 0;
+
+    static size_t RoundUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static std::mutex &RegistryMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::vector<const PageBuffer *> &Registry()
+    {
+        static std::vector<const PageBuffer *> buffers;
+        return buffers;
+    }
+
+#if defined(__linux__)
+    // A "Name:   123 kB" field of the mapping that holds the buffer, from /proc/self/smaps.
+    size_t SmapsField(const std::string &name) const
+    {
+        std::ifstream smaps("/proc/self/smaps");
+        const uintptr_t address = reinterpret_cast<uintptr_t>(data);
+        std::string line;
+        bool inside = false;
+        while (std::getline(smaps, line))
+        {
+            const size_t dash = line.find('-');
+            const size_t space = line.find(' ');
+            if (dash != std::string::npos && space != std::string::npos && dash < space && line.find(':') > space)
+            {
+                const uintptr_t start = std::stoull(line.substr(0, dash), nullptr, 16);
+                const uintptr_t end = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+                inside = start <= address && address < end;
+            }
+            else if (inside && line.starts_with(name))
+            {
+                std::istringstream value(line.substr(name.size()));
+                size_t kilobytes = 0;
+                value >> kilobytes;
+                return kilobytes * 1024;
+            }
+        }
+        return 0;
+    }
+#endif
+};
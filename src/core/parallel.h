@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+#ifdef PPL
+#include <ppl.h>
+#else
+#include <tbb/parallel_for.h>
+#endif
+
+// Runs body(i) for i in [0, count) on the same scheduler the renderer uses.
+template <typename Body>
+void ParallelFor(size_t count, const Body &body)
+{
+#ifdef PPL
+    Concurrency::parallel_for(size_t(0), count, body);
+#else
+    tbb::parallel_for(size_t(0), count, body);
+#endif
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Time stamp counter where the CPU has one, nanoseconds otherwise. Only differences on the
+// same thread are meaningful.
+inline uint64_t ReadCycleCounter()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+#endif
+}
+
+// What each pixel of a render cost, filled by the renderer when Renderer::costMap is set.
+// Node visits and primitive tests come from the statistics counters and stay zero unless
+// built with RT_STATS.
+struct PixelCostMap
+{
+    int width, height;
+    std::vector<uint64_t> cycles;
+    std::vector<uint64_t> nodeVisits;
+    std::vector<uint64_t> primitiveTests;
+
+    PixelCostMap(int width, int height)
+        : width(width), height(height),
+          cycles(size_t(width) * height), nodeVisits(size_t(width) * height), primitiveTests(size_t(width) * height)
+    {
+    }
+
+    size_t Index(int x, int y) const
+    {
+        return size_t(y) * width + x;
+    }
+};
@@ -1,15 +1,146 @@
 #pragma once
 
-#include <random>
+#include <atomic>
+#include <cstdint>
 
-double RandomDouble()
+namespace RandomDetail
 {
-    static thread_local std::mt19937 rng(std::random_device{}());
-    static thread_local std::uniform_real_distribution<double> dist(0.0, 1.0);
-    return dist(rng);
+    // 0 until SetRandomSeed is called; bumped on every call so the thread local generators reseed
+    inline std::atomic<uint32_t> generation{0};
+    inline std::atomic<uint64_t> seed{0};
+    inline std::atomic<uint32_t> nextStream{0};
+    // for runs that never set a seed
+    inline std::atomic<uint64_t> unseededStreams{0x853c49e6748fea9bull};
+
+    inline uint64_t SplitMix64(uint64_t &state)
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // xoshiro256** (Blackman and Vigna). Seeding takes four SplitMix64 steps, cheap enough to
+    // reseed for every sample, which the 2.5 KB state of mt19937 was not.
+    struct Generator
+    {
+        uint64_t s[4];
+
+        void Seed(uint64_t value)
+        {
+            for (uint64_t &word : s)
+                word = SplitMix64(value);
+        }
+
+        uint64_t Next()
+        {
+            const uint64_t result = Rotate(s[1] * 5, 7) * 9;
+            const uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = Rotate(s[3], 45);
+            return result;
+        }
+
+        static uint64_t Rotate(uint64_t x, int k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+    };
+
+    struct ThreadState
+    {
+        Generator rng;
+        uint32_t generation = 0;
+        // inside a ScopedRandomSeed: the generation is ignored
+        bool scoped = false;
+
+        ThreadState()
+        {
+            rng.Seed(unseededStreams.fetch_add(0x9e3779b97f4a7c15ull));
+        }
+    };
+
+    inline ThreadState &Local()
+    {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    inline uint64_t Mix(uint64_t a, uint64_t b)
+    {
+        uint64_t state = a ^ (b * 0xd6e8feb86659fd93ull);
+        SplitMix64(state);
+        return SplitMix64(state);
+    }
+}
+
+// Makes RandomDouble reproducible. Every thread reseeds its generator from seed and a stream
+// number, handed out in the order in which threads next draw a number. Scenes built on one
+// thread are then the same from run to run. Renders do not depend on this: the renderer seeds
+// every sample with SetSampleSeed.
+inline void SetRandomSeed(uint64_t seed)
+{
+    RandomDetail::seed.store(seed);
+    RandomDetail::nextStream.store(0);
+    RandomDetail::generation.fetch_add(1);
+}
+
+// Gives the calling thread a stream of its own for the lifetime of the object, Mix(seed, 0),
+// the stream SetRandomSeed hands to the first thread that draws. Scene builds use it while
+// other threads render: it neither reads nor bumps the global generation, so the scene does
+// not depend on timing and renders in progress are not reseeded.
+class ScopedRandomSeed
+{
+public:
+    explicit ScopedRandomSeed(uint64_t seed) : saved(RandomDetail::Local())
+    {
+        auto &local = RandomDetail::Local();
+        local.rng.Seed(RandomDetail::Mix(seed, 0));
+        local.scoped = true;
+    }
+
+    ~ScopedRandomSeed()
+    {
+        RandomDetail::Local() = saved;
+    }
+
+    ScopedRandomSeed(const ScopedRandomSeed &) = delete;
+    ScopedRandomSeed &operator=(const ScopedRandomSeed &) = delete;
+
+private:
+    RandomDetail::ThreadState saved;
+};
+
+// Seeds the calling thread's generator for one sample of one pixel, so what a sample draws
+// depends only on (seed, x, y, sample) and not on the thread that renders it. Renders are
+// then bit exact across runs, thread counts and machines, and sample ranges rendered
+// separately add up to the same image as one render of all samples.
+inline void SetSampleSeed(uint64_t seed, uint32_t x, uint32_t y, uint32_t sample)
+{
+    auto &local = RandomDetail::Local();
+    local.rng.Seed(RandomDetail::Mix(RandomDetail::Mix(seed, (uint64_t(y) << 32) | x), sample));
+    local.generation = RandomDetail::generation.load(std::memory_order_relaxed);
+}
+
+inline double RandomDouble()
+{
+    auto &local = RandomDetail::Local();
+
+    const uint32_t current = RandomDetail::generation.load(std::memory_order_relaxed);
+    if (local.generation != current && !local.scoped) [[unlikely]]
+    {
+        local.generation = current;
+        local.rng.Seed(RandomDetail::Mix(RandomDetail::seed.load(), RandomDetail::nextStream.fetch_add(1)));
+    }
+    // the top 53 bits, uniform in [0, 1)
+    return static_cast<double>(local.rng.Next() >> 11) * 0x1.0p-53;
 }
 
 inline double RandomDouble(double min, double max)
 {
     return min + (max - min) * RandomDouble();
-}
\ No newline at end of file
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+
 #include "core/vector3.h"
 
 class Ray
@@ -16,4 +18,11 @@ public:
     {
         return origin + t * direction;
     }
-};
\ No newline at end of file
+};
+
+// Moving primitives are parameterized over the normalized shutter interval [0, 1].
+// Times outside of it are clamped so that motion never leaves the time-interpolated bounds.
+inline double ShutterTime(double time)
+{
+    return std::clamp(time, 0.0, 1.0);
+}
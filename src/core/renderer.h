@@ -17,12 +17,14 @@
 #include <iostream>
 #include <ranges>
 #include <thread>
+#include <optional>
 
 #ifdef PPL
 #include <ppl.h>
 #else
 #include <tbb/tbb.h>
-#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
 #endif
 
 #include "core/camera.h"
@@ -32,67 +34,227 @@
 #include "core/vector3.h"
 #include "core/hittable.h"
 #include "io/progress_tracker.h"
+#include "io/row_sink.h"
 #include "core/environment_map.h"
+#include "core/stats.h"
+#include "core/pixel_cost.h"
+#include "core/trace.h"
+#include "core/parallel.h"
+#include "core/accumulation_buffer.h"
+#include "core/numa.h"
+#include "core/cancellation.h"
+
+enum class NumaMode
+{
+    // one task arena for the whole machine
+    Off,
+    // a task arena per NUMA node; the nodes take turns over stripes of rows, and each allocates
+    // the framebuffer rows it renders, so they are backed by its own memory
+    SplitImage,
+};
 
 class Renderer
 {
 public:
     int maxDepth = 50;
     int samplesPerPixel = 100;
+    // 0 uses every hardware thread
     unsigned int maxThreadCount = 0;
+    // every sample's random numbers derive from (seed, pixel, sample index)
+    uint64_t seed = 1;
+    // index of the first sample; a render takes samples [sampleStart, sampleStart + samplesPerPixel)
+    int sampleStart = 0;
     shared_ptr<EnvironmentMap> environmentMap = nullptr;
+    // no console output, for benchmarks and tools
+    bool quiet = false;
+    ProgressFormat progressFormat = ProgressFormat::Text;
+    // counters of the last Render; all zero unless built with RT_STATS
+    RenderStats stats{};
+    // when set, Render records what every pixel cost; must match the image size
+    PixelCostMap *costMap = nullptr;
+    NumaMode numaMode = NumaMode::Off;
+    // pin each render thread to its own core (within its node's cores with NumaMode::SplitImage)
+    bool pinThreads = false;
+    // when set, every row is handed to it as soon as it is rendered, and finished after the last
+    RowSink *rowSink = nullptr;
+    // when set, Render stops soon after it is cancelled; see Render
+    const CancellationToken *cancellation = nullptr;
+    // Render stops soon after this time
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // when set, Render stores how many samples each pixel got, row by row: samplesPerPixel
+    // everywhere unless the render was stopped
+    std::vector<uint32_t> *sampleCounts = nullptr;
 
 private:
-    Color GetColor(const Ray &ray, const Hittable &world, int currentDepth) const
+    // rays counts the rays traced, for the progress report
+    Color GetColor(const Ray &ray, const Hittable &world, int currentDepth, uint64_t &rays) const
     {
         constexpr double inf = std::numeric_limits<double>::infinity();
 
         if (currentDepth <= 0)
+        {
+            STATS_PATH_LENGTH(maxDepth);
             return Color(0, 0, 0);
+        }
+
+        rays++;
+        if (currentDepth == maxDepth)
+            STATS_COUNT(PrimaryRays);
+        else
+            STATS_COUNT(SecondaryRays);
 
         HitResult hit{};
-        if (world.Hit(ray, hit, 0.001, inf))
+        const bool hasHit = world.Hit(ray, hit, 0.001, inf);
+        STATS_END_RAY();
+        if (hasHit)
         {
             Color attenuation;
             Ray secondaryRay;
             if (hit.material->Scatter(ray, hit, attenuation, secondaryRay))
-                return attenuation * GetColor(secondaryRay, world, currentDepth - 1) + hit.material->Emitted(hit.point, 0, 0);
+                return attenuation * GetColor(secondaryRay, world, currentDepth - 1, rays) + hit.material->Emitted(hit.point, 0, 0);
 
+            STATS_PATH_LENGTH(maxDepth - currentDepth + 1);
             return hit.material->Emitted(hit.point, 0, 0);
         }
+        STATS_PATH_LENGTH(maxDepth - currentDepth + 1);
         return environmentMap ? environmentMap->GetColor(ray) : Color(0, 0, 0);
     }
 
-    void RenderLine(Image &image,
-                    const Camera &camera,
-                    const Hittable &world,
-                    int line_number,
-                    const Vector3 &pixelDelta)
+    // Samples between checks whether the render has to stop: a few microseconds of work each.
+    static constexpr int STOP_CHECK_SAMPLES = 4;
+
+    // Returns the number of rays traced. With a stop condition, complete tells whether every
+    // pixel of the row got all its samples, and counts (if set) receives how many each got.
+    uint64_t RenderLine(Image &image,
+                        const Camera &camera,
+                        const Hittable &world,
+                        int line_number,
+                        const Vector3 &pixelDelta,
+                        StopCondition *stop,
+                        uint32_t *counts,
+                        bool &complete)
     {
+        uint64_t rays = 0;
+        complete = true;
         for (int x = 0; x < image.width; ++x)
         {
-            Color color(0, 0, 0);
-            for (int s = 0; s < samplesPerPixel; ++s)
-            {
-                auto sampleOffset = Vector3(RandomDouble() - 0.5, RandomDouble() - 0.5, 0.0);
-                Ray ray = camera.GetRay((x + sampleOffset.x()) * pixelDelta.x(),
-                                        (line_number + sampleOffset.y()) * pixelDelta.y());
-                color += GetColor(ray, world, maxDepth);
-            }
-            image.pixels[line_number][x] = color / samplesPerPixel;
+            int samples = samplesPerPixel;
+            if (costMap)
+                image.pixels[line_number][x] = RenderPixelWithCost(camera, world, x, line_number, pixelDelta, rays, stop, samples);
+            else
+                image.pixels[line_number][x] = RenderPixel(camera, world, x, line_number, pixelDelta, rays, stop, samples);
+            if (counts)
+                counts[x] = static_cast<uint32_t>(samples);
+            complete = complete && samples == samplesPerPixel;
         }
+        return rays;
     }
 
-public:
-    void Render(Image &image,
-                const Camera &camera,
-                const Hittable &world)
+    // Radiance of sample s (counted from sampleStart) of pixel (x, y).
+    Color RenderSample(const Camera &camera, const Hittable &world, int x, int y, int s, const Vector3 &pixelDelta, uint64_t &rays) const
+    {
+        SetSampleSeed(seed, x, y, static_cast<uint32_t>(sampleStart + s));
+        auto sampleOffset = Vector3(RandomDouble() - 0.5, RandomDouble() - 0.5, 0.0);
+        Ray ray = camera.GetRay((x + sampleOffset.x()) * pixelDelta.x(),
+                                (y + sampleOffset.y()) * pixelDelta.y());
+        return GetColor(ray, world, maxDepth, rays);
+    }
+
+    Color RenderPixel(const Camera &camera, const Hittable &world, int x, int y, const Vector3 &pixelDelta, uint64_t &rays) const
+    {
+        Color color(0, 0, 0);
+        for (int s = 0; s < samplesPerPixel; ++s)
+            color += RenderSample(camera, world, x, y, s, pixelDelta, rays);
+        return color / samplesPerPixel;
+    }
+
+    // RenderPixel that gives up, between batches of samples, once stop says so. samples is
+    // set to the number taken; the color is their mean, black if there were none.
+    Color RenderPixel(const Camera &camera, const Hittable &world, int x, int y, const Vector3 &pixelDelta, uint64_t &rays,
+                      StopCondition *stop, int &samples) const
+    {
+        if (!stop)
+        {
+            samples = samplesPerPixel;
+            return RenderPixel(camera, world, x, y, pixelDelta, rays);
+        }
+
+        Color color(0, 0, 0);
+        int s = 0;
+        while (s < samplesPerPixel && !stop->ShouldStop())
+        {
+            const int batchEnd = std::min(samplesPerPixel, s + STOP_CHECK_SAMPLES);
+            for (; s < batchEnd; ++s)
+                color += RenderSample(camera, world, x, y, s, pixelDelta, rays);
+        }
+        samples = s;
+        return s > 0 ? color / s : Color(0, 0, 0);
+    }
+
+    // RenderPixel, recording its cycles and, from the thread's statistics, its traversal work.
+    Color RenderPixelWithCost(const Camera &camera, const Hittable &world, int x, int y, const Vector3 &pixelDelta, uint64_t &rays,
+                              StopCondition *stop, int &samples) const
+    {
+        const RenderStats &counts = StatsDetail::Local().stats;
+        const uint64_t nodes = counts[StatCounter::NodeVisits];
+        const uint64_t tests = counts.PrimitiveTests();
+        const uint64_t start = ReadCycleCounter();
+
+        const Color color = RenderPixel(camera, world, x, y, pixelDelta, rays, stop, samples);
+
+        const size_t index = costMap->Index(x, y);
+        costMap->cycles[index] = ReadCycleCounter() - start;
+        costMap->nodeVisits[index] = counts[StatCounter::NodeVisits] - nodes;
+        costMap->primitiveTests[index] = counts.PrimitiveTests() - tests;
+        return color;
+    }
+
+    // Rows per stripe in NumaMode::SplitImage: enough to keep a node's rows together in its
+    // memory, few enough that the nodes finish about together.
+    static constexpr int NUMA_STRIPE_ROWS = 16;
+
+    // Threads for each NUMA node: the node's CPUs, scaled down in proportion when fewer
+    // threads are allowed in total, but at least one per node.
+    static std::vector<int> NodeThreadCounts(const std::vector<Numa::Node> &nodes, unsigned int threadCount)
+    {
+        size_t totalCpus = 0;
+        for (const auto &node : nodes)
+            totalCpus += node.cpus.size();
+
+        std::vector<int> counts;
+        for (const auto &node : nodes)
+        {
+            const size_t share = threadCount == 0 ? node.cpus.size() : node.cpus.size() * threadCount / totalCpus;
+            counts.push_back(static_cast<int>(std::max<size_t>(share, 1)));
+        }
+        return counts;
+    }
+
+    // Runs renderRow(y) for every row on the configured number of threads, with progress
+    // reporting and statistics. renderRow returns the number of rays it traced. With
+    // NumaMode::SplitImage, allocateRow(y) is called first on the node that will render row y.
+    // Once stop (if set) says so, rows that have not started are skipped.
+    template <typename RenderRow, typename AllocateRow>
+    void RenderRows(int width, int height, const RenderRow &renderRow, const AllocateRow &allocateRow, StopCondition *stop = nullptr)
     {
         auto hardwareLimit = std::thread::hardware_concurrency();
-        auto threadCount = maxThreadCount = 0 ? 0 : std::min(maxThreadCount, hardwareLimit);
-        ProgressTracker progressTracker(image.height);
+        auto threadCount = maxThreadCount == 0 ? 0 : std::min(maxThreadCount, hardwareLimit);
+        ResetRenderStats();
 
-#ifdef PPL
+        const uint64_t samplesPerLine = uint64_t(width) * samplesPerPixel;
+        std::optional<ProgressTracker> progress;
+        auto renderLine = [&](int y)
+        {
+            if (stop && stop->ShouldStop())
+                return;
+            TRACE_SCOPE("RenderLine");
+            uint64_t rays = renderRow(y);
+            if (progress)
+                progress->AddLine(samplesPerLine, rays);
+        };
+
+#if defined(PPL) && defined(_MSC_VER)
+        (void)allocateRow;
         Concurrency::Scheduler *customScheduler = nullptr;
         if (threadCount > 0)
         {
@@ -104,22 +266,14 @@ public:
             // Attach custom scheduler to current context
             customScheduler->Attach();
         }
-#else
-        // needs to stay in scope until TBB parallel_for is done
-        std::unique_ptr<tbb::global_control> control;
-        if (threadCount > 0)
-            control = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, threadCount);
-#endif
 
-        fmt::println("Hardware concurrency: {}/{}", threadCount == 0 ? hardwareLimit : threadCount, hardwareLimit);
-
-        const Vector3 pixelDelta = Vector3(1.0f / image.width, 1.0f / image.height, 0.0f);
+        if (!quiet)
+            fmt::println("Hardware concurrency: {}/{}", threadCount == 0 ? hardwareLimit : threadCount, hardwareLimit);
+        if (!quiet)
+            progress.emplace(height, progressFormat);
 
-#if defined(PPL) && defined(_MSC_VER)
-        // MSVC version using PPL's parallel_for
-        Concurrency::parallel_for(0, image.height, [&](int y)
-                                  { RenderLine(image, camera, world, y, pixelDelta);
-                                progressTracker.IncrementLine(); });
+        // MSVC version using PPL's parallel_for; NUMA modes and pinning need TBB
+        Concurrency::parallel_for(0, height, renderLine);
 
         if (customScheduler)
         {
@@ -127,10 +281,219 @@ public:
             customScheduler->Release();
         }
 #else
-        // Use TBB parallel_for as default
-        tbb::parallel_for(0, image.height, [&](int y)
-                          { RenderLine(image, camera, world, y, pixelDelta); 
-                        progressTracker.IncrementLine(); });
+        if (numaMode == NumaMode::SplitImage)
+        {
+            const auto &nodes = Numa::Nodes();
+            const std::vector<int> threads = NodeThreadCounts(nodes, threadCount);
+            if (!quiet)
+            {
+                std::string layout;
+                for (size_t i = 0; i < nodes.size(); i++)
+                    layout += fmt::format("{}node {}: {} threads", i ? ", " : "", nodes[i].id, threads[i]);
+                fmt::println("NUMA nodes: {} ({})", nodes.size(), layout);
+            }
+
+            std::vector<std::unique_ptr<tbb::task_arena>> arenas;
+            std::vector<std::unique_ptr<Numa::ThreadPinner>> pinners;
+            std::vector<std::unique_ptr<Numa::NodeObserver>> observers;
+            // cancelled by stop, so the rows not yet started are dropped without running
+            std::vector<std::unique_ptr<tbb::task_group_context>> contexts;
+            for (size_t i = 0; i < nodes.size(); i++)
+            {
+                contexts.push_back(std::make_unique<tbb::task_group_context>());
+                if (stop)
+                    stop->Attach(*contexts.back());
+                arenas.push_back(std::make_unique<tbb::task_arena>(tbb::task_arena::constraints(nodes[i].id, threads[i])));
+                arenas.back()->initialize();
+                // lets per node data (see PageBuffer) be picked without asking the OS
+                observers.push_back(std::make_unique<Numa::NodeObserver>(*arenas.back(), static_cast<int>(i)));
+                if (pinThreads)
+                    pinners.push_back(std::make_unique<Numa::ThreadPinner>(*arenas.back(), nodes[i].cpus));
+            }
+            if (!quiet)
+                progress.emplace(height, progressFormat);
+
+            // stripe s belongs to node s % nodes; rows are numbered within the node's stripes
+            const int stripes = (height + NUMA_STRIPE_ROWS - 1) / NUMA_STRIPE_ROWS;
+            auto nodeRow = [&](size_t node, size_t index)
+            {
+                const size_t stripe = node + (index / NUMA_STRIPE_ROWS) * nodes.size();
+                return static_cast<int>(stripe * NUMA_STRIPE_ROWS + index % NUMA_STRIPE_ROWS);
+            };
+            auto nodeRowCount = [&](size_t node)
+            {
+                const size_t nodeStripes = stripes > int(node) ? (stripes - node + nodes.size() - 1) / nodes.size() : 0;
+                return nodeStripes * NUMA_STRIPE_ROWS;
+            };
+
+            std::vector<tbb::task_group> groups(nodes.size());
+            for (size_t i = 0; i < nodes.size(); i++)
+            {
+                arenas[i]->execute([&, i]
+                                   { groups[i].run([&, i]
+                                                   {
+                    const size_t rows = nodeRowCount(i);
+                    tbb::parallel_for(size_t(0), rows, [&](size_t index)
+                                      {
+                        const int y = nodeRow(i, index);
+                        if (y < height)
+                            allocateRow(y); }, *contexts[i]);
+                    tbb::parallel_for(size_t(0), rows, [&](size_t index)
+                                      {
+                        const int y = nodeRow(i, index);
+                        if (y < height)
+                            renderLine(y); }, *contexts[i]); }); });
+            }
+            // every group has to be waited for before the arenas go, even after a failure
+            std::exception_ptr error;
+            for (size_t i = 0; i < nodes.size(); i++)
+            {
+                arenas[i]->execute([&, i]
+                                   {
+                    try
+                    {
+                        groups[i].wait();
+                    }
+                    catch (...)
+                    {
+                        if (!error)
+                            error = std::current_exception();
+                    } });
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
+        else
+        {
+            // an explicit arena limits this render alone, unlike a global_control
+            tbb::task_arena arena(threadCount > 0 ? static_cast<int>(threadCount) : tbb::task_arena::automatic);
+            arena.initialize();
+            std::unique_ptr<Numa::ThreadPinner> pinner;
+            if (pinThreads)
+                pinner = std::make_unique<Numa::ThreadPinner>(arena, Numa::Detail::AllCpus());
+
+            if (!quiet)
+                fmt::println("Hardware concurrency: {}/{}", arena.max_concurrency(), hardwareLimit);
+            if (!quiet)
+                progress.emplace(height, progressFormat);
+
+            tbb::task_group_context context;
+            if (stop)
+                stop->Attach(context);
+            arena.execute([&]
+                          { tbb::parallel_for(0, height, renderLine, context); });
+        }
 #endif
+
+        if (progress)
+            progress->Finish();
+        stats = CollectRenderStats();
+        if (STATS_ENABLED && !quiet)
+            stats.Print();
+    }
+
+public:
+    // Renders the image. A render that is cancelled (see cancellation) or runs past the
+    // deadline stops within a batch of samples per thread and returns why. The image then
+    // holds, for every pixel, the mean of the samples it got, black where there were none, and
+    // sampleCounts says how many that were; weighting by them merges it with other partial
+    // renders. Complete rows have gone to rowSink, but it is not finished: the caller decides
+    // whether to write the partial image instead.
+    RenderStatus Render(Image &image,
+                        const Camera &camera,
+                        const Hittable &world)
+    {
+        TRACE_SCOPE("Render");
+        if (costMap && (costMap->width != image.width || costMap->height != image.height))
+            throw std::invalid_argument("Renderer: cost map size does not match the image.");
+
+        StopCondition condition(cancellation, deadline);
+        StopCondition *stop = condition.Active() ? &condition : nullptr;
+        if (sampleCounts)
+            sampleCounts->assign(size_t(image.width) * image.height, 0);
+        // per row with a stop condition: 0 not started, 1 stopped midway, 2 complete
+        std::vector<uint8_t> rendered(stop ? image.height : 0);
+
+        const Vector3 pixelDelta = Vector3(1.0f / image.width, 1.0f / image.height, 0.0f);
+        RenderRows(image.width, image.height, [&](int y)
+                   {
+            bool complete = true;
+            uint32_t *counts = sampleCounts ? sampleCounts->data() + size_t(y) * image.width : nullptr;
+            uint64_t rays = RenderLine(image, camera, world, y, pixelDelta, stop, counts, complete);
+            if (stop)
+                rendered[y] = complete ? 2 : 1;
+            if (rowSink && complete)
+                rowSink->WriteRow(y, image.pixels[y]);
+            return rays; }, [&](int y)
+                   {
+            // first touched by the thread that renders it, so on its node's memory
+            delete[] image.pixels[y];
+            image.pixels[y] = new Vector3[image.width]; }, stop);
+
+        // a stop that came after the last sample cut nothing short
+        if (stop && std::ranges::count(rendered, 2) < image.height)
+        {
+            for (int y = 0; y < image.height; y++)
+            {
+                if (!rendered[y])
+                    std::fill(image.pixels[y], image.pixels[y] + image.width, Color(0, 0, 0));
+            }
+            return stop->Status();
+        }
+
+        if (rowSink)
+            rowSink->Finish();
+        return RenderStatus::Complete;
+    }
+
+    // Adds samples [sampleStart, sampleStart + samplesPerPixel) of every pixel to buffer, e.g.
+    // one slice of a frame whose samples are split over several jobs; see AccumulationBuffer.
+    void Accumulate(AccumulationBuffer &buffer,
+                    const Camera &camera,
+                    const Hittable &world)
+    {
+        TRACE_SCOPE("Accumulate");
+        if (buffer.seed != seed)
+            throw std::invalid_argument("Renderer: the accumulation buffer was started with a different seed.");
+        buffer.AddRange(static_cast<uint32_t>(sampleStart), static_cast<uint32_t>(samplesPerPixel));
+
+        const Vector3 pixelDelta = Vector3(1.0f / buffer.width, 1.0f / buffer.height, 0.0f);
+        RenderRows(buffer.width, buffer.height, [&](int y)
+                   {
+            uint64_t rays = 0;
+            for (int x = 0; x < buffer.width; ++x)
+            {
+                const size_t pixel = buffer.Index(x, y);
+                for (int s = 0; s < samplesPerPixel; ++s)
+                    buffer.AddSample(pixel, RenderSample(camera, world, x, y, s, pixelDelta, rays));
+            }
+            return rays; }, [](int)
+                   {
+                       // the buffer is one allocation, which cannot be spread over nodes row by row
+                   });
+    }
+
+    // Renders samplesPerPixel samples for each pixel in [x0, x1) x [y0, y1) of a width x height
+    // image, in parallel over its rows. Returns the mean colors row by row. Used for distributed
+    // rendering, where every process renders only part of the frame.
+    std::vector<Color> RenderTile(const Camera &camera,
+                                  const Hittable &world,
+                                  int width, int height,
+                                  int x0, int y0, int x1, int y1) const
+    {
+        TRACE_SCOPE("RenderTile");
+        if (x0 < 0 || y0 < 0 || x1 > width || y1 > height || x0 > x1 || y0 > y1)
+            throw std::invalid_argument("Renderer: tile lies outside the image.");
+
+        const Vector3 pixelDelta = Vector3(1.0f / width, 1.0f / height, 0.0f);
+        const int tileWidth = x1 - x0;
+        std::vector<Color> colors(size_t(tileWidth) * (y1 - y0));
+        ParallelFor(size_t(y1 - y0), [&](size_t row)
+                    {
+            uint64_t rays = 0;
+            const int y = y0 + int(row);
+            for (int x = x0; x < x1; ++x)
+                colors[row * tileWidth + (x - x0)] = RenderPixel(camera, world, x, y, pixelDelta, rays); });
+        return colors;
     }
-};
\ No newline at end of file
+};
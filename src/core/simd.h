@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// Four doubles processed together.
+// Uses AVX when the compiler targets it (-mavx2 / /arch:AVX2), two SSE2 registers on any
+// other x86-64 build and plain arrays elsewhere, so the same kernel code compiles everywhere.
+#if defined(__AVX__)
+#define SIMD_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+struct Double4
+{
+#if defined(SIMD_AVX)
+    __m256d v;
+
+    Double4() = default;
+    Double4(__m256d v) : v(v) {}
+    explicit Double4(double x) : v(_mm256_set1_pd(x)) {}
+
+    static Double4 Load(const double *p) { return _mm256_load_pd(p); }
+    void Store(double *p) const { _mm256_store_pd(p, v); }
+#elif defined(SIMD_SSE2)
+    __m128d lo, hi;
+
+    Double4() = default;
+    Double4(__m128d lo, __m128d hi) : lo(lo), hi(hi) {}
+    explicit Double4(double x) : lo(_mm_set1_pd(x)), hi(_mm_set1_pd(x)) {}
+
+    static Double4 Load(const double *p) { return Double4(_mm_load_pd(p), _mm_load_pd(p + 2)); }
+    void Store(double *p) const
+    {
+        _mm_store_pd(p, lo);
+        _mm_store_pd(p + 2, hi);
+    }
+#else
+    double e[4];
+
+    Double4() = default;
+    explicit Double4(double x) : e{x, x, x, x} {}
+
+    static Double4 Load(const double *p)
+    {
+        Double4 r;
+        for (int i = 0; i < 4; i++)
+            r.e[i] = p[i];
+        return r;
+    }
+    void Store(double *p) const
+    {
+        for (int i = 0; i < 4; i++)
+            p[i] = e[i];
+    }
+#endif
+};
+
+// Result of a lane-wise comparison. Lanes are either all ones or all zeros.
+using Mask4 = Double4;
+
+#if defined(SIMD_AVX)
+
+inline Double4 operator+(Double4 a, Double4 b) { return _mm256_add_pd(a.v, b.v); }
+inline Double4 operator-(Double4 a, Double4 b) { return _mm256_sub_pd(a.v, b.v); }
+inline Double4 operator*(Double4 a, Double4 b) { return _mm256_mul_pd(a.v, b.v); }
+inline Double4 operator/(Double4 a, Double4 b) { return _mm256_div_pd(a.v, b.v); }
+inline Double4 Abs(Double4 a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+inline Double4 Sqrt(Double4 a) { return _mm256_sqrt_pd(a.v); }
+
+inline Mask4 operator<(Double4 a, Double4 b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); }
+inline Mask4 operator<=(Double4 a, Double4 b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ); }
+inline Mask4 operator>=(Double4 a, Double4 b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ); }
+inline Mask4 operator&(Mask4 a, Mask4 b) { return _mm256_and_pd(a.v, b.v); }
+inline Mask4 operator|(Mask4 a, Mask4 b) { return _mm256_or_pd(a.v, b.v); }
+
+// Lanes of a where mask is set, lanes of b elsewhere.
+inline Double4 Select(Mask4 mask, Double4 a, Double4 b) { return _mm256_blendv_pd(b.v, a.v, mask.v); }
+// One bit per lane, lane 0 in the lowest bit.
+inline int MoveMask(Mask4 mask) { return _mm256_movemask_pd(mask.v); }
+
+#elif defined(SIMD_SSE2)
+
+inline Double4 operator+(Double4 a, Double4 b) { return Double4(_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)); }
+inline Double4 operator-(Double4 a, Double4 b) { return Double4(_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)); }
+inline Double4 operator*(Double4 a, Double4 b) { return Double4(_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)); }
+inline Double4 operator/(Double4 a, Double4 b) { return Double4(_mm_div_pd(a.lo, b.lo), _mm_div_pd(a.hi, b.hi)); }
+inline Double4 Abs(Double4 a)
+{
+    const __m128d sign = _mm_set1_pd(-0.0);
+    return Double4(_mm_andnot_pd(sign, a.lo), _mm_andnot_pd(sign, a.hi));
+}
+inline Double4 Sqrt(Double4 a) { return Double4(_mm_sqrt_pd(a.lo), _mm_sqrt_pd(a.hi)); }
+
+inline Mask4 operator<(Double4 a, Double4 b) { return Double4(_mm_cmplt_pd(a.lo, b.lo), _mm_cmplt_pd(a.hi, b.hi)); }
+inline Mask4 operator<=(Double4 a, Double4 b) { return Double4(_mm_cmple_pd(a.lo, b.lo), _mm_cmple_pd(a.hi, b.hi)); }
+inline Mask4 operator>=(Double4 a, Double4 b) { return Double4(_mm_cmpge_pd(a.lo, b.lo), _mm_cmpge_pd(a.hi, b.hi)); }
+inline Mask4 operator&(Mask4 a, Mask4 b) { return Double4(_mm_and_pd(a.lo, b.lo), _mm_and_pd(a.hi, b.hi)); }
+inline Mask4 operator|(Mask4 a, Mask4 b) { return Double4(_mm_or_pd(a.lo, b.lo), _mm_or_pd(a.hi, b.hi)); }
+
+inline Double4 Select(Mask4 mask, Double4 a, Double4 b)
+{
+    return Double4(_mm_or_pd(_mm_and_pd(mask.lo, a.lo), _mm_andnot_pd(mask.lo, b.lo)),
+                   _mm_or_pd(_mm_and_pd(mask.hi, a.hi), _mm_andnot_pd(mask.hi, b.hi)));
+}
+inline int MoveMask(Mask4 mask) { return _mm_movemask_pd(mask.lo) | (_mm_movemask_pd(mask.hi) << 2); }
+
+#else
+
+namespace SimdDetail
+{
+    inline double MaskLane(bool set)
+    {
+        return set ? -std::numeric_limits<double>::quiet_NaN() : 0.0;
+    }
+
+    inline bool IsSet(double lane)
+    {
+        return std::signbit(lane);
+    }
+
+    template <typename Op>
+    Double4 Map(Double4 a, Double4 b, Op op)
+    {
+        Double4 r;
+        for (int i = 0; i < 4; i++)
+            r.e[i] = op(a.e[i], b.e[i]);
+        return r;
+    }
+}
+
+inline Double4 operator+(Double4 a, Double4 b) { return SimdDetail::Map(a, b, [](double x, double y) { return x + y; }); }
+inline Double4 operator-(Double4 a, Double4 b) { return SimdDetail::Map(a, b, [](double x, double y) { return x - y; }); }
+inline Double4 operator*(Double4 a, Double4 b) { return SimdDetail::Map(a, b, [](double x, double y) { return x * y; }); }
+inline Double4 operator/(Double4 a, Double4 b) { return SimdDetail::Map(a, b, [](double x, double y) { return x / y; }); }
+inline Double4 Abs(Double4 a) { return SimdDetail::Map(a, a, [](double x, double) { return std::abs(x); }); }
+inline Double4 Sqrt(Double4 a) { return SimdDetail::Map(a, a, [](double x, double) { return std::sqrt(x); }); }
+
+inline Mask4 operator<(Double4 a, Double4 b) { return SimdDetail::Map(a, b, [](double x, double y) { return SimdDetail::MaskLane(x < y); }); }
+inline Mask4 operator<=(Double4 a, Double4 b) { return SimdDetail::Map(a, b, [](double x, double y) { return SimdDetail::MaskLane(x <= y); }); }
+inline Mask4 operator>=(Double4 a, Double4 b) { return SimdDetail::Map(a, b, [](double x, double y) { return SimdDetail::MaskLane(x >= y); }); }
+inline Mask4 operator&(Mask4 a, Mask4 b)
+{
+    return SimdDetail::Map(a, b, [](double x, double y) { return SimdDetail::MaskLane(SimdDetail::IsSet(x) && SimdDetail::IsSet(y)); });
+}
+inline Mask4 operator|(Mask4 a, Mask4 b)
+{
+    return SimdDetail::Map(a, b, [](double x, double y) { return SimdDetail::MaskLane(SimdDetail::IsSet(x) || SimdDetail::IsSet(y)); });
+}
+
+inline Double4 Select(Mask4 mask, Double4 a, Double4 b)
+{
+    Double4 r;
+    for (int i = 0; i < 4; i++)
+        r.e[i] = SimdDetail::IsSet(mask.e[i]) ? a.e[i] : b.e[i];
+    return r;
+}
+inline int MoveMask(Mask4 mask)
+{
+    int bits = 0;
+    for (int i = 0; i < 4; i++)
+        bits |= SimdDetail::IsSet(mask.e[i]) ? (1 << i) : 0;
+    return bits;
+}
+
+#endif
@@ -0,0 +1,293 @@
+#pragma once
+
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "io/json_writer.h"
+
+// Ray and traversal statistics. Compiled in with -DRT_STATS; otherwise the STATS_ macros
+// expand to nothing and RenderStats stays zero.
+//
+// Every thread counts into its own cache line aligned block, without atomics. The renderer
+// resets all blocks before a render and sums them up afterwards (CollectRenderStats).
+
+#ifdef RT_STATS
+constexpr bool STATS_ENABLED = true;
+#else
+constexpr bool STATS_ENABLED = false;
+#endif
+
+enum class StatCounter
+{
+    PrimaryRays,
+    SecondaryRays,
+    // stays zero until the renderer samples lights directly
+    ShadowRays,
+    AABBTests,
+    NodeVisits,
+    // primitive tests from here to the end
+    SphereTests,
+    SpherePacketTests,
+    QuadTests,
+    TriangleTests,
+    WatertightTriangleTests,
+    TrianglePacketTests,
+    Count
+};
+
+constexpr std::string_view STAT_COUNTER_NAMES[] = {
+    "primary_rays",
+    "secondary_rays",
+    "shadow_rays",
+    "aabb_tests",
+    "node_visits",
+    "sphere_tests",
+    "sphere_packet_tests",
+    "quad_tests",
+    "triangle_tests",
+    "watertight_triangle_tests",
+    "triangle_packet_tests",
+};
+static_assert(std::size(STAT_COUNTER_NAMES) == static_cast<size_t>(StatCounter::Count));
+
+// Values 0..BUCKETS-2 get a bucket each, larger ones share the last bucket.
+struct StatHistogram
+{
+    static constexpr size_t BUCKETS = 64;
+    std::array<uint64_t, BUCKETS> buckets{};
+
+    void Add(uint64_t value)
+    {
+        buckets[std::min<uint64_t>(value, BUCKETS - 1)]++;
+    }
+
+    uint64_t Total() const
+    {
+        uint64_t total = 0;
+        for (uint64_t count : buckets)
+            total += count;
+        return total;
+    }
+
+    double Mean() const
+    {
+        uint64_t total = 0, sum = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            total += buckets[i];
+            sum += i * buckets[i];
+        }
+        return total > 0 ? static_cast<double>(sum) / total : 0.0;
+    }
+
+    size_t Max() const
+    {
+        for (size_t i = BUCKETS; i-- > 0;)
+        {
+            if (buckets[i] > 0)
+                return i;
+        }
+        return 0;
+    }
+
+    void Merge(const StatHistogram &other)
+    {
+        for (size_t i = 0; i < BUCKETS; i++)
+            buckets[i] += other.buckets[i];
+    }
+
+    // buckets up to the last non-empty one
+    void WriteJson(JsonWriter &json) const
+    {
+        json.BeginArray();
+        const size_t end = Total() > 0 ? Max() + 1 : 0;
+        for (size_t i = 0; i < end; i++)
+            json.Value(buckets[i]);
+        json.EndArray();
+    }
+};
+
+struct RenderStats
+{
+    std::array<uint64_t, static_cast<size_t>(StatCounter::Count)> counters{};
+    // rays per camera sample, including the camera ray
+    StatHistogram pathLength;
+    // deepest node reached per ray in the recursive BVHs (BvhNode, MotionBvhNode, StaticBvh)
+    StatHistogram bvhDepth;
+    // largest traversal stack per ray in the stack based BVHs (FlatBvh, SphereSet, OutOfCore)
+    StatHistogram traversalStack;
+    // nodes visited per ray, in log2 buckets: bucket b holds counts in [2^(b-1), 2^b)
+    StatHistogram nodeVisitsLog2;
+
+    uint64_t operator[](StatCounter counter) const
+    {
+        return counters[static_cast<size_t>(counter)];
+    }
+
+    uint64_t Rays() const
+    {
+        return (*this)[StatCounter::PrimaryRays] + (*this)[StatCounter::SecondaryRays] + (*this)[StatCounter::ShadowRays];
+    }
+
+    uint64_t PrimitiveTests() const
+    {
+        uint64_t tests = 0;
+        for (size_t i = static_cast<size_t>(StatCounter::SphereTests); i < counters.size(); i++)
+            tests += counters[i];
+        return tests;
+    }
+
+    void Merge(const RenderStats &other)
+    {
+        for (size_t i = 0; i < counters.size(); i++)
+            counters[i] += other.counters[i];
+        pathLength.Merge(other.pathLength);
+        bvhDepth.Merge(other.bvhDepth);
+        traversalStack.Merge(other.traversalStack);
+        nodeVisitsLog2.Merge(other.nodeVisitsLog2);
+    }
+
+    void Print() const
+    {
+        const double rays = static_cast<double>(std::max<uint64_t>(Rays(), 1));
+        fmt::print(stderr, "Rays: {} primary, {} secondary, {} shadow\n",
+                   (*this)[StatCounter::PrimaryRays], (*this)[StatCounter::SecondaryRays], (*this)[StatCounter::ShadowRays]);
+        for (size_t i = static_cast<size_t>(StatCounter::AABBTests); i < counters.size(); i++)
+        {
+            if (counters[i] > 0)
+                fmt::print(stderr, "  {:<26} {:>14} ({:.2f} per ray)\n", STAT_COUNTER_NAMES[i], counters[i], counters[i] / rays);
+        }
+        fmt::print(stderr, "Path length: mean {:.2f}, max {}\n", pathLength.Mean(), pathLength.Max());
+        if (bvhDepth.Total() > 0)
+            fmt::print(stderr, "BVH depth: mean {:.2f}, max {}\n", bvhDepth.Mean(), bvhDepth.Max());
+        if (traversalStack.Total() > 0)
+            fmt::print(stderr, "Traversal stack: mean {:.2f}, max {}\n", traversalStack.Mean(), traversalStack.Max());
+    }
+
+    void WriteJson(JsonWriter &json) const
+    {
+        json.BeginObject();
+        json.Field("enabled", STATS_ENABLED);
+        for (size_t i = 0; i < counters.size(); i++)
+            json.Field(STAT_COUNTER_NAMES[i], counters[i]);
+        json.Key("path_length");
+        pathLength.WriteJson(json);
+        json.Key("bvh_depth");
+        bvhDepth.WriteJson(json);
+        json.Key("traversal_stack");
+        traversalStack.WriteJson(json);
+        json.Key("node_visits_log2");
+        nodeVisitsLog2.WriteJson(json);
+        json.EndObject();
+    }
+};
+
+namespace StatsDetail
+{
+    struct alignas(64) ThreadStats
+    {
+        RenderStats stats;
+
+        // state of the ray being traced
+        uint32_t depth = 0;
+        uint32_t rayMaxDepth = 0;
+        uint32_t rayMaxStack = 0;
+        uint64_t rayNodeVisits = 0;
+
+        void EndRay()
+        {
+            if (rayMaxDepth > 0)
+                stats.bvhDepth.Add(rayMaxDepth);
+            if (rayMaxStack > 0)
+                stats.traversalStack.Add(rayMaxStack);
+            stats.nodeVisitsLog2.Add(std::bit_width(rayNodeVisits));
+            depth = rayMaxDepth = rayMaxStack = 0;
+            rayNodeVisits = 0;
+        }
+    };
+
+    // All blocks ever handed out. They live until the program ends, so blocks of threads that
+    // exited can still be collected.
+    inline std::mutex registryMutex;
+    inline std::vector<std::unique_ptr<ThreadStats>> registry;
+
+    inline ThreadStats &Local()
+    {
+        static thread_local ThreadStats *local = []
+        {
+            std::lock_guard lock(registryMutex);
+            registry.push_back(std::make_unique<ThreadStats>());
+            return registry.back().get();
+        }();
+        return *local;
+    }
+
+    // Tracks the depth of a recursive BVH traversal.
+    struct DepthScope
+    {
+        ThreadStats &local;
+
+        DepthScope() : local(Local())
+        {
+            local.rayNodeVisits++;
+            local.stats.counters[static_cast<size_t>(StatCounter::NodeVisits)]++;
+            local.rayMaxDepth = std::max(local.rayMaxDepth, ++local.depth);
+        }
+
+        ~DepthScope()
+        {
+            local.depth--;
+        }
+    };
+}
+
+// Zeroes the counters of all threads. Must not run while other threads are tracing.
+inline void ResetRenderStats()
+{
+    std::lock_guard lock(StatsDetail::registryMutex);
+    for (auto &local : StatsDetail::registry)
+        local->stats = RenderStats{};
+}
+
+// Sums the counters of all threads. Must not run while other threads are tracing.
+inline RenderStats CollectRenderStats()
+{
+    RenderStats total;
+    std::lock_guard lock(StatsDetail::registryMutex);
+    for (const auto &local : StatsDetail::registry)
+        total.Merge(local->stats);
+    return total;
+}
+
+#ifdef RT_STATS
+#define STATS_COUNT(counter) (StatsDetail::Local().stats.counters[static_cast<size_t>(StatCounter::counter)]++)
+// a node of a stack based traversal; stackSize is the stack size before the node was popped
+#define STATS_NODE(stackSize)                                                                                  \
+    do                                                                                                         \
+    {                                                                                                          \
+        auto &statsLocal_ = StatsDetail::Local();                                                              \
+        statsLocal_.stats.counters[static_cast<size_t>(StatCounter::NodeVisits)]++;                            \
+        statsLocal_.rayNodeVisits++;                                                                           \
+        statsLocal_.rayMaxStack = std::max(statsLocal_.rayMaxStack, static_cast<uint32_t>(stackSize));        \
+    } while (0)
+// a node of a recursive traversal; counts until the end of the enclosing scope
+#define STATS_RECURSIVE_NODE() StatsDetail::DepthScope statsDepthScope_
+// closes the per ray counts of a ray traced by the renderer
+#define STATS_END_RAY() StatsDetail::Local().EndRay()
+#define STATS_PATH_LENGTH(length) StatsDetail::Local().stats.pathLength.Add(length)
+#else
+#define STATS_COUNT(counter) ((void)0)
+#define STATS_NODE(stackSize) ((void)0)
+#define STATS_RECURSIVE_NODE() ((void)0)
+#define STATS_END_RAY() ((void)0)
+#define STATS_PATH_LENGTH(length) ((void)0)
+#endif
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "io/json_writer.h"
+
+// Scoped timers that record what ran when on which thread, exported as Chrome trace event
+// JSON (chrome://tracing, ui.perfetto.dev).
+//
+//   Trace::Start();
+//   { TRACE_SCOPE("BuildScene"); ... }
+//   Trace::Save("trace.json");
+//
+// Until Start is called a scope costs one relaxed atomic load. Recorded events go into a
+// buffer per thread, so recording does not lock either. Names must be string literals or
+// otherwise outlive the trace.
+namespace Trace
+{
+    struct Event
+    {
+        const char *name;
+        const char *category;
+        int64_t start;
+        int64_t duration;
+    };
+
+    namespace Detail
+    {
+        inline std::atomic<bool> enabled{false};
+        inline std::chrono::steady_clock::time_point epoch;
+
+        struct ThreadBuffer
+        {
+            uint32_t threadId;
+            std::string name;
+            std::vector<Event> events;
+        };
+
+        // All buffers ever handed out; they outlive their threads so Save can still read them.
+        inline std::mutex registryMutex;
+        inline std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+        inline ThreadBuffer &Local()
+        {
+            static thread_local ThreadBuffer *local = []
+            {
+                std::lock_guard lock(registryMutex);
+                registry.push_back(std::make_unique<ThreadBuffer>());
+                registry.back()->threadId = static_cast<uint32_t>(registry.size());
+                registry.back()->name = "thread " + std::to_string(registry.size());
+                return registry.back().get();
+            }();
+            return *local;
+        }
+
+        inline int64_t Now()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+        }
+    }
+
+    inline bool Enabled()
+    {
+        return Detail::enabled.load(std::memory_order_relaxed);
+    }
+
+    // Drops earlier events and starts recording. Call it before the traced threads run.
+    inline void Start()
+    {
+        std::lock_guard lock(Detail::registryMutex);
+        for (auto &buffer : Detail::registry)
+            buffer->events.clear();
+        Detail::epoch = std::chrono::steady_clock::now();
+        Detail::enabled.store(true);
+    }
+
+    inline void Stop()
+    {
+        Detail::enabled.store(false);
+    }
+
+    // Name of the calling thread in the trace viewer.
+    inline void SetThreadName(const std::string &name)
+    {
+        auto &local = Detail::Local();
+        std::lock_guard lock(Detail::registryMutex);
+        local.name = name;
+    }
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name, const char *category = "render")
+            : name(name), category(category), start(Enabled() ? Detail::Now() : -1)
+        {
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        ~Scope()
+        {
+            if (start >= 0 && Enabled())
+                Detail::Local().events.push_back(Event{name, category, start, Detail::Now() - start});
+        }
+
+    private:
+        const char *name;
+        const char *category;
+        int64_t start;
+    };
+
+    // Writes all recorded events. Must not run while traced threads are still recording.
+    inline void Save(const std::string &filename)
+    {
+        JsonWriter json(false);
+        json.BeginObject();
+        json.Field("displayTimeUnit", "ms");
+        json.Key("traceEvents").BeginArray();
+
+        std::lock_guard lock(Detail::registryMutex);
+        for (const auto &buffer : Detail::registry)
+        {
+            if (buffer->events.empty())
+                continue;
+
+            json.BeginObject();
+            json.Field("name", "thread_name").Field("ph", "M").Field("pid", 1).Field("tid", buffer->threadId);
+            json.Key("args").BeginObject().Field("name", buffer->name).EndObject();
+            json.EndObject();
+
+            for (const auto &event : buffer->events)
+            {
+                json.BeginObject();
+                json.Field("name", event.name).Field("cat", event.category).Field("ph", "X");
+                json.Field("ts", event.start).Field("dur", event.duration);
+                json.Field("pid", 1).Field("tid", buffer->threadId);
+                json.EndObject();
+            }
+        }
+
+        json.EndArray();
+        json.EndObject();
+        json.Save(filename);
+    }
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(...) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(__VA_ARGS__)
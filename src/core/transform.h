@@ -277,6 +277,21 @@ public:
         return FromRotateRadZ(angle * DegToRad);
     }
 
+    // Component-wise interpolation between two matrices. Exact for translation and scale,
+    // an approximation for rotations (good for small angles between the two keys).
+    static Transform Lerp(const Transform &a, const Transform &b, double t)
+    {
+        std::array<std::array<double, 4>, 4> matrix;
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                matrix[i][j] = a.m[i][j] + t * (b.m[i][j] - a.m[i][j]);
+            }
+        }
+        return Transform(matrix);
+    }
+
     // Rotate around arbitrary axis
     static Transform FromRotateRad(double angle, const Vector3 &axis)
     {
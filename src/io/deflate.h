@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+// Self-contained zlib stream compressor (RFC 1950/1951) for the PNG writer: LZ77 with hash
+// chains and the fixed Huffman code, so no code tables have to be built or transmitted.
+// This compresses filtered image rows to roughly what zlib's fastest levels reach.
+
+inline uint32_t Crc32(std::span<const uint8_t> data, uint32_t crc = 0)
+{
+    static const auto table = []
+    {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (uint8_t byte : data)
+        crc = table[(crc ^ byte) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline uint32_t Adler32(std::span<const uint8_t> data, uint32_t adler = 1)
+{
+    constexpr uint32_t MOD = 65521;
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    // 5552 bytes is the most that can be summed before the 32-bit sums may overflow
+    while (!data.empty())
+    {
+        const size_t n = std::min<size_t>(data.size(), 5552);
+        for (size_t i = 0; i < n; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= MOD;
+        b %= MOD;
+        data = data.subspan(n);
+    }
+    return (b << 16) | a;
+}
+
+// Streaming zlib compressor. Feed data with Write, take finished bytes with TakeOutput, and
+// end the stream with Finish. Keeps a 32 KB window plus one maximal match of lookahead.
+class DeflateStream
+{
+public:
+    explicit DeflateStream(int maxChainLength = 32) : maxChain(maxChainLength)
+    {
+        head.fill(NONE);
+        prev.fill(NONE);
+        // zlib header: deflate with a 32 KB window, no dictionary; 0x7801 is a multiple of 31
+        output.push_back(0x78);
+        output.push_back(0x01);
+        // one fixed Huffman block for the whole stream, marked final
+        PutBits(1, 1);
+        PutBits(1, 2);
+    }
+
+    void Write(std::span<const uint8_t> data)
+    {
+        adler = Adler32(data, adler);
+        buffer.insert(buffer.end(), data.begin(), data.end());
+        Compress(false);
+    }
+
+    // Flushes everything, ends the block and appends the checksum.
+    void Finish()
+    {
+        Compress(true);
+        PutCode(FixedLiteralCode(256));
+        if (bitCount > 0)
+        {
+            output.push_back(static_cast<uint8_t>(bitBuffer));
+            bitBuffer = 0;
+            bitCount = 0;
+        }
+        for (int shift = 24; shift >= 0; shift -= 8)
+            output.push_back(static_cast<uint8_t>(adler >> shift));
+    }
+
+    // Moves the complete bytes produced so far into out.
+    void TakeOutput(std::vector<uint8_t> &out)
+    {
+        out.insert(out.end(), output.begin(), output.end());
+        output.clear();
+    }
+
+    size_t PendingOutput() const { return output.size(); }
+
+private:
+    static constexpr size_t WINDOW = 1 << 15;
+    static constexpr size_t MIN_MATCH = 3;
+    static constexpr size_t MAX_MATCH = 258;
+    static constexpr size_t HASH_SIZE = 1 << 15;
+    static constexpr int64_t NONE = -1;
+
+    struct Code
+    {
+        uint32_t bits;
+        int length;
+    };
+
+    int maxChain;
+    std::vector<uint8_t> output;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+    uint32_t adler = 1;
+
+    // buffer[i] is stream position base + i; holds the window and the data not yet compressed
+    std::vector<uint8_t> buffer;
+    int64_t base = 0;
+    int64_t position = 0;
+    // most recent position of each 3-byte hash, and the previous one with the same hash
+    std::array<int64_t, HASH_SIZE> head;
+    std::array<int64_t, WINDOW> prev;
+
+    void PutBits(uint32_t bits, int count)
+    {
+        bitBuffer |= uint64_t(bits) << bitCount;
+        bitCount += count;
+        while (bitCount >= 8)
+        {
+            output.push_back(static_cast<uint8_t>(bitBuffer));
+            bitBuffer >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    // Huffman codes are sent most significant bit first, unlike everything else
+    void PutCode(Code code)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < code.length; i++)
+            reversed |= ((code.bits >> i) & 1) << (code.length - 1 - i);
+        PutBits(reversed, code.length);
+    }
+
+    static Code FixedLiteralCode(uint32_t symbol)
+    {
+        if (symbol < 144)
+            return {0x30 + symbol, 8};
+        if (symbol < 256)
+            return {0x190 + symbol - 144, 9};
+        if (symbol < 280)
+            return {symbol - 256, 7};
+        return {0xc0 + symbol - 280, 8};
+    }
+
+    void PutLiteral(uint8_t byte)
+    {
+        PutCode(FixedLiteralCode(byte));
+    }
+
+    void PutMatch(size_t length, size_t distance)
+    {
+        static constexpr uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                     35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static constexpr uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                                       193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                                       6145, 8193, 12289, 16385, 24577};
+        static constexpr uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                                       6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        int l = 28;
+        while (LENGTH_BASE[l] > length)
+            l--;
+        PutCode(FixedLiteralCode(257 + l));
+        PutBits(static_cast<uint32_t>(length - LENGTH_BASE[l]), LENGTH_EXTRA[l]);
+
+        int d = 29;
+        while (DISTANCE_BASE[d] > distance)
+            d--;
+        PutCode({static_cast<uint32_t>(d), 5});
+        PutBits(static_cast<uint32_t>(distance - DISTANCE_BASE[d]), DISTANCE_EXTRA[d]);
+    }
+
+    uint8_t At(int64_t pos) const { return buffer[pos - base]; }
+
+    size_t Hash(int64_t pos) const
+    {
+        const uint32_t v = uint32_t(At(pos)) | uint32_t(At(pos + 1)) << 8 | uint32_t(At(pos + 2)) << 16;
+        return (v * 2654435761u) >> (32 - 15);
+    }
+
+    void Insert(int64_t pos)
+    {
+        const size_t h = Hash(pos);
+        prev[pos & (WINDOW - 1)] = head[h];
+        head[h] = pos;
+    }
+
+    void Compress(bool flush)
+    {
+        const int64_t end = base + static_cast<int64_t>(buffer.size());
+        // keep a full match of lookahead unless the stream ends
+        const int64_t limit = flush ? end : end - static_cast<int64_t>(MAX_MATCH);
+
+        while (position < limit)
+        {
+            const int64_t available = end - position;
+            size_t bestLength = 0, bestDistance = 0;
+
+            if (available >= static_cast<int64_t>(MIN_MATCH))
+            {
+                const size_t maxLength = std::min<size_t>(MAX_MATCH, available);
+                int64_t candidate = head[Hash(position)];
+                for (int chain = 0; candidate != NONE && chain < maxChain; chain++)
+                {
+                    if (position - candidate > static_cast<int64_t>(WINDOW) || candidate < base)
+                        break;
+                    const uint8_t *a = &buffer[candidate - base];
+                    const uint8_t *b = &buffer[position - base];
+                    size_t length = 0;
+                    while (length < maxLength && a[length] == b[length])
+                        length++;
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = static_cast<size_t>(position - candidate);
+                        if (length == maxLength)
+                            break;
+                    }
+                    candidate = prev[candidate & (WINDOW - 1)];
+                }
+            }
+
+            if (bestLength >= MIN_MATCH)
+            {
+                PutMatch(bestLength, bestDistance);
+                for (size_t i = 0; i < bestLength; i++, position++)
+                {
+                    if (end - position >= static_cast<int64_t>(MIN_MATCH))
+                        Insert(position);
+                }
+            }
+            else
+            {
+                PutLiteral(At(position));
+                if (available >= static_cast<int64_t>(MIN_MATCH))
+                    Insert(position);
+                position++;
+            }
+        }
+
+        // drop what has fallen out of the window
+        const int64_t keepFrom = std::max<int64_t>(base, position - static_cast<int64_t>(WINDOW));
+        if (keepFrom - base >= static_cast<int64_t>(WINDOW))
+        {
+            buffer.erase(buffer.begin(), buffer.begin() + (keepFrom - base));
+            base = keepFrom;
+        }
+    }
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "io/row_sink.h"
+
+// OpenEXR scanline file without compression, readable by any EXR reader. Every scanline is its
+// own chunk of known size, so the line offset table is written first and each row goes to its
+// final place as soon as it arrives. Half floats halve the size and keep about three decimal
+// digits over the whole range a render produces.
+enum class ExrPixelType
+{
+    Half,
+    Float,
+};
+
+// IEEE 754 binary16 from binary32, rounding to nearest even. Too large values become infinity.
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const int exponent = static_cast<int>((bits >> 23) & 0xff);
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // infinity stays infinity, NaN stays a (quiet) NaN
+    if (exponent == 255)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+    const int halfExponent = exponent - 127 + 15;
+    if (halfExponent >= 31)
+        return sign | 0x7c00;
+
+    if (halfExponent <= 0)
+    {
+        // subnormal half, or zero when even rounding cannot reach the smallest one
+        if (halfExponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        const int shift = 14 - halfExponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return sign | static_cast<uint16_t>(half);
+    }
+
+    // a carry out of the mantissa correctly moves on to the next exponent, or to infinity
+    uint32_t half = (uint32_t(halfExponent) << 10) | (mantissa >> 13);
+    const uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | static_cast<uint16_t>(half);
+}
+
+class ExrWriter : public ImageWriter
+{
+public:
+    ExrWriter(const std::string &filename, int width, int height, ExrPixelType pixelType = ExrPixelType::Half)
+        : width(width), height(height), pixelType(pixelType), file(filename)
+    {
+        std::vector<uint8_t> header;
+        auto put32 = [&](uint32_t v)
+        {
+            for (int i = 0; i < 4; i++)
+                header.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        };
+        auto putFloat = [&](float v)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            put32(bits);
+        };
+        auto putString = [&](std::string_view s)
+        {
+            header.insert(header.end(), s.begin(), s.end());
+            header.push_back(0);
+        };
+        auto attribute = [&](std::string_view name, std::string_view type, uint32_t size)
+        {
+            putString(name);
+            putString(type);
+            put32(size);
+        };
+        auto box = [&](std::string_view name)
+        {
+            attribute(name, "box2i", 16);
+            put32(0);
+            put32(0);
+            put32(static_cast<uint32_t>(width - 1));
+            put32(static_cast<uint32_t>(height - 1));
+        };
+
+        put32(20000630); // magic number
+        put32(2);        // version 2, single part scanline file
+
+        // channels are stored in alphabetical order
+        attribute("channels", "chlist", 3 * 18 + 1);
+        for (const char *channel : {"B", "G", "R"})
+        {
+            putString(channel);
+            put32(pixelType == ExrPixelType::Half ? 1 : 2);
+            put32(0); // pLinear and reserved
+            put32(1); // x sampling
+            put32(1); // y sampling
+        }
+        header.push_back(0);
+
+        attribute("compression", "compression", 1);
+        header.push_back(0); // NO_COMPRESSION
+        box("dataWindow");
+        box("displayWindow");
+        attribute("lineOrder", "lineOrder", 1);
+        header.push_back(0); // INCREASING_Y
+        attribute("pixelAspectRatio", "float", 4);
+        putFloat(1.0f);
+        attribute("screenWindowCenter", "v2f", 8);
+        putFloat(0.0f);
+        putFloat(0.0f);
+        attribute("screenWindowWidth", "float", 4);
+        putFloat(1.0f);
+        header.push_back(0); // end of header
+
+        // line offset table: chunk y starts after the table and y earlier chunks
+        dataStart = header.size() + uint64_t(height) * 8;
+        for (int y = 0; y < height; y++)
+        {
+            const uint64_t offset = ChunkOffset(y);
+            put32(static_cast<uint32_t>(offset));
+            put32(static_cast<uint32_t>(offset >> 32));
+        }
+        file.WriteAt(0, header.data(), header.size());
+    }
+
+    std::vector<uint8_t> EncodeRow(int y, const Vector3 *row) override
+    {
+        const size_t sampleSize = pixelType == ExrPixelType::Half ? 2 : 4;
+        std::vector<uint8_t> chunk(8 + 3 * size_t(width) * sampleSize);
+        auto put32 = [&](uint8_t *out, uint32_t v)
+        {
+            for (int i = 0; i < 4; i++)
+                out[i] = static_cast<uint8_t>(v >> (8 * i));
+        };
+        put32(&chunk[0], static_cast<uint32_t>(y));
+        put32(&chunk[4], static_cast<uint32_t>(chunk.size() - 8));
+
+        // within a chunk each channel's samples follow each other: all B, then all G, then all R
+        uint8_t *out = chunk.data() + 8;
+        for (int c = 2; c >= 0; c--)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const float value = static_cast<float>(row[x][c]);
+                if (pixelType == ExrPixelType::Half)
+                {
+                    const uint16_t half = FloatToHalf(value);
+                    out[0] = static_cast<uint8_t>(half);
+                    out[1] = static_cast<uint8_t>(half >> 8);
+                }
+                else
+                {
+                    uint32_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    put32(out, bits);
+                }
+                out += sampleSize;
+            }
+        }
+
+        return chunk;
+    }
+
+    void StoreRow(int y, std::vector<uint8_t> data) override
+    {
+        file.WriteAt(ChunkOffset(y), data.data(), data.size());
+    }
+
+    void Close() override
+    {
+        file.Close();
+    }
+
+private:
+    int width, height;
+    ExrPixelType pixelType;
+    uint64_t dataStart = 0;
+    PositionalFile file;
+
+    uint64_t ChunkOffset(int y) const
+    {
+        const uint64_t sampleSize = pixelType == ExrPixelType::Half ? 2 : 4;
+        return dataStart + uint64_t(y) * (8 + 3 * uint64_t(width) * sampleSize);
+    }
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "core/pixel_cost.h"
+#include "core/stats.h"
+#include "io/image.h"
+
+// Turbo colormap (Anton Mikhailov, Google 2019), polynomial approximation. t in [0, 1], blue over green to red.
+inline Color TurboColor(double t)
+{
+    t = std::clamp(t, 0.0, 1.0);
+    const double t2 = t * t, t3 = t2 * t, t4 = t3 * t, t5 = t4 * t;
+    const double r = 0.13572138 + 4.61539260 * t - 42.66032258 * t2 + 132.13108234 * t3 - 152.94239396 * t4 + 59.28637943 * t5;
+    const double g = 0.09140261 + 2.19418839 * t + 4.84296658 * t2 - 14.18503333 * t3 + 4.27729857 * t4 + 2.82956604 * t5;
+    const double b = 0.10667330 + 12.64194608 * t - 60.58204836 * t2 + 110.36276771 * t3 - 89.90310912 * t4 + 27.34824973 * t5;
+    return Color(std::clamp(r, 0.0, 1.0), std::clamp(g, 0.0, 1.0), std::clamp(b, 0.0, 1.0));
+}
+
+// Writes values (one per pixel, row by row from the top) as a false color BMP. The colors run
+// from 0 to the 99th percentile, so a few very expensive pixels do not flatten the rest;
+// everything above it is red. Returns that value.
+inline uint64_t SaveHeatmap(std::span<const uint64_t> values, int width, int height, const std::string &filename)
+{
+    if (values.size() != size_t(width) * height)
+        throw std::invalid_argument("SaveHeatmap: value count does not match the image size.");
+
+    std::vector<uint64_t> sorted(values.begin(), values.end());
+    const size_t rank = sorted.empty() ? 0 : (sorted.size() - 1) * 99 / 100;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    const uint64_t scale = sorted.empty() ? 0 : std::max<uint64_t>(sorted[rank], 1);
+
+    Image image(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+            image.pixels[y][x] = TurboColor(static_cast<double>(values[size_t(y) * width + x]) / scale);
+    }
+    SaveBmp(image, filename);
+    return scale;
+}
+
+// Writes the cost maps next to the image file: name_cycles.bmp, and with RT_STATS also
+// name_nodes.bmp and name_primitives.bmp.
+inline void SaveCostHeatmaps(const PixelCostMap &costs, const std::string &imageFile)
+{
+    const size_t dot = imageFile.find_last_of('.');
+    const std::string stem = dot == std::string::npos ? imageFile : imageFile.substr(0, dot);
+
+    auto save = [&](const std::vector<uint64_t> &values, const std::string &suffix, const char *unit)
+    {
+        const std::string file = stem + suffix;
+        const uint64_t scale = SaveHeatmap(values, costs.width, costs.height, file);
+        fmt::println("Heatmap saved to {} (red = {} {} per pixel)", file, scale, unit);
+    };
+
+    save(costs.cycles, "_cycles.bmp", "cycles");
+    if (STATS_ENABLED)
+    {
+        save(costs.nodeVisits, "_nodes.bmp", "node visits");
+        save(costs.primitiveTests, "_primitives.bmp", "primitive tests");
+    }
+}
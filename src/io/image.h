@@ -5,6 +5,8 @@
 #include <vector>
 #include <iostream>
 #include "core/vector3.h"
+#include "core/trace.h"
+#include "io/tonemap.h"
 
 struct Image
 {
@@ -30,22 +32,11 @@ struct Image
     }
 };
 
-inline double LinearTosRGB(double x)
+// Write a 24-bit BMP file (no compression). The file is assembled in memory, with the pixels
+// converted in parallel, and written in one go.
+void SaveBmp(const Image &image, const std::string &filename, const TonemapSettings &settings)
 {
-    if (x <= 0.0031308)
-        return 12.92 * x;
-    else
-        return 1.055 * std::pow(x, 1.0 / 2.4) - 0.055;
-}
-
-// Write a 24-bit BMP file (no compression)
-void SaveBmp(const Image &image, const std::string &filename, bool convertToSRGB = false)
-{
-    std::ofstream ofs(filename, std::ios::binary);
-    if (!ofs)
-    {
-        throw std::runtime_error("Cannot open file for writing: " + filename);
-    }
+    TRACE_SCOPE("SaveBmp", "io");
 
     int width = image.width;
     int height = image.height;
@@ -55,34 +46,21 @@ void SaveBmp(const Image &image, const std::string &filename, bool convertToSRGB
     int dataSize = rowSize * height;
     int fileSize = 54 + dataSize;
 
-    // BMP file header (14 bytes)
-    uint8_t fileHeader[14] = {
-        'B', 'M',   // Signature
-        0, 0, 0, 0, // File size (will fill later)
-        0, 0,       // Reserved
-        0, 0,       // Reserved
-        54, 0, 0, 0 // Pixel data offset
-    };
+    std::vector<uint8_t> file(fileSize, 0);
+    uint8_t *fileHeader = file.data();
+    uint8_t *dibHeader = file.data() + 14;
 
+    // BMP file header (14 bytes)
+    fileHeader[0] = 'B'; // Signature
+    fileHeader[1] = 'M';
     fileHeader[2] = (uint8_t)(fileSize);
     fileHeader[3] = (uint8_t)(fileSize >> 8);
     fileHeader[4] = (uint8_t)(fileSize >> 16);
     fileHeader[5] = (uint8_t)(fileSize >> 24);
+    fileHeader[10] = 54; // Pixel data offset
 
-    // DIB header (BITMAPINFOHEADER, 40 bytes)
-    uint8_t dibHeader[40] = {
-        40, 0, 0, 0, // Header size
-        0, 0, 0, 0,  // Width (fill later)
-        0, 0, 0, 0,  // Height (fill later)
-        1, 0,        // Color planes
-        24, 0,       // Bits per pixel
-        0, 0, 0, 0,  // Compression (0 = none)
-        0, 0, 0, 0,  // Image size (can be 0)
-        0, 0, 0, 0,  // X pixels per meter (optional)
-        0, 0, 0, 0,  // Y pixels per meter (optional)
-        0, 0, 0, 0,  // Colors in color table (0 = default)
-        0, 0, 0, 0   // Important colors (0 = all)
-    };
+    // DIB header (BITMAPINFOHEADER, 40 bytes); compression, sizes and color table stay 0
+    dibHeader[0] = 40; // Header size
 
     dibHeader[4] = (uint8_t)(width);
     dibHeader[5] = (uint8_t)(width >> 8);
@@ -94,44 +72,30 @@ void SaveBmp(const Image &image, const std::string &filename, bool convertToSRGB
     dibHeader[10] = (uint8_t)(height >> 16);
     dibHeader[11] = (uint8_t)(height >> 24);
 
-    // Write headers
-    ofs.write(reinterpret_cast<char *>(fileHeader), 14);
-    ofs.write(reinterpret_cast<char *>(dibHeader), 40);
+    dibHeader[12] = 1;  // Color planes
+    dibHeader[14] = 24; // Bits per pixel
 
-    // Write pixel data (BGR format, bottom-up)
-    std::vector<uint8_t> padding(rowSize - 3 * width, 0);
+    // Pixel data in BGR order, bottom-up: image row 0 is the last row of the file
+    uint8_t *lastRow = file.data() + 54 + size_t(height - 1) * rowSize;
+    Tonemap(image.pixels, width, height, lastRow, -rowSize, settings, ChannelOrder::BGR);
 
-    for (int y = height - 1; y >= 0; --y)
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
     {
-        for (int x = 0; x < width; ++x)
-        {
-            auto clamp = [](float c) -> uint8_t
-            {
-                if (c < 0.0f)
-                    return 0;
-                if (c > 1.0f)
-                    return 255;
-                return static_cast<uint8_t>(c * 255.0f);
-            };
-
-            uint8_t r = clamp(convertToSRGB ? LinearTosRGB(image.pixels[y][x].x()) : image.pixels[y][x].x());
-            uint8_t g = clamp(convertToSRGB ? LinearTosRGB(image.pixels[y][x].y()) : image.pixels[y][x].y());
-            uint8_t b = clamp(convertToSRGB ? LinearTosRGB(image.pixels[y][x].z()) : image.pixels[y][x].z());
-
-            // BMP uses BGR order
-            ofs.put(b);
-            ofs.put(g);
-            ofs.put(r);
-        }
-        ofs.write(reinterpret_cast<char *>(padding.data()), padding.size());
+        throw std::runtime_error("Cannot open file for writing: " + filename);
     }
 
+    ofs.write(reinterpret_cast<const char *>(file.data()), file.size());
+
     if (!ofs)
     {
         throw std::runtime_error("Failed to write BMP data to file: " + filename);
     }
+}
 
-    ofs.close();
+void SaveBmp(const Image &image, const std::string &filename, bool convertToSRGB = false)
+{
+    SaveBmp(image, filename, TonemapSettings{.srgb = convertToSRGB});
 }
 
 void SaveBmp_sRGB(const Image &image, const std::string &filename)
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "core/trace.h"
+#include "io/exr_writer.h"
+#include "io/image.h"
+#include "io/output_pipeline.h"
+#include "io/pfm_writer.h"
+#include "io/png_writer.h"
+#include "io/row_sink.h"
+#include "io/tonemap.h"
+
+// 24-bit BMP written row by row: the file size is known up front, so each row goes straight
+// to its place in the bottom-up pixel data.
+class BmpWriter : public ImageWriter
+{
+public:
+    BmpWriter(const std::string &filename, int width, int height, const TonemapSettings &settings = {})
+        : width(width), height(height), rowSize((3 * width + 3) & ~3), settings(settings), file(filename)
+    {
+        const uint32_t fileSize = 54 + uint32_t(rowSize) * height;
+        uint8_t header[54] = {};
+        auto put32 = [&](int offset, uint32_t v)
+        {
+            for (int i = 0; i < 4; i++)
+                header[offset + i] = static_cast<uint8_t>(v >> (8 * i));
+        };
+        header[0] = 'B';
+        header[1] = 'M';
+        put32(2, fileSize);
+        header[10] = 54; // pixel data offset
+        header[14] = 40; // BITMAPINFOHEADER size
+        put32(18, static_cast<uint32_t>(width));
+        put32(22, static_cast<uint32_t>(height));
+        header[26] = 1;  // color planes
+        header[28] = 24; // bits per pixel
+        file.WriteAt(0, header, sizeof(header));
+    }
+
+    std::vector<uint8_t> EncodeRow(int y, const Vector3 *row) override
+    {
+        std::vector<uint8_t> data(rowSize, 0);
+        TonemapRow(row, width, y, data.data(), settings, ChannelOrder::BGR);
+        return data;
+    }
+
+    void StoreRow(int y, std::vector<uint8_t> data) override
+    {
+        file.WriteAt(54 + uint64_t(height - 1 - y) * rowSize, data.data(), data.size());
+    }
+
+    void Close() override
+    {
+        file.Close();
+    }
+
+private:
+    int width, height, rowSize;
+    TonemapSettings settings;
+    PositionalFile file;
+};
+
+// Picks the writer from the file extension: .bmp and .png are tonemapped with settings, .pfm
+// and .exr keep the linear float values.
+inline std::unique_ptr<ImageWriter> CreateImageWriter(const std::string &filename, int width, int height, const TonemapSettings &settings = {})
+{
+    const size_t dot = filename.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : filename.substr(dot + 1);
+    std::ranges::transform(extension, extension.begin(), [](unsigned char c)
+                           { return static_cast<char>(std::tolower(c)); });
+
+    if (extension == "bmp")
+        return std::make_unique<BmpWriter>(filename, width, height, settings);
+    if (extension == "png")
+        return std::make_unique<PngWriter>(filename, width, height, settings);
+    if (extension == "pfm")
+        return std::make_unique<PfmWriter>(filename, width, height);
+    if (extension == "exr")
+        return std::make_unique<ExrWriter>(filename, width, height);
+    throw std::invalid_argument("Unsupported image format: " + filename + " (use .bmp, .png, .pfm or .exr)");
+}
+
+// Writes a finished image in the format given by the file extension, encoding rows in parallel.
+inline void SaveImage(const Image &image, const std::string &filename, const TonemapSettings &settings = {})
+{
+    TRACE_SCOPE("SaveImage", "io");
+    OutputPipeline pipeline(CreateImageWriter(filename, image.width, image.height, settings));
+    for (int y = 0; y < image.height; y++)
+        pipeline.WriteRow(y, image.pixels[y]);
+    pipeline.Finish();
+}
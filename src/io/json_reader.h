@@ -0,0 +1,384 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Minimal streaming JSON reader, the counterpart of JsonWriter. It pulls one value at a time
+// from a stream, so a document is never held in memory as a whole; the caller walks the
+// structure it expects and skips what it does not know.
+//
+//   JsonReader json(stream);
+//   json.BeginObject();
+//   std::string key;
+//   while (json.NextKey(key))
+//   {
+//       if (key == "width")
+//           width = json.ReadInt();
+//       else
+//           json.Skip();
+//   }
+//
+// Characters come straight from the stream buffer, and keys and numbers are read into
+// buffers that are reused, so reading a long array of small objects hardly allocates.
+//
+// Malformed input throws std::runtime_error naming the line and column.
+class JsonReader
+{
+public:
+    enum class Type
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object,
+    };
+
+    explicit JsonReader(std::istream &in) : in(*in.rdbuf()) {}
+
+    // Type of the next value, without reading it.
+    Type Peek()
+    {
+        SkipWhitespace();
+        const int c = in.sgetc();
+        switch (c)
+        {
+        case '{':
+            return Type::Object;
+        case '[':
+            return Type::Array;
+        case '"':
+            return Type::String;
+        case 't':
+        case 'f':
+            return Type::Bool;
+        case 'n':
+            return Type::Null;
+        default:
+            if (c == '-' || (c >= '0' && c <= '9'))
+                return Type::Number;
+            Fail(c == EOF ? "unexpected end of input" : std::string("unexpected character '") + char(c) + "'");
+        }
+    }
+
+    void BeginObject()
+    {
+        Expect('{');
+        first.push_back(true);
+    }
+
+    // Reads the next member's key. Returns false, and leaves the object, at its closing brace.
+    bool NextKey(std::string &key)
+    {
+        if (!NextMember('}'))
+            return false;
+        ReadString(key);
+        Expect(':');
+        return true;
+    }
+
+    void BeginArray()
+    {
+        Expect('[');
+        first.push_back(true);
+    }
+
+    // Moves to the next element. Returns false, and leaves the array, at its closing bracket.
+    bool NextElement()
+    {
+        return NextMember(']');
+    }
+
+    std::string ReadString()
+    {
+        std::string value;
+        ReadString(value);
+        return value;
+    }
+
+    // Into value, reusing its capacity.
+    void ReadString(std::string &value)
+    {
+        Expect('"');
+        value.clear();
+        while (true)
+        {
+            int c = Get();
+            if (c == '"')
+                return;
+            if (c == EOF)
+                Fail("unterminated string");
+            if (c < 0x20)
+                Fail("control character in string");
+            if (c != '\\')
+            {
+                value += char(c);
+                continue;
+            }
+
+            c = Get();
+            switch (c)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                value += char(c);
+                break;
+            case 'b':
+                value += '\b';
+                break;
+            case 'f':
+                value += '\f';
+                break;
+            case 'n':
+                value += '\n';
+                break;
+            case 'r':
+                value += '\r';
+                break;
+            case 't':
+                value += '\t';
+                break;
+            case 'u':
+                AppendUtf8(value, ReadCodePoint());
+                break;
+            default:
+                Fail("invalid escape sequence");
+            }
+        }
+    }
+
+    double ReadNumber()
+    {
+        const std::string &text = NumberText();
+        double value = 0.0;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end != text.data() + text.size())
+            Fail("invalid number '" + text + "'");
+        return value;
+    }
+
+    // A number that must be an integer, such as a count or a seed.
+    int64_t ReadInt()
+    {
+        const std::string &text = NumberText();
+        int64_t value = 0;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc() || end != text.data() + text.size())
+            Fail("expected an integer, got '" + text + "'");
+        return value;
+    }
+
+    bool ReadBool()
+    {
+        SkipWhitespace();
+        if (in.sgetc() == 't')
+        {
+            Literal("true");
+            return true;
+        }
+        Literal("false");
+        return false;
+    }
+
+    void ReadNull()
+    {
+        SkipWhitespace();
+        Literal("null");
+    }
+
+    // Reads and discards the next value, however deeply nested.
+    void Skip()
+    {
+        switch (Peek())
+        {
+        case Type::Object:
+        {
+            BeginObject();
+            std::string key;
+            while (NextKey(key))
+                Skip();
+            break;
+        }
+        case Type::Array:
+            BeginArray();
+            while (NextElement())
+                Skip();
+            break;
+        case Type::String:
+            ReadString();
+            break;
+        case Type::Number:
+            NumberText();
+            break;
+        case Type::Bool:
+            ReadBool();
+            break;
+        case Type::Null:
+            ReadNull();
+            break;
+        }
+    }
+
+    // Requires that nothing but whitespace follows the document.
+    void ExpectEnd()
+    {
+        SkipWhitespace();
+        if (in.sgetc() != EOF)
+            Fail("unexpected data after the document");
+    }
+
+    // Throws a std::runtime_error with the current position, for errors found by the caller,
+    // such as a member of the wrong type.
+    [[noreturn]] void Fail(const std::string &message) const
+    {
+        throw std::runtime_error("JSON line " + std::to_string(line) + " column " + std::to_string(column) + ": " + message);
+    }
+
+private:
+    std::streambuf &in;
+    // per open object or array: whether no member has been read yet, so no comma is due
+    std::vector<bool> first;
+    // text of the last number
+    std::string number;
+    int line = 1;
+    int column = 1;
+
+    int Get()
+    {
+        const int c = in.sbumpc();
+        if (c == '\n')
+        {
+            line++;
+            column = 1;
+        }
+        else if (c != EOF)
+        {
+            column++;
+        }
+        return c;
+    }
+
+    void SkipWhitespace()
+    {
+        int c = in.sgetc();
+        while (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            Get();
+            c = in.sgetc();
+        }
+    }
+
+    void Expect(char expected)
+    {
+        SkipWhitespace();
+        const int c = Get();
+        if (c != expected)
+            Fail(std::string("expected '") + expected + "'" + (c == EOF ? ", got the end of input" : std::string(", got '") + char(c) + "'"));
+    }
+
+    void Literal(const char *word)
+    {
+        for (const char *p = word; *p; p++)
+        {
+            if (Get() != *p)
+                Fail(std::string("expected ") + word);
+        }
+    }
+
+    bool NextMember(char close)
+    {
+        if (first.empty())
+            Fail("not inside an object or array");
+        SkipWhitespace();
+        if (in.sgetc() == close)
+        {
+            Get();
+            first.pop_back();
+            return false;
+        }
+        if (!first.back())
+            Expect(',');
+        first.back() = false;
+        return true;
+    }
+
+    const std::string &NumberText()
+    {
+        SkipWhitespace();
+        number.clear();
+        int c = in.sgetc();
+        while (c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9'))
+        {
+            number += char(Get());
+            c = in.sgetc();
+        }
+        if (number.empty())
+            Fail("expected a number");
+        return number;
+    }
+
+    uint32_t ReadHex4()
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            const int c = Get();
+            value <<= 4;
+            if (c >= '0' && c <= '9')
+                value |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value |= c - 'A' + 10;
+            else
+                Fail("invalid \\u escape");
+        }
+        return value;
+    }
+
+    // The code point of a \u escape, joining UTF-16 surrogate pairs.
+    uint32_t ReadCodePoint()
+    {
+        const uint32_t high = ReadHex4();
+        if (high < 0xd800 || high > 0xdbff)
+            return high;
+        if (Get() != '\\' || Get() != 'u')
+            Fail("unpaired surrogate in \\u escape");
+        const uint32_t low = ReadHex4();
+        if (low < 0xdc00 || low > 0xdfff)
+            Fail("unpaired surrogate in \\u escape");
+        return 0x10000 + ((high - 0xd800) << 10) + (low - 0xdc00);
+    }
+
+    static void AppendUtf8(std::string &out, uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            out += char(codePoint);
+        }
+        else if (codePoint < 0x800)
+        {
+            out += char(0xc0 | codePoint >> 6);
+            out += char(0x80 | (codePoint & 0x3f));
+        }
+        else if (codePoint < 0x10000)
+        {
+            out += char(0xe0 | codePoint >> 12);
+            out += char(0x80 | (codePoint >> 6 & 0x3f));
+            out += char(0x80 | (codePoint & 0x3f));
+        }
+        else
+        {
+            out += char(0xf0 | codePoint >> 18);
+            out += char(0x80 | (codePoint >> 12 & 0x3f));
+            out += char(0x80 | (codePoint >> 6 & 0x3f));
+            out += char(0x80 | (codePoint & 0x3f));
+        }
+    }
+};
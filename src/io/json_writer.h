@@ -0,0 +1,182 @@
+#pragma once
+
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+#include "fmt/format.h"
+
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Minimal streaming JSON writer. Values are appended in document order; the writer only
+// tracks where commas go, it does not validate the structure.
+//
+//   JsonWriter json;
+//   json.BeginObject().Field("scene", "cornell_box").Key("rays").BeginArray() ... ;
+class JsonWriter
+{
+public:
+    // pretty: one member per line, indented by two spaces per level
+    explicit JsonWriter(bool pretty = true) : pretty(pretty) {}
+
+    JsonWriter &BeginObject() { return Open('{'); }
+    JsonWriter &EndObject() { return Close('}'); }
+    JsonWriter &BeginArray() { return Open('['); }
+    JsonWriter &EndArray() { return Close(']'); }
+
+    JsonWriter &Key(std::string_view key)
+    {
+        Separate();
+        WriteString(key);
+        out += pretty ? ": " : ":";
+        afterKey = true;
+        return *this;
+    }
+
+    JsonWriter &Value(std::string_view value)
+    {
+        Separate();
+        WriteString(value);
+        return *this;
+    }
+
+    JsonWriter &Value(const char *value) { return Value(std::string_view(value)); }
+    JsonWriter &Value(const std::string &value) { return Value(std::string_view(value)); }
+
+    JsonWriter &Value(bool value)
+    {
+        Separate();
+        out += value ? "true" : "false";
+        return *this;
+    }
+
+    JsonWriter &Value(std::nullptr_t)
+    {
+        Separate();
+        out += "null";
+        return *this;
+    }
+
+    template <std::integral T>
+    JsonWriter &Value(T value)
+    {
+        Separate();
+        fmt::format_to(std::back_inserter(out), "{}", value);
+        return *this;
+    }
+
+    // NaN and infinities have no JSON representation and are written as null.
+    JsonWriter &Value(double value)
+    {
+        Separate();
+        if (std::isfinite(value))
+            fmt::format_to(std::back_inserter(out), "{}", value);
+        else
+            out += "null";
+        return *this;
+    }
+
+    template <typename T>
+    JsonWriter &Field(std::string_view key, const T &value)
+    {
+        return Key(key).Value(value);
+    }
+
+    const std::string &String() const { return out; }
+
+    void Save(const std::string &filename) const
+    {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Cannot open file for writing: " + filename);
+        file << out << '\n';
+    }
+
+private:
+    std::string out;
+    // per open container: whether it has members yet
+    std::vector<bool> hasMembers;
+    bool afterKey = false;
+    bool pretty;
+
+    JsonWriter &Open(char bracket)
+    {
+        Separate();
+        out += bracket;
+        hasMembers.push_back(false);
+        return *this;
+    }
+
+    JsonWriter &Close(char bracket)
+    {
+        if (hasMembers.empty())
+            throw std::logic_error("JsonWriter: unbalanced close.");
+        const bool members = hasMembers.back();
+        hasMembers.pop_back();
+        if (members)
+            NewLine();
+        out += bracket;
+        return *this;
+    }
+
+    // comma and indentation in front of the next member; nothing between a key and its value
+    void Separate()
+    {
+        if (afterKey)
+        {
+            afterKey = false;
+            return;
+        }
+        if (hasMembers.empty())
+            return;
+        if (hasMembers.back())
+            out += ',';
+        hasMembers.back() = true;
+        NewLine();
+    }
+
+    void NewLine()
+    {
+        if (!pretty)
+            return;
+        out += '\n';
+        out.append(2 * hasMembers.size(), ' ');
+    }
+
+    void WriteString(std::string_view value)
+    {
+        out += '"';
+        for (char c : value)
+        {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<int>(c));
+                else
+                    out += c;
+            }
+        }
+        out += '"';
+    }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &filename)
+    {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Failed to open file: " + filename);
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to read the size of file: " + filename);
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+        if (size == 0)
+            return;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map file: " + filename);
+        }
+        data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data == nullptr)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map file: " + filename);
+        }
+#else
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open file: " + filename);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to read the size of file: " + filename);
+        }
+        size = static_cast<size_t>(st.st_size);
+        if (size == 0)
+            return;
+
+        void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to map file: " + filename);
+        }
+        data = static_cast<const char *>(address);
+        // the loaders read the whole file front to back; advice values are not flags, so one
+        // call each
+        madvise(address, size, MADV_SEQUENTIAL);
+        madvise(address, size, MADV_WILLNEED);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (data)
+            munmap(const_cast<char *>(data), size);
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *Data() const { return data; }
+    size_t Size() const { return size; }
+    std::string_view View() const { return std::string_view(data, size); }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
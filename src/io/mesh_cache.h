@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#define FMT_HEADER_ONLY
+#include "fmt/format.h"
+
+#include "collision/indexed_mesh.h"
+#include "collision/experimental/flat_bvh.h"
+#include "io/mapped_file.h"
+#include "core/trace.h"
+#include "io/object_loader.h"
+
+// Binary cache of a mesh and its flattened BVH.
+//
+// Layout: a fixed header followed by the vertex, index, node and triangle packet arrays, each starting at a
+// 64 byte aligned offset and stored in the in-memory representation of this build
+// (native endianness and struct layout, checked via the element sizes in the header).
+// Loading maps the file, checks the indices in the arrays once and hands them to FlatBvh::Mesh
+// without copying.
+//
+// The header records the size, modification time and content hash of the source OBJ.
+// A cache is used when size and time match, or when the size matches and the hash of the
+// current source is unchanged; otherwise it is rebuilt.
+namespace MeshCache
+{
+    static constexpr char MAGIC[8] = {'S', 'R', 'T', 'M', 'E', 'S', 'H', '\0'};
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint64_t ALIGNMENT = 64;
+
+    static_assert(std::is_trivially_copyable_v<Point3>);
+    static_assert(std::is_trivially_copyable_v<IndexedTriangle>);
+    static_assert(std::is_trivially_copyable_v<FlatBvh::BvhFlatNode>);
+    static_assert(std::is_trivially_copyable_v<TrianglePacket4>);
+    static_assert(alignof(TrianglePacket4) <= ALIGNMENT);
+
+    struct Section
+    {
+        uint64_t offset = 0;
+        uint64_t count = 0;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+
+        // element sizes of this build, to reject caches written with a different layout
+        uint32_t positionSize;
+        uint32_t triangleSize;
+        uint32_t normalSize;
+        uint32_t uvSize;
+        uint32_t nodeSize;
+        uint32_t packetSize;
+
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t sourceHash;
+
+        Section positions;
+        Section triangles;
+        Section normals;
+        Section uvs;
+        Section nodes;
+        Section packets;
+
+        // hash of all fields above
+        uint64_t headerHash;
+    };
+
+    // 64-bit hash over 8 byte words; only used to detect changed sources and damaged headers.
+    inline uint64_t Hash(const void *data, size_t size)
+    {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+            h ^= h >> 32;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, bytes + i, size - i);
+        h = (h ^ tail) * 0xC4CEB9FE1A85EC53ull;
+        return h ^ (h >> 29);
+    }
+
+    inline uint64_t HashFile(const std::string &file)
+    {
+        MappedFile source(file);
+        return Hash(source.Data(), source.Size());
+    }
+
+    inline int64_t FileTime(const std::string &file)
+    {
+        return std::filesystem::last_write_time(file).time_since_epoch().count();
+    }
+
+    inline uint64_t HeaderHash(const Header &header)
+    {
+        return Hash(&header, offsetof(Header, headerHash));
+    }
+
+    inline std::string DefaultCachePath(const std::string &objFile)
+    {
+        return objFile + ".srtmesh";
+    }
+
+    // Parses the OBJ file, builds the flat BVH and writes both to cacheFile.
+    inline void Write(const std::string &objFile, const std::string &cacheFile)
+    {
+        IndexedMesh mesh = LoadIndexedMesh(objFile);
+        auto nodes = FlatBvh::BuildFlatBvh(mesh.positions, mesh.triangles, TrianglePacket4::WIDTH);
+        auto packets = FlatBvh::Mesh::BuildPackets(mesh.View());
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.headerSize = sizeof(Header);
+        header.positionSize = sizeof(Point3);
+        header.triangleSize = sizeof(IndexedTriangle);
+        header.normalSize = sizeof(Vector3);
+        header.uvSize = sizeof(TexCoord);
+        header.nodeSize = sizeof(FlatBvh::BvhFlatNode);
+        header.packetSize = sizeof(TrianglePacket4);
+        header.sourceSize = std::filesystem::file_size(objFile);
+        header.sourceTime = FileTime(objFile);
+        header.sourceHash = HashFile(objFile);
+
+        uint64_t offset = sizeof(Header);
+        auto place = [&](Section &section, size_t count, size_t elementSize)
+        {
+            offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+            section = Section{offset, count};
+            offset += count * elementSize;
+        };
+        place(header.positions, mesh.positions.size(), sizeof(Point3));
+        place(header.triangles, mesh.triangles.size(), sizeof(IndexedTriangle));
+        place(header.normals, mesh.normals.size(), sizeof(Vector3));
+        place(header.uvs, mesh.uvs.size(), sizeof(TexCoord));
+        place(header.nodes, nodes.size(), sizeof(FlatBvh::BvhFlatNode));
+        place(header.packets, packets.size(), sizeof(TrianglePacket4));
+        header.headerHash = HeaderHash(header);
+
+        // Write to a temporary file first so concurrent readers never see a partial cache.
+        const std::string tempFile = cacheFile + ".tmp";
+        {
+            std::ofstream ofs(tempFile, std::ios::binary | std::ios::trunc);
+            if (!ofs)
+                throw std::runtime_error("Cannot open file for writing: " + tempFile);
+
+            ofs.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+            auto writeSection = [&](const Section &section, const void *data, size_t bytes)
+            {
+                static const char zeros[ALIGNMENT] = {};
+                ofs.write(zeros, section.offset - static_cast<uint64_t>(ofs.tellp()));
+                ofs.write(static_cast<const char *>(data), bytes);
+            };
+            writeSection(header.positions, mesh.positions.data(), mesh.positions.size() * sizeof(Point3));
+            writeSection(header.triangles, mesh.triangles.data(), mesh.triangles.size() * sizeof(IndexedTriangle));
+            writeSection(header.normals, mesh.normals.data(), mesh.normals.size() * sizeof(Vector3));
+            writeSection(header.uvs, mesh.uvs.data(), mesh.uvs.size() * sizeof(TexCoord));
+            writeSection(header.nodes, nodes.data(), nodes.size() * sizeof(FlatBvh::BvhFlatNode));
+            writeSection(header.packets, packets.data(), packets.size() * sizeof(TrianglePacket4));
+
+            if (!ofs)
+                throw std::runtime_error("Failed to write mesh cache: " + tempFile);
+        }
+        std::filesystem::rename(tempFile, cacheFile);
+    }
+
+    // Returns the header of a structurally valid cache file, or nullptr.
+    inline const Header *ValidHeader(const MappedFile &file)
+    {
+        if (file.Size() < sizeof(Header))
+            return nullptr;
+
+        const auto *header = reinterpret_cast<const Header *>(file.Data());
+        if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header->version != VERSION ||
+            header->headerSize != sizeof(Header) ||
+            header->headerHash != HeaderHash(*header) ||
+            header->positionSize != sizeof(Point3) ||
+            header->triangleSize != sizeof(IndexedTriangle) ||
+            header->normalSize != sizeof(Vector3) ||
+            header->uvSize != sizeof(TexCoord) ||
+            header->nodeSize != sizeof(FlatBvh::BvhFlatNode) ||
+            header->packetSize != sizeof(TrianglePacket4))
+            return nullptr;
+
+        for (auto [section, elementSize] : {std::pair{header->positions, header->positionSize},
+                                            std::pair{header->triangles, header->triangleSize},
+                                            std::pair{header->normals, header->normalSize},
+                                            std::pair{header->uvs, header->uvSize},
+                                            std::pair{header->nodes, header->nodeSize},
+                                            std::pair{header->packets, header->packetSize}})
+        {
+            if (section.offset % ALIGNMENT != 0 || section.offset > file.Size() ||
+                section.count > (file.Size() - section.offset) / elementSize)
+                return nullptr;
+        }
+        return header;
+    }
+
+    // Checks every index in the body once, so a damaged cache is rejected instead of being
+    // read out of bounds by the traversal.
+    inline bool ValidBody(const IndexedMeshView &view, std::span<const FlatBvh::BvhFlatNode> nodes,
+                          std::span<const TrianglePacket4> packets)
+    {
+        if ((!view.normals.empty() && view.normals.size() != view.positions.size()) ||
+            (!view.uvs.empty() && view.uvs.size() != view.positions.size()))
+            return false;
+        for (const auto &triangle : view.triangles)
+        {
+            for (uint32_t vertex : triangle.v)
+            {
+                if (vertex >= view.positions.size())
+                    return false;
+            }
+        }
+        for (const auto &packet : packets)
+        {
+            for (uint32_t triangle : packet.triangle)
+            {
+                if (triangle != TrianglePacket4::EMPTY && triangle >= view.triangles.size())
+                    return false;
+            }
+        }
+
+        // Children come after their parent, so the tree has no cycles. TraverseFlatBvhPackets
+        // holds at most depth + 2 nodes on its 64 entry stack.
+        std::vector<uint8_t> depth(nodes.size(), 0);
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            const auto &node = nodes[i];
+            if (node.object_index != FlatBvh::INVALID_INDEX)
+            {
+                if (node.object_index >= view.triangles.size() || node.object_index / TrianglePacket4::WIDTH >= packets.size())
+                    return false;
+                continue;
+            }
+            if (depth[i] > 62)
+                return false;
+            for (size_t child : {node.left_index, node.right_index})
+            {
+                if (child <= i || child >= nodes.size())
+                    return false;
+                depth[child] = std::max<uint8_t>(depth[child], depth[i] + 1);
+            }
+        }
+        return true;
+    }
+
+    inline bool IsUpToDate(const Header &header, const std::string &objFile)
+    {
+        if (!std::filesystem::exists(objFile))
+            return true; // cache without its source is still usable
+        if (header.sourceSize != std::filesystem::file_size(objFile))
+            return false;
+        if (header.sourceTime == FileTime(objFile))
+            return true;
+        return header.sourceHash == HashFile(objFile);
+    }
+
+    template <typename T>
+    std::span<const T> SectionSpan(const MappedFile &file, const Section &section)
+    {
+        return std::span<const T>(reinterpret_cast<const T *>(file.Data() + section.offset), section.count);
+    }
+
+    // Maps a cache file and returns a mesh that uses it in place.
+    // Returns nullptr if the file is not a valid cache or is stale with respect to objFile
+    // (pass an empty objFile to skip the staleness check).
+    inline std::shared_ptr<FlatBvh::Mesh> Load(const std::string &cacheFile, const std::string &objFile = "",
+                                               std::shared_ptr<Material> material = DefaultMaterial())
+    {
+        if (!std::filesystem::exists(cacheFile))
+            return nullptr;
+
+        auto file = std::make_shared<const MappedFile>(cacheFile);
+        const Header *header = ValidHeader(*file);
+        if (header == nullptr || (!objFile.empty() && !IsUpToDate(*header, objFile)))
+            return nullptr;
+
+        IndexedMeshView view{
+            .positions = SectionSpan<Point3>(*file, header->positions),
+            .triangles = SectionSpan<IndexedTriangle>(*file, header->triangles),
+            .normals = SectionSpan<Vector3>(*file, header->normals),
+            .uvs = SectionSpan<TexCoord>(*file, header->uvs)};
+        auto nodes = SectionSpan<FlatBvh::BvhFlatNode>(*file, header->nodes);
+        auto packets = SectionSpan<TrianglePacket4>(*file, header->packets);
+        if (!ValidBody(view, nodes, packets))
+            return nullptr;
+
+        return FlatBvh::Mesh::CreateView(file, view, nodes, packets, material);
+    }
+
+    // Loads objFile through its cache, converting it first if the cache is missing or stale.
+    inline std::shared_ptr<FlatBvh::Mesh> LoadOrConvert(const std::string &objFile, std::shared_ptr<Material> material = DefaultMaterial())
+    {
+        TRACE_SCOPE("MeshCache::LoadOrConvert", "io");
+        auto start = std::chrono::steady_clock::now();
+        const auto cacheFile = DefaultCachePath(objFile);
+
+        auto mesh = Load(cacheFile, objFile, material);
+        if (!mesh)
+        {
+            fmt::println("Converting {} to {}", objFile, cacheFile);
+            Write(objFile, cacheFile);
+            mesh = Load(cacheFile, "", material);
+            if (!mesh)
+                throw std::runtime_error("Failed to load freshly written mesh cache: " + cacheFile);
+        }
+        mesh->SetSource(objFile);
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        fmt::println("Mesh cache {}: {} triangles in {:.2f} ms", cacheFile, mesh->FaceCount(), elapsed);
+        return mesh;
+    }
+}
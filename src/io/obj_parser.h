@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core/vector3.h"
+#include "core/parallel.h"
+#include "core/trace.h"
+#include "collision/indexed_mesh.h"
+#include "io/mapped_file.h"
+
+// Result of parsing a Wavefront OBJ file. Polygons are fan-triangulated.
+struct ObjData
+{
+    static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+    std::vector<Point3> vertices;
+    std::vector<Vector3> normals;
+    std::vector<TexCoord> texcoords;
+    // Zero-based position indices of each triangle.
+    std::vector<IndexedTriangle> triangles;
+    // Normal and texture coordinate indices per triangle, or NO_INDEX for corners without one.
+    // Empty if the file does not reference any normals or texture coordinates.
+    std::vector<IndexedTriangle> normalTriangles;
+    std::vector<IndexedTriangle> texcoordTriangles;
+
+    size_t TriangleCount() const { return triangles.size(); }
+};
+
+struct ObjLoadStats
+{
+    size_t bytes = 0;
+    size_t chunks = 0;
+    double seconds = 0.0;
+
+    double MegabytesPerSecond() const
+    {
+        return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+};
+
+namespace ObjParser
+{
+    // Files are split into chunks of roughly this size, each parsed by one task.
+    static constexpr size_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+    // Negative (relative) indices can only be resolved once the number of vertices in the
+    // preceding chunks is known. Until then they are stored as the chunk-local vertex
+    // position plus this bias; absolute indices are always far below it.
+    static constexpr int64_t RELATIVE_BIAS = int64_t(1) << 48;
+    // Marks corners without a normal or texture coordinate reference.
+    static constexpr int64_t MISSING = INT64_MIN;
+
+    struct Chunk
+    {
+        std::vector<Point3> vertices;
+        std::vector<Vector3> normals;
+        std::vector<TexCoord> texcoords;
+        // One entry per polygon corner, see RELATIVE_BIAS for the encoding.
+        std::vector<int64_t> corners;
+        // Filled lazily: stay empty until the first corner with such a reference.
+        std::vector<int64_t> normalCorners;
+        std::vector<int64_t> texcoordCorners;
+        // Number of corners of each polygon.
+        std::vector<uint32_t> polygonSizes;
+        size_t triangleCount = 0;
+    };
+
+    inline bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char *SkipBlanks(const char *p, const char *end)
+    {
+        while (p < end && IsBlank(*p))
+            ++p;
+        return p;
+    }
+
+    [[noreturn]] inline void ThrowLineError(const char *what, const char *lineBegin, const char *lineEnd)
+    {
+        throw std::runtime_error(std::string(what) + " in line: " + std::string(lineBegin, lineEnd));
+    }
+
+    template <size_t N>
+    inline const char *ParseDoubles(double (&values)[N], size_t required, const char *p, const char *end, const char *lineBegin)
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            p = SkipBlanks(p, end);
+            auto [next, ec] = std::from_chars(p, end, values[i]);
+            if (ec != std::errc())
+            {
+                if (i < required)
+                    ThrowLineError("Invalid vertex format", lineBegin, end);
+                values[i] = 0.0;
+                continue;
+            }
+            p = next;
+        }
+        return p;
+    }
+
+    // Parses an OBJ index and encodes it, see RELATIVE_BIAS.
+    inline const char *ParseIndex(int64_t &encoded, size_t localCount, const char *p, const char *end, const char *lineBegin)
+    {
+        int64_t index = 0;
+        auto [next, ec] = std::from_chars(p, end, index);
+        if (ec != std::errc() || index == 0)
+            ThrowLineError("Invalid face format", lineBegin, end);
+
+        encoded = index > 0 ? index - 1 : RELATIVE_BIAS + static_cast<int64_t>(localCount) + index;
+        return next;
+    }
+
+    inline void PushAttribute(std::vector<int64_t> &attributeCorners, size_t cornerCount, int64_t encoded)
+    {
+        if (attributeCorners.size() + 1 < cornerCount)
+            attributeCorners.resize(cornerCount - 1, MISSING);
+        attributeCorners.push_back(encoded);
+    }
+
+    inline void ParseFace(Chunk &chunk, const char *p, const char *end, const char *lineBegin)
+    {
+        uint32_t count = 0;
+        while (true)
+        {
+            p = SkipBlanks(p, end);
+            if (p >= end)
+                break;
+
+            // Corners are "v", "v/vt", "v//vn" or "v/vt/vn".
+            int64_t index;
+            p = ParseIndex(index, chunk.vertices.size(), p, end, lineBegin);
+            chunk.corners.push_back(index);
+
+            if (p < end && *p == '/')
+            {
+                ++p;
+                if (p < end && *p != '/' && !IsBlank(*p))
+                {
+                    p = ParseIndex(index, chunk.texcoords.size(), p, end, lineBegin);
+                    PushAttribute(chunk.texcoordCorners, chunk.corners.size(), index);
+                }
+                if (p < end && *p == '/')
+                {
+                    p = ParseIndex(index, chunk.normals.size(), p + 1, end, lineBegin);
+                    PushAttribute(chunk.normalCorners, chunk.corners.size(), index);
+                }
+            }
+            if (p < end && !IsBlank(*p))
+                ThrowLineError("Invalid face format", lineBegin, end);
+
+            ++count;
+        }
+
+        if (count < 3)
+            ThrowLineError("Invalid face format", lineBegin, end);
+
+        chunk.polygonSizes.push_back(count);
+        chunk.triangleCount += count - 2;
+    }
+
+    inline void ParseChunk(Chunk &chunk, const char *begin, const char *end)
+    {
+        const char *p = begin;
+        while (p < end)
+        {
+            const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (lineEnd == nullptr)
+                lineEnd = end;
+
+            const char *lineBegin = p;
+            p = SkipBlanks(p, lineEnd);
+            if (lineEnd - p >= 2 && IsBlank(p[1]))
+            {
+                if (p[0] == 'v')
+                {
+                    double xyz[3];
+                    ParseDoubles(xyz, 3, p + 2, lineEnd, lineBegin);
+                    chunk.vertices.emplace_back(xyz[0], xyz[1], xyz[2]);
+                }
+                else if (p[0] == 'f')
+                {
+                    ParseFace(chunk, p + 2, lineEnd, lineBegin);
+                }
+            }
+            else if (lineEnd - p >= 3 && p[0] == 'v' && IsBlank(p[2]))
+            {
+                if (p[1] == 'n')
+                {
+                    double xyz[3];
+                    ParseDoubles(xyz, 3, p + 3, lineEnd, lineBegin);
+                    chunk.normals.emplace_back(xyz[0], xyz[1], xyz[2]);
+                }
+                else if (p[1] == 't')
+                {
+                    double uv[2];
+                    ParseDoubles(uv, 1, p + 3, lineEnd, lineBegin);
+                    chunk.texcoords.push_back(TexCoord{uv[0], uv[1]});
+                }
+            }
+
+            p = lineEnd + 1;
+        }
+    }
+
+    // Chunk boundaries are moved forward to the next line start so no line is split.
+    inline std::vector<const char *> SplitAtLines(const char *data, size_t size)
+    {
+        const char *end = data + size;
+        std::vector<const char *> bounds{data};
+        for (size_t offset = CHUNK_SIZE; offset < size; offset += CHUNK_SIZE)
+        {
+            const char *p = std::max(data + offset, bounds.back());
+            const char *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (newline == nullptr)
+                break;
+            bounds.push_back(newline + 1);
+        }
+        bounds.push_back(end);
+        return bounds;
+    }
+
+    // Fan-triangulates the polygons of a chunk. corners holds one reference per polygon corner,
+    // encoded as described at RELATIVE_BIAS; offset is the number of elements before the chunk.
+    // References outside [0, count) throw when strict and become ObjData::NO_INDEX otherwise.
+    inline void Triangulate(const Chunk &chunk, std::vector<int64_t> &corners, size_t offset, size_t count, bool strict, IndexedTriangle *out)
+    {
+        corners.resize(chunk.corners.size(), MISSING);
+        auto resolve = [&](int64_t corner) -> uint32_t
+        {
+            if (corner == MISSING)
+                return ObjData::NO_INDEX;
+            int64_t index = corner >= RELATIVE_BIAS / 2
+                                ? corner - RELATIVE_BIAS + static_cast<int64_t>(offset)
+                                : corner;
+            if (index < 0 || index >= static_cast<int64_t>(count))
+            {
+                if (strict)
+                    throw std::runtime_error("Face references invalid vertex indices");
+                return ObjData::NO_INDEX;
+            }
+            return static_cast<uint32_t>(index);
+        };
+
+        const int64_t *corner = corners.data();
+        for (uint32_t polygonSize : chunk.polygonSizes)
+        {
+            // fan triangulation around the first corner
+            uint32_t first = resolve(corner[0]);
+            for (uint32_t k = 1; k + 1 < polygonSize; ++k)
+                *out++ = IndexedTriangle{first, resolve(corner[k]), resolve(corner[k + 1])};
+            corner += polygonSize;
+        }
+    }
+}
+
+// Parses the vertices and faces of an OBJ file. The file is memory mapped and parsed in
+// parallel chunks; the chunks are merged in file order, so the result is deterministic.
+ObjData ParseObj(const std::string &filename, ObjLoadStats *stats = nullptr)
+{
+    using namespace ObjParser;
+    TRACE_SCOPE("ParseObj", "io");
+
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file(filename);
+
+    auto bounds = SplitAtLines(file.Data(), file.Size());
+    size_t chunkCount = bounds.size() - 1;
+    std::vector<Chunk> chunks(chunkCount);
+
+    ParallelFor(chunkCount, [&](size_t i)
+                { ParseChunk(chunks[i], bounds[i], bounds[i + 1]); });
+
+    // Prefix sums give every chunk its place in the merged buffers.
+    std::vector<size_t> vertexOffsets(chunkCount + 1, 0);
+    std::vector<size_t> normalOffsets(chunkCount + 1, 0);
+    std::vector<size_t> texcoordOffsets(chunkCount + 1, 0);
+    std::vector<size_t> triangleOffsets(chunkCount + 1, 0);
+    bool hasNormalRefs = false, hasTexcoordRefs = false;
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        vertexOffsets[i + 1] = vertexOffsets[i] + chunks[i].vertices.size();
+        normalOffsets[i + 1] = normalOffsets[i] + chunks[i].normals.size();
+        texcoordOffsets[i + 1] = texcoordOffsets[i] + chunks[i].texcoords.size();
+        triangleOffsets[i + 1] = triangleOffsets[i] + chunks[i].triangleCount;
+        hasNormalRefs |= !chunks[i].normalCorners.empty();
+        hasTexcoordRefs |= !chunks[i].texcoordCorners.empty();
+    }
+
+    if (vertexOffsets.back() > UINT32_MAX || normalOffsets.back() > UINT32_MAX || texcoordOffsets.back() > UINT32_MAX)
+        throw std::runtime_error("OBJ file has too many vertices: " + filename);
+
+    ObjData data;
+    data.vertices.resize(vertexOffsets.back());
+    data.normals.resize(normalOffsets.back());
+    data.texcoords.resize(texcoordOffsets.back());
+    data.triangles.resize(triangleOffsets.back());
+    if (hasNormalRefs)
+        data.normalTriangles.resize(triangleOffsets.back());
+    if (hasTexcoordRefs)
+        data.texcoordTriangles.resize(triangleOffsets.back());
+
+    ParallelFor(chunkCount, [&](size_t i)
+                {
+        Chunk &chunk = chunks[i];
+        std::copy(chunk.vertices.begin(), chunk.vertices.end(), data.vertices.begin() + vertexOffsets[i]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + normalOffsets[i]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), data.texcoords.begin() + texcoordOffsets[i]);
+
+        // Invalid position indices are an error, invalid normal or texture coordinate
+        // references only drop that attribute for the corner.
+        Triangulate(chunk, chunk.corners, vertexOffsets[i], data.vertices.size(), true, data.triangles.data() + triangleOffsets[i]);
+        if (hasNormalRefs)
+            Triangulate(chunk, chunk.normalCorners, normalOffsets[i], data.normals.size(), false, data.normalTriangles.data() + triangleOffsets[i]);
+        if (hasTexcoordRefs)
+            Triangulate(chunk, chunk.texcoordCorners, texcoordOffsets[i], data.texcoords.size(), false, data.texcoordTriangles.data() + triangleOffsets[i]); });
+
+    if (stats)
+    {
+        stats->bytes = file.Size();
+        stats->chunks = chunkCount;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return data;
+}
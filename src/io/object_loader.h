@@ -1,84 +1,123 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
-#include <fstream>
-#include <sstream>
+
+#define FMT_HEADER_ONLY
+#include "fmt/format.h"
 
 #include "core/hittable.h"
 #include "core/transform.h"
+#include "collision/hittable_list.h"
 #include "collision/triangle.h"
 #include "collision/face.h"
+#include "collision/indexed_mesh.h"
+#include "io/obj_parser.h"
 
 static std::vector<Face> ReadFaces(const std::string &filename)
 {
-    std::vector<Face> faces;
-    std::vector<Vector3> vertices;
+    ObjLoadStats stats;
+    ObjData obj = ParseObj(filename, &stats);
+
+    if (obj.triangles.empty())
+    {
+        throw std::runtime_error("No valid faces found in OBJ file");
+    }
 
-    std::ifstream file(filename);
-    if (!file)
+    fmt::println("Loaded {}: {} vertices, {} triangles in {:.3f}s ({:.1f} MB/s)",
+                 filename, obj.vertices.size(), obj.TriangleCount(), stats.seconds, stats.MegabytesPerSecond());
+
+    std::vector<Face> faces;
+    faces.reserve(obj.TriangleCount());
+    for (const auto &tri : obj.triangles)
     {
-        throw std::runtime_error("Failed to open file: " + filename);
+        faces.emplace_back(Face(obj.vertices[tri.v[0]], obj.vertices[tri.v[1]], obj.vertices[tri.v[2]]));
     }
 
-    std::string line;
-    while (std::getline(file, line))
+    return faces;
+}
+
+// Builds per-vertex normal and uv streams from the per-corner references of an OBJ file.
+// Positions that are used with different normals or uvs are duplicated, once per combination.
+// A stream is dropped if any corner lacks a reference for it.
+static void WeldVertexAttributes(ObjData &obj, IndexedMesh &mesh)
+{
+    auto complete = [](const std::vector<IndexedTriangle> &refs)
     {
-        if (line.empty() || line[0] == '#')
-            continue;
+        return !refs.empty() && std::ranges::none_of(refs, [](const IndexedTriangle &t)
+                                                     { return t.v[0] == ObjData::NO_INDEX || t.v[1] == ObjData::NO_INDEX || t.v[2] == ObjData::NO_INDEX; });
+    };
+    const bool useNormals = complete(obj.normalTriangles);
+    const bool useUvs = complete(obj.texcoordTriangles);
 
-        std::istringstream iss(line);
-        std::string prefix;
-        iss >> prefix;
+    if (!useNormals && !useUvs)
+    {
+        mesh.positions = std::move(obj.vertices);
+        mesh.triangles = std::move(obj.triangles);
+        return;
+    }
 
-        if (prefix == "v")
+    struct Key
+    {
+        uint32_t position, normal, uv;
+        bool operator==(const Key &) const = default;
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key &k) const
         {
-            double x, y, z;
-            if (!(iss >> x >> y >> z))
-            {
-                throw std::runtime_error("Invalid vertex format in line: " + line);
-            }
-            vertices.emplace_back(Vector3(x, y, z));
+            uint64_t h = k.position * 0x9E3779B97F4A7C15ull;
+            h ^= (k.normal + 0x7F4A7C15ull) * 0xC2B2AE3D27D4EB4Full;
+            h ^= (k.uv + 0x165667B1ull) * 0x165667B19E3779F9ull;
+            return static_cast<size_t>(h ^ (h >> 29));
         }
-        else if (prefix == "f")
+    };
+
+    std::unordered_map<Key, uint32_t, KeyHash> welded;
+    welded.reserve(obj.vertices.size());
+    mesh.triangles.resize(obj.triangles.size());
+
+    for (size_t i = 0; i < obj.triangles.size(); ++i)
+    {
+        for (int c = 0; c < 3; ++c)
         {
-            std::string v1_str, v2_str, v3_str;
-            if (!(iss >> v1_str >> v2_str >> v3_str))
-            {
-                throw std::runtime_error("Invalid face format in line: " + line);
-            }
+            Key key{obj.triangles[i].v[c],
+                    useNormals ? obj.normalTriangles[i].v[c] : 0,
+                    useUvs ? obj.texcoordTriangles[i].v[c] : 0};
 
-            // Parse vertex indices (handle formats like "1", "1/2", "1/2/3")
-            auto parseVertexIndex = [](const std::string &str) -> int
-            {
-                size_t slash_pos = str.find('/');
-                if (slash_pos != std::string::npos)
-                    return std::stoi(str.substr(0, slash_pos)) - 1; // Convert to 0-indexed
-                return std::stoi(str) - 1;                          // Convert to 0-indexed
-            };
-
-            int v1 = parseVertexIndex(v1_str);
-            int v2 = parseVertexIndex(v2_str);
-            int v3 = parseVertexIndex(v3_str);
-
-            if (v1 < 0 || v1 >= vertices.size() ||
-                v2 < 0 || v2 >= vertices.size() ||
-                v3 < 0 || v3 >= vertices.size())
+            auto [it, inserted] = welded.try_emplace(key, static_cast<uint32_t>(mesh.positions.size()));
+            if (inserted)
             {
-                throw std::runtime_error("Face references invalid vertex indices");
+                mesh.positions.push_back(obj.vertices[key.position]);
+                if (useNormals)
+                    mesh.normals.push_back(UnitVector(obj.normals[key.normal]));
+                if (useUvs)
+                    mesh.uvs.push_back(obj.texcoords[key.uv]);
             }
-
-            faces.emplace_back(Face(vertices[v1], vertices[v2], vertices[v3]));
+            mesh.triangles[i].v[c] = it->second;
         }
     }
+}
+
+static IndexedMesh LoadIndexedMesh(const std::string &filename)
+{
+    ObjLoadStats stats;
+    ObjData obj = ParseObj(filename, &stats);
 
-    if (faces.empty())
+    if (obj.triangles.empty())
     {
-        throw std::runtime_error("No valid faces found in OBJ file");
+        throw std::runtime_error("No valid faces found in OBJ file: " + filename);
     }
 
-    return faces;
+    fmt::println("Loaded {}: {} vertices, {} triangles in {:.3f}s ({:.1f} MB/s)",
+                 filename, obj.vertices.size(), obj.TriangleCount(), stats.seconds, stats.MegabytesPerSecond());
+
+    IndexedMesh mesh;
+    WeldVertexAttributes(obj, mesh);
+    return mesh;
 }
 
 static std::shared_ptr<HittableList> LoadAsTriangleList(const std::string &filename)
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#ifndef PPL
+#include <tbb/flow_graph.h>
+#endif
+
+#include "core/trace.h"
+#include "io/row_sink.h"
+
+// Overlaps writing the image with rendering it. Each row handed over is encoded by a task on
+// the renderer's thread pool, so the encoding runs on whichever threads have no render work
+// left, and a serial stage stores the encoded rows in image order as soon as they are
+// contiguous. By the time the last row is rendered the file is complete up to the few rows
+// still in flight, so a frame costs its render time plus the encoding of about one row.
+//
+// The rows must stay valid until Finish returns. Without TBB (the PPL build) the writer
+// encodes on the render threads instead.
+class OutputPipeline : public RowSink
+{
+public:
+    explicit OutputPipeline(std::unique_ptr<ImageWriter> writer)
+        : writer(std::move(writer))
+#ifndef PPL
+          ,
+          encode(graph, tbb::flow::unlimited, [this](const RowMessage &message)
+                 {
+                     TRACE_SCOPE("EncodeRow", "io");
+                     return EncodedRow{message.y, this->writer->EncodeRow(message.y, message.row)}; }),
+          order(graph, [](const EncodedRow &encoded)
+                { return size_t(encoded.y); }),
+          store(graph, tbb::flow::serial, [this](EncodedRow encoded)
+                {
+                    TRACE_SCOPE("StoreRow", "io");
+                    this->writer->StoreRow(encoded.y, std::move(encoded.data)); })
+#endif
+    {
+#ifndef PPL
+        tbb::flow::make_edge(encode, order);
+        tbb::flow::make_edge(order, store);
+#endif
+    }
+
+    OutputPipeline(const OutputPipeline &) = delete;
+    OutputPipeline &operator=(const OutputPipeline &) = delete;
+
+    // Without Finish, e.g. when the render threw, the rows not stored yet are dropped. The
+    // graph's tasks refer to this object, so it still waits for those running; their errors
+    // are Finish's to report and are swallowed here.
+    ~OutputPipeline()
+    {
+#ifndef PPL
+        graph.cancel();
+        try
+        {
+            graph.wait_for_all();
+        }
+        catch (...)
+        {
+        }
+#endif
+    }
+
+    void WriteRow(int y, const Vector3 *row) override
+    {
+#ifndef PPL
+        encode.try_put(RowMessage{y, row});
+#else
+        writer->WriteRow(y, row);
+#endif
+    }
+
+    // Waits for the rows in flight, then completes the file. Rethrows the first error of an
+    // encode or store task.
+    void Finish() override
+    {
+#ifndef PPL
+        graph.wait_for_all();
+#endif
+        writer->Finish();
+    }
+
+private:
+    std::unique_ptr<ImageWriter> writer;
+
+#ifndef PPL
+    struct RowMessage
+    {
+        int y;
+        const Vector3 *row;
+    };
+
+    struct EncodedRow
+    {
+        int y;
+        std::vector<uint8_t> data;
+    };
+
+    tbb::flow::graph graph;
+    tbb::flow::function_node<RowMessage, EncodedRow> encode;
+    tbb::flow::sequencer_node<EncodedRow> order;
+    tbb::flow::function_node<EncodedRow> store;
+#endif
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "io/row_sink.h"
+
+// Portable float map: a short text header followed by 32-bit float RGB, rows bottom up. The
+// negative scale in the header marks the data as little endian. Keeps the full linear range.
+class PfmWriter : public ImageWriter
+{
+public:
+    PfmWriter(const std::string &filename, int width, int height)
+        : width(width), height(height), file(filename)
+    {
+        const std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+        headerSize = header.size();
+        file.WriteAt(0, header.data(), header.size());
+    }
+
+    std::vector<uint8_t> EncodeRow(int, const Vector3 *row) override
+    {
+        std::vector<uint8_t> data(size_t(width) * 3 * sizeof(float));
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                const float value = static_cast<float>(row[x][c]);
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                uint8_t *out = &data[(3 * size_t(x) + c) * sizeof(float)];
+                for (int i = 0; i < 4; i++)
+                    out[i] = static_cast<uint8_t>(bits >> (8 * i));
+            }
+        }
+
+        return data;
+    }
+
+    void StoreRow(int y, std::vector<uint8_t> data) override
+    {
+        file.WriteAt(headerSize + uint64_t(height - 1 - y) * data.size(), data.data(), data.size());
+    }
+
+    void Close() override
+    {
+        file.Close();
+    }
+
+private:
+    int width, height;
+    uint64_t headerSize;
+    PositionalFile file;
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "io/deflate.h"
+#include "io/row_sink.h"
+#include "io/tonemap.h"
+
+// 8-bit RGB PNG, compressed with the bundled deflate (io/deflate.h). Rows are tonemapped in
+// parallel; filtering and compression follow image order. Compressed data goes to disk in IDAT
+// chunks as it is produced.
+class PngWriter : public ImageWriter
+{
+public:
+    PngWriter(const std::string &filename, int width, int height, const TonemapSettings &settings = {})
+        : filename(filename), width(width), height(height), settings(settings),
+          file(filename, std::ios::binary), previous(RowBytes(), 0)
+    {
+        if (!file)
+            throw std::runtime_error("Cannot open file for writing: " + filename);
+
+        static constexpr uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        file.write(reinterpret_cast<const char *>(SIGNATURE), sizeof(SIGNATURE));
+
+        std::vector<uint8_t> header;
+        PutBigEndian(header, static_cast<uint32_t>(width));
+        PutBigEndian(header, static_cast<uint32_t>(height));
+        header.push_back(8); // bit depth
+        header.push_back(2); // color type: RGB
+        header.push_back(0); // compression: deflate
+        header.push_back(0); // filter method: adaptive
+        header.push_back(0); // no interlace
+        WriteChunk("IHDR", header);
+    }
+
+    std::vector<uint8_t> EncodeRow(int y, const Vector3 *row) override
+    {
+        std::vector<uint8_t> pixels(RowBytes());
+        TonemapRow(row, width, y, pixels.data(), settings);
+        return pixels;
+    }
+
+    void StoreRow(int, std::vector<uint8_t> data) override
+    {
+        CompressRow(data);
+        previous = std::move(data);
+        rowsStored++;
+        if (deflate.PendingOutput() >= IDAT_SIZE)
+            FlushCompressed();
+    }
+
+    void Close() override
+    {
+        if (rowsStored != height)
+            throw std::runtime_error("PngWriter: not all rows were written to " + filename);
+        deflate.Finish();
+        FlushCompressed();
+        WriteChunk("IEND", {});
+        file.close();
+        if (!file)
+            throw std::runtime_error("Failed to write PNG data to file: " + filename);
+    }
+
+private:
+    static constexpr size_t IDAT_SIZE = 1 << 16;
+
+    std::string filename;
+    int width, height;
+    TonemapSettings settings;
+    std::ofstream file;
+
+    int rowsStored = 0;
+    std::vector<uint8_t> previous;
+    DeflateStream deflate;
+    std::vector<uint8_t> compressed;
+
+    size_t RowBytes() const { return 3 * size_t(width); }
+
+    static void PutBigEndian(std::vector<uint8_t> &out, uint32_t v)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<uint8_t>(v >> shift));
+    }
+
+    void WriteChunk(const char *type, std::span<const uint8_t> data)
+    {
+        std::vector<uint8_t> chunk;
+        chunk.reserve(data.size() + 12);
+        PutBigEndian(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        // the CRC covers the type and the data
+        PutBigEndian(chunk, Crc32(std::span(chunk).subspan(4)));
+        file.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+        if (!file)
+            throw std::runtime_error("Failed to write PNG data to file: " + filename);
+    }
+
+    void FlushCompressed()
+    {
+        deflate.TakeOutput(compressed);
+        for (size_t start = 0; start < compressed.size(); start += IDAT_SIZE)
+            WriteChunk("IDAT", std::span(compressed).subspan(start, std::min(IDAT_SIZE, compressed.size() - start)));
+        compressed.clear();
+    }
+
+    static uint8_t Paeth(int a, int b, int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return static_cast<uint8_t>(a);
+        return static_cast<uint8_t>(pb <= pc ? b : c);
+    }
+
+    // Picks the filter whose output has the smallest sum of absolute (signed) bytes, the
+    // heuristic libpng uses, and feeds the filtered row to the compressor. Filters predict
+    // from the previous row.
+    void CompressRow(const std::vector<uint8_t> &row)
+    {
+        const size_t n = row.size();
+        std::vector<uint8_t> best, candidate(n + 1);
+        uint64_t bestCost = UINT64_MAX;
+
+        for (uint8_t filter = 0; filter < 5; filter++)
+        {
+            candidate[0] = filter;
+            uint64_t cost = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                const int a = i >= 3 ? row[i - 3] : 0;
+                const int b = previous[i];
+                const int c = i >= 3 ? previous[i - 3] : 0;
+                int predicted = 0;
+                switch (filter)
+                {
+                case 1:
+                    predicted = a;
+                    break;
+                case 2:
+                    predicted = b;
+                    break;
+                case 3:
+                    predicted = (a + b) / 2;
+                    break;
+                case 4:
+                    predicted = Paeth(a, b, c);
+                    break;
+                }
+                const uint8_t value = static_cast<uint8_t>(row[i] - predicted);
+                candidate[i + 1] = value;
+                cost += value < 128 ? value : 256 - value;
+            }
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                best.swap(candidate);
+                candidate.resize(n + 1);
+            }
+        }
+
+        deflate.Write(best);
+    }
+};
@@ -6,58 +6,161 @@
 #include "fmt/format.h"
 #include "fmt/printf.h"
 
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
 
+#include "io/json_writer.h"
+
+enum class ProgressFormat
+{
+    // one status line on stderr, rewritten in place
+    Text,
+    // one JSON object per line on stderr, for job schedulers
+    JsonLines,
+};
+
+// Render progress. Workers add finished lines to counters sharded by thread, without locks
+// or I/O; a reporter thread sums the shards at a fixed interval and does all the printing.
 class ProgressTracker
 {
 private:
-    std::atomic<int> completed_lines{0};
+    static constexpr size_t SHARDS = 64;
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> lines{0};
+        std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> rays{0};
+    };
+
+    struct Totals
+    {
+        uint64_t lines = 0, samples = 0, rays = 0;
+    };
+
+    std::array<Shard, SHARDS> shards;
     int total_lines;
+    ProgressFormat format;
+    std::chrono::milliseconds interval;
     std::chrono::steady_clock::time_point start_time;
-    mutable std::chrono::steady_clock::time_point last_update;
 
-public:
-    ProgressTracker(int total) : total_lines(total), start_time(std::chrono::steady_clock::now())
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread reporter;
+
+    static size_t ShardIndex()
+    {
+        static std::atomic<size_t> nextShard{0};
+        static thread_local const size_t index = nextShard.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return index;
+    }
+
+    Totals Sum() const
     {
-        last_update = start_time;
+        Totals totals;
+        for (const auto &shard : shards)
+        {
+            totals.lines += shard.lines.load(std::memory_order_relaxed);
+            totals.samples += shard.samples.load(std::memory_order_relaxed);
+            totals.rays += shard.rays.load(std::memory_order_relaxed);
+        }
+        return totals;
     }
 
-    void IncrementLine()
+    void Run()
     {
-        int current = ++completed_lines;
+        Totals last;
+        auto lastTime = start_time;
 
-        if (current % 10 == 0 || current == total_lines)
+        std::unique_lock lock(mutex);
+        while (!wake.wait_for(lock, interval, [this]
+                              { return stopping; }))
         {
-            ShowProgress(current, total_lines);
+            auto now = std::chrono::steady_clock::now();
+            Totals current = Sum();
+            // rates over the last interval, so they follow the scene's cost as the render proceeds
+            double seconds = std::chrono::duration<double>(now - lastTime).count();
+            Report(current, (current.samples - last.samples) / seconds, (current.rays - last.rays) / seconds, false);
+            last = current;
+            lastTime = now;
         }
+
+        Totals current = Sum();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        Report(current, current.samples / elapsed, current.rays / elapsed, true);
     }
 
-    void ShowProgress(int current, int total) const
+    void Report(const Totals &totals, double samplesPerSecond, double raysPerSecond, bool done) const
     {
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        double fraction = total_lines > 0 ? static_cast<double>(totals.lines) / total_lines : 1.0;
+        double eta = fraction > 0.0 ? elapsed / fraction - elapsed : 0.0;
 
-        // Only update display every 100ms to avoid spam
-        if (now - last_update < std::chrono::milliseconds(100) && current != total)
+        if (format == ProgressFormat::JsonLines)
         {
+            JsonWriter json(false);
+            json.BeginObject();
+            json.Field("event", done ? "done" : "progress");
+            json.Field("lines", totals.lines).Field("total_lines", total_lines);
+            json.Field("samples", totals.samples).Field("rays", totals.rays);
+            json.Field("elapsed", elapsed).Field("eta", done ? 0.0 : eta);
+            json.Field("samples_per_sec", samplesPerSecond).Field("rays_per_sec", raysPerSecond);
+            json.EndObject();
+            fmt::print(stderr, "{}\n", json.String());
+            std::fflush(stderr);
             return;
         }
-        last_update = now;
 
-        double percentage = (double)current / total * 100.0;
-        double lines_per_sec = elapsed > 0 ? (double)current / elapsed : 0;
+        fmt::print(stderr, "\rProgress: {}/{} ({:.1f}%) - {:.2f} Msamples/s - {:.2f} Mrays/s - ETA: {:.0f}s ({:.0f}s)   ",
+                   totals.lines, total_lines, 100.0 * fraction, samplesPerSecond * 1e-6, raysPerSecond * 1e-6, eta, eta + elapsed);
+        if (done)
+            fmt::print(stderr, "\nRendering completed in {:.1f}s\n", elapsed);
+        std::fflush(stderr);
+    }
+
+public:
+    ProgressTracker(int total, ProgressFormat format = ProgressFormat::Text,
+                    std::chrono::milliseconds interval = std::chrono::milliseconds(500))
+        : total_lines(total), format(format), interval(interval), start_time(std::chrono::steady_clock::now())
+    {
+        reporter = std::thread([this]
+                               { Run(); });
+    }
+
+    ProgressTracker(const ProgressTracker &) = delete;
+    ProgressTracker &operator=(const ProgressTracker &) = delete;
 
-        // Calculate ETA
-        double eta_seconds = lines_per_sec > 0 ? (total - current) / lines_per_sec : 0;
+    ~ProgressTracker()
+    {
+        Finish();
+    }
 
-        fmt::print(stderr, "\rProgress: {}/{} ({:.1f}%) - {:.1f} lines/sec - ETA: {:.0f}s ({:.0f}s)",
-                   current, total, percentage, lines_per_sec, eta_seconds, eta_seconds + elapsed);
+    // Called by the workers for every finished line.
+    void AddLine(uint64_t samples, uint64_t rays)
+    {
+        Shard &shard = shards[ShardIndex()];
+        shard.samples.fetch_add(samples, std::memory_order_relaxed);
+        shard.rays.fetch_add(rays, std::memory_order_relaxed);
+        shard.lines.fetch_add(1, std::memory_order_relaxed);
+    }
 
-        if (current == total)
+    // Stops the reporter after a final report. Call once the workers are done.
+    void Finish()
+    {
         {
-            fmt::print(stderr, "\nRendering completed in {}s\n", elapsed);
+            std::lock_guard lock(mutex);
+            stopping = true;
         }
+        wake.notify_one();
+        if (reporter.joinable())
+            reporter.join();
     }
 };
 
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only file with positional reads that may be issued from several threads at once.
+class RandomAccessFile
+{
+public:
+    explicit RandomAccessFile(const std::string &filename) : filename(filename)
+    {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Failed to open file: " + filename);
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to stat file: " + filename);
+        }
+        size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open file: " + filename);
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to stat file: " + filename);
+        }
+        size = static_cast<uint64_t>(st.st_size);
+#endif
+    }
+
+    ~RandomAccessFile()
+    {
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    RandomAccessFile(const RandomAccessFile &) = delete;
+    RandomAccessFile &operator=(const RandomAccessFile &) = delete;
+
+    uint64_t Size() const { return size; }
+
+    void ReadAt(uint64_t offset, void *destination, size_t bytes) const
+    {
+        if (offset > size || bytes > size - offset)
+            throw std::runtime_error("Read past the end of file: " + filename);
+
+        auto *out = static_cast<char *>(destination);
+        while (bytes > 0)
+        {
+#ifdef _WIN32
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD toRead = static_cast<DWORD>(std::min<size_t>(bytes, 1u << 30));
+            DWORD read = 0;
+            if (!ReadFile(file, out, toRead, &read, &overlapped) || read == 0)
+                throw std::runtime_error("Failed to read file: " + filename);
+#else
+            ssize_t read = pread(fd, out, bytes, static_cast<off_t>(offset));
+            if (read <= 0)
+                throw std::runtime_error("Failed to read file: " + filename);
+#endif
+            out += read;
+            offset += read;
+            bytes -= read;
+        }
+    }
+
+private:
+    std::string filename;
+    uint64_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+};
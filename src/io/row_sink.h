@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "core/vector3.h"
+
+// Receives finished rows of the linear framebuffer while the render is still running, so image
+// writers can put them on disk as they complete instead of after the whole frame. Rows arrive
+// from the render threads in any order; implementations must be thread-safe.
+class RowSink
+{
+public:
+    virtual ~RowSink() = default;
+
+    // row holds width colors; y counts from the top of the image.
+    virtual void WriteRow(int y, const Vector3 *row) = 0;
+
+    // Called once after the last row; completes the file.
+    virtual void Finish() = 0;
+};
+
+// An image file writer, split into a part that can run on many threads at once (tonemapping,
+// packing samples) and a part that has to see the rows in order (compression, file layout).
+// Used as a RowSink it encodes on the delivering thread and holds back rows that arrive early;
+// OutputPipeline runs the two parts as separate stages instead.
+class ImageWriter : public RowSink
+{
+public:
+    // Converts row y to the bytes stored for it. Thread-safe; rows come in any order.
+    virtual std::vector<uint8_t> EncodeRow(int y, const Vector3 *row) = 0;
+
+    // Stores encoded rows, called by one thread at a time for y = 0, 1, 2, ...
+    virtual void StoreRow(int y, std::vector<uint8_t> data) = 0;
+
+    // Completes the file after the last row is stored.
+    virtual void Close() = 0;
+
+    void WriteRow(int y, const Vector3 *row) override
+    {
+        std::vector<uint8_t> data = EncodeRow(y, row);
+
+        std::lock_guard lock(mutex);
+        pending.emplace(y, std::move(data));
+        while (!pending.empty() && pending.begin()->first == nextRow)
+        {
+            StoreRow(nextRow, std::move(pending.begin()->second));
+            pending.erase(pending.begin());
+            nextRow++;
+        }
+    }
+
+    void Finish() override
+    {
+        std::lock_guard lock(mutex);
+        if (!pending.empty())
+            throw std::runtime_error("ImageWriter: row " + std::to_string(nextRow) + " was never written.");
+        Close();
+    }
+
+private:
+    std::mutex mutex;
+    std::map<int, std::vector<uint8_t>> pending;
+    int nextRow = 0;
+};
+
+// Output file whose layout is known up front, so every row can be written straight to its own
+// offset as soon as it arrives.
+class PositionalFile
+{
+public:
+    PositionalFile(const std::string &filename) : filename(filename), file(filename, std::ios::binary)
+    {
+        if (!file)
+            throw std::runtime_error("Cannot open file for writing: " + filename);
+    }
+
+    void WriteAt(uint64_t offset, const void *data, size_t size)
+    {
+        std::lock_guard lock(mutex);
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+        if (!file)
+            throw std::runtime_error("Failed to write image data to file: " + filename);
+    }
+
+    void Close()
+    {
+        std::lock_guard lock(mutex);
+        file.close();
+        if (!file)
+            throw std::runtime_error("Failed to write image data to file: " + filename);
+    }
+
+private:
+    std::string filename;
+    std::ofstream file;
+    std::mutex mutex;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "core/vector3.h"
+#include "core/parallel.h"
+#include "core/trace.h"
+
+// Conversion of the linear float framebuffer to 8-bit pixels for the image writers.
+
+enum class ToneCurve
+{
+    // values above 1 are clipped
+    Clamp,
+    // x / (1 + x)
+    Reinhard,
+    // Narkowicz's fit of the ACES filmic curve
+    Aces,
+};
+
+struct TonemapSettings
+{
+    // in stops: the image is scaled by 2^exposure before the tone curve
+    double exposure = 0.0;
+    ToneCurve curve = ToneCurve::Clamp;
+    // encode with the sRGB transfer function; otherwise values are written linearly
+    bool srgb = true;
+    // add one step of noise before quantizing, which breaks up banding in smooth gradients
+    bool dither = false;
+};
+
+enum class ChannelOrder
+{
+    RGB,
+    BGR,
+};
+
+namespace TonemapDetail
+{
+    inline double LinearToSrgb(double x)
+    {
+        return x <= 0.0031308 ? 12.92 * x : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055;
+    }
+
+    // sRGB encoding of linear values in [0, 1], sampled at LUT_SIZE + 1 points and stored as
+    // 8.8 fixed point of the 8-bit value. Rounding the input to the nearest entry is off by at
+    // most half a step times the steepest slope of the curve (12.92 * 255 near black), that is
+    // 0.1 of an 8-bit step.
+    constexpr size_t LUT_SIZE = 1 << 14;
+
+    inline const std::array<uint16_t, LUT_SIZE + 1> &SrgbLut()
+    {
+        static const auto lut = []
+        {
+            std::array<uint16_t, LUT_SIZE + 1> table{};
+            for (size_t i = 0; i <= LUT_SIZE; i++)
+                table[i] = static_cast<uint16_t>(std::lround(LinearToSrgb(double(i) / LUT_SIZE) * 255.0 * 256.0));
+            return table;
+        }();
+        return lut;
+    }
+
+    inline double ApplyCurve(double x, ToneCurve curve)
+    {
+        switch (curve)
+        {
+        case ToneCurve::Reinhard:
+            return x / (1.0 + x);
+        case ToneCurve::Aces:
+            return (x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14);
+        default:
+            return x;
+        }
+    }
+
+    // Uniform noise in [0, 256) in 8.8 fixed point, from a hash of the pixel and channel, so
+    // the dither pattern does not depend on how the rows are split over threads.
+    inline uint32_t DitherNoise(uint32_t x, uint32_t y, uint32_t channel)
+    {
+        uint32_t h = x * 0x8da6b343u ^ y * 0xd8163841u ^ channel * 0xcb1ab31fu;
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        h ^= h >> 16;
+        return h >> 24;
+    }
+}
+
+// Converts one row of linear colors to 8-bit pixels, three bytes per pixel. y only seeds the dither.
+inline void TonemapRow(const Vector3 *row, int width, int y, uint8_t *out, const TonemapSettings &settings = {}, ChannelOrder order = ChannelOrder::RGB)
+{
+    using namespace TonemapDetail;
+
+    const auto &lut = SrgbLut();
+    const double scale = std::exp2(settings.exposure);
+    const int r = order == ChannelOrder::RGB ? 0 : 2;
+    const int b = 2 - r;
+
+    for (int x = 0; x < width; x++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            double v = ApplyCurve(row[x][c] * scale, settings.curve);
+            // also maps NaN to 0
+            v = v > 0.0 ? std::min(v, 1.0) : 0.0;
+
+            const uint32_t fixed = settings.srgb ? lut[static_cast<size_t>(v * LUT_SIZE + 0.5)]
+                                                 : static_cast<uint32_t>(v * 255.0 * 256.0 + 0.5);
+            // without dithering, + 128 rounds to the nearest value
+            const uint32_t noise = settings.dither ? DitherNoise(x, y, c) : 128;
+            const uint32_t value = std::min<uint32_t>((fixed + noise) >> 8, 255);
+            out[3 * x + (c == 0 ? r : c == 2 ? b : 1)] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+// Converts rows of linear colors to 8-bit pixels. Output row y starts at dst + y * dstStride;
+// a negative stride writes the rows bottom up, as BMP wants them. Rows are converted in
+// parallel blocks; each pixel is read and written once.
+inline void Tonemap(const Vector3 *const *rows, int width, int height, uint8_t *dst, ptrdiff_t dstStride,
+                    const TonemapSettings &settings = {}, ChannelOrder order = ChannelOrder::RGB)
+{
+    TRACE_SCOPE("Tonemap", "io");
+
+    constexpr int ROWS_PER_BLOCK = 16;
+    const size_t blocks = (size_t(height) + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+    ParallelFor(blocks, [&](size_t block)
+                {
+        const int yEnd = std::min(height, int(block + 1) * ROWS_PER_BLOCK);
+        for (int y = int(block) * ROWS_PER_BLOCK; y < yEnd; y++)
+            TonemapRow(rows[y], width, y, dst + y * dstStride, settings, order); });
+}
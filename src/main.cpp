@@ -5,21 +5,120 @@
 
 #include <iostream>
 #include <chrono>
+#include <csignal>
 #include <exception>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 #include "core/camera.h"
+#include "core/page_memory.h"
 #include "core/renderer.h"
 #include "io/image.h"
+#include "io/image_writer.h"
+#include "io/json_writer.h"
+#include "io/heatmap.h"
+#include "core/trace.h"
 #include "scenes/scene.h"
-#include "scenes/cornell_box.h"
+#include "scenes/scene_registry.h"
 
 using namespace std;
 using namespace std::chrono;
 
-int main()
+// Ctrl+C stops the render and keeps what it has; a second one ends the process as usual.
+static CancellationToken interrupt;
+
+// --heatmaps also writes per pixel cost images next to the image (see io/heatmap.h)
+// --trace records the phases and render tasks to trace.json (see core/trace.h)
+// --progress-json reports progress as JSON lines on stderr
+// --threads <n> limits the render threads, --numa splits the image over NUMA nodes, --pin pins threads to cores
+// --huge-pages thp|explicit and --replicate place mesh BVHs in huge pages / a copy per NUMA node (see core/page_memory.h)
+// --time-limit <seconds> stops the render after that long and saves the partial image
+// --scene <name or file.json> renders a bundled scene or a scene file (see scenes/scene_file.h) instead of the Cornell box
+// --output <file> writes .bmp, .png, .pfm or .exr instead of output_<elapsed>.bmp (see io/image_writer.h)
+int main(int argc, char *argv[])
 {
+    bool heatmaps = false, trace = false, progressJson = false, numa = false, pin = false;
+    unsigned int threads = 0;
+    double timeLimit = 0.0;
+    std::string output, sceneName = "cornell_box";
+    MemoryPlacement placement;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string
+            {
+                if (i + 1 >= argc)
+                    throw std::invalid_argument("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--output")
+                output = value();
+            else if (arg == "--scene")
+                sceneName = value();
+            else if (arg == "--threads")
+                threads = static_cast<unsigned int>(std::stoul(value()));
+            else if (arg == "--time-limit")
+                timeLimit = std::stod(value());
+            else if (arg == "--numa")
+                numa = true;
+            else if (arg == "--pin")
+                pin = true;
+            else if (arg == "--huge-pages")
+                placement.pages = ParsePagePolicy(value());
+            else if (arg == "--replicate")
+                placement.replicatePerNode = true;
+            else if (arg == "--heatmaps")
+                heatmaps = true;
+            else if (arg == "--trace")
+                trace = true;
+            else if (arg == "--progress-json")
+                progressJson = true;
+            else
+                throw std::invalid_argument("Unknown option: " + arg);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        fmt::println(stderr, "Usage: {} [--scene name|file.json] [--output file] [--threads n] [--time-limit seconds] [--numa] [--pin] "
+                             "[--huge-pages default|thp|explicit] [--replicate] [--heatmaps] [--trace] [--progress-json]",
+                     argv[0]);
+        return 1;
+    }
+
+    if (trace)
+    {
+        Trace::SetThreadName("main");
+        Trace::Start();
+    }
+
+    AccelerationMemoryPlacement() = placement;
     fmt::println("Building Scene...");
-    auto scene = CornellBox();
+    Scene scene;
+    try
+    {
+        TRACE_SCOPE("BuildScene", "scene");
+        scene = FindScene(sceneName).create();
+    }
+    catch (const std::exception &e)
+    {
+        cerr << "Error building scene " << sceneName << ": " << e.what() << "\n";
+        return 1;
+    }
+    if (placement.Enabled())
+    {
+        const auto memory = PageBuffer::Collect();
+        if (memory.buffers == 0)
+            fmt::println("Note: --huge-pages and --replicate apply to FlatBvh meshes; scene {} has none", sceneName);
+        else
+            fmt::println("Acceleration memory: {} buffers, {:.1f} MB, {:.1f} MB resident, {:.1f} MB in huge pages",
+                     memory.buffers, memory.bytes / 1e6, memory.resident / 1e6, memory.hugePages / 1e6);
+    }
     auto height = 720;
     auto width = static_cast<int>(height * scene.camera->AspectRatio());
     fmt::println("Image size: {} x {}", width, height);
@@ -29,9 +128,54 @@ int main()
     Renderer renderer{
         .maxDepth = 50,
         .samplesPerPixel = 100,
-        .maxThreadCount = 0,
-        .environmentMap = scene.environmentMap};
-    renderer.Render(image, *scene.camera, *scene.objects);
+        .maxThreadCount = threads,
+        .environmentMap = scene.environmentMap,
+        .progressFormat = progressJson ? ProgressFormat::JsonLines : ProgressFormat::Text,
+        .numaMode = numa ? NumaMode::SplitImage : NumaMode::Off,
+        .pinThreads = pin,
+        .cancellation = &interrupt};
+    if (timeLimit > 0.0)
+        renderer.deadline = start + duration_cast<steady_clock::duration>(duration<double>(timeLimit));
+    std::vector<uint32_t> sampleCounts;
+    renderer.sampleCounts = &sampleCounts;
+    std::signal(SIGINT, [](int)
+                {
+        interrupt.Cancel();
+        std::signal(SIGINT, SIG_DFL); });
+    std::unique_ptr<PixelCostMap> costMap;
+    if (heatmaps)
+    {
+        costMap = std::make_unique<PixelCostMap>(width, height);
+        renderer.costMap = costMap.get();
+    }
+
+    // rows are encoded and written while the render runs; the default name needs the render
+    // time, so that file gets its name afterwards
+    const std::string streamFile = output.empty() ? "output_rendering.bmp" : output;
+    RenderStatus status = RenderStatus::Complete;
+    try
+    {
+        {
+            OutputPipeline pipeline(CreateImageWriter(streamFile, width, height));
+            renderer.rowSink = &pipeline;
+            status = renderer.Render(image, *scene.camera, *scene.objects);
+        }
+        if (status != RenderStatus::Complete)
+        {
+            uint64_t samples = 0;
+            for (uint32_t count : sampleCounts)
+                samples += count;
+            fmt::println("Render {} with {:.1f}% of the samples; saving the partial image",
+                         status == RenderStatus::Cancelled ? "cancelled" : "out of time",
+                         100.0 * samples / (double(width) * height * renderer.samplesPerPixel));
+            SaveImage(image, streamFile);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        cerr << "Error rendering to " << streamFile << ": " << e.what() << "\n";
+        return 1;
+    }
 
     auto end = steady_clock::now();
     auto duration = duration_cast<seconds>(end - start);
@@ -39,13 +183,35 @@ int main()
 
     try
     {
-        auto filename = fmt::format("output_{:%H.%M.%S}.bmp", duration);
-        SaveBmp_sRGB(image, filename);
-        fmt::println("BMP saved to {}", filename);
+        auto filename = streamFile;
+        if (output.empty())
+        {
+            filename = fmt::format("output_{:%H.%M.%S}.bmp", duration);
+            std::filesystem::rename(streamFile, filename);
+        }
+        fmt::println("Image saved to {}", filename);
+
+        if (costMap)
+            SaveCostHeatmaps(*costMap, filename);
+
+        if (STATS_ENABLED)
+        {
+            JsonWriter json;
+            renderer.stats.WriteJson(json);
+            json.Save("stats.json");
+            fmt::println("Statistics saved to stats.json");
+        }
+
+        if (trace)
+        {
+            Trace::Stop();
+            Trace::Save("trace.json");
+            fmt::println("Trace saved to trace.json");
+        }
     }
     catch (const std::exception &e)
     {
-        cerr << "Error writing BMP: " << e.what() << "\n";
+        cerr << "Error writing output: " << e.what() << "\n";
     }
 
     return 0;
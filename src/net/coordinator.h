@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include "io/image.h"
+#include "net/socket.h"
+#include "net/tile_protocol.h"
+
+struct CoordinatorOptions
+{
+    TileProtocol::RenderJob job;
+    int samplesPerPixel = 100;
+    int tileSize = 64;
+    // samples per task; smaller values spread a few large tiles over more workers. 0 takes all
+    int samplesPerTask = 0;
+    // a worker that sends nothing for this long is treated as dead and its tile re-issued
+    std::chrono::seconds taskTimeout{600};
+    bool quiet = false;
+};
+
+// Splits a frame into tiles and sample ranges and hands them to worker processes that connect
+// over TCP, one task at a time per worker. Workers can join at any point. When a worker dies,
+// or stops answering, its task goes back to the front of the queue for the next free worker.
+// Results are kept per task and merged in task order, so the image does not depend on which
+// worker finished first.
+class Coordinator
+{
+public:
+    Coordinator(const CoordinatorOptions &options, uint16_t port)
+        : options(options), listener(Socket::Listen(port))
+    {
+        const auto &job = options.job;
+        if (job.width <= 0 || job.height <= 0 || options.samplesPerPixel <= 0 || options.tileSize <= 0)
+            throw std::invalid_argument("Coordinator: image size, samples and tile size must be positive.");
+
+        const int samplesPerTask = options.samplesPerTask > 0 ? std::min(options.samplesPerTask, options.samplesPerPixel) : options.samplesPerPixel;
+        for (int sampleStart = 0; sampleStart < options.samplesPerPixel; sampleStart += samplesPerTask)
+        {
+            for (int y = 0; y < job.height; y += options.tileSize)
+            {
+                for (int x = 0; x < job.width; x += options.tileSize)
+                {
+                    TileProtocol::TileTask task;
+                    task.id = static_cast<uint32_t>(tasks.size());
+                    task.x0 = x;
+                    task.y0 = y;
+                    task.x1 = std::min(x + options.tileSize, job.width);
+                    task.y1 = std::min(y + options.tileSize, job.height);
+                    task.sampleStart = static_cast<uint32_t>(sampleStart);
+                    task.samples = static_cast<uint32_t>(std::min(samplesPerTask, options.samplesPerPixel - sampleStart));
+                    tasks.push_back(task);
+                    queue.push_back(task.id);
+                }
+            }
+        }
+        results.resize(tasks.size());
+    }
+
+    uint16_t Port() const { return listener.LocalPort(); }
+
+    size_t TaskCount() const { return tasks.size(); }
+
+    size_t ReissuedCount() const { return reissued; }
+
+    size_t WorkerCount() const { return workersSeen; }
+
+    // Accepts workers and serves them until every task has a result. Returns false if Stop
+    // ended it first.
+    bool Run()
+    {
+        std::vector<std::thread> connections;
+        while (!Done() && !stopped)
+        {
+            Socket connection = listener.Accept(std::chrono::milliseconds(200));
+            if (connection.Valid())
+                connections.emplace_back(&Coordinator::Serve, this, std::move(connection), ++workersSeen);
+        }
+        // wakes the connections that wait for work, so they can tell their workers to stop
+        queueReady.notify_all();
+        for (auto &thread : connections)
+            thread.join();
+        return Done();
+    }
+
+    // Makes Run return without waiting for further workers, e.g. when no more will come.
+    void Stop()
+    {
+        std::lock_guard lock(mutex);
+        stopped = true;
+        queueReady.notify_all();
+    }
+
+    // The merged frame: every pixel is the mean of all its samples, weighted by sample count.
+    void Resolve(Image &image) const
+    {
+        const auto &job = options.job;
+        if (image.width != job.width || image.height != job.height)
+            throw std::invalid_argument("Coordinator: image size does not match the job.");
+
+        std::vector<double> sums(size_t(job.width) * job.height * 3, 0.0);
+        std::vector<uint32_t> counts(size_t(job.width) * job.height, 0);
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            const auto &task = tasks[i];
+            const auto &result = *results[i];
+            const int tileWidth = task.x1 - task.x0;
+            for (int y = task.y0; y < task.y1; y++)
+            {
+                for (int x = task.x0; x < task.x1; x++)
+                {
+                    const size_t pixel = size_t(y) * job.width + x;
+                    const size_t source = (size_t(y - task.y0) * tileWidth + (x - task.x0)) * 3;
+                    for (int c = 0; c < 3; c++)
+                        sums[pixel * 3 + c] += double(result.colors[source + c]) * result.samples;
+                    counts[pixel] += result.samples;
+                }
+            }
+        }
+
+        for (int y = 0; y < job.height; y++)
+        {
+            for (int x = 0; x < job.width; x++)
+            {
+                const size_t pixel = size_t(y) * job.width + x;
+                const double scale = counts[pixel] > 0 ? 1.0 / counts[pixel] : 0.0;
+                image.pixels[y][x] = Color(sums[pixel * 3] * scale, sums[pixel * 3 + 1] * scale, sums[pixel * 3 + 2] * scale);
+            }
+        }
+    }
+
+private:
+    CoordinatorOptions options;
+    Socket listener;
+    std::vector<TileProtocol::TileTask> tasks;
+    std::vector<std::optional<TileProtocol::TileResult>> results;
+
+    std::mutex mutex;
+    std::condition_variable queueReady;
+    std::deque<uint32_t> queue;
+    size_t completed = 0;
+    size_t reissued = 0;
+    std::atomic<size_t> workersSeen{0};
+    std::atomic<bool> stopped{false};
+
+    bool Done()
+    {
+        std::lock_guard lock(mutex);
+        return completed == tasks.size();
+    }
+
+    // Next task to hand out, or nothing once all tasks are complete or Run is stopped.
+    std::optional<uint32_t> NextTask()
+    {
+        std::unique_lock lock(mutex);
+        queueReady.wait(lock, [&]
+                        { return !queue.empty() || completed == tasks.size() || stopped; });
+        if (queue.empty() || stopped)
+            return std::nullopt;
+        const uint32_t id = queue.front();
+        queue.pop_front();
+        return id;
+    }
+
+    void Complete(TileProtocol::TileResult &&result)
+    {
+        std::lock_guard lock(mutex);
+        const uint32_t id = result.id;
+        results[id] = std::move(result);
+        completed++;
+        if (!options.quiet && (completed * 10 / tasks.size() != (completed - 1) * 10 / tasks.size() || completed == tasks.size()))
+            fmt::println("Tiles: {}/{}", completed, tasks.size());
+        if (completed == tasks.size())
+            queueReady.notify_all();
+    }
+
+    void Reissue(uint32_t id)
+    {
+        std::lock_guard lock(mutex);
+        queue.push_front(id);
+        reissued++;
+        queueReady.notify_one();
+    }
+
+    void Serve(Socket connection, size_t worker)
+    {
+        using namespace TileProtocol;
+        std::optional<uint32_t> current;
+        try
+        {
+            connection.SetReceiveTimeout(options.taskTimeout);
+            MessageType type;
+            std::vector<uint8_t> payload;
+            if (!Receive(connection, type, payload) || type != MessageType::Hello)
+                throw std::runtime_error("no hello");
+            MessageReader hello(payload);
+            if (hello.Get32() != MAGIC || hello.Get32() != VERSION)
+                throw std::runtime_error("protocol version mismatch");
+            Send(connection, MessageType::Job, Encode(options.job));
+
+            while ((current = NextTask()))
+            {
+                const TileTask &task = tasks[*current];
+                Send(connection, MessageType::Tile, Encode(task));
+                if (!Receive(connection, type, payload))
+                    throw std::runtime_error("connection closed");
+                if (type != MessageType::Result)
+                    throw std::runtime_error("unexpected message");
+
+                TileResult result = DecodeResult(payload);
+                if (result.id != task.id || result.samples != task.samples || result.colors.size() != task.PixelCount() * 3)
+                    throw std::runtime_error("result does not match its tile");
+                Complete(std::move(result));
+                current.reset();
+            }
+            Send(connection, MessageType::Done);
+        }
+        catch (const std::exception &e)
+        {
+            if (current)
+            {
+                if (!options.quiet)
+                    fmt::println(stderr, "Worker {} failed ({}), re-issuing tile {}", worker, e.what(), *current);
+                Reissue(*current);
+            }
+            else if (!options.quiet)
+                fmt::println(stderr, "Worker {} disconnected: {}", worker, e.what());
+        }
+    }
+};
@@ -0,0 +1,674 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "core/camera.h"
+#include "core/random.h"
+#include "core/renderer.h"
+#include "io/image.h"
+#include "io/image_writer.h"
+#include "io/json_reader.h"
+#include "io/json_writer.h"
+#include "io/tonemap.h"
+#include "net/shared_memory.h"
+#include "net/socket.h"
+#include "scenes/scene_registry.h"
+
+// A long running render process. Scenes are built once, on first use or up front, and stay
+// resident with their acceleration structures, and the thread pool stays warm, so a small
+// render costs its render time only. Clients connect to a local socket and send requests as
+// JSON, one per line; every request gets one JSON line back, in completion order, carrying
+// the request's id:
+//
+//   {"id": "a1", "scene": "cornell_box", "width": 128, "spp": 16, "output": "a1.png"}
+//   {"id": "a2", "scene": "cornell_box", "width": 128, "priority": 5, "camera": {"fov": 30}}
+//   {"command": "release", "shm": "/srt-4711-2"}
+//   {"command": "status"}
+//   {"command": "shutdown"}
+//
+// A render with "output" writes that file (.bmp, .png, .pfm, .exr); without it the pixels go
+// to a shared memory block named in the reply, 8-bit sRGB or, with "format": "float32",
+// linear floats, three channels per pixel, rows from the top. The client releases the block
+// when it has read it; the server drops the oldest unreleased ones beyond a limit.
+// Renders run one at a time on the whole pool, highest priority first, in arrival order
+// within a priority.
+namespace RenderServerProtocol
+{
+    struct RenderRequest
+    {
+        std::string id;
+        std::string scene;
+        int width = 160;
+        // 0 follows from the width and the scene camera's aspect ratio
+        int height = 0;
+        int samplesPerPixel = 16;
+        int maxDepth = 50;
+        uint64_t seed = 1;
+        // higher renders first
+        int priority = 0;
+        // image file to write; empty returns the pixels in shared memory
+        std::string output;
+        bool floatPixels = false;
+
+        // override the scene camera
+        std::optional<Vector3> origin, target, up;
+        std::optional<double> fov, focusDistance, aperture;
+    };
+
+    struct Message
+    {
+        // render, status, release or shutdown
+        std::string command = "render";
+        RenderRequest request;
+        // the block to release
+        std::string shm;
+    };
+
+    inline Vector3 ReadVector3(JsonReader &json)
+    {
+        double v[3];
+        int count = 0;
+        json.BeginArray();
+        while (json.NextElement())
+        {
+            if (count == 3)
+                json.Fail("expected three numbers");
+            v[count++] = json.ReadNumber();
+        }
+        if (count != 3)
+            json.Fail("expected three numbers");
+        return Vector3(v[0], v[1], v[2]);
+    }
+
+    inline void ReadCamera(JsonReader &json, RenderRequest &request)
+    {
+        json.BeginObject();
+        std::string key;
+        while (json.NextKey(key))
+        {
+            if (key == "origin")
+                request.origin = ReadVector3(json);
+            else if (key == "target")
+                request.target = ReadVector3(json);
+            else if (key == "up")
+                request.up = ReadVector3(json);
+            else if (key == "fov")
+                request.fov = json.ReadNumber();
+            else if (key == "focus_distance")
+                request.focusDistance = json.ReadNumber();
+            else if (key == "aperture")
+                request.aperture = json.ReadNumber();
+            else
+                json.Fail("unknown camera member '" + key + "'");
+        }
+    }
+
+    inline Message Parse(const std::string &line)
+    {
+        std::istringstream stream(line);
+        JsonReader json(stream);
+        Message message;
+        auto &request = message.request;
+
+        json.BeginObject();
+        std::string key;
+        while (json.NextKey(key))
+        {
+            if (key == "command")
+                message.command = json.ReadString();
+            else if (key == "shm")
+                message.shm = json.ReadString();
+            else if (key == "id")
+                request.id = json.Peek() == JsonReader::Type::String ? json.ReadString() : std::to_string(json.ReadInt());
+            else if (key == "scene")
+                request.scene = json.ReadString();
+            else if (key == "width")
+                request.width = static_cast<int>(json.ReadInt());
+            else if (key == "height")
+                request.height = static_cast<int>(json.ReadInt());
+            else if (key == "spp")
+                request.samplesPerPixel = static_cast<int>(json.ReadInt());
+            else if (key == "depth")
+                request.maxDepth = static_cast<int>(json.ReadInt());
+            else if (key == "seed")
+                request.seed = static_cast<uint64_t>(json.ReadInt());
+            else if (key == "priority")
+                request.priority = static_cast<int>(json.ReadInt());
+            else if (key == "output")
+                request.output = json.ReadString();
+            else if (key == "format")
+            {
+                const std::string format = json.ReadString();
+                if (format != "rgb8" && format != "float32")
+                    json.Fail("format must be rgb8 or float32");
+                request.floatPixels = format == "float32";
+            }
+            else if (key == "camera")
+                ReadCamera(json, request);
+            else
+                json.Fail("unknown member '" + key + "'");
+        }
+        json.ExpectEnd();
+
+        if (message.command == "render")
+        {
+            if (request.scene.empty())
+                throw std::invalid_argument("A render request needs a scene.");
+            if (request.width <= 0 || request.height < 0 || request.samplesPerPixel <= 0 || request.maxDepth <= 0)
+                throw std::invalid_argument("Image size, samples and depth must be positive.");
+        }
+        else if (message.command != "status" && message.command != "release" && message.command != "shutdown")
+        {
+            throw std::invalid_argument("Unknown command: " + message.command);
+        }
+        return message;
+    }
+
+    inline std::string ErrorReply(const std::string &id, const std::string &error)
+    {
+        JsonWriter json(false);
+        json.BeginObject().Field("id", id).Field("status", "error").Field("error", error).EndObject();
+        return json.String();
+    }
+}
+
+struct RenderServerOptions
+{
+    std::string socketPath = "simple_ray_tracer.sock";
+    // 0 uses every hardware thread
+    unsigned int threads = 0;
+    // further requests are turned away while this many wait
+    size_t maxQueued = 4096;
+    // unreleased shared memory results kept before the oldest go
+    size_t maxSharedResults = 256;
+    // scenes are built with this seed, so random scenes come out the same every run
+    uint64_t sceneSeed = 1;
+    bool quiet = false;
+};
+
+class RenderServer
+{
+public:
+    explicit RenderServer(const RenderServerOptions &options)
+        : options(options), listener(Socket::ListenLocal(options.socketPath))
+    {
+    }
+
+    ~RenderServer()
+    {
+        listener.Close();
+#ifdef _WIN32
+        DeleteFileA(options.socketPath.c_str());
+#else
+        unlink(options.socketPath.c_str());
+#endif
+    }
+
+    // Builds a scene now rather than on its first request.
+    void Preload(const std::string &scene)
+    {
+        LoadScene(scene);
+    }
+
+    // Serves clients until a shutdown request or Stop. Requests still queued then are answered
+    // with an error.
+    void Run()
+    {
+        std::thread renderThread(&RenderServer::RenderLoop, this);
+        std::map<std::thread::id, std::thread> connectionThreads;
+        while (!stopping)
+        {
+            JoinFinished(connectionThreads);
+            Socket socket = listener.Accept(std::chrono::milliseconds(200));
+            if (!socket.Valid())
+                continue;
+            auto connection = std::make_shared<Connection>(std::move(socket));
+            {
+                std::lock_guard lock(connectionsMutex);
+                connections.push_back(connection);
+            }
+            std::thread thread(&RenderServer::Serve, this, std::move(connection));
+            const auto id = thread.get_id();
+            connectionThreads.emplace(id, std::move(thread));
+        }
+
+        queueReady.notify_all();
+        renderThread.join();
+        {
+            // wakes the connections blocked in a receive
+            std::lock_guard lock(connectionsMutex);
+            for (auto &connection : connections)
+                connection->socket.Shutdown();
+        }
+        for (auto &[id, thread] : connectionThreads)
+            thread.join();
+    }
+
+    void Stop()
+    {
+        stopping = true;
+        queueReady.notify_all();
+    }
+
+    size_t RenderedCount() const { return rendered; }
+
+private:
+    struct Connection
+    {
+        explicit Connection(Socket socket) : socket(std::move(socket)) {}
+
+        Socket socket;
+        std::mutex sendMutex;
+
+        // A client that went away misses its reply; that is not the server's problem.
+        void Send(const std::string &line)
+        {
+            std::lock_guard lock(sendMutex);
+            if (!socket.Valid())
+                return;
+            try
+            {
+                socket.SendAll(line.data(), line.size());
+                socket.SendAll("\n", 1);
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+    };
+
+    struct Job
+    {
+        RenderServerProtocol::RenderRequest request;
+        uint64_t sequence;
+        std::shared_ptr<Connection> connection;
+    };
+
+    struct JobOrder
+    {
+        // priority_queue puts the greatest first: higher priority, then lower sequence
+        bool operator()(const Job &a, const Job &b) const
+        {
+            return a.request.priority != b.request.priority ? a.request.priority < b.request.priority : a.sequence > b.sequence;
+        }
+    };
+
+    static constexpr size_t MAX_LINE = 1 << 20;
+
+    RenderServerOptions options;
+    Socket listener;
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> rendered{0};
+
+    std::mutex connectionsMutex;
+    std::vector<std::shared_ptr<Connection>> connections;
+    // connection threads whose Serve returned, for Run to join
+    std::vector<std::thread::id> finishedThreads;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::priority_queue<Job, std::vector<Job>, JobOrder> queue;
+    uint64_t nextSequence = 0;
+
+    // A scene is built once, outside scenesMutex, so a slow build does not hold up status
+    // requests; the slot stays in the map from the first request on.
+    struct SceneSlot
+    {
+        std::once_flag once;
+        std::optional<Scene> scene;
+        std::atomic<bool> ready{false};
+    };
+
+    std::mutex scenesMutex;
+    std::map<std::string, std::shared_ptr<SceneSlot>> scenes;
+
+    std::mutex sharedMutex;
+    // oldest first
+    std::deque<SharedMemory> sharedResults;
+    uint64_t sharedCount = 0;
+
+    Scene &LoadScene(const std::string &name)
+    {
+        const SceneEntry entry = FindScene(name);
+        std::shared_ptr<SceneSlot> slot;
+        {
+            std::lock_guard lock(scenesMutex);
+            auto &found = scenes[name];
+            if (!found)
+                found = std::make_shared<SceneSlot>();
+            slot = found;
+        }
+
+        try
+        {
+            std::call_once(slot->once, [&]
+                           {
+                const auto start = std::chrono::steady_clock::now();
+                ScopedRandomSeed seed(options.sceneSeed);
+                slot->scene.emplace(entry.create());
+                slot->ready = true;
+                if (!options.quiet)
+                    fmt::println("Scene {} built in {:.2f}s", name, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()); });
+        }
+        catch (...)
+        {
+            // a failed build (a bad scene file) is retried by the next request, and does not stay listed
+            std::lock_guard lock(scenesMutex);
+            auto found = scenes.find(name);
+            if (found != scenes.end() && found->second == slot)
+                scenes.erase(found);
+            throw;
+        }
+        return *slot->scene;
+    }
+
+    // Joins the connection threads that have returned from Serve.
+    void JoinFinished(std::map<std::thread::id, std::thread> &threads)
+    {
+        std::vector<std::thread::id> finished;
+        {
+            std::lock_guard lock(connectionsMutex);
+            finished.swap(finishedThreads);
+        }
+        for (const auto id : finished)
+        {
+            auto found = threads.find(id);
+            found->second.join();
+            threads.erase(found);
+        }
+    }
+
+    // Drops the server's reference and closes the socket once the client is done with it.
+    // Queued renders keep the connection alive; their replies go nowhere.
+    void Disconnect(const std::shared_ptr<Connection> &connection)
+    {
+        std::lock_guard lock(connectionsMutex);
+        std::erase(connections, connection);
+        {
+            std::lock_guard sendLock(connection->sendMutex);
+            connection->socket.Close();
+        }
+        finishedThreads.push_back(std::this_thread::get_id());
+    }
+
+    // Reads request lines from one client and queues them; replies are sent by whoever finishes them.
+    void Serve(std::shared_ptr<Connection> connection)
+    {
+        std::string pending;
+        char buffer[4096];
+        try
+        {
+            while (!stopping)
+            {
+                const size_t count = connection->socket.ReceiveSome(buffer, sizeof(buffer));
+                if (count == 0)
+                    break;
+                pending.append(buffer, count);
+
+                size_t newline;
+                while ((newline = pending.find('\n')) != std::string::npos)
+                {
+                    std::string line = pending.substr(0, newline);
+                    pending.erase(0, newline + 1);
+                    if (!line.empty() && line.back() == '\r')
+                        line.pop_back();
+                    if (line.find_first_not_of(" \t") != std::string::npos)
+                        Handle(connection, line);
+                }
+                if (pending.size() > MAX_LINE)
+                {
+                    connection->Send(RenderServerProtocol::ErrorReply("", "Request line too long"));
+                    break;
+                }
+            }
+        }
+        catch (const std::exception &)
+        {
+            // the client is gone; its queued renders still run, their replies go nowhere
+        }
+        Disconnect(connection);
+    }
+
+    void Handle(const std::shared_ptr<Connection> &connection, const std::string &line)
+    {
+        RenderServerProtocol::Message message;
+        try
+        {
+            message = RenderServerProtocol::Parse(line);
+        }
+        catch (const std::exception &e)
+        {
+            connection->Send(RenderServerProtocol::ErrorReply("", e.what()));
+            return;
+        }
+
+        const std::string &id = message.request.id;
+        if (message.command == "render")
+        {
+            std::unique_lock lock(queueMutex);
+            if (queue.size() >= options.maxQueued)
+            {
+                lock.unlock();
+                connection->Send(RenderServerProtocol::ErrorReply(id, "Queue full"));
+                return;
+            }
+            queue.push(Job{std::move(message.request), nextSequence++, connection});
+            lock.unlock();
+            queueReady.notify_one();
+        }
+        else if (message.command == "status")
+        {
+            connection->Send(Status(id));
+        }
+        else if (message.command == "release")
+        {
+            const bool found = Release(message.shm);
+            connection->Send(found ? Ok(id) : RenderServerProtocol::ErrorReply(id, "No shared memory named " + message.shm));
+        }
+        else
+        {
+            connection->Send(Ok(id));
+            Stop();
+        }
+    }
+
+    static std::string Ok(const std::string &id)
+    {
+        JsonWriter json(false);
+        json.BeginObject().Field("id", id).Field("status", "ok").EndObject();
+        return json.String();
+    }
+
+    std::string Status(const std::string &id)
+    {
+        JsonWriter json(false);
+        json.BeginObject().Field("id", id).Field("status", "ok");
+        {
+            std::lock_guard lock(queueMutex);
+            json.Field("queued", queue.size());
+        }
+        json.Field("rendered", rendered.load());
+        {
+            std::lock_guard lock(sharedMutex);
+            json.Field("shared_results", sharedResults.size());
+        }
+        json.Key("scenes").BeginArray();
+        {
+            std::lock_guard lock(scenesMutex);
+            for (const auto &[name, slot] : scenes)
+            {
+                if (slot->ready)
+                    json.Value(name);
+            }
+        }
+        json.EndArray();
+        json.EndObject();
+        return json.String();
+    }
+
+    bool Release(const std::string &name)
+    {
+        std::lock_guard lock(sharedMutex);
+        for (auto it = sharedResults.begin(); it != sharedResults.end(); ++it)
+        {
+            if (it->Name() == name)
+            {
+                it->Unlink();
+                sharedResults.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void RenderLoop()
+    {
+        while (true)
+        {
+            std::unique_lock lock(queueMutex);
+            queueReady.wait(lock, [&]
+                            { return stopping || !queue.empty(); });
+            if (stopping)
+                break;
+            Job job = queue.top();
+            queue.pop();
+            lock.unlock();
+
+            std::string reply;
+            try
+            {
+                reply = Execute(job.request);
+            }
+            catch (const std::exception &e)
+            {
+                reply = RenderServerProtocol::ErrorReply(job.request.id, e.what());
+            }
+            job.connection->Send(reply);
+        }
+
+        std::lock_guard lock(queueMutex);
+        for (; !queue.empty(); queue.pop())
+            queue.top().connection->Send(RenderServerProtocol::ErrorReply(queue.top().request.id, "Server shutting down"));
+    }
+
+    std::string Execute(const RenderServerProtocol::RenderRequest &request)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        Scene &scene = LoadScene(request.scene);
+        const Camera &base = *scene.camera;
+
+        const int width = request.width;
+        const int height = request.height > 0 ? request.height : std::max(1, static_cast<int>(width / base.AspectRatio()));
+        const Camera camera(request.origin.value_or(base.Origin()), request.target.value_or(base.Target()),
+                            request.fov.value_or(base.Fov()), static_cast<double>(width) / height,
+                            request.focusDistance.value_or(base.FocusDistance()), request.aperture.value_or(base.Aperture()),
+                            base.ExposureStart(), base.ExposureEnd(), request.up.value_or(base.Up()));
+
+        Renderer renderer{
+            .maxDepth = request.maxDepth,
+            .samplesPerPixel = request.samplesPerPixel,
+            .maxThreadCount = options.threads,
+            .seed = request.seed,
+            .environmentMap = scene.environmentMap,
+            .quiet = true};
+
+        JsonWriter json(false);
+        json.BeginObject().Field("id", request.id).Field("status", "ok");
+        json.Field("width", width).Field("height", height);
+
+        Image image(width, height);
+        if (!request.output.empty())
+        {
+            OutputPipeline pipeline(CreateImageWriter(request.output, width, height));
+            renderer.rowSink = &pipeline;
+            renderer.Render(image, camera, *scene.objects);
+            json.Field("output", request.output);
+        }
+        else
+        {
+            renderer.Render(image, camera, *scene.objects);
+            SharedMemory memory = ShareImage(image, request.floatPixels);
+            json.Field("shm", memory.Name()).Field("bytes", memory.Size());
+            json.Field("format", request.floatPixels ? "float32" : "rgb8");
+            Keep(std::move(memory));
+        }
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        json.Field("seconds", seconds);
+        json.EndObject();
+        rendered++;
+        if (!options.quiet)
+            fmt::println("Rendered {} ({} {}x{}, {} spp) in {:.3f}s", request.id, request.scene, width, height, request.samplesPerPixel, seconds);
+        return json.String();
+    }
+
+    SharedMemory ShareImage(const Image &image, bool floatPixels)
+    {
+        const size_t channels = size_t(image.width) * 3;
+        const size_t rowBytes = floatPixels ? channels * sizeof(float) : channels;
+        std::string name;
+        {
+            std::lock_guard lock(sharedMutex);
+#ifdef _WIN32
+            name = fmt::format("/srt-{}-{}", _getpid(), ++sharedCount);
+#else
+            name = fmt::format("/srt-{}-{}", getpid(), ++sharedCount);
+#endif
+        }
+        SharedMemory memory = SharedMemory::Create(name, rowBytes * image.height);
+
+        auto *bytes = static_cast<uint8_t *>(memory.Data());
+        for (int y = 0; y < image.height; y++)
+        {
+            uint8_t *row = bytes + y * rowBytes;
+            if (floatPixels)
+            {
+                auto *values = reinterpret_cast<float *>(row);
+                for (int x = 0; x < image.width; x++)
+                {
+                    for (int c = 0; c < 3; c++)
+                        values[3 * x + c] = static_cast<float>(image.pixels[y][x][c]);
+                }
+            }
+            else
+            {
+                TonemapRow(image.pixels[y], image.width, y, row);
+            }
+        }
+        return memory;
+    }
+
+    void Keep(SharedMemory memory)
+    {
+        std::lock_guard lock(sharedMutex);
+        sharedResults.push_back(std::move(memory));
+        while (sharedResults.size() > options.maxSharedResults)
+        {
+            sharedResults.front().Unlink();
+            sharedResults.pop_front();
+        }
+    }
+};
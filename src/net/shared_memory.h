@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Named shared memory, for handing results to another process on the same machine without
+// a copy through a socket. POSIX names start with a slash ("/srt-1"); on Windows the name
+// lives as long as some process has it open, so the creator keeps it open until Unlink.
+class SharedMemory
+{
+public:
+    SharedMemory() = default;
+
+    SharedMemory(SharedMemory &&other) noexcept
+        : name(std::move(other.name)), data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)),
+          owner(std::exchange(other.owner, false))
+#ifdef _WIN32
+          ,
+          mapping(std::exchange(other.mapping, nullptr))
+#endif
+    {
+    }
+
+    SharedMemory &operator=(SharedMemory &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            name = std::move(other.name);
+            data = std::exchange(other.data, nullptr);
+            size = std::exchange(other.size, 0);
+            owner = std::exchange(other.owner, false);
+#ifdef _WIN32
+            mapping = std::exchange(other.mapping, nullptr);
+#endif
+        }
+        return *this;
+    }
+
+    SharedMemory(const SharedMemory &) = delete;
+    SharedMemory &operator=(const SharedMemory &) = delete;
+
+    ~SharedMemory()
+    {
+        Close();
+    }
+
+    // Creates a new block; fails if the name is taken.
+    static SharedMemory Create(const std::string &name, size_t size)
+    {
+        SharedMemory memory;
+        memory.name = name;
+        memory.size = size;
+        memory.owner = true;
+#ifdef _WIN32
+        memory.mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                            static_cast<DWORD>(uint64_t(size) >> 32), static_cast<DWORD>(size), name.c_str());
+        if (!memory.mapping || GetLastError() == ERROR_ALREADY_EXISTS)
+            throw std::runtime_error("Cannot create shared memory " + name);
+        memory.data = MapViewOfFile(memory.mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+        const int file = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (file < 0)
+            throw std::runtime_error("Cannot create shared memory " + name);
+        if (ftruncate(file, static_cast<off_t>(size)) != 0)
+        {
+            close(file);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("Cannot size shared memory " + name);
+        }
+        void *address = size > 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : nullptr;
+        close(file);
+        memory.data = address == MAP_FAILED ? nullptr : address;
+#endif
+        if (!memory.data && size > 0)
+            throw std::runtime_error("Cannot map shared memory " + name);
+        return memory;
+    }
+
+    // Maps an existing block read only.
+    static SharedMemory Open(const std::string &name, size_t size)
+    {
+        SharedMemory memory;
+        memory.name = name;
+        memory.size = size;
+#ifdef _WIN32
+        memory.mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+        if (!memory.mapping)
+            throw std::runtime_error("Cannot open shared memory " + name);
+        memory.data = MapViewOfFile(memory.mapping, FILE_MAP_READ, 0, 0, size);
+#else
+        const int file = shm_open(name.c_str(), O_RDONLY, 0);
+        if (file < 0)
+            throw std::runtime_error("Cannot open shared memory " + name);
+        void *address = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0) : nullptr;
+        close(file);
+        memory.data = address == MAP_FAILED ? nullptr : address;
+#endif
+        if (!memory.data && size > 0)
+            throw std::runtime_error("Cannot map shared memory " + name);
+        return memory;
+    }
+
+    const std::string &Name() const { return name; }
+    void *Data() const { return data; }
+    size_t Size() const { return size; }
+
+    // Removes the name, so the block goes away once nobody has it mapped. Closes this mapping.
+    void Unlink()
+    {
+#ifndef _WIN32
+        if (!name.empty())
+            shm_unlink(name.c_str());
+#endif
+        owner = false;
+        Close();
+    }
+
+private:
+    std::string name;
+    void *data = nullptr;
+    size_t size = 0;
+    // created here, so the name is removed with it
+    bool owner = false;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        if (data)
+            munmap(data, size);
+        if (owner)
+            shm_unlink(name.c_str());
+#endif
+        data = nullptr;
+        owner = false;
+    }
+};
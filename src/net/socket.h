@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Blocking TCP or local (Unix domain) connection or listening socket. Errors throw std::runtime_error; a peer that
+// goes away shows up as ReceiveAll returning false or as SendAll throwing.
+class Socket
+{
+public:
+#ifdef _WIN32
+    using Handle = SOCKET;
+    static constexpr Handle INVALID = INVALID_SOCKET;
+#else
+    using Handle = int;
+    static constexpr Handle INVALID = -1;
+#endif
+
+    Socket() = default;
+    explicit Socket(Handle handle) : handle(handle) {}
+
+    Socket(Socket &&other) noexcept : handle(std::exchange(other.handle, INVALID)) {}
+
+    Socket &operator=(Socket &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            handle = std::exchange(other.handle, INVALID);
+        }
+        return *this;
+    }
+
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+
+    ~Socket()
+    {
+        Close();
+    }
+
+    bool Valid() const { return handle != INVALID; }
+
+    void Close()
+    {
+        if (handle == INVALID)
+            return;
+#ifdef _WIN32
+        closesocket(handle);
+#else
+        close(handle);
+#endif
+        handle = INVALID;
+    }
+
+    // Ends both directions without closing the handle, which wakes a thread blocked in a
+    // receive on it: the receive sees the connection as closed.
+    void Shutdown()
+    {
+        if (handle == INVALID)
+            return;
+#ifdef _WIN32
+        shutdown(handle, SD_BOTH);
+#else
+        shutdown(handle, SHUT_RDWR);
+#endif
+    }
+
+    // Listens on all interfaces. Port 0 picks a free port; see LocalPort.
+    static Socket Listen(uint16_t port, int backlog = 64)
+    {
+        Startup();
+        Socket socket(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+        if (!socket.Valid())
+            throw std::runtime_error("Cannot create socket");
+
+        int reuse = 1;
+        setsockopt(socket.handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (bind(socket.handle, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+            throw std::runtime_error("Cannot bind to port " + std::to_string(port));
+        if (listen(socket.handle, backlog) != 0)
+            throw std::runtime_error("Cannot listen on port " + std::to_string(port));
+        return socket;
+    }
+
+    static Socket Connect(const std::string &host, uint16_t port)
+    {
+        Startup();
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *addresses = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+            throw std::runtime_error("Cannot resolve host " + host);
+
+        Socket socket;
+        for (addrinfo *address = addresses; address; address = address->ai_next)
+        {
+            Socket candidate(::socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+            if (candidate.Valid() && connect(candidate.handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0)
+            {
+                socket = std::move(candidate);
+                break;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (!socket.Valid())
+            throw std::runtime_error("Cannot connect to " + host + ":" + std::to_string(port));
+
+        // messages are written whole, so there is nothing to gain from Nagle's delay
+        int noDelay = 1;
+        setsockopt(socket.handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+        return socket;
+    }
+
+    // Listens on a Unix domain socket at path, replacing a file left there by an earlier run.
+    // Windows 10 and later have these too.
+    static Socket ListenLocal(const std::string &path, int backlog = 64)
+    {
+        Startup();
+        const sockaddr_un address = LocalAddress(path);
+        Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (!socket.Valid())
+            throw std::runtime_error("Cannot create socket");
+
+#ifdef _WIN32
+        DeleteFileA(path.c_str());
+#else
+        unlink(path.c_str());
+#endif
+        if (bind(socket.handle, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+            throw std::runtime_error("Cannot bind to " + path);
+        if (listen(socket.handle, backlog) != 0)
+            throw std::runtime_error("Cannot listen on " + path);
+        return socket;
+    }
+
+    static Socket ConnectLocal(const std::string &path)
+    {
+        Startup();
+        const sockaddr_un address = LocalAddress(path);
+        Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (!socket.Valid() || connect(socket.handle, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+            throw std::runtime_error("Cannot connect to " + path);
+        return socket;
+    }
+
+    uint16_t LocalPort() const
+    {
+        sockaddr_in address{};
+        socklen_t length = sizeof(address);
+        getsockname(handle, reinterpret_cast<sockaddr *>(&address), &length);
+        return ntohs(address.sin_port);
+    }
+
+    // Waits up to timeout for a connection. Returns an invalid socket if none came in.
+    Socket Accept(std::chrono::milliseconds timeout)
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(handle, &readable);
+        timeval wait{static_cast<long>(timeout.count() / 1000), static_cast<long>(timeout.count() % 1000 * 1000)};
+        if (select(static_cast<int>(handle) + 1, &readable, nullptr, nullptr, &wait) <= 0)
+            return Socket();
+
+        Socket connection(accept(handle, nullptr, nullptr));
+        // fails harmlessly on local sockets, which have no Nagle delay
+        if (connection.Valid())
+        {
+            int noDelay = 1;
+            setsockopt(connection.handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+        }
+        return connection;
+    }
+
+    // Receives fail once nothing arrives for this long; zero waits forever.
+    void SetReceiveTimeout(std::chrono::milliseconds timeout)
+    {
+#ifdef _WIN32
+        DWORD value = static_cast<DWORD>(timeout.count());
+#else
+        timeval value{static_cast<time_t>(timeout.count() / 1000), static_cast<suseconds_t>(timeout.count() % 1000 * 1000)};
+#endif
+        setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void SendAll(const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            const int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+#ifdef _WIN32
+            const int sent = send(handle, bytes, chunk, 0);
+#else
+            // a closed peer must not raise SIGPIPE and kill the process
+            const int sent = static_cast<int>(send(handle, bytes, chunk, MSG_NOSIGNAL));
+#endif
+            if (sent <= 0)
+                throw std::runtime_error("Connection lost while sending");
+            bytes += sent;
+            size -= sent;
+        }
+    }
+
+    // Returns false if the peer closed the connection before the first byte. Throws if it
+    // closes midway, on errors and on timeouts.
+    bool ReceiveAll(void *data, size_t size)
+    {
+        char *bytes = static_cast<char *>(data);
+        size_t received = 0;
+        while (received < size)
+        {
+            const int chunk = static_cast<int>(std::min<size_t>(size - received, 1 << 30));
+            const int count = static_cast<int>(recv(handle, bytes + received, chunk, 0));
+            if (count == 0 && received == 0)
+                return false;
+            if (count <= 0)
+                throw std::runtime_error("Connection lost while receiving");
+            received += count;
+        }
+        return true;
+    }
+
+    // Receives whatever has arrived, up to size bytes, waiting for at least one. Returns 0 once
+    // the peer has closed the connection; throws on errors and timeouts.
+    size_t ReceiveSome(void *data, size_t size)
+    {
+        const int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+        const int count = static_cast<int>(recv(handle, static_cast<char *>(data), chunk, 0));
+        if (count < 0)
+            throw std::runtime_error("Connection lost while receiving");
+        return static_cast<size_t>(count);
+    }
+
+private:
+    Handle handle = INVALID;
+
+    static sockaddr_un LocalAddress(const std::string &path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+            throw std::invalid_argument("Socket path is empty or too long: " + path);
+        std::copy(path.begin(), path.end(), address.sun_path);
+        return address;
+    }
+
+    static void Startup()
+    {
+#ifdef _WIN32
+        static const bool started = []
+        {
+            WSADATA data;
+            if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+                throw std::runtime_error("Cannot initialize Winsock");
+            return true;
+        }();
+        (void)started;
+#endif
+    }
+};
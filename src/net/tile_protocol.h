@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "net/socket.h"
+
+// Messages between the render farm coordinator and its workers. Every message is a 4 byte
+// type and a 4 byte payload size, followed by the payload; all numbers are little endian.
+//
+//   worker                      coordinator
+//   Hello (magic, version)  ->
+//                           <-  Job (scene, image size, depth, seed)
+//                           <-  Tile (rectangle, sample range)
+//   Result (mean colors)    ->
+//                               ... more tiles ...
+//                           <-  Done
+namespace TileProtocol
+{
+    constexpr uint32_t MAGIC = 0x46545253; // "SRTF"
+    constexpr uint32_t VERSION = 1;
+    // largest accepted payload, so a corrupt size cannot trigger a huge allocation
+    constexpr uint32_t MAX_PAYLOAD = 1u << 30;
+
+    enum class MessageType : uint32_t
+    {
+        Hello = 1,
+        Job,
+        Tile,
+        Result,
+        Done,
+    };
+
+    struct RenderJob
+    {
+        std::string scene;
+        int width = 0, height = 0;
+        int maxDepth = 50;
+        uint64_t seed = 1;
+    };
+
+    // Pixels [x0, x1) x [y0, y1), samples [sampleStart, sampleStart + samples) of each.
+    struct TileTask
+    {
+        uint32_t id = 0;
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        uint32_t sampleStart = 0, samples = 0;
+
+        size_t PixelCount() const { return size_t(x1 - x0) * (y1 - y0); }
+    };
+
+    struct TileResult
+    {
+        uint32_t id = 0;
+        uint32_t samples = 0;
+        // mean color of every pixel, RGB, row by row
+        std::vector<float> colors;
+    };
+
+    class MessageWriter
+    {
+    public:
+        std::vector<uint8_t> bytes;
+
+        MessageWriter &Put32(uint32_t v)
+        {
+            for (int i = 0; i < 4; i++)
+                bytes.push_back(static_cast<uint8_t>(v >> (8 * i)));
+            return *this;
+        }
+
+        MessageWriter &Put64(uint64_t v)
+        {
+            Put32(static_cast<uint32_t>(v));
+            return Put32(static_cast<uint32_t>(v >> 32));
+        }
+
+        MessageWriter &PutString(const std::string &s)
+        {
+            Put32(static_cast<uint32_t>(s.size()));
+            bytes.insert(bytes.end(), s.begin(), s.end());
+            return *this;
+        }
+
+        MessageWriter &PutFloats(std::span<const float> values)
+        {
+            Put32(static_cast<uint32_t>(values.size()));
+            for (float value : values)
+            {
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                Put32(bits);
+            }
+            return *this;
+        }
+    };
+
+    class MessageReader
+    {
+    public:
+        explicit MessageReader(std::span<const uint8_t> bytes) : bytes(bytes) {}
+
+        uint32_t Get32()
+        {
+            Need(4);
+            uint32_t v = 0;
+            for (int i = 0; i < 4; i++)
+                v |= uint32_t(bytes[position + i]) << (8 * i);
+            position += 4;
+            return v;
+        }
+
+        uint64_t Get64()
+        {
+            const uint64_t low = Get32();
+            return low | uint64_t(Get32()) << 32;
+        }
+
+        std::string GetString()
+        {
+            const uint32_t size = Get32();
+            Need(size);
+            std::string s(reinterpret_cast<const char *>(bytes.data() + position), size);
+            position += size;
+            return s;
+        }
+
+        std::vector<float> GetFloats()
+        {
+            const uint32_t count = Get32();
+            Need(size_t(count) * 4);
+            std::vector<float> values(count);
+            for (float &value : values)
+            {
+                const uint32_t bits = Get32();
+                std::memcpy(&value, &bits, sizeof(bits));
+            }
+            return values;
+        }
+
+    private:
+        std::span<const uint8_t> bytes;
+        size_t position = 0;
+
+        void Need(size_t size) const
+        {
+            if (bytes.size() - position < size)
+                throw std::runtime_error("Truncated render farm message");
+        }
+    };
+
+    inline void Send(Socket &socket, MessageType type, const MessageWriter &payload = {})
+    {
+        MessageWriter header;
+        header.Put32(static_cast<uint32_t>(type)).Put32(static_cast<uint32_t>(payload.bytes.size()));
+        header.bytes.insert(header.bytes.end(), payload.bytes.begin(), payload.bytes.end());
+        socket.SendAll(header.bytes.data(), header.bytes.size());
+    }
+
+    // Returns false if the peer closed the connection between messages.
+    inline bool Receive(Socket &socket, MessageType &type, std::vector<uint8_t> &payload)
+    {
+        uint8_t header[8];
+        if (!socket.ReceiveAll(header, sizeof(header)))
+            return false;
+        MessageReader reader(header);
+        type = static_cast<MessageType>(reader.Get32());
+        const uint32_t size = reader.Get32();
+        if (size > MAX_PAYLOAD)
+            throw std::runtime_error("Render farm message too large");
+        payload.resize(size);
+        if (size > 0 && !socket.ReceiveAll(payload.data(), size))
+            throw std::runtime_error("Connection lost while receiving");
+        return true;
+    }
+
+    inline MessageWriter Encode(const RenderJob &job)
+    {
+        MessageWriter writer;
+        writer.PutString(job.scene).Put32(job.width).Put32(job.height).Put32(job.maxDepth).Put64(job.seed);
+        return writer;
+    }
+
+    inline RenderJob DecodeJob(std::span<const uint8_t> payload)
+    {
+        MessageReader reader(payload);
+        RenderJob job;
+        job.scene = reader.GetString();
+        job.width = static_cast<int>(reader.Get32());
+        job.height = static_cast<int>(reader.Get32());
+        job.maxDepth = static_cast<int>(reader.Get32());
+        job.seed = reader.Get64();
+        return job;
+    }
+
+    inline MessageWriter Encode(const TileTask &task)
+    {
+        MessageWriter writer;
+        writer.Put32(task.id).Put32(task.x0).Put32(task.y0).Put32(task.x1).Put32(task.y1);
+        writer.Put32(task.sampleStart).Put32(task.samples);
+        return writer;
+    }
+
+    inline TileTask DecodeTask(std::span<const uint8_t> payload)
+    {
+        MessageReader reader(payload);
+        TileTask task;
+        task.id = reader.Get32();
+        task.x0 = static_cast<int>(reader.Get32());
+        task.y0 = static_cast<int>(reader.Get32());
+        task.x1 = static_cast<int>(reader.Get32());
+        task.y1 = static_cast<int>(reader.Get32());
+        task.sampleStart = reader.Get32();
+        task.samples = reader.Get32();
+        return task;
+    }
+
+    inline MessageWriter Encode(const TileResult &result)
+    {
+        MessageWriter writer;
+        writer.Put32(result.id).Put32(result.samples).PutFloats(result.colors);
+        return writer;
+    }
+
+    inline TileResult DecodeResult(std::span<const uint8_t> payload)
+    {
+        MessageReader reader(payload);
+        TileResult result;
+        result.id = reader.Get32();
+        result.samples = reader.Get32();
+        result.colors = reader.GetFloats();
+        return result;
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include "core/random.h"
+#include "core/renderer.h"
+#include "net/socket.h"
+#include "net/tile_protocol.h"
+#include "scenes/scene_registry.h"
+
+struct WorkerOptions
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 5555;
+    // keep trying to reach a coordinator that is not up yet for this long
+    std::chrono::seconds connectTimeout{30};
+    // stop without answering after this many tiles (0: never), to test how the coordinator
+    // copes with a worker that dies in the middle of a tile
+    int failAfter = 0;
+    bool quiet = false;
+};
+
+// Connects to a coordinator, builds the scene it names and renders tiles until told to stop.
+// Returns the number of tiles rendered.
+inline int RunWorker(const WorkerOptions &options)
+{
+    using namespace TileProtocol;
+
+    Socket connection;
+    const auto deadline = std::chrono::steady_clock::now() + options.connectTimeout;
+    while (!connection.Valid())
+    {
+        try
+        {
+            connection = Socket::Connect(options.host, options.port);
+        }
+        catch (const std::exception &)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+                throw;
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
+
+    MessageWriter hello;
+    hello.Put32(MAGIC).Put32(VERSION);
+    Send(connection, MessageType::Hello, hello);
+
+    MessageType type;
+    std::vector<uint8_t> payload;
+    if (!Receive(connection, type, payload) || type != MessageType::Job)
+        throw std::runtime_error("Coordinator did not send a job");
+    const RenderJob job = DecodeJob(payload);
+
+    // the same seed on every worker builds the same scene
+    SetRandomSeed(job.seed);
+    Scene scene = FindScene(job.scene).create();
+    Renderer renderer{
+        .maxDepth = job.maxDepth,
+        .seed = job.seed,
+        .environmentMap = scene.environmentMap,
+        .quiet = true};
+    if (!options.quiet)
+        fmt::println("Rendering {} ({} x {}) for {}:{}", job.scene, job.width, job.height, options.host, options.port);
+
+    int rendered = 0;
+    while (Receive(connection, type, payload) && type == MessageType::Tile)
+    {
+        if (options.failAfter > 0 && rendered == options.failAfter)
+            return rendered;
+
+        const TileTask task = DecodeTask(payload);
+        // samples are seeded by their index, so a re-issued task renders exactly the same
+        renderer.sampleStart = static_cast<int>(task.sampleStart);
+        renderer.samplesPerPixel = static_cast<int>(task.samples);
+        const std::vector<Color> colors = renderer.RenderTile(*scene.camera, *scene.objects, job.width, job.height,
+                                                              task.x0, task.y0, task.x1, task.y1);
+
+        TileResult result;
+        result.id = task.id;
+        result.samples = task.samples;
+        result.colors.reserve(colors.size() * 3);
+        for (const Color &color : colors)
+        {
+            for (int c = 0; c < 3; c++)
+                result.colors.push_back(static_cast<float>(color[c]));
+        }
+        Send(connection, MessageType::Result, Encode(result));
+        rendered++;
+    }
+    return rendered;
+}
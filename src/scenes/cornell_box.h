@@ -37,6 +37,7 @@ Scene CornellBox()
 
     Camera cam(Vector3(0, 278, -800), Vector3(0, 278, 0), 40.0, 1.0);
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(world),
         .camera = make_shared<Camera>(cam)};
 }
\ No newline at end of file
@@ -7,12 +7,14 @@
 #include "collision/hittable_list.h"
 #include "core/material.h"
 #include "collision/sphere.h"
+#include "collision/sphere_set.h"
 #include "core/camera.h"
 #include "collision/bvh_node.h"
 
 Scene FinalScene01()
 {
     vector<shared_ptr<Hittable>> scene_objects{};
+    SphereList spheres;
 
     auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
     scene_objects.push_back(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
@@ -33,7 +35,7 @@ Scene FinalScene01()
                     // diffuse
                     auto albedo = Color::Random() * Color::Random();
                     sphere_material = make_shared<Lambertian>(albedo);
-                    scene_objects.push_back(make_shared<Sphere>(center, 0.2, sphere_material));
+                    spheres.Add(center, 0.2, sphere_material);
                 }
                 else if (choose_mat < 0.95)
                 {
@@ -41,30 +43,33 @@ Scene FinalScene01()
                     auto albedo = Color::Random(0.5, 1);
                     auto fuzz = RandomDouble(0, 0.5);
                     sphere_material = make_shared<Metal>(albedo, fuzz);
-                    scene_objects.push_back(make_shared<Sphere>(center, 0.2, sphere_material));
+                    spheres.Add(center, 0.2, sphere_material);
                 }
                 else
                 {
                     // glass
                     sphere_material = make_shared<Dielectric>(1.5);
-                    scene_objects.push_back(make_shared<Sphere>(center, 0.2, sphere_material));
+                    spheres.Add(center, 0.2, sphere_material);
                 }
             }
         }
     }
 
     auto material1 = make_shared<Dielectric>(1.5);
-    scene_objects.push_back(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+    spheres.Add(Point3(0, 1, 0), 1.0, material1);
 
     auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    scene_objects.push_back(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+    spheres.Add(Point3(-4, 1, 0), 1.0, material2);
 
     auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    scene_objects.push_back(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+    spheres.Add(Point3(4, 1, 0), 1.0, material3);
+
+    scene_objects.push_back(SphereSet::Create(std::move(spheres)));
 
     auto camera = make_shared<Camera>(Vector3(13, 2, 3), Vector3(0, 0, 0), 20.0, 16.0 / 9.0, 10.0, 0.1);
 
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(scene_objects, 0, scene_objects.size()),
         .camera = camera,
         .environmentMap = GradientMap::Sky()};
@@ -74,6 +79,7 @@ Scene FinalScene01()
 Scene Benchmark01()
 {
     vector<shared_ptr<Hittable>> scene_objects{};
+    SphereList spheres;
 
     auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
     scene_objects.push_back(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
@@ -138,7 +144,7 @@ Scene Benchmark01()
                     Color albedo2(rnd.albedo2_r, rnd.albedo2_g, rnd.albedo2_b);
                     auto albedo = albedo1 * albedo2;
                     sphere_material = make_shared<Lambertian>(albedo);
-                    scene_objects.push_back(make_shared<Sphere>(center, 0.2, sphere_material));
+                    spheres.Add(center, 0.2, sphere_material);
                 }
                 else if (rnd.choose_mat < 0.95)
                 {
@@ -146,13 +152,13 @@ Scene Benchmark01()
                     auto albedo = Color(rnd.albedo_r, rnd.albedo_g, rnd.albedo_b);
                     auto fuzz = rnd.metal_fuzz * 0.5; // Scale to [0, 0.5)
                     sphere_material = make_shared<Metal>(albedo, fuzz);
-                    scene_objects.push_back(make_shared<Sphere>(center, 0.2, sphere_material));
+                    spheres.Add(center, 0.2, sphere_material);
                 }
                 else
                 {
                     // Glass
                     sphere_material = make_shared<Dielectric>(1.5);
-                    scene_objects.push_back(make_shared<Sphere>(center, 0.2, sphere_material));
+                    spheres.Add(center, 0.2, sphere_material);
                 }
             }
         }
@@ -160,17 +166,20 @@ Scene Benchmark01()
 
     // Rest remains identical (deterministic)
     auto material1 = make_shared<Dielectric>(1.5);
-    scene_objects.push_back(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+    spheres.Add(Point3(0, 1, 0), 1.0, material1);
 
     auto material2 = make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    scene_objects.push_back(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+    spheres.Add(Point3(-4, 1, 0), 1.0, material2);
 
     auto material3 = make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    scene_objects.push_back(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+    spheres.Add(Point3(4, 1, 0), 1.0, material3);
+
+    scene_objects.push_back(SphereSet::Create(std::move(spheres)));
 
     auto camera = make_shared<Camera>(Vector3(13, 2, 3), Vector3(0, 0, 0), 20.0, 16.0 / 9.0, 10.0, 0.1);
 
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(scene_objects, 0, scene_objects.size()),
         .camera = camera,
         .environmentMap = GradientMap::Sky()};
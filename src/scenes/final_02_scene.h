@@ -10,10 +10,14 @@
 #include "collision/box.h"
 #include "core/transform.h"
 #include "collision/instance.h"
+#include "collision/sphere_set.h"
 
 Scene FinalScene02()
 {
+    auto arena = make_shared<Arena>();
+
     vector<shared_ptr<Hittable>> boxes1;
+    boxes1.reserve(20 * 20);
     auto ground = make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
 
     int boxes_per_side = 20;
@@ -29,13 +33,13 @@ Scene FinalScene02()
             auto y1 = RandomDouble(1, 101);
             auto z1 = z0 + w;
 
-            boxes1.push_back(CreateBox(Point3(x0, y0, z0), Point3(x1, y1, z1), ground));
+            boxes1.push_back(CreateBox(Point3(x0, y0, z0), Point3(x1, y1, z1), ground, arena.get()));
         }
     }
 
     vector<shared_ptr<Hittable>> world;
 
-    world.push_back(BvhNode::Build(boxes1));
+    world.push_back(BvhNode::Build(boxes1, *arena));
 
     auto light = make_shared<Emissive>(Color(7, 7, 7));
     world.push_back(make_shared<Quad>(Point3(123, 554, 147), Vector3(300, 0, 0), Vector3(0, 0, 265), light));
@@ -46,20 +50,21 @@ Scene FinalScene02()
     auto boundary = make_shared<Sphere>(Point3(360, 150, 145), 70, make_shared<Dielectric>(1.5));
     world.push_back(boundary);
 
-    vector<shared_ptr<Hittable>> boxes2;
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
+    SphereList spheres;
+    auto white = spheres.AddMaterial(make_shared<Lambertian>(Color(.73, .73, .73)));
     int ns = 1000;
     for (int j = 0; j < ns; j++)
     {
-        boxes2.push_back(make_shared<Sphere>(Point3::Random(0, 165), 10, white));
+        spheres.Add(Point3::Random(0, 165), 10, white);
     }
 
-    world.push_back(make_shared<Instance>(BvhNode::Build(boxes2), Transform::FromRotateY(15).Translate(Vector3(-100, 270, 395))));
+    world.push_back(make_shared<Instance>(SphereSet::Create(std::move(spheres)), Transform::FromRotateY(15).Translate(Vector3(-100, 270, 395))));
 
     Camera cam(Point3(478, 278, -600), Point3(278, 278, 0), 40, 1.0);
 
     return Scene{
-        .objects = BvhNode::Build(world),
+        .arena = arena,
+        .objects = KeepArena(arena, BvhNode::Build(world, *arena)),
         .camera = make_shared<Camera>(cam),
     };
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include "collision/quad.h"
 #include "collision/experimental/flat_bvh.h"
 #include "collision/experimental/static_bvh.h"
+#include "collision/experimental/out_of_core_bvh.h"
+#include "io/mesh_cache.h"
 
 vector<shared_ptr<Hittable>> EmptyCornellBox()
 {
@@ -43,6 +45,7 @@ Scene MeshTest(string file)
     auto cam = std::make_shared<Camera>(Vector3(0, 278, -800), Vector3(0, 278, 0), 40.0, 1.0);
 
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(world),
         .camera = cam,
     };
@@ -51,9 +54,10 @@ Scene MeshTest(string file)
 Scene FlatMeshTest(string file)
 {
     auto world = EmptyCornellBox();
-    auto mesh = FlatBvh::Mesh::Create(file);
+    auto mesh = MeshCache::LoadOrConvert(file);
     fmt::println("Face Count: {}", mesh->FaceCount());
     fmt::println("BVH Node Count: {}", mesh->BvhNodeCount());
+    fmt::println("Mesh Memory: {:.1f} MB", mesh->MemoryUsage() / (1024.0 * 1024.0));
     auto scale = 250.0 / mesh->BoundingBox().LongestAxis().Length();
     auto scaled = std::make_shared<Instance>(mesh, Transform::FromTranslate(0, 0, 300).Scale(scale).RotateY(180));
     world.push_back(scaled);
@@ -63,6 +67,7 @@ Scene FlatMeshTest(string file)
     auto cam = std::make_shared<Camera>(Vector3(0, 278, -800), Vector3(0, 278, 0), 40.0, 1.0);
 
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(world),
         .camera = cam,
     };
@@ -71,7 +76,7 @@ Scene FlatMeshTest(string file)
 Scene StaticMeshTest(string file)
 {
     auto world = EmptyCornellBox();
-    auto mesh = StaticBvh::Mesh::Create("assets/stanford-bunny.obj");
+    auto mesh = StaticBvh::Mesh::CreateCached(file);
     fmt::println("Face Count: {}", mesh->FaceCount());
     auto scale = 250.0 / mesh->BoundingBox().LongestAxis().Length();
     auto scaled = std::make_shared<Instance>(mesh, Transform::FromTranslate(0, 0, 300).Scale(scale).RotateY(180));
@@ -82,6 +87,7 @@ Scene StaticMeshTest(string file)
     auto cam = std::make_shared<Camera>(Vector3(0, 278, -800), Vector3(0, 278, 0), 40.0, 1.0);
 
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(world),
         .camera = cam,
     };
@@ -104,6 +110,7 @@ Scene TriangleListTest(string file, bool useBvh = true)
     auto cam = std::make_shared<Camera>(Vector3(0, 278, -800), Vector3(0, 278, 0), 40.0, 1.0);
 
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(world),
         .camera = cam,
     };
@@ -127,4 +134,24 @@ Scene StanfordBunnyAsStaticMesh()
 Scene StanfordBunnyAsFlatMesh()
 {
     return FlatMeshTest("assets/stanford-bunny.obj");
-}
\ No newline at end of file
+}
+Scene OutOfCoreMeshTest(string file, size_t memoryCap = 64 * 1024 * 1024)
+{
+    auto world = EmptyCornellBox();
+    auto mesh = OutOfCore::OpenOrConvert(file, memoryCap);
+    fmt::println("Face Count: {}", mesh->FaceCount());
+    fmt::println("Chunk Memory Cap: {:.1f} MB", memoryCap / (1024.0 * 1024.0));
+    auto scale = 250.0 / mesh->BoundingBox().LongestAxis().Length();
+    auto scaled = std::make_shared<Instance>(mesh, Transform::FromTranslate(0, 0, 300).Scale(scale).RotateY(180));
+    world.push_back(scaled);
+
+    fmt::println("Scaled Mesh BB: {:.3f}", scaled->BoundingBox());
+
+    auto cam = std::make_shared<Camera>(Vector3(0, 278, -800), Vector3(0, 278, 0), 40.0, 1.0);
+
+    return Scene{
+        .arena = nullptr,
+        .objects = BvhNode::Build(world),
+        .camera = cam,
+    };
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "scenes/scene.h"
+#include "core/hittable.h"
+#include "core/material.h"
+#include "core/camera.h"
+#include "core/transform.h"
+#include "collision/sphere.h"
+#include "collision/box.h"
+#include "collision/instance.h"
+#include "collision/motion_bvh_node.h"
+
+// Bouncing spheres and a sliding box, rendered with the shutter open over [0, 1].
+Scene MotionBlurScene()
+{
+    vector<shared_ptr<Hittable>> scene_objects{};
+
+    auto ground_material = make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
+    scene_objects.push_back(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
+
+    for (int a = -11; a < 11; a++)
+    {
+        for (int b = -11; b < 11; b++)
+        {
+            auto choose_mat = RandomDouble();
+            Point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
+
+            if ((center - Point3(4, 0.2, 0)).Length() > 0.9)
+            {
+                if (choose_mat < 0.8)
+                {
+                    // diffuse spheres bounce
+                    auto albedo = Color::Random() * Color::Random();
+                    auto center2 = center + Vector3(0, RandomDouble(0, 0.5), 0);
+                    scene_objects.push_back(make_shared<Sphere>(center, center2, 0.2, make_shared<Lambertian>(albedo)));
+                }
+                else if (choose_mat < 0.95)
+                {
+                    auto albedo = Color::Random(0.5, 1);
+                    auto fuzz = RandomDouble(0, 0.5);
+                    scene_objects.push_back(make_shared<Sphere>(center, 0.2, make_shared<Metal>(albedo, fuzz)));
+                }
+                else
+                {
+                    scene_objects.push_back(make_shared<Sphere>(center, 0.2, make_shared<Dielectric>(1.5)));
+                }
+            }
+        }
+    }
+
+    scene_objects.push_back(make_shared<Sphere>(Point3(0, 1, 0), 1.0, make_shared<Dielectric>(1.5)));
+    scene_objects.push_back(make_shared<Sphere>(Point3(4, 1, 0), 1.0, make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0)));
+
+    auto box = CreateBox(Point3(-0.75, 0, -0.75), Point3(0.75, 1.5, 0.75), make_shared<Lambertian>(Color(0.4, 0.2, 0.1)));
+    scene_objects.push_back(make_shared<MotionInstance>(box,
+                                                        Transform::FromTranslate(-4.5, 0, 0).RotateY(10),
+                                                        Transform::FromTranslate(-3.5, 0, 0).RotateY(20)));
+
+    auto camera = make_shared<Camera>(Vector3(13, 2, 3), Vector3(0, 0, 0), 20.0, 16.0 / 9.0, 10.0, 0.1,
+                                      0.0, 1.0, Vector3(0, 1, 0));
+
+    return Scene{
+        .arena = nullptr,
+        .objects = MotionBvhNode::Build(scene_objects),
+        .camera = camera,
+        .environmentMap = GradientMap::Sky()};
+}
@@ -24,6 +24,7 @@ Scene QuadsScene()
 
     Camera cam(Point3(0, 0, 9), Point3(0, 0, 0), 80.0, 1.0);
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(world.shapes),
         .camera = make_shared<Camera>(cam),
         .environmentMap = GradientMap::Sky()};
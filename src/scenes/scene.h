@@ -3,10 +3,31 @@
 #include "core/hittable.h"
 #include "core/camera.h"
 #include "core/environment_map.h"
+#include "core/arena.h"
 
+// Objects built in an arena point into it. Scenes that use one pass their root through
+// KeepArena, so objects, and every copy of it, keeps the arena alive; a child taken out of
+// the tree on its own does not, and must not outlive the root.
 struct Scene
 {
+    // Backing memory of primitives and BVH nodes built with it. Declared first so it is
+    // released last, after everything that points into it, in a single step.
+    std::shared_ptr<Arena> arena;
     std::shared_ptr<Hittable> objects;
     std::shared_ptr<Camera> camera;
     std::shared_ptr<EnvironmentMap> environmentMap = nullptr;
-};
\ No newline at end of file
+};
+
+// Returns a pointer to root that shares ownership of root and arena: the arena is released
+// when the last copy goes, after the root.
+inline std::shared_ptr<Hittable> KeepArena(std::shared_ptr<Arena> arena, std::shared_ptr<Hittable> root)
+{
+    struct Owner
+    {
+        std::shared_ptr<Arena> arena;
+        std::shared_ptr<Hittable> root;
+    };
+    Hittable *pointer = root.get();
+    auto owner = std::make_shared<Owner>(std::move(arena), std::move(root));
+    return std::shared_ptr<Hittable>(owner, pointer);
+}
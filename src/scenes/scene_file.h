@@ -0,0 +1,1140 @@
+#pragma once
+
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "core/arena.h"
+#include "core/camera.h"
+#include "core/environment_map.h"
+#include "core/material.h"
+#include "core/trace.h"
+#include "core/transform.h"
+#include "collision/box.h"
+#include "collision/bvh_node.h"
+#include "collision/hittable_list.h"
+#include "collision/instance.h"
+#include "collision/motion_bvh_node.h"
+#include "collision/quad.h"
+#include "collision/sphere.h"
+#include "collision/sphere_set.h"
+#include "collision/triangle.h"
+#include "collision/experimental/flat_bvh.h"
+#include "collision/experimental/static_bvh.h"
+#include "collision/experimental/out_of_core_bvh.h"
+#include "io/json_reader.h"
+#include "io/json_writer.h"
+#include "io/mesh_cache.h"
+#include "io/object_loader.h"
+#include "scenes/scene.h"
+
+// Scenes described in a JSON file instead of code, so that a new scene needs no rebuild.
+//
+//   {
+//     "camera": {"origin": [0, 278, -800], "target": [0, 278, 0], "fov": 40, "aspect": 1},
+//     "environment": {"type": "gradient", "bottom": [1, 1, 1], "top": [0.5, 0.7, 1]},
+//     "materials": {
+//       "white": {"type": "lambertian", "albedo": [0.73, 0.73, 0.73]},
+//       "light": {"type": "emissive", "emission": [15, 15, 15]}
+//     },
+//     "shapes": {
+//       "bunny": {"type": "mesh", "file": "assets/stanford-bunny.obj", "bvh": "flat", "material": "white"}
+//     },
+//     "objects": [
+//       {"type": "quad", "corner": [65.5, 554, 332], "u": [-130, 0, 0], "v": [0, 0, -105], "material": "light"},
+//       {"type": "instance", "shape": "bunny", "transform": [{"translate": [0, 0, 300]}, {"scale": 1500}]}
+//     ]
+//   }
+//
+// Camera members: origin, target, fov (degrees), aspect, focus_distance, aperture, exposure
+// ([start, end]) and up. Environments: "gradient" (bottom, top) and "sky". Materials:
+// "lambertian" (albedo), "metal" (albedo, fuzz), "dielectric" (refraction_index) and
+// "emissive" (emission). Objects:
+//   sphere      center, radius, material; center_end makes it move over the shutter
+//   quad        corner, u, v, material
+//   triangle    v0, v1, v2, material
+//   box         min, max, material
+//   sphere_set  materials (a list), spheres ([[x, y, z, radius, material index], ...])
+//   mesh        file (OBJ), material, bvh ("flat", "static", "triangles" or "out_of_core"),
+//               memory_cap_mb for out_of_core
+//   group       objects, bvh (false keeps a plain list)
+//   instance    shape (a name from "shapes") or object, transform; transform_end makes it move
+// A material is a name from "materials" or a material object in place.
+//
+// A transform is either 12 (or 16) numbers, the rows of the matrix, or a list of steps
+// applied like the chained Transform calls: {"translate": [x, y, z]}, {"scale": s or [x, y, z]},
+// {"rotate_x": degrees} (also _y, _z), {"rotate": {"angle": degrees, "axis": [x, y, z]}}
+// and {"matrix": [12 numbers]}.
+//
+// The file is read in one pass without holding the document, so that scenes with millions
+// of instances load at the speed of the parse: a section may only refer to names defined
+// above it, every object and material starts with its "type", and instances, spheres,
+// quads and triangles go to the scene's arena. "shapes" are built once and placed only by
+// instances. OBJ paths are relative to the working directory, like in the built-in scenes.
+namespace SceneFile
+{
+    class Reader
+    {
+    public:
+        explicit Reader(std::istream &in) : json(in) {}
+
+        Scene Read()
+        {
+            TRACE_SCOPE("SceneFile::Read", "scene");
+            Scene scene;
+            scene.arena = std::make_shared<Arena>();
+            arena = scene.arena.get();
+
+            std::vector<std::shared_ptr<Hittable>> world;
+            bool movingWorld = false;
+            json.BeginObject();
+            std::string section;
+            while (json.NextKey(section))
+            {
+                if (section == "camera")
+                {
+                    scene.camera = ReadCamera();
+                }
+                else if (section == "environment")
+                {
+                    scene.environmentMap = ReadEnvironment();
+                }
+                else if (section == "materials")
+                {
+                    json.BeginObject();
+                    std::string name;
+                    while (json.NextKey(name))
+                    {
+                        if (materials.contains(name))
+                            json.Fail("material '" + name + "' is defined twice");
+                        materials.emplace(name, ReadMaterial());
+                    }
+                }
+                else if (section == "shapes")
+                {
+                    json.BeginObject();
+                    std::string name;
+                    while (json.NextKey(name))
+                    {
+                        if (shapes.contains(name))
+                            json.Fail("shape '" + name + "' is defined twice");
+                        bool moving = false;
+                        auto shape = ReadObject(moving);
+                        shapes.emplace(name, Shape{shape, moving});
+                    }
+                }
+                else if (section == "objects")
+                {
+                    json.BeginArray();
+                    while (json.NextElement())
+                        world.push_back(ReadObject(movingWorld));
+                }
+                else
+                {
+                    json.Fail("unknown section '" + section + "'");
+                }
+            }
+            json.ExpectEnd();
+
+            if (!scene.camera)
+                throw std::invalid_argument("A scene file needs a camera.");
+            if (world.empty())
+                throw std::invalid_argument("A scene file needs at least one object.");
+            if (movingWorld)
+                scene.objects = KeepArena(scene.arena, MotionBvhNode::Build(std::move(world)));
+            else
+                scene.objects = KeepArena(scene.arena, BvhNode::Build(std::move(world), *scene.arena));
+            return scene;
+        }
+
+    private:
+        struct Shape
+        {
+            std::shared_ptr<Hittable> object;
+            // moves over the shutter, so the tree above it has to interpolate its box
+            bool moving;
+        };
+
+        JsonReader json;
+        Arena *arena = nullptr;
+        std::unordered_map<std::string, std::shared_ptr<Material>> materials;
+        std::unordered_map<std::string, Shape> shapes;
+        // type names and references, reused from object to object
+        std::string text;
+
+        Vector3 ReadVector()
+        {
+            double values[3];
+            json.BeginArray();
+            for (double &value : values)
+            {
+                if (!json.NextElement())
+                    json.Fail("expected three numbers");
+                value = json.ReadNumber();
+            }
+            if (json.NextElement())
+                json.Fail("expected three numbers");
+            return Vector3(values[0], values[1], values[2]);
+        }
+
+        // Reads the "type" member, which has to come first.
+        const std::string &ReadType(const char *what)
+        {
+            std::string &key = text;
+            if (!json.NextKey(key) || key != "type")
+                json.Fail(std::string(what) + " starts with its \"type\"");
+            json.ReadString(text);
+            return text;
+        }
+
+        std::shared_ptr<Camera> ReadCamera()
+        {
+            Vector3 origin(0, 0, 0), target(0, 0, -1), up(0, 1, 0);
+            double fov = 90.0, aspect = 16.0 / 9.0, focusDistance = 1.0, aperture = 0.0;
+            double exposureStart = 0.0, exposureEnd = 0.0;
+            json.BeginObject();
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "origin")
+                    origin = ReadVector();
+                else if (key == "target")
+                    target = ReadVector();
+                else if (key == "up")
+                    up = ReadVector();
+                else if (key == "fov")
+                    fov = json.ReadNumber();
+                else if (key == "aspect")
+                    aspect = json.ReadNumber();
+                else if (key == "focus_distance")
+                    focusDistance = json.ReadNumber();
+                else if (key == "aperture")
+                    aperture = json.ReadNumber();
+                else if (key == "exposure")
+                {
+                    json.BeginArray();
+                    if (!json.NextElement())
+                        json.Fail("expected [start, end]");
+                    exposureStart = json.ReadNumber();
+                    if (!json.NextElement())
+                        json.Fail("expected [start, end]");
+                    exposureEnd = json.ReadNumber();
+                    if (json.NextElement())
+                        json.Fail("expected [start, end]");
+                }
+                else
+                    json.Fail("unknown camera member '" + key + "'");
+            }
+            if (!(fov > 0.0 && fov < 180.0) || !(aspect > 0.0))
+                json.Fail("the camera needs a field of view between 0 and 180 degrees and a positive aspect ratio");
+            return std::make_shared<Camera>(origin, target, fov, aspect, focusDistance, aperture, exposureStart, exposureEnd, up);
+        }
+
+        std::shared_ptr<EnvironmentMap> ReadEnvironment()
+        {
+            if (json.Peek() == JsonReader::Type::Null)
+            {
+                json.ReadNull();
+                return nullptr;
+            }
+            json.BeginObject();
+            const std::string &type = ReadType("an environment");
+            if (type == "sky")
+            {
+                std::string key;
+                if (json.NextKey(key))
+                    json.Fail("unknown sky member '" + key + "'");
+                return GradientMap::Sky();
+            }
+            if (type != "gradient")
+                json.Fail("unknown environment type '" + type + "'");
+
+            std::optional<Color> bottom, top;
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "bottom")
+                    bottom = ReadVector();
+                else if (key == "top")
+                    top = ReadVector();
+                else
+                    json.Fail("unknown gradient member '" + key + "'");
+            }
+            if (!bottom || !top)
+                json.Fail("a gradient needs bottom and top colors");
+            return std::make_shared<GradientMap>(*bottom, *top);
+        }
+
+        std::shared_ptr<Material> ReadMaterial()
+        {
+            json.BeginObject();
+            const std::string &typeName = ReadType("a material");
+            enum class Type
+            {
+                Lambertian,
+                Metal,
+                Dielectric,
+                Emissive,
+            } type;
+            if (typeName == "lambertian")
+                type = Type::Lambertian;
+            else if (typeName == "metal")
+                type = Type::Metal;
+            else if (typeName == "dielectric")
+                type = Type::Dielectric;
+            else if (typeName == "emissive")
+                type = Type::Emissive;
+            else
+                json.Fail("unknown material type '" + typeName + "'");
+
+            Color color(0.5, 0.5, 0.5);
+            double fuzz = 0.0, refractionIndex = 1.5;
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if ((key == "albedo" && type != Type::Dielectric && type != Type::Emissive) ||
+                    (key == "emission" && type == Type::Emissive))
+                    color = ReadVector();
+                else if (key == "fuzz" && type == Type::Metal)
+                    fuzz = json.ReadNumber();
+                else if (key == "refraction_index" && type == Type::Dielectric)
+                    refractionIndex = json.ReadNumber();
+                else
+                    json.Fail("unknown " + typeName + " member '" + key + "'");
+            }
+
+            switch (type)
+            {
+            case Type::Lambertian:
+                return std::make_shared<Lambertian>(color);
+            case Type::Metal:
+                return std::make_shared<Metal>(color, fuzz);
+            case Type::Dielectric:
+                return std::make_shared<Dielectric>(refractionIndex);
+            case Type::Emissive:
+                return std::make_shared<Emissive>(color);
+            }
+            return nullptr;
+        }
+
+        // A name from "materials" or a material in place.
+        std::shared_ptr<Material> ReadMaterialReference()
+        {
+            if (json.Peek() == JsonReader::Type::Object)
+                return ReadMaterial();
+            json.ReadString(text);
+            auto found = materials.find(text);
+            if (found == materials.end())
+                json.Fail("unknown material '" + text + "'");
+            return found->second;
+        }
+
+        Transform ReadTransformStep()
+        {
+            json.BeginObject();
+            std::string key;
+            if (!json.NextKey(key))
+                json.Fail("empty transform step");
+
+            Transform step;
+            if (key == "translate")
+                step = Transform::FromTranslate(ReadVector());
+            else if (key == "scale" && json.Peek() == JsonReader::Type::Number)
+                step = Transform::FromScale(json.ReadNumber());
+            else if (key == "scale")
+            {
+                const Vector3 scale = ReadVector();
+                step = Transform::FromScale(scale.x(), scale.y(), scale.z());
+            }
+            else if (key == "rotate_x")
+                step = Transform::FromRotateX(json.ReadNumber());
+            else if (key == "rotate_y")
+                step = Transform::FromRotateY(json.ReadNumber());
+            else if (key == "rotate_z")
+                step = Transform::FromRotateZ(json.ReadNumber());
+            else if (key == "rotate")
+            {
+                double angle = 0.0;
+                Vector3 axis(0, 1, 0);
+                json.BeginObject();
+                std::string member;
+                while (json.NextKey(member))
+                {
+                    if (member == "angle")
+                        angle = json.ReadNumber();
+                    else if (member == "axis")
+                        axis = ReadVector();
+                    else
+                        json.Fail("unknown rotate member '" + member + "'");
+                }
+                step = Transform::FromRotate(angle, axis);
+            }
+            else if (key == "matrix")
+            {
+                json.BeginArray();
+                step = ReadMatrix(false);
+            }
+            else
+                json.Fail("unknown transform step '" + key + "'");
+
+            if (json.NextKey(key))
+                json.Fail("a transform step has a single member");
+            return step;
+        }
+
+        // The rows of an affine matrix from an array whose '[' has been read; atFirst when
+        // NextElement has already moved to the first number.
+        Transform ReadMatrix(bool atFirst)
+        {
+            double values[16];
+            int count = 0;
+            for (bool more = atFirst || json.NextElement(); more; more = json.NextElement())
+            {
+                if (count == 16)
+                    json.Fail("a matrix has 12 or 16 numbers");
+                values[count++] = json.ReadNumber();
+            }
+            if (count != 12 && count != 16)
+                json.Fail("a matrix has 12 or 16 numbers");
+            if (count == 16 && (values[12] != 0.0 || values[13] != 0.0 || values[14] != 0.0 || values[15] != 1.0))
+                json.Fail("only affine transforms are supported");
+
+            Transform matrix;
+            for (int row = 0; row < 3; row++)
+            {
+                for (int column = 0; column < 4; column++)
+                    matrix(row, column) = values[row * 4 + column];
+            }
+            return matrix;
+        }
+
+        // Matrix rows or a list of steps.
+        Transform ReadTransform()
+        {
+            json.BeginArray();
+            if (!json.NextElement())
+                return Transform();
+            if (json.Peek() == JsonReader::Type::Number)
+                return ReadMatrix(true);
+
+            Transform transform;
+            do
+                transform = transform * ReadTransformStep();
+            while (json.NextElement());
+            return transform;
+        }
+
+        [[noreturn]] void UnknownMember(const char *type, const std::string &key)
+        {
+            json.Fail(std::string("unknown ") + type + " member '" + key + "'");
+        }
+
+        template <typename T>
+        const T &Required(const std::optional<T> &value, const char *type, const char *member)
+        {
+            if (!value)
+                json.Fail(std::string("a ") + type + " needs " + member);
+            return *value;
+        }
+
+        // One object. Sets moving when the object moves over the shutter.
+        std::shared_ptr<Hittable> ReadObject(bool &moving)
+        {
+            json.BeginObject();
+            const std::string &type = ReadType("an object");
+            if (type == "sphere")
+                return ReadSphere(moving);
+            if (type == "quad")
+                return ReadQuad();
+            if (type == "triangle")
+                return ReadTriangle();
+            if (type == "box")
+                return ReadBox();
+            if (type == "sphere_set")
+                return ReadSphereSet();
+            if (type == "mesh")
+                return ReadMesh();
+            if (type == "group")
+                return ReadGroup(moving);
+            if (type == "instance")
+                return ReadInstance(moving);
+            json.Fail("unknown object type '" + type + "'");
+        }
+
+        std::shared_ptr<Hittable> ReadSphere(bool &moving)
+        {
+            std::optional<Point3> center, centerEnd;
+            std::optional<double> radius;
+            auto material = DefaultMaterial();
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "center")
+                    center = ReadVector();
+                else if (key == "center_end")
+                    centerEnd = ReadVector();
+                else if (key == "radius")
+                    radius = json.ReadNumber();
+                else if (key == "material")
+                    material = ReadMaterialReference();
+                else
+                    UnknownMember("sphere", key);
+            }
+            Required(center, "sphere", "a center");
+            Required(radius, "sphere", "a radius");
+            if (centerEnd)
+            {
+                moving = true;
+                return MakeShared<Sphere>(arena, *center, *centerEnd, *radius, material);
+            }
+            return MakeShared<Sphere>(arena, *center, *radius, material);
+        }
+
+        std::shared_ptr<Hittable> ReadQuad()
+        {
+            std::optional<Vector3> corner, u, v;
+            auto material = DefaultMaterial();
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "corner")
+                    corner = ReadVector();
+                else if (key == "u")
+                    u = ReadVector();
+                else if (key == "v")
+                    v = ReadVector();
+                else if (key == "material")
+                    material = ReadMaterialReference();
+                else
+                    UnknownMember("quad", key);
+            }
+            return MakeShared<Quad>(arena, Required(corner, "quad", "a corner"), Required(u, "quad", "an edge u"),
+                                    Required(v, "quad", "an edge v"), material);
+        }
+
+        std::shared_ptr<Hittable> ReadTriangle()
+        {
+            std::optional<Point3> v0, v1, v2;
+            auto material = DefaultMaterial();
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "v0")
+                    v0 = ReadVector();
+                else if (key == "v1")
+                    v1 = ReadVector();
+                else if (key == "v2")
+                    v2 = ReadVector();
+                else if (key == "material")
+                    material = ReadMaterialReference();
+                else
+                    UnknownMember("triangle", key);
+            }
+            return MakeShared<Triangle>(arena, Required(v0, "triangle", "v0"), Required(v1, "triangle", "v1"),
+                                        Required(v2, "triangle", "v2"), material);
+        }
+
+        std::shared_ptr<Hittable> ReadBox()
+        {
+            std::optional<Point3> min, max;
+            auto material = DefaultMaterial();
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "min")
+                    min = ReadVector();
+                else if (key == "max")
+                    max = ReadVector();
+                else if (key == "material")
+                    material = ReadMaterialReference();
+                else
+                    UnknownMember("box", key);
+            }
+            return CreateBox(Required(min, "box", "a min corner"), Required(max, "box", "a max corner"), material, arena);
+        }
+
+        std::shared_ptr<Hittable> ReadSphereSet()
+        {
+            SphereList list;
+            // the set's id of each listed material; SphereList merges repeated ones
+            std::vector<uint32_t> ids;
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "materials")
+                {
+                    json.BeginArray();
+                    while (json.NextElement())
+                        ids.push_back(list.AddMaterial(ReadMaterialReference()));
+                }
+                else if (key == "spheres")
+                {
+                    json.BeginArray();
+                    while (json.NextElement())
+                    {
+                        double values[4];
+                        int64_t material = 0;
+                        int count = 0;
+                        json.BeginArray();
+                        while (json.NextElement())
+                        {
+                            if (count < 4)
+                                values[count] = json.ReadNumber();
+                            else if (count == 4)
+                                material = json.ReadInt();
+                            else
+                                json.Fail("a sphere is [x, y, z, radius] or [x, y, z, radius, material]");
+                            count++;
+                        }
+                        if (count < 4)
+                            json.Fail("a sphere is [x, y, z, radius] or [x, y, z, radius, material]");
+                        if (material < 0)
+                            json.Fail("negative material index");
+                        list.Add(Point3(values[0], values[1], values[2]), values[3], static_cast<uint32_t>(material));
+                    }
+                }
+                else
+                    UnknownMember("sphere_set", key);
+            }
+
+            if (list.Size() == 0)
+                json.Fail("a sphere_set needs spheres");
+            if (ids.empty())
+                ids.push_back(list.AddMaterial(DefaultMaterial()));
+            for (uint32_t &id : list.materialIds)
+            {
+                if (id >= ids.size())
+                    json.Fail("material index " + std::to_string(id) + " is not in the set's materials");
+                id = ids[id];
+            }
+            return SphereSet::Create(std::move(list));
+        }
+
+        std::shared_ptr<Hittable> ReadMesh()
+        {
+            enum class Bvh
+            {
+                Flat,
+                Static,
+                Triangles,
+                OutOfCore,
+            } bvh = Bvh::Flat;
+            std::string file;
+            auto material = DefaultMaterial();
+            double memoryCapMb = 64.0;
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "file")
+                    json.ReadString(file);
+                else if (key == "material")
+                    material = ReadMaterialReference();
+                else if (key == "memory_cap_mb")
+                    memoryCapMb = json.ReadNumber();
+                else if (key == "bvh")
+                {
+                    json.ReadString(text);
+                    if (text == "flat")
+                        bvh = Bvh::Flat;
+                    else if (text == "static")
+                        bvh = Bvh::Static;
+                    else if (text == "triangles")
+                        bvh = Bvh::Triangles;
+                    else if (text == "out_of_core")
+                        bvh = Bvh::OutOfCore;
+                    else
+                        json.Fail("unknown mesh bvh '" + text + "'");
+                }
+                else
+                    UnknownMember("mesh", key);
+            }
+            if (file.empty())
+                json.Fail("a mesh needs a file");
+            if (!(memoryCapMb > 0.0))
+                json.Fail("memory_cap_mb must be positive");
+
+            switch (bvh)
+            {
+            case Bvh::Flat:
+                return MeshCache::LoadOrConvert(file, material);
+            case Bvh::Static:
+                return StaticBvh::Mesh::CreateCached(file, material);
+            case Bvh::OutOfCore:
+                return OutOfCore::OpenOrConvert(file, static_cast<size_t>(memoryCapMb * 1024 * 1024), material);
+            case Bvh::Triangles:
+                break;
+            }
+            auto triangles = LoadAsTriangleList(file);
+            for (auto &triangle : triangles->shapes)
+                static_cast<Triangle &>(*triangle).material = material;
+            return BvhNode::Build(std::move(triangles->shapes), *arena);
+        }
+
+        std::shared_ptr<Hittable> ReadGroup(bool &moving)
+        {
+            std::vector<std::shared_ptr<Hittable>> objects;
+            bool bvh = true, movingObjects = false;
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if (key == "objects")
+                {
+                    json.BeginArray();
+                    while (json.NextElement())
+                        objects.push_back(ReadObject(movingObjects));
+                }
+                else if (key == "bvh")
+                    bvh = json.ReadBool();
+                else
+                    UnknownMember("group", key);
+            }
+            if (objects.empty())
+                json.Fail("a group needs objects");
+
+            moving = moving || movingObjects;
+            if (!bvh)
+                return MakeShared<HittableList>(arena, objects);
+            if (movingObjects)
+                return MotionBvhNode::Build(std::move(objects));
+            return BvhNode::Build(std::move(objects), *arena);
+        }
+
+        std::shared_ptr<Hittable> ReadInstance(bool &moving)
+        {
+            std::shared_ptr<Hittable> object;
+            bool movingObject = false;
+            Transform transform;
+            std::optional<Transform> transformEnd;
+            std::string key;
+            while (json.NextKey(key))
+            {
+                if ((key == "shape" || key == "object") && object)
+                    json.Fail("an instance has either a shape or an object");
+                if (key == "shape")
+                {
+                    json.ReadString(text);
+                    auto found = shapes.find(text);
+                    if (found == shapes.end())
+                        json.Fail("unknown shape '" + text + "'");
+                    object = found->second.object;
+                    movingObject = found->second.moving;
+                }
+                else if (key == "object")
+                    object = ReadObject(movingObject);
+                else if (key == "transform")
+                    transform = ReadTransform();
+                else if (key == "transform_end")
+                    transformEnd = ReadTransform();
+                else
+                    UnknownMember("instance", key);
+            }
+            if (!object)
+                json.Fail("an instance needs a shape or an object");
+
+            moving = moving || movingObject || transformEnd.has_value();
+            if (transformEnd)
+                return MakeShared<MotionInstance>(arena, object, transform, *transformEnd);
+            return MakeShared<Instance>(arena, object, transform);
+        }
+    };
+
+    // Describes a built scene in the format above, for exporting the scenes written in code.
+    // Materials get names, and so does every shape placed by more than one instance. BVH
+    // trees are written as the objects they hold and rebuilt on load; meshes are written as
+    // references to the OBJ file they were loaded from.
+    class Writer
+    {
+    public:
+        explicit Writer(std::ostream &out) : out(out) {}
+
+        void Write(const Scene &scene)
+        {
+            if (!scene.camera || !scene.objects)
+                throw std::invalid_argument("SceneFile::Writer: the scene has no camera or no objects.");
+
+            std::vector<const Hittable *> objects;
+            Leaves(*scene.objects, objects);
+            for (const Hittable *object : objects)
+                Collect(*object);
+            for (const Hittable *shape : placed)
+            {
+                if (uses[shape] > 1)
+                {
+                    shapeNames.emplace(shape, "shape_" + std::to_string(shapes.size()));
+                    shapes.push_back(shape);
+                }
+            }
+
+            out << "{\n  \"camera\": " << Line([&](JsonWriter &json)
+                                             { WriteCamera(json, *scene.camera); });
+            if (scene.environmentMap)
+            {
+                out << ",\n  \"environment\": " << Line([&](JsonWriter &json)
+                                                    { WriteEnvironment(json, *scene.environmentMap); });
+            }
+
+            out << ",\n  \"materials\": {";
+            for (size_t i = 0; i < materials.size(); i++)
+            {
+                out << (i > 0 ? ",\n    \"" : "\n    \"") << materialNames.at(materials[i]) << "\": "
+                    << Line([&](JsonWriter &json)
+                            { WriteMaterial(json, *materials[i]); });
+            }
+            out << (materials.empty() ? "}" : "\n  }");
+
+            out << ",\n  \"shapes\": {";
+            for (size_t i = 0; i < shapes.size(); i++)
+            {
+                out << (i > 0 ? ",\n    \"" : "\n    \"") << shapeNames.at(shapes[i]) << "\": "
+                    << Line([&](JsonWriter &json)
+                            { WriteObject(json, *shapes[i]); });
+            }
+            out << (shapes.empty() ? "}" : "\n  }");
+
+            out << ",\n  \"objects\": [";
+            for (size_t i = 0; i < objects.size(); i++)
+            {
+                out << (i > 0 ? ",\n    " : "\n    ") << Line([&](JsonWriter &json)
+                                                       { WriteObject(json, *objects[i]); });
+            }
+            out << "\n  ]\n}\n";
+        }
+
+    private:
+        std::ostream &out;
+        std::vector<const Material *> materials;
+        std::unordered_map<const Material *, std::string> materialNames;
+        // shapes placed by instances, each after the ones it contains, and how often each is placed
+        std::vector<const Hittable *> placed;
+        std::unordered_map<const Hittable *, int> uses;
+        std::vector<const Hittable *> shapes;
+        std::unordered_map<const Hittable *, std::string> shapeNames;
+
+        // one object, material or camera per line
+        template <typename Function>
+        static std::string Line(Function write)
+        {
+            JsonWriter json(false);
+            write(json);
+            return json.String();
+        }
+
+        [[noreturn]] static void Unsupported(const char *what, const std::type_info &type)
+        {
+            throw std::runtime_error(std::string("Scene files cannot describe ") + what + " of type " + type.name() + ".");
+        }
+
+        // The shapes under a BVH, which the reader rebuilds.
+        static void Leaves(const Hittable &object, std::vector<const Hittable *> &leaves)
+        {
+            if (auto *node = dynamic_cast<const BvhNode *>(&object))
+            {
+                Leaves(*node->Left(), leaves);
+                if (node->Right() != node->Left())
+                    Leaves(*node->Right(), leaves);
+            }
+            else if (auto *motionNode = dynamic_cast<const MotionBvhNode *>(&object))
+            {
+                Leaves(*motionNode->Left(), leaves);
+                if (motionNode->Right() != motionNode->Left())
+                    Leaves(*motionNode->Right(), leaves);
+            }
+            else
+            {
+                leaves.push_back(&object);
+            }
+        }
+
+        void AddMaterial(const std::shared_ptr<Material> &material)
+        {
+            if (materialNames.try_emplace(material.get(), "material_" + std::to_string(materials.size())).second)
+                materials.push_back(material.get());
+        }
+
+        void Place(const Hittable &shape)
+        {
+            if (uses[&shape]++ > 0)
+                return;
+            Collect(shape);
+            placed.push_back(&shape);
+        }
+
+        // Names the materials and counts the placements of shapes below object.
+        void Collect(const Hittable &object)
+        {
+            if (auto *sphere = dynamic_cast<const Sphere *>(&object))
+                AddMaterial(sphere->material);
+            else if (auto *quad = dynamic_cast<const Quad *>(&object))
+                AddMaterial(quad->GetMaterial());
+            else if (auto *triangle = dynamic_cast<const Triangle *>(&object))
+                AddMaterial(triangle->material);
+            else if (auto *set = dynamic_cast<const SphereSet *>(&object))
+            {
+                for (const auto &material : set->Spheres().materials)
+                    AddMaterial(material);
+            }
+            else if (auto *list = dynamic_cast<const HittableList *>(&object))
+            {
+                for (const auto &shape : list->shapes)
+                    Collect(*shape);
+            }
+            else if (dynamic_cast<const BvhNode *>(&object) || dynamic_cast<const MotionBvhNode *>(&object))
+            {
+                std::vector<const Hittable *> leaves;
+                Leaves(object, leaves);
+                for (const Hittable *leaf : leaves)
+                    Collect(*leaf);
+            }
+            else if (auto *instance = dynamic_cast<const Instance *>(&object))
+                Place(*instance->Object());
+            else if (auto *motionInstance = dynamic_cast<const MotionInstance *>(&object))
+                Place(*motionInstance->Object());
+            else if (auto *flatMesh = dynamic_cast<const FlatBvh::Mesh *>(&object))
+                AddMaterial(flatMesh->GetMaterial());
+            else if (auto *staticMesh = dynamic_cast<const StaticBvh::Mesh *>(&object))
+                AddMaterial(staticMesh->GetMaterial());
+            else
+                Unsupported("an object", typeid(object));
+        }
+
+        static void WriteVector(JsonWriter &json, std::string_view key, const Vector3 &value)
+        {
+            json.Key(key).BeginArray().Value(value.x()).Value(value.y()).Value(value.z()).EndArray();
+        }
+
+        static void WriteTransform(JsonWriter &json, std::string_view key, const Transform &transform)
+        {
+            json.Key(key).BeginArray();
+            for (int row = 0; row < 3; row++)
+            {
+                for (int column = 0; column < 4; column++)
+                    json.Value(transform(row, column));
+            }
+            json.EndArray();
+        }
+
+        static void WriteCamera(JsonWriter &json, const Camera &camera)
+        {
+            json.BeginObject();
+            WriteVector(json, "origin", camera.Origin());
+            WriteVector(json, "target", camera.Target());
+            WriteVector(json, "up", camera.Up());
+            json.Field("fov", camera.Fov()).Field("aspect", camera.AspectRatio());
+            json.Field("focus_distance", camera.FocusDistance()).Field("aperture", camera.Aperture());
+            json.Key("exposure").BeginArray().Value(camera.ExposureStart()).Value(camera.ExposureEnd()).EndArray();
+            json.EndObject();
+        }
+
+        static void WriteEnvironment(JsonWriter &json, const EnvironmentMap &environment)
+        {
+            auto *gradient = dynamic_cast<const GradientMap *>(&environment);
+            if (!gradient)
+                Unsupported("an environment", typeid(environment));
+            json.BeginObject().Field("type", "gradient");
+            WriteVector(json, "bottom", gradient->BottomColor());
+            WriteVector(json, "top", gradient->TopColor());
+            json.EndObject();
+        }
+
+        static void WriteMaterial(JsonWriter &json, const Material &material)
+        {
+            json.BeginObject();
+            if (auto *lambertian = dynamic_cast<const Lambertian *>(&material))
+            {
+                json.Field("type", "lambertian");
+                WriteVector(json, "albedo", lambertian->Albedo());
+            }
+            else if (auto *metal = dynamic_cast<const Metal *>(&material))
+            {
+                json.Field("type", "metal");
+                WriteVector(json, "albedo", metal->Albedo());
+                json.Field("fuzz", metal->Fuzziness());
+            }
+            else if (auto *dielectric = dynamic_cast<const Dielectric *>(&material))
+            {
+                json.Field("type", "dielectric").Field("refraction_index", dielectric->RefractionIndex());
+            }
+            else if (auto *emissive = dynamic_cast<const Emissive *>(&material))
+            {
+                json.Field("type", "emissive");
+                WriteVector(json, "emission", emissive->Emission());
+            }
+            else
+            {
+                Unsupported("a material", typeid(material));
+            }
+            json.EndObject();
+        }
+
+        void WriteMaterialReference(JsonWriter &json, const std::shared_ptr<Material> &material) const
+        {
+            json.Field("material", materialNames.at(material.get()));
+        }
+
+        void WriteObjects(JsonWriter &json, const std::vector<const Hittable *> &objects) const
+        {
+            json.Key("objects").BeginArray();
+            for (const Hittable *object : objects)
+                WriteObject(json, *object);
+            json.EndArray();
+        }
+
+        // The shape an instance places, by name when it is shared.
+        void WriteChild(JsonWriter &json, const Hittable &child) const
+        {
+            auto found = shapeNames.find(&child);
+            if (found != shapeNames.end())
+            {
+                json.Field("shape", found->second);
+                return;
+            }
+            json.Key("object");
+            WriteObject(json, child);
+        }
+
+        static void WriteMesh(JsonWriter &json, const std::string &file, const char *bvh)
+        {
+            if (file.empty())
+                throw std::runtime_error("Scene files refer to meshes by their OBJ file, and this mesh was built in memory.");
+            json.Field("type", "mesh").Field("file", file).Field("bvh", bvh);
+        }
+
+        void WriteObject(JsonWriter &json, const Hittable &object) const
+        {
+            json.BeginObject();
+            if (auto *sphere = dynamic_cast<const Sphere *>(&object))
+            {
+                json.Field("type", "sphere");
+                WriteVector(json, "center", sphere->center);
+                if (sphere->motion.LengthSquared() > 0.0)
+                    WriteVector(json, "center_end", sphere->center + sphere->motion);
+                json.Field("radius", sphere->radius);
+                WriteMaterialReference(json, sphere->material);
+            }
+            else if (auto *quad = dynamic_cast<const Quad *>(&object))
+            {
+                json.Field("type", "quad");
+                WriteVector(json, "corner", quad->Corner());
+                WriteVector(json, "u", quad->EdgeU());
+                WriteVector(json, "v", quad->EdgeV());
+                WriteMaterialReference(json, quad->GetMaterial());
+            }
+            else if (auto *triangle = dynamic_cast<const Triangle *>(&object))
+            {
+                json.Field("type", "triangle");
+                WriteVector(json, "v0", triangle->v0);
+                WriteVector(json, "v1", triangle->v1);
+                WriteVector(json, "v2", triangle->v2);
+                WriteMaterialReference(json, triangle->material);
+            }
+            else if (auto *set = dynamic_cast<const SphereSet *>(&object))
+            {
+                const SphereList list = set->Spheres();
+                json.Field("type", "sphere_set");
+                json.Key("materials").BeginArray();
+                for (const auto &material : list.materials)
+                    json.Value(materialNames.at(material.get()));
+                json.EndArray();
+                json.Key("spheres").BeginArray();
+                for (size_t i = 0; i < list.Size(); i++)
+                {
+                    const Point3 &center = list.centers[i];
+                    json.BeginArray().Value(center.x()).Value(center.y()).Value(center.z()).Value(list.radii[i]);
+                    json.Value(list.materialIds[i]).EndArray();
+                }
+                json.EndArray();
+            }
+            else if (auto *list = dynamic_cast<const HittableList *>(&object))
+            {
+                json.Field("type", "group").Field("bvh", false);
+                std::vector<const Hittable *> shapes;
+                for (const auto &shape : list->shapes)
+                    shapes.push_back(shape.get());
+                WriteObjects(json, shapes);
+            }
+            else if (dynamic_cast<const BvhNode *>(&object) || dynamic_cast<const MotionBvhNode *>(&object))
+            {
+                json.Field("type", "group");
+                std::vector<const Hittable *> leaves;
+                Leaves(object, leaves);
+                WriteObjects(json, leaves);
+            }
+            else if (auto *instance = dynamic_cast<const Instance *>(&object))
+            {
+                json.Field("type", "instance");
+                WriteChild(json, *instance->Object());
+                WriteTransform(json, "transform", instance->ObjectToWorld());
+            }
+            else if (auto *motionInstance = dynamic_cast<const MotionInstance *>(&object))
+            {
+                json.Field("type", "instance");
+                WriteChild(json, *motionInstance->Object());
+                WriteTransform(json, "transform", motionInstance->StartTransform());
+                WriteTransform(json, "transform_end", motionInstance->EndTransform());
+            }
+            else if (auto *flatMesh = dynamic_cast<const FlatBvh::Mesh *>(&object))
+            {
+                WriteMesh(json, flatMesh->Source(), "flat");
+                WriteMaterialReference(json, flatMesh->GetMaterial());
+            }
+            else if (auto *staticMesh = dynamic_cast<const StaticBvh::Mesh *>(&object))
+            {
+                WriteMesh(json, staticMesh->Source(), "static");
+                WriteMaterialReference(json, staticMesh->GetMaterial());
+            }
+            else
+            {
+                Unsupported("an object", typeid(object));
+            }
+            json.EndObject();
+        }
+    };
+
+    inline Scene Read(std::istream &in)
+    {
+        return Reader(in).Read();
+    }
+
+    inline Scene Load(const std::string &file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in)
+            throw std::runtime_error("Cannot open scene file: " + file);
+        try
+        {
+            return Read(in);
+        }
+        catch (const std::runtime_error &e)
+        {
+            throw std::runtime_error(file + ": " + e.what());
+        }
+    }
+
+    inline void Write(const Scene &scene, std::ostream &out)
+    {
+        Writer(out).Write(scene);
+    }
+
+    inline void Save(const Scene &scene, const std::string &file)
+    {
+        std::ofstream out(file, std::ios::binary);
+        if (!out)
+            throw std::runtime_error("Cannot open file for writing: " + file);
+        Write(scene, out);
+        if (!out)
+            throw std::runtime_error("Failed to write scene file: " + file);
+    }
+
+    // Scene names ending in .json are files rather than built-in scenes.
+    inline bool IsSceneFile(const std::string &name)
+    {
+        return name.ends_with(".json");
+    }
+}
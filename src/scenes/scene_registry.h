@@ -0,0 +1,57 @@
+#pragma once
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "scenes/scene.h"
+#include "scenes/scene_file.h"
+#include "scenes/cornell_box.h"
+#include "scenes/final_01_scene.h"
+#include "scenes/final_02_scene.h"
+#include "scenes/mesh_test.h"
+#include "scenes/motion_blur.h"
+#include "scenes/quads_scene.h"
+#include "scenes/triangle_test.h"
+
+struct SceneEntry
+{
+    std::string name;
+    std::function<Scene()> create;
+};
+
+// The scenes that ship with the renderer, by name. Mesh scenes load their models from assets/.
+inline const std::vector<SceneEntry> &BundledScenes()
+{
+    static const std::vector<SceneEntry> scenes = {
+        {"cornell_box", CornellBox},
+        {"final_01", FinalScene01},
+        {"benchmark_01", Benchmark01},
+        {"final_02", FinalScene02},
+        {"quads", QuadsScene},
+        {"triangles", TriangleTest},
+        {"motion_blur", MotionBlurScene},
+        {"pyramid", []
+         { return Pyramid(); }},
+        {"pyramid_flat_bvh", []
+         { return FlatMeshTest("assets/pyramid.obj"); }},
+        {"pyramid_static_bvh", []
+         { return StaticMeshTest("assets/pyramid.obj"); }},
+    };
+    return scenes;
+}
+
+// A bundled scene by name, or a scene file (see scenes/scene_file.h) by its .json path.
+inline SceneEntry FindScene(const std::string &name)
+{
+    if (SceneFile::IsSceneFile(name))
+        return SceneEntry{name, [name]
+                          { return SceneFile::Load(name); }};
+    for (const auto &entry : BundledScenes())
+    {
+        if (entry.name == name)
+            return entry;
+    }
+    throw std::invalid_argument("Unknown scene: " + name);
+}
@@ -31,6 +31,7 @@ Scene TriangleTest()
 
     Camera cam(Vector3(0, 300, -800), Vector3(0, 0, 0), 40.0, 1.0);
     return Scene{
+        .arena = nullptr,
         .objects = BvhNode::Build(world),
         .camera = make_shared<Camera>(cam),
         .environmentMap = GradientMap::Sky()};
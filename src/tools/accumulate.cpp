@@ -0,0 +1,137 @@
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <chrono>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "core/accumulation_buffer.h"
+#include "core/renderer.h"
+#include "io/image_writer.h"
+#include "scenes/scene_registry.h"
+
+using namespace std::chrono;
+
+// Renders a frame in slices of samples, e.g. one batch job per slice, and merges the slices.
+// Merging samples 0-31 and 32-63 gives exactly the image of one render of samples 0-63, so a
+// frame can stop at whatever sample count the slices finished by a deadline add up to.
+// Usage: accumulate render [--scene name] [--width n] [--depth n] [--seed n]
+//                          --start n --count n --output slice.acc
+//        accumulate merge --output image.(bmp|png|pfm|exr) [--buffer merged.acc] slice.acc...
+
+static int Render(int argc, char *argv[])
+{
+    std::string sceneName = "cornell_box", output;
+    int width = 640, maxDepth = 50, start = 0, count = 0;
+    uint64_t seed = 1;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--scene")
+            sceneName = value();
+        else if (arg == "--width")
+            width = std::stoi(value());
+        else if (arg == "--depth")
+            maxDepth = std::stoi(value());
+        else if (arg == "--seed")
+            seed = std::stoull(value());
+        else if (arg == "--start")
+            start = std::stoi(value());
+        else if (arg == "--count")
+            count = std::stoi(value());
+        else if (arg == "--output")
+            output = value();
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+    if (count <= 0 || start < 0 || output.empty())
+        throw std::invalid_argument("render needs --start, a positive --count and --output");
+
+    SetRandomSeed(seed);
+    Scene scene = FindScene(sceneName).create();
+    const int height = std::max(1, static_cast<int>(width / scene.camera->AspectRatio()));
+
+    AccumulationBuffer buffer(width, height, seed);
+    Renderer renderer{
+        .maxDepth = maxDepth,
+        .samplesPerPixel = count,
+        .seed = seed,
+        .sampleStart = start,
+        .environmentMap = scene.environmentMap};
+
+    auto renderStart = steady_clock::now();
+    renderer.Accumulate(buffer, *scene.camera, *scene.objects);
+    fmt::println("Samples {}-{} of {} ({} x {}) in {:.2f}s",
+                 start, start + count - 1, sceneName, width, height, duration<double>(steady_clock::now() - renderStart).count());
+
+    buffer.Save(output);
+    fmt::println("Buffer saved to {}", output);
+    return 0;
+}
+
+static int Merge(int argc, char *argv[])
+{
+    std::string output, bufferFile;
+    std::vector<std::string> inputs;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if ((arg == "--output" || arg == "--buffer") && i + 1 < argc)
+            (arg == "--output" ? output : bufferFile) = argv[++i];
+        else if (arg.starts_with("--"))
+            throw std::invalid_argument("Unknown option: " + arg);
+        else
+            inputs.push_back(arg);
+    }
+    if (inputs.empty() || output.empty())
+        throw std::invalid_argument("merge needs --output and at least one buffer");
+
+    AccumulationBuffer merged = AccumulationBuffer::Load(inputs[0]);
+    for (size_t i = 1; i < inputs.size(); i++)
+        merged.Merge(AccumulationBuffer::Load(inputs[i]));
+
+    std::string ranges;
+    for (const auto &range : merged.ranges)
+        ranges += fmt::format("{}{}-{}", ranges.empty() ? "" : ", ", range.start, range.start + range.count - 1);
+    fmt::println("Merged {} buffers: {} samples per pixel ({})", inputs.size(), merged.TotalSamples(), ranges);
+
+    if (!bufferFile.empty())
+    {
+        merged.Save(bufferFile);
+        fmt::println("Buffer saved to {}", bufferFile);
+    }
+
+    Image image(merged.width, merged.height);
+    merged.Resolve(image);
+    SaveImage(image, output);
+    fmt::println("Image saved to {}", output);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string mode = argc > 1 ? argv[1] : "";
+    try
+    {
+        if (mode == "render")
+            return Render(argc, argv);
+        if (mode == "merge")
+            return Merge(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        return 1;
+    }
+
+    fmt::println(stderr, "Usage: {} render|merge [options]", argv[0]);
+    return 1;
+}
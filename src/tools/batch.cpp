@@ -0,0 +1,91 @@
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <exception>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "core/batch_runner.h"
+#include "io/json_writer.h"
+
+// Renders a list of jobs concurrently, sharing the cores between them (see core/batch_runner.h),
+// and reports each job's latency and the overall throughput.
+// Usage: batch <jobs.jsonl> [--threads n] [--max-jobs n] [--band-rows n] [--json file]
+// jobs.jsonl holds one job per line, e.g.
+//   {"id": "a", "scene": "cornell_box", "width": 256, "spp": 32, "output": "a.png"}
+// --max-jobs 1 renders the jobs one after another, for comparison.
+int main(int argc, char *argv[])
+{
+    try
+    {
+        if (argc < 2)
+        {
+            fmt::println(stderr, "Usage: {} <jobs.jsonl> [--threads n] [--max-jobs n] [--band-rows n] [--json file]", argv[0]);
+            return 1;
+        }
+
+        BatchOptions options;
+        std::string jsonFile;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string
+            {
+                if (i + 1 >= argc)
+                    throw std::invalid_argument("Missing value for " + arg);
+                return argv[++i];
+            };
+
+            if (arg == "--threads")
+                options.threads = static_cast<unsigned int>(std::stoul(value()));
+            else if (arg == "--max-jobs")
+                options.maxConcurrentJobs = std::stoul(value());
+            else if (arg == "--band-rows")
+                options.bandRows = std::stoi(value());
+            else if (arg == "--json")
+                jsonFile = value();
+            else
+                throw std::invalid_argument("Unknown option: " + arg);
+        }
+
+        std::ifstream file(argv[1]);
+        if (!file)
+            throw std::runtime_error(std::string("Cannot open ") + argv[1]);
+        std::vector<BatchJob> jobs;
+        std::string line;
+        for (int number = 1; std::getline(file, line); number++)
+        {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            try
+            {
+                jobs.push_back(ParseBatchJob(line));
+            }
+            catch (const std::exception &e)
+            {
+                throw std::runtime_error(fmt::format("{} line {}: {}", argv[1], number, e.what()));
+            }
+            if (jobs.back().id.empty())
+                jobs.back().id = fmt::format("job{}", jobs.size());
+        }
+
+        BatchRunner runner(options);
+        const BatchReport report = runner.Run(jobs);
+        report.Print();
+
+        if (!jsonFile.empty())
+        {
+            JsonWriter json;
+            report.WriteJson(json);
+            json.Save(jsonFile);
+            fmt::println("Report saved to {}", jsonFile);
+        }
+        return report.Succeeded() == jobs.size() ? 0 : 1;
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        return 1;
+    }
+}
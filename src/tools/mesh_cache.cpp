@@ -0,0 +1,46 @@
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <chrono>
+#include <exception>
+#include <string>
+
+#include "io/mesh_cache.h"
+
+using namespace std::chrono;
+
+// Converts an OBJ file into the binary mesh cache format.
+// Usage: mesh_cache <input.obj> [output.srtmesh]
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fmt::println(stderr, "Usage: {} <input.obj> [output.srtmesh]", argv[0]);
+        return 1;
+    }
+
+    std::string input = argv[1];
+    std::string output = argc > 2 ? argv[2] : MeshCache::DefaultCachePath(input);
+
+    try
+    {
+        auto start = steady_clock::now();
+        MeshCache::Write(input, output);
+        auto written = duration<double>(steady_clock::now() - start).count();
+
+        start = steady_clock::now();
+        auto mesh = MeshCache::Load(output);
+        auto loaded = duration<double, std::milli>(steady_clock::now() - start).count();
+
+        fmt::println("Wrote {} in {:.3f}s: {} triangles, {} BVH nodes, {:.1f} MB",
+                     output, written, mesh->FaceCount(), mesh->BvhNodeCount(), mesh->MemoryUsage() / (1024.0 * 1024.0));
+        fmt::println("Reload takes {:.2f} ms", loaded);
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
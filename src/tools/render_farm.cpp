@@ -0,0 +1,173 @@
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef PPL
+#include <tbb/global_control.h>
+#endif
+
+#include "io/image.h"
+#include "io/image_writer.h"
+#include "net/coordinator.h"
+#include "net/worker.h"
+#include "scenes/scene_registry.h"
+
+using namespace std::chrono;
+
+// Distributed rendering: a coordinator splits the frame into tiles and sample ranges, workers
+// render them. Workers are separate processes on this or other machines; start them by hand,
+// or let the coordinator spawn local ones.
+// Usage: render_farm coordinator [--scene name] [--port n] [--width n] [--spp n] [--depth n]
+//                                [--seed n] [--tile n] [--samples-per-task n] [--timeout s]
+//                                [--spawn n] [--output file]
+//        render_farm worker [--host name] [--port n] [--threads n] [--fail-after tiles]
+
+static int RunCoordinator(int argc, char *argv[], const std::string &self)
+{
+    CoordinatorOptions options;
+    options.job.scene = "cornell_box";
+    uint16_t port = 5555;
+    int width = 640, spawn = 0;
+    std::string output = "farm.png";
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--scene")
+            options.job.scene = value();
+        else if (arg == "--port")
+            port = static_cast<uint16_t>(std::stoi(value()));
+        else if (arg == "--width")
+            width = std::stoi(value());
+        else if (arg == "--spp")
+            options.samplesPerPixel = std::stoi(value());
+        else if (arg == "--depth")
+            options.job.maxDepth = std::stoi(value());
+        else if (arg == "--seed")
+            options.job.seed = std::stoull(value());
+        else if (arg == "--tile")
+            options.tileSize = std::stoi(value());
+        else if (arg == "--samples-per-task")
+            options.samplesPerTask = std::stoi(value());
+        else if (arg == "--timeout")
+            options.taskTimeout = seconds(std::stoi(value()));
+        else if (arg == "--spawn")
+            spawn = std::stoi(value());
+        else if (arg == "--output")
+            output = value();
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+
+    // the image height follows from the camera, so the scene is built here once as well
+    SetRandomSeed(options.job.seed);
+    Scene scene = FindScene(options.job.scene).create();
+    options.job.width = width;
+    options.job.height = std::max(1, static_cast<int>(width / scene.camera->AspectRatio()));
+
+    Coordinator coordinator(options, port);
+    fmt::println("Coordinator on port {}: {} x {}, {} spp, {} tasks",
+                 coordinator.Port(), options.job.width, options.job.height, options.samplesPerPixel, coordinator.TaskCount());
+
+    // spawned workers run until the coordinator sends them home; when all of them have exited
+    // nobody is left to finish the frame
+    std::vector<std::thread> workers;
+    std::atomic<int> running{spawn};
+    for (int i = 0; i < spawn; i++)
+    {
+        workers.emplace_back([&, command = fmt::format("\"{}\" worker --port {}", self, coordinator.Port())]
+                             {
+            std::system(command.c_str());
+            if (--running == 0)
+                coordinator.Stop(); });
+    }
+
+    auto start = steady_clock::now();
+    const bool complete = coordinator.Run();
+    for (auto &worker : workers)
+        worker.join();
+    if (!complete)
+        throw std::runtime_error("All workers exited before the frame was complete");
+
+    fmt::println("Rendered in {:.2f}s by {} workers, {} tiles re-issued",
+                 duration<double>(steady_clock::now() - start).count(), coordinator.WorkerCount(), coordinator.ReissuedCount());
+
+    Image image(options.job.width, options.job.height);
+    coordinator.Resolve(image);
+    SaveImage(image, output);
+    fmt::println("Image saved to {}", output);
+    return 0;
+}
+
+static int RunWorkerProcess(int argc, char *argv[])
+{
+    WorkerOptions options;
+    unsigned int threads = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--host")
+            options.host = value();
+        else if (arg == "--port")
+            options.port = static_cast<uint16_t>(std::stoi(value()));
+        else if (arg == "--threads")
+            threads = static_cast<unsigned int>(std::stoul(value()));
+        else if (arg == "--fail-after")
+            options.failAfter = std::stoi(value());
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+
+#ifndef PPL
+    std::unique_ptr<tbb::global_control> control;
+    if (threads > 0)
+        control = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, threads);
+#else
+    (void)threads;
+#endif
+
+    const int tiles = RunWorker(options);
+    fmt::println("Worker done after {} tiles", tiles);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string mode = argc > 1 ? argv[1] : "";
+    try
+    {
+        if (mode == "coordinator")
+            return RunCoordinator(argc, argv, argv[0]);
+        if (mode == "worker")
+            return RunWorkerProcess(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        return 1;
+    }
+
+    fmt::println(stderr, "Usage: {} coordinator|worker [options]", argv[0]);
+    return 1;
+}
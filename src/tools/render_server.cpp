@@ -0,0 +1,136 @@
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "net/render_server.h"
+#include "net/socket.h"
+
+// Keeps scenes loaded and renders requests sent to a local socket (see net/render_server.h).
+// Usage: render_server serve [--socket path] [--threads n] [--preload a,b,...] [--max-queued n]
+//        render_server send [--socket path] [request ...]
+// send passes each request, or each line of stdin when none are given, to the server and
+// prints the replies.
+
+static std::vector<std::string> SplitList(const std::string &list)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        if (end > start)
+            items.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
+    return items;
+}
+
+static int Serve(int argc, char *argv[])
+{
+    RenderServerOptions options;
+    std::vector<std::string> preload;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--socket")
+            options.socketPath = value();
+        else if (arg == "--threads")
+            options.threads = static_cast<unsigned int>(std::stoul(value()));
+        else if (arg == "--preload")
+            preload = SplitList(value());
+        else if (arg == "--max-queued")
+            options.maxQueued = std::stoul(value());
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+
+    RenderServer server(options);
+    for (const auto &scene : preload)
+        server.Preload(scene);
+    fmt::println("Listening on {}", options.socketPath);
+    server.Run();
+    fmt::println("Server stopped after {} renders", server.RenderedCount());
+    return 0;
+}
+
+static int Send(int argc, char *argv[])
+{
+    std::string socketPath = RenderServerOptions{}.socketPath;
+    std::vector<std::string> requests;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc)
+            socketPath = argv[++i];
+        else
+            requests.push_back(arg);
+    }
+    if (requests.empty())
+    {
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+                requests.push_back(line);
+        }
+    }
+
+    Socket connection = Socket::ConnectLocal(socketPath);
+    for (const auto &request : requests)
+    {
+        connection.SendAll(request.data(), request.size());
+        connection.SendAll("\n", 1);
+    }
+
+    // one reply per request
+    std::string pending;
+    char buffer[4096];
+    for (size_t replies = 0; replies < requests.size();)
+    {
+        const size_t count = connection.ReceiveSome(buffer, sizeof(buffer));
+        if (count == 0)
+            throw std::runtime_error("The server closed the connection");
+        pending.append(buffer, count);
+        size_t newline;
+        while ((newline = pending.find('\n')) != std::string::npos)
+        {
+            fmt::println("{}", pending.substr(0, newline));
+            pending.erase(0, newline + 1);
+            replies++;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const std::string mode = argc > 1 ? argv[1] : "";
+    try
+    {
+        if (mode == "serve")
+            return Serve(argc, argv);
+        if (mode == "send")
+            return Send(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        return 1;
+    }
+
+    fmt::println(stderr, "Usage: {} serve|send [options]", argv[0]);
+    return 1;
+}
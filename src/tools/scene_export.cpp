@@ -0,0 +1,58 @@
+#define FMT_HEADER_ONLY
+#include "fmt/core.h"
+
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <string>
+
+#include "core/random.h"
+#include "scenes/scene_file.h"
+#include "scenes/scene_registry.h"
+
+// Writes built-in scenes as scene files (see scenes/scene_file.h), which main, batch,
+// render_farm and render_server then take in place of a scene name.
+// Usage: scene_export <scene> <output.json>
+//        scene_export --all <directory>
+// Scenes are built with random seed 1, as batch and render_server build them, so the
+// random parts of an exported scene match what those render.
+static void Export(const SceneEntry &entry, const std::string &file)
+{
+    SetRandomSeed(1);
+    Scene scene = entry.create();
+    const auto start = std::chrono::steady_clock::now();
+    SceneFile::Save(scene, file);
+    fmt::println("{} -> {} ({:.1f} KB) in {:.1f} ms", entry.name, file, std::filesystem::file_size(file) / 1024.0,
+                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fmt::println(stderr, "Usage: {} <scene> <output.json> | --all <directory>", argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        const std::string first = argv[1];
+        if (first == "--all")
+        {
+            const std::filesystem::path directory = argv[2];
+            std::filesystem::create_directories(directory);
+            for (const auto &entry : BundledScenes())
+                Export(entry, (directory / (entry.name + ".json")).string());
+        }
+        else
+        {
+            Export(FindScene(first), argv[2]);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fmt::println(stderr, "Error: {}", e.what());
+        return 1;
+    }
+    return 0;
+}